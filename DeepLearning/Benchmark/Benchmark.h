@@ -0,0 +1,78 @@
+#pragma once
+#include<chrono>
+#include<functional>
+#include<string>
+#include<vector>
+
+namespace benchmark
+{
+	// Calls body once to warm up, then repeats it until minSeconds have elapsed and returns the mean seconds per call.
+	inline double MeasureSeconds(const std::function<void()>& body, const double& minSeconds = 0.25, unsigned long long* outIterations = nullptr)
+	{
+		body();
+
+		unsigned long long iterations = 0;
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		double elapsed = 0.0;
+		do
+		{
+			body();
+			++iterations;
+			elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		} while (elapsed < minSeconds);
+
+		if (outIterations != nullptr)
+		{
+			*outIterations = iterations;
+		}
+		return elapsed / static_cast<double>(iterations);
+	}
+
+	struct Result
+	{
+		std::string Name;
+		unsigned long long Iterations;
+		double Nanoseconds;
+		double BytesPerSecond;
+		double FlopsPerSecond;
+	};
+
+	// Runs named cases in the manner of Google Benchmark: mean wall time per call, throughput from the bytes and floating-point
+	// operations of one call, JSON in its output format, and the change of every case against a baseline file from an earlier run.
+	class Reporter final
+	{
+	public:
+		Reporter(const std::string& filter, const double& minSeconds);
+
+		// Cases missing from the baseline are reported without a change. Returns false when the file cannot be read.
+		bool LoadBaseline(const std::string& path);
+		// Runs body when name contains the filter. bytes and flops are per call, 0 where they mean nothing.
+		void Measure(const std::string& name, const double& bytes, const double& flops, const std::function<void()>& body);
+		bool WriteJson(const std::string& path) const;
+		// Cases slower than the baseline by more than threshold (0.1 = 10%).
+		unsigned int CountRegressions(const double& threshold) const;
+		const std::vector<Result>& GetResults() const;
+	private:
+		const Result* findBaseline(const std::string& name) const;
+
+		std::string mFilter;
+		double mMinSeconds;
+		std::vector<Result> mResults;
+		std::vector<Result> mBaseline;
+	};
+
+	void RunGemmBenchmark();
+	void RunSimdBenchmark();
+	void RunExpressionBenchmark();
+	void RunReductionBenchmark();
+	void RunLayerBenchmark();
+	// Data-parallel training scaling over 1, 2, 4 and 8 processes of this executable, each started as RunDistributedWorker.
+	void RunDistributedBenchmark();
+	// The body of a worker process started by RunDistributedBenchmark; false when its group failed.
+	bool RunDistributedWorker();
+	// Dynamic batching of an InferenceServer against per-request Predict, in process and over a local socket, under a
+	// closed-loop load of 1 and 16 clients: throughput, p50 and p99 latency, and the mean batch formed.
+	void RunInferenceBenchmark();
+	// The regression suite: Ndarray construction and copy, element-wise expressions, Dot, reductions and an MLP training step.
+	void RunSuite(Reporter& reporter);
+}
@@ -0,0 +1,118 @@
+#include<chrono>
+#include<cstdio>
+#include<thread>
+#include<vector>
+
+#include "Benchmark.h"
+#include "Distributed.h"
+#include "Mlp.h"
+
+namespace
+{
+	using Array = numpy::Ndarray<float>;
+
+	// Strong scaling of an MNIST-sized MLP (784 -> 256 -> 256 -> 10): every step trains one mini-batch of 256 rows, split
+	// between the processes.
+	const unsigned int BATCH = 256;
+	const unsigned int WARMUP_STEPS = 3;
+	const unsigned int STEPS = 20;
+
+	Array filled(const unsigned int& rows, const unsigned int& columns, const float& scale)
+	{
+		Array array({ rows, columns });
+		for (size_t i = 0; i < array.GetTotalSize(); ++i)
+		{
+			array.At(i) = scale * (static_cast<float>((i * 37) % 23) - 11.0f);
+		}
+		return array;
+	}
+
+	// Runs the training steps on every process of group. On rank 0, stepSeconds is the time per step of the whole group and
+	// reduceSeconds the time of one AllReduce of all the gradients on its own.
+	bool trainSteps(numpy::ProcessGroup& group, double& stepSeconds, double& reduceSeconds)
+	{
+		const Array x = filled(BATCH, 784, 0.05f);
+		Array t({ BATCH, 10 }, 0.0f);
+		for (unsigned int r = 0; r < BATCH; ++r)
+		{
+			t.At(r * 10 + r % 10) = 1.0f;
+		}
+		size_t begin = 0;
+		size_t end = 0;
+		group.GetShard(BATCH, begin, end);
+		const Array xShard = x.Slice(0, begin, end);
+		const Array tShard = t.Slice(0, begin, end);
+
+		numpy::Mlp<float> mlp({ 784, 256, 256, 10 }, 1);
+		numpy::GradientReducer<float> reducer(group);
+		for (unsigned int step = 0; step < WARMUP_STEPS; ++step)
+		{
+			mlp.TrainBatch(xShard, tShard, 0.001f, reducer);
+		}
+		if (!group.Barrier())
+			return false;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (unsigned int step = 0; step < STEPS; ++step)
+		{
+			mlp.TrainBatch(xShard, tShard, 0.001f, reducer);
+		}
+		if (!group.Barrier())
+			return false;
+		stepSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / STEPS;
+
+		size_t parameters = 0;
+		for (unsigned int l = 0; l < mlp.GetLayerCount(); ++l)
+		{
+			parameters += mlp.GetLayer(l).GetWeight().GetTotalSize() + mlp.GetLayer(l).GetBias().GetTotalSize();
+		}
+		std::vector<float> gradients(parameters, 1.0f);
+		start = std::chrono::steady_clock::now();
+		for (unsigned int step = 0; step < STEPS; ++step)
+		{
+			if (!group.AllReduce(gradients.data(), gradients.size()))
+				return false;
+		}
+		if (!group.Barrier())
+			return false;
+		reduceSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / STEPS;
+		return true;
+	}
+}
+
+namespace benchmark
+{
+	void RunDistributedBenchmark()
+	{
+		const unsigned int threadCount = numpy::ThreadPool::Instance().GetThreadCount();
+		std::printf("%-20s %12s %12s %12s %9s %11s   (%u hardware threads)\n", "data parallel", "step ms", "samples/s", "allreduce ms",
+			"speedup", "efficiency", std::thread::hardware_concurrency());
+		double single = 0.0;
+		for (const unsigned int workers : { 1u, 2u, 4u, 8u })
+		{
+			numpy::ProcessGroup group(workers);
+			double stepSeconds = 0.0;
+			double reduceSeconds = 0.0;
+			const bool bDone = group.IsValid() && trainSteps(group, stepSeconds, reduceSeconds);
+			char name[48];
+			std::snprintf(name, sizeof(name), "%u processes", workers);
+			if (!group.Join() || !bDone)
+			{
+				std::printf("%-20s failed\n", name);
+				continue;
+			}
+			single = workers == 1u ? stepSeconds : single;
+			const double speedup = single / stepSeconds;
+			std::printf("%-20s %12.3f %12.0f %12.3f %8.2fx %10.1f%%\n", name, stepSeconds * 1e3, BATCH / stepSeconds, reduceSeconds * 1e3,
+				speedup, speedup / workers * 100.0);
+		}
+		numpy::ThreadPool::Instance().SetThreadCount(threadCount);
+	}
+
+	bool RunDistributedWorker()
+	{
+		numpy::ProcessGroup group;
+		double stepSeconds = 0.0;
+		double reduceSeconds = 0.0;
+		return trainSteps(group, stepSeconds, reduceSeconds);
+	}
+}
@@ -0,0 +1,74 @@
+#include<cstdio>
+
+#include "Benchmark.h"
+#include "Numpy.h"
+
+namespace
+{
+	using Array = numpy::Ndarray<float>;
+	using Numpy = numpy::Numpy<float>;
+
+	void report(const char* name, const unsigned int& operations, const unsigned int& inputs, const double& eagerSeconds, const double& fusedSeconds, const unsigned int& size)
+	{
+		// An eager operation reads two operands (or one and a scalar) and writes one temporary; the fused pass reads each input once and writes once.
+		const double bytesPerElement = sizeof(float);
+		const double eagerBytes = (3.0 * operations) * bytesPerElement * size;
+		const double fusedBytes = (inputs + 1.0) * bytesPerElement * size;
+		std::printf("%-34s %4u %12.3f %12.3f %8.2fx %10.1f %10.1f %9.1f%%\n", name, operations, eagerSeconds * 1e3, fusedSeconds * 1e3,
+			eagerSeconds / fusedSeconds, eagerBytes / eagerSeconds * 1e-9, fusedBytes / fusedSeconds * 1e-9, 100.0 * (1.0 - fusedBytes / eagerBytes));
+	}
+}
+
+namespace benchmark
+{
+	void RunExpressionBenchmark()
+	{
+		const unsigned int size = 1u << 22;
+		const Array a({ size }, 0.5f);
+		const Array b({ size }, 1.5f);
+		const Array c({ size }, -2.0f);
+		const Array d({ size }, 0.25f);
+		Array out;
+
+		std::printf("%u floats, eager materialises every intermediate with Eval()\n", size);
+		std::printf("%-34s %4s %12s %12s %9s %10s %10s %10s\n", "expression", "ops", "eager ms", "fused ms", "speedup", "eager GB/s", "fused GB/s", "saved");
+
+		report("a + b", 1, 2,
+			MeasureSeconds([&]() { out = a + b; }),
+			MeasureSeconds([&]() { out = a + b; }), size);
+
+		report("a * a + 5", 2, 1,
+			MeasureSeconds([&]() { Array t = (a * a).Eval(); out = t + 5; }),
+			MeasureSeconds([&]() { out = a * a + 5; }), size);
+
+		report("max(a * b + c, 0)", 3, 3,
+			MeasureSeconds([&]() { Array t = (a * b).Eval(); Array u = (t + c).Eval(); out = Numpy::Maximum(u, 0.0f); }),
+			MeasureSeconds([&]() { out = Numpy::Maximum(a * b + c, 0.0f); }), size);
+
+		report("((a * b + c) * d + a) * 0.5 + 1", 6, 4,
+			MeasureSeconds([&]() { Array t = (a * b).Eval(); t = (t + c).Eval(); t = (t * d).Eval(); t = (t + a).Eval(); t = (t * 0.5f).Eval(); out = t + 1.0f; }),
+			MeasureSeconds([&]() { out = ((a * b + c) * d + a) * 0.5f + 1.0f; }), size);
+
+		report("a*b + c*d + a*c + b*d", 7, 4,
+			MeasureSeconds([&]() { Array t = (a * b).Eval(); Array u = (c * d).Eval(); t = (t + u).Eval(); u = (a * c).Eval(); t = (t + u).Eval(); u = (b * d).Eval(); out = t + u; }),
+			MeasureSeconds([&]() { out = a * b + c * d + a * c + b * d; }), size);
+
+		// Broadcast operands against a tiled copy made with BroadcastTo, which is what callers had to build before.
+		std::printf("\n%-34s %12s %12s %9s\n", "broadcast (4096 x 1024)", "tiled ms", "broadcast ms", "speedup");
+		const Array batch({ 4096, 1024 }, 0.5f);
+		const Array row({ 1024 }, 2.0f);
+		const Array column({ 4096, 1 }, 2.0f);
+		const Array scalar({ 1 }, 2.0f);
+		const struct
+		{
+			const char* Name;
+			const Array& Operand;
+		} cases[] = { { "batch + row", row }, { "batch + column", column }, { "batch + (1)", scalar } };
+		for (const auto& broadcastCase : cases)
+		{
+			const double tiledSeconds = MeasureSeconds([&]() { const Array view = broadcastCase.Operand.BroadcastTo({ 4096, 1024 }); const Array tiled(view); out = batch + tiled; });
+			const double broadcastSeconds = MeasureSeconds([&]() { out = batch + broadcastCase.Operand; });
+			std::printf("%-34s %12.3f %12.3f %8.2fx\n", broadcastCase.Name, tiledSeconds * 1e3, broadcastSeconds * 1e3, tiledSeconds / broadcastSeconds);
+		}
+	}
+}
@@ -0,0 +1,116 @@
+#include<algorithm>
+#include<cmath>
+#include<cstdio>
+#include<memory>
+#include<random>
+
+#include "Benchmark.h"
+#include "Numpy.h"
+
+namespace
+{
+	// The loop Numpy<T>::Dot used before the blocked engine: one dot product per output, walking b down a column.
+	void naiveDot(const unsigned int& m, const unsigned int& n, const unsigned int& k, const float* a, const float* b, float* c)
+	{
+		for (unsigned int i = 0; i < m * n; ++i)
+		{
+			const unsigned int row = i / n;
+			const unsigned int column = i % n;
+			float sum = 0.0f;
+			for (unsigned int j = 0; j < k; ++j)
+			{
+				sum += a[j + row * k] * b[column + j * n];
+			}
+			c[i] = sum;
+		}
+	}
+
+	std::unique_ptr<float[]> randomBuffer(const unsigned int& size, std::mt19937& engine)
+	{
+		std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+		std::unique_ptr<float[]> array = std::make_unique<float[]>(size);
+		for (unsigned int i = 0; i < size; ++i)
+		{
+			array[i] = distribution(engine);
+		}
+		return array;
+	}
+
+	numpy::Ndarray<float> matrix(const unsigned int& rows, const unsigned int& columns, const std::unique_ptr<float[]>& array)
+	{
+		std::unique_ptr<unsigned int[]> arraySize = std::make_unique<unsigned int[]>(2);
+		arraySize[0] = rows;
+		arraySize[1] = columns;
+		return numpy::Ndarray<float>(2u, rows * columns, arraySize, array);
+	}
+}
+
+namespace benchmark
+{
+	void RunGemmBenchmark()
+	{
+		struct Shape
+		{
+			const char* Name;
+			unsigned int M;
+			unsigned int K;
+			unsigned int N;
+		};
+		const Shape shapes[] =
+		{
+			{ "square", 64, 64, 64 },
+			{ "square", 256, 256, 256 },
+			{ "square", 512, 512, 512 },
+			{ "square", 1024, 1024, 1024 },
+			{ "digits 64x16", 32, 64, 16 },
+			{ "digits 64x16", 1797, 64, 16 },
+			{ "digits 16x10", 1797, 16, 10 },
+			{ "tall-skinny", 65536, 64, 16 },
+			{ "tall-skinny", 16384, 256, 32 },
+			{ "short-wide", 16, 256, 16384 },
+		};
+
+		std::mt19937 engine(1234);
+		std::printf("%-14s %6s %6s %6s %14s %14s %9s %10s\n", "shape", "M", "K", "N", "naive GFLOP/s", "gemm GFLOP/s", "speedup", "max error");
+		for (const Shape& shape : shapes)
+		{
+			const std::unique_ptr<float[]> rawA = randomBuffer(shape.M * shape.K, engine);
+			const std::unique_ptr<float[]> rawB = randomBuffer(shape.K * shape.N, engine);
+			const numpy::Ndarray<float> a = matrix(shape.M, shape.K, rawA);
+			const numpy::Ndarray<float> b = matrix(shape.K, shape.N, rawB);
+			numpy::Ndarray<float> c;
+			std::unique_ptr<float[]> reference = std::make_unique<float[]>(shape.M * shape.N);
+
+			const double flops = 2.0 * shape.M * shape.N * shape.K;
+			const double naiveSeconds = MeasureSeconds([&]() { naiveDot(shape.M, shape.N, shape.K, rawA.get(), rawB.get(), reference.get()); });
+			const double gemmSeconds = MeasureSeconds([&]() { c = numpy::Numpy<float>::Dot(a, b); });
+
+			float maxError = 0.0f;
+			for (unsigned int i = 0; i < shape.M * shape.N; ++i)
+			{
+				maxError = std::max(maxError, std::fabs(c.At(i) - reference[i]));
+			}
+
+			std::printf("%-14s %6u %6u %6u %14.2f %14.2f %8.1fx %10.2e\n", shape.Name, shape.M, shape.K, shape.N,
+				flops / naiveSeconds * 1e-9, flops / gemmSeconds * 1e-9, naiveSeconds / gemmSeconds, maxError);
+		}
+
+		// Dot(x, w^T) as a backward pass writes it: Transpose() hands Gemm the strides, the old path copied w first.
+		std::printf("\n%-14s %6s %6s %6s %14s %14s %9s\n", "transposed", "M", "K", "N", "copy GFLOP/s", "view GFLOP/s", "speedup");
+		for (const unsigned int size : { 256u, 512u, 1024u })
+		{
+			const std::unique_ptr<float[]> rawA = randomBuffer(size * size, engine);
+			const std::unique_ptr<float[]> rawB = randomBuffer(size * size, engine);
+			const numpy::Ndarray<float> a = matrix(size, size, rawA);
+			const numpy::Ndarray<float> b = matrix(size, size, rawB);
+			numpy::Ndarray<float> c;
+
+			const double flops = 2.0 * size * size * size;
+			const double copySeconds = MeasureSeconds([&]() { c = numpy::Numpy<float>::Dot(a, numpy::Ndarray<float>(b.Transpose())); });
+			const double viewSeconds = MeasureSeconds([&]() { c = numpy::Numpy<float>::Dot(a, b.Transpose()); });
+
+			std::printf("%-14s %6u %6u %6u %14.2f %14.2f %8.1fx\n", "a * b^T", size, size, size,
+				flops / copySeconds * 1e-9, flops / viewSeconds * 1e-9, copySeconds / viewSeconds);
+		}
+	}
+}
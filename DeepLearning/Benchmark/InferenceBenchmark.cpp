@@ -0,0 +1,187 @@
+#include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<cstdio>
+#include<functional>
+#include<memory>
+#include<string>
+#include<thread>
+#include<utility>
+#include<vector>
+
+#include "Benchmark.h"
+#include "InferenceServer.h"
+#include "Mlp.h"
+
+namespace
+{
+	using Array = numpy::Ndarray<float>;
+	using Clock = std::chrono::steady_clock;
+
+	const double SECONDS = 0.5;
+	const size_t SAMPLES = 256;
+	const char* const MODEL_PATH = "inference-benchmark.npz";
+	const char* const SOCKET_PATH = "inference-benchmark.sock";
+
+	// One client of the load: sends the row at input and writes the logits to output, returning false on failure.
+	using Call = std::function<bool(const float* input, float* output)>;
+
+	// Closed-loop load generator: each client sends one-row requests back to back for SECONDS and records the latency of every
+	// one. The report gives throughput over all clients, latency percentiles, and the mean batch the server formed.
+	void generate(const char* name, const Array& samples, const size_t& outputs, std::vector<Call>& clients,
+		const numpy::InferenceServer<float>* server)
+	{
+		std::vector<std::vector<double>> latencies(clients.size());
+		std::atomic<bool> bFailed(false);
+		std::atomic<bool> bStop(false);
+		std::vector<std::thread> threads;
+		const Clock::time_point start = Clock::now();
+		for (size_t c = 0; c < clients.size(); ++c)
+		{
+			threads.emplace_back([&, c]()
+			{
+				std::vector<float> output(outputs);
+				latencies[c].reserve(1u << 16);
+				for (size_t i = c; !bStop.load(std::memory_order_relaxed); i += clients.size())
+				{
+					const Clock::time_point sent = Clock::now();
+					if (!clients[c](samples.GetData() + i % SAMPLES * samples.GetArraySize(1), output.data()))
+					{
+						bFailed.store(true);
+						return;
+					}
+					latencies[c].push_back(std::chrono::duration<double>(Clock::now() - sent).count());
+				}
+			});
+		}
+		std::this_thread::sleep_for(std::chrono::duration<double>(SECONDS));
+		bStop.store(true);
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+		const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		if (bFailed.load())
+		{
+			std::printf("%-36s failed\n", name);
+			return;
+		}
+
+		std::vector<double> all;
+		for (const std::vector<double>& client : latencies)
+		{
+			all.insert(all.end(), client.begin(), client.end());
+		}
+		std::sort(all.begin(), all.end());
+		const auto percentile = [&all](const double& p) { return all.empty() ? 0.0 : all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))]; };
+		const numpy::InferenceStatistics statistics = server != nullptr ? server->GetStatistics() : numpy::InferenceStatistics{ 0, 0, 0 };
+		std::printf("%-36s %7zu %12.0f %10.1f %10.1f %10.1f\n", name, clients.size(), all.size() / elapsed, percentile(0.5) * 1e6,
+			percentile(0.99) * 1e6, statistics.Batches == 0u ? 1.0 : static_cast<double>(statistics.Rows) / statistics.Batches);
+	}
+
+	void serve(const char* model, const Array& samples, const size_t& outputs, const unsigned int& clientCount)
+	{
+		char name[64];
+
+		// The per-request path the server replaces: every client runs a 1-row Predict on its own copy of the model.
+		struct Direct
+		{
+			numpy::Mlp<float> Model;
+			Array Row;
+		};
+		std::vector<std::unique_ptr<Direct>> copies;
+		std::vector<Call> clients;
+		const size_t inputs = samples.GetArraySize(1);
+		for (unsigned int c = 0; c < clientCount; ++c)
+		{
+			copies.push_back(std::make_unique<Direct>(Direct{ numpy::Mlp<float>({ 1, 1 }), Array({ 1, inputs }) }));
+			Direct& direct = *copies.back();
+			if (!direct.Model.Load(MODEL_PATH))
+				return;
+			clients.push_back([&direct, inputs, outputs](const float* input, float* output)
+			{
+				std::copy(input, input + inputs, direct.Row.GetData());
+				const Array& logits = direct.Model.Predict(direct.Row);
+				std::copy(logits.GetData(), logits.GetData() + outputs, output);
+				return true;
+			});
+		}
+		std::snprintf(name, sizeof(name), "%s per-request Predict", model);
+		generate(name, samples, outputs, clients, nullptr);
+
+		struct Setting
+		{
+			const char* Name;
+			unsigned int MaxBatch;
+			long long Budget;
+			bool bSocket;
+		};
+		const Setting settings[] = {
+			{ "server batch 1", 1u, 0, false },
+			{ "server batch 64 budget 0us", 64u, 0, false },
+			{ "server batch 64 budget 200us", 64u, 200, false },
+			{ "socket batch 1", 1u, 0, true },
+			{ "socket batch 64 budget 200us", 64u, 200, true },
+		};
+		for (const Setting& setting : settings)
+		{
+			numpy::InferenceServer<float> server(MODEL_PATH, setting.MaxBatch, std::chrono::microseconds(setting.Budget));
+			std::vector<std::unique_ptr<numpy::InferenceClient<float>>> connections;
+			clients.clear();
+			for (unsigned int c = 0; c < clientCount; ++c)
+			{
+				if (!setting.bSocket)
+				{
+					clients.push_back([&server](const float* input, float* output) { return server.Infer(input, 1, output); });
+					continue;
+				}
+				if (c == 0u && !server.Listen(SOCKET_PATH))
+					break;
+				connections.push_back(std::make_unique<numpy::InferenceClient<float>>());
+				numpy::InferenceClient<float>& client = *connections.back();
+				client.Connect(SOCKET_PATH);
+				clients.push_back([&client](const float* input, float* output) { return client.Infer(input, 1, output); });
+			}
+			std::snprintf(name, sizeof(name), "%s %s", model, setting.Name);
+			if (clients.size() != clientCount)
+			{
+				std::printf("%-36s failed\n", name);
+				continue;
+			}
+			server.ResetStatistics();
+			generate(name, samples, outputs, clients, &server);
+		}
+	}
+}
+
+namespace benchmark
+{
+	void RunInferenceBenchmark()
+	{
+		std::printf("%-36s %7s %12s %10s %10s %10s\n", "inference, 1-row requests", "clients", "requests/s", "p50 us", "p99 us", "batch");
+		const std::vector<std::pair<const char*, std::vector<unsigned int>>> models = {
+			{ "digits", { 64, 16, 16, 10 } },
+			{ "mnist", { 784, 256, 256, 10 } },
+		};
+		for (const std::pair<const char*, std::vector<unsigned int>>& model : models)
+		{
+			const std::vector<unsigned int>& sizes = model.second;
+			numpy::Mlp<float> mlp({ sizes[0], sizes[1], sizes[2], sizes[3] }, 1);
+			if (!mlp.Save(MODEL_PATH))
+			{
+				std::printf("%-36s cannot write %s\n", model.first, MODEL_PATH);
+				continue;
+			}
+			Array samples({ SAMPLES, static_cast<size_t>(sizes[0]) });
+			for (size_t i = 0; i < samples.GetTotalSize(); ++i)
+			{
+				samples.At(i) = 0.05f * (static_cast<float>((i * 37) % 23) - 11.0f);
+			}
+			for (const unsigned int clients : { 1u, 16u })
+			{
+				serve(model.first, samples, sizes[3], clients);
+			}
+			std::remove(MODEL_PATH);
+		}
+	}
+}
@@ -0,0 +1,125 @@
+#include<cmath>
+#include<cstdio>
+
+#include "Benchmark.h"
+#include "Layer.h"
+
+namespace
+{
+	using Array = numpy::Ndarray<float>;
+	using Numpy = numpy::Numpy<float>;
+
+	Array filled(const unsigned int& rows, const unsigned int& columns, const float& scale)
+	{
+		Array array({ rows, columns });
+		for (size_t i = 0; i < array.GetTotalSize(); ++i)
+		{
+			array.At(i) = scale * (static_cast<float>((i * 37) % 23) - 11.0f);
+		}
+		return array;
+	}
+
+	// delta = grad * where(u <= 0, 0, 1), materialised as the layered version does.
+	void reluDerivative(const Array& grad, const Array& u, Array& delta)
+	{
+		delta = grad;
+		for (size_t i = 0; i < delta.GetTotalSize(); ++i)
+		{
+			if (u.At(i) <= 0.0f)
+			{
+				delta.At(i) = 0.0f;
+			}
+		}
+	}
+
+	// exp, row sums, division and log(y + 1e-7) as separate passes over the batch.
+	float layeredSoftmaxCrossEntropy(const Array& u, const Array& t, Array& y, Array& delta)
+	{
+		Array e = u;
+		for (size_t i = 0; i < e.GetTotalSize(); ++i)
+		{
+			e.At(i) = std::exp(e.At(i));
+		}
+		const Array sum = Numpy::Sum(e, 1, true);
+		y = e;
+		for (size_t i = 0; i < y.GetTotalSize(); ++i)
+		{
+			y.At(i) /= sum.At(i / y.GetArraySize(1));
+		}
+		float loss = 0.0f;
+		for (size_t i = 0; i < y.GetTotalSize(); ++i)
+		{
+			loss -= t.At(i) * std::log(y.At(i) + 1e-7f);
+		}
+		delta = y + t * -1.0f;
+		return loss / static_cast<float>(y.GetArraySize(0));
+	}
+}
+
+namespace benchmark
+{
+	void RunLayerBenchmark()
+	{
+		struct Shape
+		{
+			unsigned int Batch;
+			unsigned int Input;
+			unsigned int Output;
+		};
+		// The digits MLP (64 -> 16 -> 10 at batch 32) and an MNIST-sized hidden layer.
+		const Shape shapes[] = { { 32, 64, 16 }, { 1797, 64, 16 }, { 256, 784, 256 }, { 1024, 1024, 1024 } };
+
+		std::printf("%-20s %12s %12s %9s %12s %12s %9s\n", "dense relu", "fwd ms", "fused ms", "speedup", "bwd ms", "fused ms", "speedup");
+		for (const Shape& shape : shapes)
+		{
+			const Array x = filled(shape.Batch, shape.Input, 0.05f);
+			const Array grad = filled(shape.Batch, shape.Output, 0.01f);
+			numpy::Dense<float> layer(shape.Input, shape.Output, numpy::Activation::Relu, 1);
+			const Array& w = layer.GetWeight();
+			const Array& b = layer.GetBias();
+			Array u;
+			Array y;
+			Array delta;
+			Array gradWeight;
+			Array gradBias;
+			Array gradInput;
+
+			const double layeredForward = MeasureSeconds([&]() { Numpy::Dot(u, x, w); u += b; Numpy::Maximum(y, u, 0.0f); });
+			const double fusedForward = MeasureSeconds([&]() { layer.Forward(x); });
+			const double layeredBackward = MeasureSeconds([&]()
+			{
+				reluDerivative(grad, u, delta);
+				Numpy::Dot(gradWeight, x.Transpose(), delta);
+				gradBias = Numpy::Sum(delta, 0);
+				Numpy::Dot(gradInput, delta, w.Transpose());
+			});
+			const double fusedBackward = MeasureSeconds([&]() { layer.Backward(grad); });
+
+			char name[48];
+			std::snprintf(name, sizeof(name), "%u x %u -> %u", shape.Batch, shape.Input, shape.Output);
+			std::printf("%-20s %12.4f %12.4f %8.2fx %12.4f %12.4f %8.2fx\n", name, layeredForward * 1e3, fusedForward * 1e3, layeredForward / fusedForward,
+				layeredBackward * 1e3, fusedBackward * 1e3, layeredBackward / fusedBackward);
+		}
+
+		std::printf("\n%-20s %12s %12s %9s\n", "softmax + CE", "layered ms", "fused ms", "speedup");
+		const unsigned int batches[] = { 32, 1797, 65536 };
+		for (const unsigned int& batch : batches)
+		{
+			const Array u = filled(batch, 10, 0.3f);
+			Array t({ batch, 10 }, 0.0f);
+			for (unsigned int r = 0; r < batch; ++r)
+			{
+				t.At(r * 10 + r % 10) = 1.0f;
+			}
+			Array y;
+			Array delta;
+			numpy::SoftmaxCrossEntropy<float> loss;
+
+			const double layered = MeasureSeconds([&]() { layeredSoftmaxCrossEntropy(u, t, y, delta); });
+			const double fused = MeasureSeconds([&]() { loss.Forward(u, t); });
+			char name[48];
+			std::snprintf(name, sizeof(name), "%u x 10", batch);
+			std::printf("%-20s %12.4f %12.4f %8.2fx\n", name, layered * 1e3, fused * 1e3, layered / fused);
+		}
+	}
+}
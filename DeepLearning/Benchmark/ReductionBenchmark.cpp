@@ -0,0 +1,102 @@
+#include<cmath>
+#include<cstdio>
+#include<memory>
+
+#include "Benchmark.h"
+#include "Numpy.h"
+
+namespace
+{
+	using Array = numpy::Ndarray<float>;
+	using Numpy = numpy::Numpy<float>;
+
+	// The sequential loops a hand-written reduction over a row-major buffer uses.
+	void loopSum(const float* data, const unsigned int& rows, const unsigned int& columns, const int& axis, float* out)
+	{
+		if (axis == 0)
+		{
+			for (unsigned int c = 0; c < columns; ++c)
+			{
+				out[c] = 0.0f;
+			}
+			for (unsigned int r = 0; r < rows; ++r)
+			{
+				for (unsigned int c = 0; c < columns; ++c)
+				{
+					out[c] += data[r * columns + c];
+				}
+			}
+			return;
+		}
+
+		for (unsigned int r = 0; r < rows; ++r)
+		{
+			float sum = 0.0f;
+			for (unsigned int c = 0; c < columns; ++c)
+			{
+				sum += data[r * columns + c];
+			}
+			out[r] = sum;
+		}
+	}
+}
+
+namespace benchmark
+{
+	void RunReductionBenchmark()
+	{
+		struct Shape
+		{
+			unsigned int Rows;
+			unsigned int Columns;
+		};
+		// Batch-by-feature shapes: axis 0 is the strided gradient sum over a batch, axis 1 the contiguous softmax denominator.
+		const Shape shapes[] = { { 1797, 64 }, { 1797, 10 }, { 4096, 1024 }, { 65536, 256 }, { 1, 1u << 24 } };
+
+		std::printf("%-16s %5s %10s %10s %8s %12s %12s\n", "shape", "axis", "loop GB/s", "sum GB/s", "speedup", "loop error", "sum error");
+		for (const Shape& shape : shapes)
+		{
+			const unsigned int size = shape.Rows * shape.Columns;
+			std::unique_ptr<unsigned int[]> arraySize = std::make_unique<unsigned int[]>(2);
+			arraySize[0] = shape.Rows;
+			arraySize[1] = shape.Columns;
+			std::unique_ptr<float[]> raw = std::make_unique<float[]>(size);
+			for (unsigned int i = 0; i < size; ++i)
+			{
+				raw[i] = 0.1f + 0.001f * static_cast<float>(i % 17);
+			}
+			const Array a(2u, size, arraySize, raw);
+
+			for (int axis = 0; axis < 2; ++axis)
+			{
+				if (shape.Rows == 1 && axis == 0)
+					continue;
+
+				const unsigned int outputs = axis == 0 ? shape.Columns : shape.Rows;
+				const unsigned int length = axis == 0 ? shape.Rows : shape.Columns;
+				std::unique_ptr<float[]> loop = std::make_unique<float[]>(outputs);
+				Array sum;
+
+				const double bytes = static_cast<double>(sizeof(float)) * size;
+				const double loopSeconds = MeasureSeconds([&]() { loopSum(raw.get(), shape.Rows, shape.Columns, axis, loop.get()); });
+				const double sumSeconds = MeasureSeconds([&]() { sum = Numpy::Sum(a, axis); });
+
+				// Relative error of the first output against a double-precision sum.
+				double exact = 0.0;
+				for (unsigned int r = 0; r < length; ++r)
+				{
+					exact += raw[axis == 0 ? r * shape.Columns : r];
+				}
+				char name[32];
+				std::snprintf(name, sizeof(name), "%u x %u", shape.Rows, shape.Columns);
+				std::printf("%-16s %5d %10.2f %10.2f %7.2fx %12.2e %12.2e\n", name, axis, bytes / loopSeconds * 1e-9, bytes / sumSeconds * 1e-9,
+					loopSeconds / sumSeconds, std::fabs(loop[0] - exact) / exact, std::fabs(sum.At(0) - exact) / exact);
+			}
+		}
+
+		const Array logits({ 1797, 10 }, 0.5f);
+		Numpy::ArgMax(logits, 1);
+		std::printf("%-16s %5d %10.2f GB/s argmax\n", "1797 x 10", 1,
+			sizeof(float) * 1797.0 * 10.0 / MeasureSeconds([&]() { Numpy::ArgMax(logits, 1); }) * 1e-9);
+	}
+}
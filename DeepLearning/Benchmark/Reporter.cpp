@@ -0,0 +1,169 @@
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<ctime>
+#include<fstream>
+#include<sstream>
+#include<thread>
+
+#include "Benchmark.h"
+
+namespace
+{
+	// Reads the number after "key": in the object text; the baseline is a file this program wrote, so no general parser is needed.
+	bool readNumber(const std::string& object, const char* key, double& value)
+	{
+		const std::string quoted = std::string("\"") + key + "\":";
+		const size_t position = object.find(quoted);
+		if (position == std::string::npos)
+			return false;
+
+		value = std::strtod(object.c_str() + position + quoted.size(), nullptr);
+		return true;
+	}
+
+	bool readString(const std::string& object, const char* key, std::string& value)
+	{
+		const std::string quoted = std::string("\"") + key + "\": \"";
+		const size_t begin = object.find(quoted);
+		if (begin == std::string::npos)
+			return false;
+
+		const size_t end = object.find('"', begin + quoted.size());
+		if (end == std::string::npos)
+			return false;
+
+		value = object.substr(begin + quoted.size(), end - begin - quoted.size());
+		return true;
+	}
+}
+
+namespace benchmark
+{
+	Reporter::Reporter(const std::string& filter, const double& minSeconds)
+		: mFilter(filter)
+		, mMinSeconds(minSeconds)
+	{
+		std::printf("%-36s %12s %12s %10s %10s %9s\n", "case", "ns/op", "iterations", "GB/s", "GFLOP/s", "baseline");
+	}
+
+	bool Reporter::LoadBaseline(const std::string& path)
+	{
+		std::ifstream file(path);
+		if (!file)
+			return false;
+
+		std::stringstream stream;
+		stream << file.rdbuf();
+		const std::string text = stream.str();
+
+		mBaseline.clear();
+		size_t begin = text.find("\"benchmarks\"");
+		while (begin != std::string::npos && (begin = text.find('{', begin)) != std::string::npos)
+		{
+			const size_t end = text.find('}', begin);
+			if (end == std::string::npos)
+				break;
+
+			const std::string object = text.substr(begin, end - begin);
+			Result result = {};
+			double iterations = 0.0;
+			if (readString(object, "name", result.Name) && readNumber(object, "real_time", result.Nanoseconds))
+			{
+				readNumber(object, "iterations", iterations);
+				readNumber(object, "bytes_per_second", result.BytesPerSecond);
+				readNumber(object, "flops_per_second", result.FlopsPerSecond);
+				result.Iterations = static_cast<unsigned long long>(iterations);
+				mBaseline.push_back(result);
+			}
+			begin = end;
+		}
+		return true;
+	}
+
+	void Reporter::Measure(const std::string& name, const double& bytes, const double& flops, const std::function<void()>& body)
+	{
+		if (name.find(mFilter) == std::string::npos)
+			return;
+
+		Result result;
+		result.Name = name;
+		const double seconds = MeasureSeconds(body, mMinSeconds, &result.Iterations);
+		result.Nanoseconds = seconds * 1e9;
+		result.BytesPerSecond = bytes / seconds;
+		result.FlopsPerSecond = flops / seconds;
+		mResults.push_back(result);
+
+		char change[16] = "";
+		const Result* baseline = findBaseline(name);
+		if (baseline != nullptr)
+		{
+			std::snprintf(change, sizeof(change), "%+.1f%%", 100.0 * (result.Nanoseconds / baseline->Nanoseconds - 1.0));
+		}
+		std::printf("%-36s %12.1f %12llu %10.2f %10.2f %9s\n", name.c_str(), result.Nanoseconds, result.Iterations,
+			result.BytesPerSecond * 1e-9, result.FlopsPerSecond * 1e-9, change);
+	}
+
+	bool Reporter::WriteJson(const std::string& path) const
+	{
+		std::ofstream file(path);
+		if (!file)
+			return false;
+
+		char date[32];
+		const std::time_t now = std::time(nullptr);
+		std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+		file << "{\n  \"context\": {\n";
+		file << "    \"date\": \"" << date << "\",\n";
+		file << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+#ifdef NDEBUG
+		file << "    \"library_build_type\": \"release\"\n";
+#else
+		file << "    \"library_build_type\": \"debug\"\n";
+#endif
+		file << "  },\n  \"benchmarks\": [\n";
+		for (size_t i = 0; i < mResults.size(); ++i)
+		{
+			const Result& result = mResults[i];
+			char line[512];
+			std::snprintf(line, sizeof(line),
+				"    {\n      \"name\": \"%s\",\n      \"iterations\": %llu,\n      \"real_time\": %.3f,\n      \"time_unit\": \"ns\",\n"
+				"      \"bytes_per_second\": %.6e,\n      \"flops_per_second\": %.6e\n    }%s\n",
+				result.Name.c_str(), result.Iterations, result.Nanoseconds, result.BytesPerSecond, result.FlopsPerSecond,
+				i + 1 < mResults.size() ? "," : "");
+			file << line;
+		}
+		file << "  ]\n}\n";
+		return static_cast<bool>(file);
+	}
+
+	unsigned int Reporter::CountRegressions(const double& threshold) const
+	{
+		unsigned int count = 0;
+		for (const Result& result : mResults)
+		{
+			const Result* baseline = findBaseline(result.Name);
+			if (baseline != nullptr && result.Nanoseconds > baseline->Nanoseconds * (1.0 + threshold))
+			{
+				++count;
+			}
+		}
+		return count;
+	}
+
+	const std::vector<Result>& Reporter::GetResults() const
+	{
+		return mResults;
+	}
+
+	const Result* Reporter::findBaseline(const std::string& name) const
+	{
+		for (const Result& result : mBaseline)
+		{
+			if (result.Name == name)
+				return &result;
+		}
+		return nullptr;
+	}
+}
@@ -0,0 +1,90 @@
+#include<cstdio>
+#include<memory>
+
+#include "Benchmark.h"
+#include "Simd.h"
+
+namespace
+{
+	// The loops Ndarray<T>::operator+ and operator* ran before the dispatched kernels.
+	template<typename T>
+	void loopAdd(const T* a, const T* b, T* out, const unsigned int& size)
+	{
+		for (unsigned int i = 0; i < size; ++i)
+		{
+			out[i] = a[i] + b[i];
+		}
+	}
+
+	template<typename T>
+	void loopMultiply(const T* a, const T& b, T* out, const unsigned int& size)
+	{
+		for (unsigned int i = 0; i < size; ++i)
+		{
+			out[i] = a[i] * b;
+		}
+	}
+
+	template<typename T>
+	void runType(const char* typeName)
+	{
+		const numpy::SimdLevel supported = numpy::Simd::GetSupportedLevel();
+
+		for (unsigned int size = 1u << 10; size <= 1u << 26; size <<= 4)
+		{
+			std::unique_ptr<T[]> a = std::make_unique<T[]>(size);
+			std::unique_ptr<T[]> b = std::make_unique<T[]>(size);
+			std::unique_ptr<T[]> out = std::make_unique<T[]>(size);
+			for (unsigned int i = 0; i < size; ++i)
+			{
+				a[i] = static_cast<T>(i % 13);
+				b[i] = static_cast<T>(i % 7);
+			}
+			const double minSeconds = size >= (1u << 22) ? 0.5 : 0.1;
+
+			const double addBytes = 3.0 * sizeof(T) * size;
+			std::printf("%-6s %-9s %9u %9.2f", typeName, "a + b", size,
+				addBytes / benchmark::MeasureSeconds([&]() { loopAdd(a.get(), b.get(), out.get(), size); }, minSeconds) * 1e-9);
+			for (int level = 0; level <= static_cast<int>(numpy::SimdLevel::AVX512); ++level)
+			{
+				if (level > static_cast<int>(supported))
+				{
+					std::printf(" %9s", "-");
+					continue;
+				}
+				numpy::Simd::SetLevel(static_cast<numpy::SimdLevel>(level));
+				std::printf(" %9.2f", addBytes / benchmark::MeasureSeconds([&]() { numpy::ElementwiseKernel<T>::Add(a.get(), b.get(), out.get(), size); }, minSeconds) * 1e-9);
+			}
+			std::printf("\n");
+
+			const double scaleBytes = 2.0 * sizeof(T) * size;
+			const T scale = static_cast<T>(3);
+			std::printf("%-6s %-9s %9u %9.2f", typeName, "a * 3", size,
+				scaleBytes / benchmark::MeasureSeconds([&]() { loopMultiply(a.get(), scale, out.get(), size); }, minSeconds) * 1e-9);
+			for (int level = 0; level <= static_cast<int>(numpy::SimdLevel::AVX512); ++level)
+			{
+				if (level > static_cast<int>(supported))
+				{
+					std::printf(" %9s", "-");
+					continue;
+				}
+				numpy::Simd::SetLevel(static_cast<numpy::SimdLevel>(level));
+				std::printf(" %9.2f", scaleBytes / benchmark::MeasureSeconds([&]() { numpy::ElementwiseKernel<T>::Multiply(a.get(), scale, out.get(), size); }, minSeconds) * 1e-9);
+			}
+			std::printf("\n");
+		}
+		numpy::Simd::SetLevel(supported);
+	}
+}
+
+namespace benchmark
+{
+	void RunSimdBenchmark()
+	{
+		std::printf("supported level: %s, all columns in GB/s\n", numpy::Simd::GetName(numpy::Simd::GetSupportedLevel()));
+		std::printf("%-6s %-9s %9s %9s %9s %9s %9s %9s\n", "type", "op", "size", "loop", "Scalar", "SSE2", "AVX2", "AVX-512");
+		runType<float>("float");
+		runType<double>("double");
+		runType<int>("int32");
+	}
+}
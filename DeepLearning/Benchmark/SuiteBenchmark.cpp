@@ -0,0 +1,329 @@
+#include<algorithm>
+#include<cmath>
+#include<cstdint>
+#include<cstdio>
+#include<numeric>
+#include<random>
+#include<string>
+
+#include "Autograd.h"
+#include "Benchmark.h"
+#include "Convolution.h"
+#include "DataLoader.h"
+#include "Graph.h"
+#include "Half.h"
+#include "Layer.h"
+#include "Npy.h"
+#include "Profiler.h"
+#include "StaticNdarray.h"
+
+namespace
+{
+	using Array = numpy::Ndarray<float>;
+	using Numpy = numpy::Numpy<float>;
+
+	Array filled(const unsigned int& rows, const unsigned int& columns, const float& scale)
+	{
+		Array array({ rows, columns });
+		for (size_t i = 0; i < array.GetTotalSize(); ++i)
+		{
+			array.At(i) = scale * (static_cast<float>((i * 37) % 23) - 11.0f);
+		}
+		return array;
+	}
+
+	std::string shapeName(const char* prefix, const unsigned int& m, const unsigned int& n, const unsigned int& k)
+	{
+		return std::string(prefix) + "/" + std::to_string(m) + "x" + std::to_string(n) + "x" + std::to_string(k);
+	}
+}
+
+namespace benchmark
+{
+	void RunSuite(Reporter& reporter)
+	{
+		const double bytes = sizeof(float);
+
+		const unsigned int sizes[] = { 1u << 10, 1u << 20 };
+		for (const unsigned int& size : sizes)
+		{
+			const std::string suffix = "/" + std::to_string(size);
+			const Array a({ size }, 0.5f);
+			const Array b({ size }, 1.5f);
+			const Array c({ size }, -2.0f);
+			Array out;
+
+			reporter.Measure("ndarray/construct" + suffix, bytes * size, 0.0, [&]() { Array fresh({ size }, 1.0f); });
+			reporter.Measure("ndarray/copy" + suffix, 2.0 * bytes * size, 0.0, [&]() { Array copy(a); });
+			reporter.Measure("elementwise/add" + suffix, 3.0 * bytes * size, size, [&]() { Numpy::Add(out, a, b); });
+			reporter.Measure("elementwise/fused_relu_fma" + suffix, 4.0 * bytes * size, 3.0 * size, [&]() { Numpy::Maximum(out, a * b + c, 0.0f); });
+		}
+
+		const Array batch = filled(1024, 1024, 0.01f);
+		const Array row = filled(1, 1024, 0.02f).Reshape({ 1024 });
+		Array out;
+		reporter.Measure("elementwise/broadcast_add/1024x1024", 2.0 * bytes * 1024 * 1024, 1024.0 * 1024, [&]() { Numpy::Add(out, batch, row); });
+
+		// Small arrays, where per-row and per-element index arithmetic rather than bandwidth sets the time.
+		const Array smallBatch = filled(32, 32, 0.01f);
+		const Array smallRow = filled(1, 32, 0.02f).Reshape({ 32 });
+		reporter.Measure("elementwise/broadcast_add/32x32", 2.0 * bytes * 32 * 32, 32.0 * 32, [&]() { Numpy::Add(out, smallBatch, smallRow); });
+		const Array smallTransposed = filled(64, 64, 0.01f).Transpose();
+		float atSum = 0.0f;
+		reporter.Measure("ndarray/strided_at/64x64", bytes * 64 * 64, 64.0 * 64, [&]()
+		{
+			for (size_t i = 0; i < smallTransposed.GetTotalSize(); ++i)
+			{
+				atSum += smallTransposed.At(i);
+			}
+		});
+
+		struct Shape
+		{
+			unsigned int M;
+			unsigned int N;
+			unsigned int K;
+		};
+		// Square sizes across the cache levels, and the digits MLP layers at batch 32 and at the full data set.
+		const Shape shapes[] = { { 64, 64, 64 }, { 256, 256, 256 }, { 1024, 1024, 1024 }, { 32, 16, 64 }, { 1797, 16, 64 }, { 1797, 10, 16 } };
+		for (const Shape& shape : shapes)
+		{
+			const Array a = filled(shape.M, shape.K, 0.01f);
+			const Array b = filled(shape.K, shape.N, 0.01f);
+			const double traffic = bytes * (static_cast<double>(shape.M) * shape.K + static_cast<double>(shape.K) * shape.N + static_cast<double>(shape.M) * shape.N);
+			const double flops = 2.0 * shape.M * shape.N * shape.K;
+			reporter.Measure(shapeName("dot", shape.M, shape.N, shape.K), traffic, flops, [&]() { Numpy::Dot(out, a, b); });
+		}
+		// The digits hidden layer at batch 32 (x . w + b, then ReLU): the fused dynamic GEMM against the fixed-shape kernel.
+		const Array hidden = filled(32, 16, 0.01f);
+		const Array hiddenWeight = filled(16, 16, 0.01f);
+		const Array hiddenBias = filled(1, 16, 0.02f).Reshape({ 16 });
+		const double denseTraffic = bytes * (32.0 * 16 + 16.0 * 16 + 16.0 + 32.0 * 16);
+		reporter.Measure("dense_relu/32x16x16", denseTraffic, 2.0 * 32 * 16 * 16, [&]() { Numpy::Dot(out, hidden, hiddenWeight, hiddenBias, true); });
+		numpy::StaticNdarray<float, 32, 16> staticHidden;
+		numpy::StaticNdarray<float, 16, 16> staticWeight;
+		numpy::StaticNdarray<float, 16> staticBias;
+		numpy::StaticNdarray<float, 32, 16> staticOut;
+		staticHidden.Assign(hidden);
+		staticWeight.Assign(hiddenWeight);
+		staticBias.Assign(hiddenBias);
+		reporter.Measure("static/dense_relu/32x16x16", denseTraffic, 2.0 * 32 * 16 * 16,
+			[&]() { staticOut = numpy::StaticNumpy<float>::Dot(staticHidden, staticWeight, staticBias, true); });
+
+		const Array square = filled(1024, 1024, 0.01f);
+		reporter.Measure("dot/transposed/1024x1024x1024", bytes * 3.0 * 1024 * 1024, 2.0 * 1024 * 1024 * 1024,
+			[&]() { Numpy::Dot(out, square.Transpose(), square); });
+
+		// The same product with 16-bit storage (packed to float and summed in float), and through the int8 GEMM with w quantized
+		// ahead of time and the rows of x quantized on the fly.
+		const double squareFlops = 2.0 * 1024 * 1024 * 1024;
+		const numpy::Ndarray<numpy::BFloat16> squareBf16 = square.AsType<numpy::BFloat16>();
+		const numpy::Ndarray<numpy::Float16> squareFp16 = square.AsType<numpy::Float16>();
+		numpy::Ndarray<numpy::BFloat16> outBf16;
+		numpy::Ndarray<numpy::Float16> outFp16;
+		reporter.Measure("dot/bf16/1024x1024x1024", 2.0 * 3.0 * 1024 * 1024, squareFlops, [&]() { numpy::Numpy<numpy::BFloat16>::Dot(outBf16, squareBf16, squareBf16); });
+		reporter.Measure("dot/fp16/1024x1024x1024", 2.0 * 3.0 * 1024 * 1024, squareFlops, [&]() { numpy::Numpy<numpy::Float16>::Dot(outFp16, squareFp16, squareFp16); });
+		Array squareScales;
+		const numpy::Ndarray<std::int8_t> squareValues = Numpy::Quantize(square, 1, squareScales);
+		const numpy::QuantizedMatrix<float> squareInt8(squareValues, squareScales);
+		const Array noBias;
+		reporter.Measure("dot/int8/1024x1024x1024", (2.0 * bytes + 1.0) * 1024 * 1024, squareFlops, [&]() { Numpy::Dot(out, square, squareInt8, noBias, false); });
+
+		// Attention-style scores, one q . k^T per head with k^T a transposed view, and a per-sample projection sharing one weight
+		// matrix, which packs each B panel once for the whole batch.
+		const Array heads = filled(64 * 128, 64, 0.01f).Reshape({ 64, 128, 64 });
+		const Array keys = filled(64 * 128, 64, 0.01f).Reshape({ 64, 128, 64 }).Transpose({ 0, 2, 1 });
+		const double headTraffic = bytes * 64.0 * (128.0 * 64 * 2 + 128.0 * 128);
+		reporter.Measure("dot/batched/64x128x128x64", headTraffic, 2.0 * 64 * 128 * 128 * 64, [&]() { Numpy::Dot(out, heads, keys); });
+		const Array projection = filled(64, 64, 0.01f);
+		const Array perSample = filled(128 * 64, 64, 0.01f).Reshape({ 128, 64, 64 }).Transpose({ 1, 0, 2 });
+		const double projectionTraffic = bytes * (128.0 * 64 * 64 * 2 + 64.0 * 64);
+		reporter.Measure("dot/batched_shared_b/64x128x64x64", projectionTraffic, 2.0 * 64 * 128 * 64 * 64, [&]() { Numpy::Dot(out, perSample, projection); });
+
+		// A 3x3 same-padded convolution, 32 channels in and out over 16x16 images: the naive loop nest against im2col + GEMM
+		// and Winograd, in both layouts, and the 2x2 max pool after it.
+		const Array images = filled(4 * 32, 16 * 16, 0.01f).Reshape({ 4, 32, 16, 16 });
+		const Array filters = filled(32 * 32, 3 * 3, 0.01f).Reshape({ 32, 32, 3, 3 });
+		const Array imagesNhwc(images.Transpose({ 0, 2, 3, 1 }));
+		const Array filtersNhwc(filters.Transpose({ 2, 3, 1, 0 }));
+		const Array filterBias = filled(1, 32, 0.02f).Reshape({ 32 });
+		numpy::ConvolutionParameters nchw;
+		nchw.Padding = 1;
+		numpy::ConvolutionParameters nhwc = nchw;
+		nhwc.Layout = numpy::ImageLayout::Nhwc;
+		const double convolutionTraffic = bytes * (2.0 * 4 * 32 * 16 * 16 + 32.0 * 32 * 9);
+		const double convolutionFlops = 2.0 * 4 * 32 * 16 * 16 * 32 * 9;
+		const struct
+		{
+			const char* Name;
+			numpy::ConvolutionAlgorithm Algorithm;
+		} algorithms[] = { { "direct", numpy::ConvolutionAlgorithm::Direct }, { "im2col", numpy::ConvolutionAlgorithm::Im2col },
+			{ "winograd", numpy::ConvolutionAlgorithm::Winograd } };
+		for (const auto& algorithm : algorithms)
+		{
+			reporter.Measure(std::string("conv2d/") + algorithm.Name + "/nchw/4x32x16x16", convolutionTraffic, convolutionFlops,
+				[&]() { numpy::Convolution<float>::Forward(out, images, filters, filterBias, nchw, true, algorithm.Algorithm); });
+			reporter.Measure(std::string("conv2d/") + algorithm.Name + "/nhwc/4x32x16x16", convolutionTraffic, convolutionFlops,
+				[&]() { numpy::Convolution<float>::Forward(out, imagesNhwc, filtersNhwc, filterBias, nhwc, true, algorithm.Algorithm); });
+		}
+		numpy::Ndarray<size_t> poolIndices;
+		reporter.Measure("maxpool/nchw/4x32x16x16", bytes * 1.25 * 4 * 32 * 16 * 16, 0.0,
+			[&]() { numpy::Convolution<float>::MaxPool(out, poolIndices, images, 2, 2, numpy::ImageLayout::Nchw); });
+
+		const Array tall = filled(4096, 1024, 0.01f);
+		const double tallBytes = bytes * 4096 * 1024;
+		reporter.Measure("reduce/sum_axis1/4096x1024", tallBytes, 4096.0 * 1024, [&]() { out = Numpy::Sum(tall, 1); });
+		reporter.Measure("reduce/sum_axis0/4096x1024", tallBytes, 4096.0 * 1024, [&]() { out = Numpy::Sum(tall, 0); });
+		reporter.Measure("reduce/max_axis0/4096x1024", tallBytes, 4096.0 * 1024, [&]() { out = Numpy::Max(tall, 0); });
+		reporter.Measure("reduce/argmax_axis1/4096x1024", tallBytes, 0.0, [&]() { Numpy::ArgMax(tall, 1); });
+		reporter.Measure("reduce/sum_all/4096x1024", tallBytes, 4096.0 * 1024, [&]() { Numpy::Sum(tall); });
+
+		// Transcendentals through MathKernel, next to the std::exp loop they replace, and the row softmax of the digits output
+		// layer and of a wide matrix.
+		const double squareBytes = bytes * 1024 * 1024;
+		reporter.Measure("math/exp/1024x1024", 2.0 * squareBytes, 1024.0 * 1024, [&]() { Numpy::Exp(out, square); });
+		reporter.Measure("math/exp_std/1024x1024", 2.0 * squareBytes, 1024.0 * 1024, [&]()
+		{
+			const float* x = square.GetData();
+			float* y = out.GetData();
+			for (size_t i = 0; i < square.GetTotalSize(); ++i)
+			{
+				y[i] = std::exp(x[i]);
+			}
+		});
+		reporter.Measure("math/tanh/1024x1024", 2.0 * squareBytes, 1024.0 * 1024, [&]() { Numpy::Tanh(out, square); });
+		reporter.Measure("math/gelu/1024x1024", 2.0 * squareBytes, 1024.0 * 1024, [&]() { Numpy::Gelu(out, square); });
+		const Array digitLogits = filled(1797, 10, 0.3f);
+		reporter.Measure("math/softmax/1797x10", 2.0 * bytes * 1797 * 10, 1797.0 * 10, [&]() { Numpy::Softmax(out, digitLogits); });
+		reporter.Measure("math/softmax/4096x1024", 2.0 * tallBytes, 4096.0 * 1024, [&]() { Numpy::Softmax(out, tall); });
+
+		// Opening a 16 MiB weight file: Load parses and copies everything, Map only maps it and reads the header.
+		const std::string npyPath = "benchmark_suite.npy";
+		numpy::Npy<float>::Save(npyPath, tall);
+		reporter.Measure("io/npy_load/4096x1024", tallBytes, 0.0, [&]() { const Array loaded = numpy::Npy<float>::Load(npyPath); });
+		reporter.Measure("io/npy_map/4096x1024", 0.0, 0.0, [&]() { const Array mapped = numpy::Npy<float>::Map(npyPath); });
+		std::remove(npyPath.c_str());
+
+		// One training step of the digits MLP (64 -> 16 -> 16 -> 10, batch 32): forward, loss, backward and update.
+		const unsigned int batchSize = 32;
+		const Array x = filled(batchSize, 64, 0.1f);
+		Array t({ batchSize, 10 }, 0.0f);
+		for (unsigned int r = 0; r < batchSize; ++r)
+		{
+			t.At(r * 10 + r % 10) = 1.0f;
+		}
+		numpy::Dense<float> hidden1(64, 16, numpy::Activation::Relu, 1);
+		numpy::Dense<float> hidden2(16, 16, numpy::Activation::Relu, 2);
+		numpy::Dense<float> output(16, 10, numpy::Activation::Identity, 3);
+		numpy::SoftmaxCrossEntropy<float> loss;
+		// Three GEMMs per layer (forward, weight gradient, input gradient).
+		const double stepFlops = 3.0 * 2.0 * batchSize * (64.0 * 16 + 16.0 * 16 + 16.0 * 10);
+		reporter.Measure("mlp/train_step/digits_batch32", 0.0, stepFlops, [&]()
+		{
+			loss.Forward(output.Forward(hidden2.Forward(hidden1.Forward(x))), t);
+			hidden1.Backward(hidden2.Backward(output.Backward(loss.Backward())));
+			hidden1.Update(0.001f);
+			hidden2.Update(0.001f);
+			output.Update(0.001f);
+		});
+		// The same step recorded on a tape, against the hand-written backward passes above.
+		numpy::Tape<float> tape;
+		Array* weights[] = { &hidden1.GetWeight(), &hidden1.GetBias(), &hidden2.GetWeight(), &hidden2.GetBias(), &output.GetWeight(), &output.GetBias() };
+		reporter.Measure("autograd/train_step/digits_batch32", 0.0, stepFlops, [&]()
+		{
+			tape.Clear();
+			numpy::Variable<float> parameters[6];
+			for (int i = 0; i < 6; ++i)
+			{
+				parameters[i] = tape.Parameter(*weights[i]);
+			}
+			const numpy::Variable<float> h1 = tape.Relu(tape.Dot(tape.Constant(x), parameters[0]) + parameters[1]);
+			const numpy::Variable<float> h2 = tape.Relu(tape.Dot(h1, parameters[2]) + parameters[3]);
+			tape.Backward(tape.SoftmaxCrossEntropy(tape.Dot(h2, parameters[4]) + parameters[5], t));
+			for (int i = 0; i < 6; ++i)
+			{
+				*weights[i] -= parameters[i].GetGradient() * 0.001f;
+			}
+		});
+
+		// Softmax probabilities of the digits MLP over the whole data set: layer by layer, each result its own array, and as a
+		// compiled graph running in one planned workspace.
+		const Array digits = filled(1797, 64, 0.1f);
+		const double inferenceFlops = 2.0 * 1797 * (64.0 * 16 + 16.0 * 16 + 16.0 * 10);
+		Array probability;
+		reporter.Measure("mlp/inference/digits_1797", 0.0, inferenceFlops, [&]()
+		{
+			Array u1;
+			Array u2;
+			Array logits;
+			Numpy::Dot(u1, digits, hidden1.GetWeight(), hidden1.GetBias(), true);
+			Numpy::Dot(u2, u1, hidden2.GetWeight(), hidden2.GetBias(), true);
+			Numpy::Dot(logits, u2, output.GetWeight(), output.GetBias(), false);
+			probability = logits;
+			for (size_t r = 0; r < 1797; ++r)
+			{
+				float* row = probability.GetData() + r * 10;
+				const float maximum = *std::max_element(row, row + 10);
+				float sum = 0.0f;
+				for (int c = 0; c < 10; ++c)
+				{
+					row[c] = std::exp(row[c] - maximum);
+					sum += row[c];
+				}
+				for (int c = 0; c < 10; ++c)
+				{
+					row[c] /= sum;
+				}
+			}
+		});
+		numpy::Graph<float> graph;
+		numpy::Symbol<float> y = graph.Input({ 1797, 64 });
+		y = graph.Relu(graph.Dot(y, graph.Constant(hidden1.GetWeight())) + graph.Constant(hidden1.GetBias()));
+		y = graph.Relu(graph.Dot(y, graph.Constant(hidden2.GetWeight())) + graph.Constant(hidden2.GetBias()));
+		y = graph.Softmax(graph.Dot(y, graph.Constant(output.GetWeight())) + graph.Constant(output.GetBias()));
+		numpy::CompiledGraph<float> compiled = graph.Compile({ y });
+		reporter.Measure("graph/inference/digits_1797", 0.0, inferenceFlops, [&]() { compiled.Run({ &digits }); });
+
+		// Getting one shuffled digits mini-batch: gathered on the training thread, and handed over by a prefetching loader.
+		const Array samples = filled(1797, 64, 0.1f);
+		const Array targets = filled(1797, 10, 0.1f);
+		std::vector<size_t> order(samples.GetArraySize(0));
+		std::iota(order.begin(), order.end(), size_t(0));
+		std::shuffle(order.begin(), order.end(), std::mt19937(0));
+		const double batchBytes = 2.0 * bytes * batchSize * (64 + 10);
+		Array xBatch;
+		Array tBatch;
+		size_t position = 0;
+		reporter.Measure("loader/take/digits_batch32", batchBytes, 0.0, [&]()
+		{
+			position = position + 2 * batchSize > order.size() ? 0 : position + batchSize;
+			Numpy::Take(xBatch, samples, order.data() + position, batchSize);
+			Numpy::Take(tBatch, targets, order.data() + position, batchSize);
+		});
+		numpy::DataLoader<float> loader({ &samples, &targets }, batchSize, 2, 0);
+		reporter.Measure("loader/next/digits_batch32", batchBytes, 0.0, [&]()
+		{
+			if (loader.Next() == nullptr)
+			{
+				loader.Next();
+			}
+		});
+
+		// What one instrumented call costs in a profiled build, with the profiler off and recording.
+		reporter.Measure("profile/scope_disabled", 0.0, 0.0, [&]() { const numpy::ProfileScope scope("benchmark"); });
+		size_t scopes = 0;
+		numpy::Profiler::Enable();
+		reporter.Measure("profile/scope_enabled", 0.0, 0.0, [&]()
+		{
+			{
+				const numpy::ProfileScope scope("benchmark");
+			}
+			if (++scopes % 4096u == 0u)
+			{
+				numpy::Profiler::Reset();
+			}
+		});
+		numpy::Profiler::Enable(false);
+		numpy::Profiler::Reset();
+	}
+}
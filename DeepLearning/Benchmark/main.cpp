@@ -0,0 +1,122 @@
+#include<cstdlib>
+#include<cstring>
+#include<iostream>
+#include<string>
+
+#include "Benchmark.h"
+#include "Distributed.h"
+#include "ThreadPool.h"
+
+namespace
+{
+	// Value of --name=value, or nullptr when argument is not that option.
+	const char* option(const char* argument, const char* name)
+	{
+		const size_t length = std::strlen(name);
+		if (std::strncmp(argument, name, length) == 0 && argument[length] == '=')
+			return argument + length + 1;
+		return nullptr;
+	}
+}
+
+// Benchmark [--filter=substring] [--json=out.json] [--baseline=baseline.json] [--threshold=0.1] [--min-time=seconds] [--threads=n]
+//           [--tables[=group]]
+// Runs the regression suite and compares it with the baseline (the stored Benchmark/baseline.json when built by CMake).
+// Each case in the stored baseline is the timing recorded when the case was added; it is re-recorded only by a change to what
+// the case measures, so a diff of the file shows new or redefined cases rather than run-to-run noise.
+// --threads overrides NUMPY_NUM_THREADS for the whole run.
+// --tables runs the comparison tables of the gemm, simd, expression, reduction, layer, distributed and inference groups instead.
+int main(int argc, char* argv[])
+{
+	// A process started by the distributed table trains its share and does nothing else.
+	if (numpy::ProcessGroup::IsWorker())
+		return benchmark::RunDistributedWorker() ? 0 : 1;
+
+	std::string filter;
+	std::string jsonPath;
+#ifdef NUMPY_BENCHMARK_BASELINE
+	std::string baselinePath = NUMPY_BENCHMARK_BASELINE;
+#else
+	std::string baselinePath;
+#endif
+	double threshold = 0.1;
+	double minSeconds = 0.25;
+	const char* tables = nullptr;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* value = nullptr;
+		if ((value = option(argv[i], "--filter")) != nullptr)
+			filter = value;
+		else if ((value = option(argv[i], "--json")) != nullptr)
+			jsonPath = value;
+		else if ((value = option(argv[i], "--baseline")) != nullptr)
+			baselinePath = value;
+		else if ((value = option(argv[i], "--threshold")) != nullptr)
+			threshold = std::atof(value);
+		else if ((value = option(argv[i], "--min-time")) != nullptr)
+			minSeconds = std::atof(value);
+		else if ((value = option(argv[i], "--threads")) != nullptr)
+			numpy::ThreadPool::Instance().SetThreadCount(static_cast<unsigned int>(std::atoi(value)));
+		else if ((value = option(argv[i], "--tables")) != nullptr)
+			tables = value;
+		else if (std::strcmp(argv[i], "--tables") == 0)
+			tables = "";
+		else
+		{
+			std::cerr << "unknown argument " << argv[i] << std::endl;
+			return 2;
+		}
+	}
+
+	if (tables != nullptr)
+	{
+		if (std::strstr("gemm", tables) != nullptr)
+		{
+			benchmark::RunGemmBenchmark();
+		}
+		if (std::strstr("simd", tables) != nullptr)
+		{
+			benchmark::RunSimdBenchmark();
+		}
+		if (std::strstr("expression", tables) != nullptr)
+		{
+			benchmark::RunExpressionBenchmark();
+		}
+		if (std::strstr("reduction", tables) != nullptr)
+		{
+			benchmark::RunReductionBenchmark();
+		}
+		if (std::strstr("layer", tables) != nullptr)
+		{
+			benchmark::RunLayerBenchmark();
+		}
+		if (std::strstr("distributed", tables) != nullptr)
+		{
+			benchmark::RunDistributedBenchmark();
+		}
+		if (std::strstr("inference", tables) != nullptr)
+		{
+			benchmark::RunInferenceBenchmark();
+		}
+		std::cout << "Benchmark Done" << std::endl;
+		return 0;
+	}
+
+	benchmark::Reporter reporter(filter, minSeconds);
+	const bool bBaseline = !baselinePath.empty() && reporter.LoadBaseline(baselinePath);
+	benchmark::RunSuite(reporter);
+
+	if (!jsonPath.empty() && !reporter.WriteJson(jsonPath))
+	{
+		std::cerr << "cannot write " << jsonPath << std::endl;
+		return 2;
+	}
+	if (bBaseline)
+	{
+		const unsigned int regressions = reporter.CountRegressions(threshold);
+		std::cout << regressions << " of " << reporter.GetResults().size() << " cases slower than " << baselinePath
+			<< " by more than " << threshold * 100.0 << "%" << std::endl;
+	}
+	std::cout << "Benchmark Done" << std::endl;
+}
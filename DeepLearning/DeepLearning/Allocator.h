@@ -0,0 +1,550 @@
+#pragma once
+#include<atomic>
+#include<cstddef>
+#include<memory>
+#include<mutex>
+#include<new>
+#include<type_traits>
+#include<vector>
+#include "Profiler.h"
+
+namespace numpy
+{
+	struct AllocationStatistics
+	{
+		// Blocks taken from and returned to the system allocator; a steady-state step should add nothing to either.
+		unsigned long long SystemAllocations;
+		unsigned long long SystemDeallocations;
+		// Requests served by recycling a pooled block or by bumping an arena.
+		unsigned long long PoolAllocations;
+		unsigned long long ArenaAllocations;
+	};
+
+	class Arena;
+	struct MemoryPoolMailbox;
+
+	// Static facade behind every Ndarray buffer. Requests go to the arena of the innermost ArenaScope on this thread if there is one,
+	// otherwise to this thread's MemoryPool.
+	class Allocator final
+	{
+	public:
+		Allocator() = delete;
+		~Allocator() = delete;
+
+		// Uninitialised storage for count elements, 64-byte aligned. The shared_ptr control block comes from the same source,
+		// so a recycled buffer costs no malloc at all.
+		template<typename T>
+		static std::shared_ptr<T[]> AllocateShared(const size_t& count);
+
+		static AllocationStatistics GetStatistics();
+		static void ResetStatistics();
+		static Arena* GetArena();
+
+		static constexpr size_t ALIGNMENT = 64;
+	private:
+		friend class MemoryPool;
+		friend struct MemoryPoolMailbox;
+		friend class Arena;
+		friend class ArenaScope;
+
+		template<typename U>
+		struct ControlAllocator;
+		template<typename T>
+		struct Deleter;
+
+		static void* allocate(const size_t& size, Arena* arena);
+		// owner is the mailbox of the pool that allocated block, or nullptr when no pool did.
+		static void deallocate(void* block, const size_t& size, Arena* arena, MemoryPoolMailbox* owner);
+		static void* systemAllocate(const size_t& size);
+		static void systemDeallocate(void* block);
+
+		static std::atomic<unsigned long long> sSystemAllocations;
+		static std::atomic<unsigned long long> sSystemDeallocations;
+		static std::atomic<unsigned long long> sPoolAllocations;
+		static std::atomic<unsigned long long> sArenaAllocations;
+		static thread_local Arena* spArena;
+	};
+
+	// Per-thread free lists of 64-byte-aligned blocks in power-of-two size classes, so the common path takes no lock.
+	// A block freed on another thread is posted back to the allocating thread's mailbox, which that thread drains into its lists
+	// when they run dry. Each list caches at most MAX_CACHED_BYTES, or MIN_CACHED_BLOCKS blocks of the large classes, and
+	// frees the excess to the system. Blocks above MAX_POOLED_SIZE go straight back to the system.
+	class MemoryPool final
+	{
+		friend class Allocator;
+	public:
+		MemoryPool(const MemoryPool& rhs) = delete;
+		MemoryPool& operator=(const MemoryPool& rhs) = delete;
+		~MemoryPool();
+
+		static MemoryPool& Instance();
+
+		void* Allocate(const size_t& size);
+		void Deallocate(void* block, const size_t& size);
+		// Hands every cached block back to the system.
+		void Release();
+
+		static constexpr unsigned int MIN_CLASS_SHIFT = 6;
+		static constexpr unsigned int SIZE_CLASS_COUNT = 23;
+		static constexpr size_t MAX_POOLED_SIZE = static_cast<size_t>(1) << (MIN_CLASS_SHIFT + SIZE_CLASS_COUNT - 1);
+		static constexpr size_t MAX_CACHED_BYTES = static_cast<size_t>(1) << 26;
+		static constexpr size_t MIN_CACHED_BLOCKS = 2;
+	private:
+		friend struct MemoryPoolMailbox;
+
+		struct FreeBlock
+		{
+			FreeBlock* Next;
+			// Size class of a block waiting in a mailbox.
+			unsigned int Class;
+		};
+
+		MemoryPool();
+
+		void drain();
+		static void post(MemoryPoolMailbox& mailbox, void* block, const size_t& size);
+		static unsigned int sizeClass(const size_t& size);
+		static size_t capacity(const unsigned int& index);
+
+		FreeBlock* mFreeLists[SIZE_CLASS_COUNT];
+		size_t mFreeCounts[SIZE_CLASS_COUNT];
+		MemoryPoolMailbox* mpMailbox;
+
+		// Set once this thread's pool is destroyed, so buffers released later during thread or program exit bypass it.
+		static thread_local bool sbDestroyed;
+	};
+
+	// Blocks other threads freed for one pool, pushed without a lock and taken all at once by the pool's thread. A mailbox outlives
+	// its pool: once closed, blocks posted to it go to the system, and the next thread to create a pool reopens it.
+	struct MemoryPoolMailbox
+	{
+		std::atomic<MemoryPool::FreeBlock*> Head;
+		MemoryPoolMailbox* NextFree;
+
+		static MemoryPoolMailbox* Open();
+		static void Close(MemoryPoolMailbox* mailbox);
+
+		// Head of a mailbox whose pool is gone.
+		static MemoryPool::FreeBlock sClosed;
+		static std::mutex sMutex;
+		static MemoryPoolMailbox* spFree;
+	};
+
+	// Bump allocator for buffers that live for one training step: Allocate is a pointer increment and Reset() frees everything in O(1).
+	// Blocks are kept across resets; a step that outgrows them adds a block, which later steps reuse.
+	class Arena final
+	{
+	public:
+		explicit Arena(const size_t& blockSize = static_cast<size_t>(1) << 24);
+		Arena(const Arena& rhs) = delete;
+		Arena& operator=(const Arena& rhs) = delete;
+		~Arena();
+
+		void* Allocate(const size_t& size);
+		// Every array allocated from the arena must be gone (or never touched again) before this is called.
+		void Reset();
+		size_t GetUsedSize() const;
+		size_t GetCapacity() const;
+	private:
+		struct Block
+		{
+			char* Data;
+			size_t Size;
+		};
+
+		std::vector<Block> mBlocks;
+		size_t mBlockIndex;
+		size_t mBlockUsed;
+		size_t mUsedSize;
+		size_t mBlockSize;
+	};
+
+	// Routes the Ndarray allocations of this thread to arena until the scope ends; scopes nest.
+	class ArenaScope final
+	{
+	public:
+		explicit ArenaScope(Arena& arena);
+		ArenaScope(const ArenaScope& rhs) = delete;
+		ArenaScope& operator=(const ArenaScope& rhs) = delete;
+		~ArenaScope();
+	private:
+		Arena* mpPrevious;
+	};
+
+	inline std::atomic<unsigned long long> Allocator::sSystemAllocations(0);
+	inline std::atomic<unsigned long long> Allocator::sSystemDeallocations(0);
+	inline std::atomic<unsigned long long> Allocator::sPoolAllocations(0);
+	inline std::atomic<unsigned long long> Allocator::sArenaAllocations(0);
+	inline thread_local Arena* Allocator::spArena = nullptr;
+	inline thread_local bool MemoryPool::sbDestroyed = false;
+	inline MemoryPool::FreeBlock MemoryPoolMailbox::sClosed = { nullptr, 0 };
+	inline std::mutex MemoryPoolMailbox::sMutex;
+	inline MemoryPoolMailbox* MemoryPoolMailbox::spFree = nullptr;
+
+	template<typename U>
+	struct Allocator::ControlAllocator
+	{
+		using value_type = U;
+
+		ControlAllocator(Arena* arena, MemoryPoolMailbox* owner)
+			: Source(arena)
+			, Owner(owner)
+		{
+		}
+
+		template<typename V>
+		ControlAllocator(const ControlAllocator<V>& rhs)
+			: Source(rhs.Source)
+			, Owner(rhs.Owner)
+		{
+		}
+
+		U* allocate(const size_t& count)
+		{
+			return static_cast<U*>(Allocator::allocate(count * sizeof(U), Source));
+		}
+
+		void deallocate(U* block, const size_t& count)
+		{
+			Allocator::deallocate(block, count * sizeof(U), Source, Owner);
+		}
+
+		template<typename V>
+		bool operator==(const ControlAllocator<V>& rhs) const
+		{
+			return Source == rhs.Source && Owner == rhs.Owner;
+		}
+
+		template<typename V>
+		bool operator!=(const ControlAllocator<V>& rhs) const
+		{
+			return !(*this == rhs);
+		}
+
+		Arena* Source;
+		MemoryPoolMailbox* Owner;
+	};
+
+	template<typename T>
+	struct Allocator::Deleter
+	{
+		void operator()(T* block) const
+		{
+			Allocator::deallocate(block, Size, Source, Owner);
+		}
+
+		size_t Size;
+		Arena* Source;
+		MemoryPoolMailbox* Owner;
+	};
+
+	template<typename T>
+	std::shared_ptr<T[]> Allocator::AllocateShared(const size_t& count)
+	{
+		static_assert(std::is_trivially_default_constructible<T>::value && std::is_trivially_destructible<T>::value,
+			"pooled buffers are neither constructed nor destroyed");
+
+		Arena* arena = spArena;
+		MemoryPoolMailbox* owner = arena == nullptr && !MemoryPool::sbDestroyed ? MemoryPool::Instance().mpMailbox : nullptr;
+		const size_t size = (count == 0 ? 1 : count) * sizeof(T);
+		NUMPY_PROFILE_ALLOCATION(size);
+		T* block = static_cast<T*>(allocate(size, arena));
+		return std::shared_ptr<T[]>(block, Deleter<T>{ size, arena, owner }, ControlAllocator<T>(arena, owner));
+	}
+
+	inline AllocationStatistics Allocator::GetStatistics()
+	{
+		AllocationStatistics statistics;
+		statistics.SystemAllocations = sSystemAllocations.load(std::memory_order_relaxed);
+		statistics.SystemDeallocations = sSystemDeallocations.load(std::memory_order_relaxed);
+		statistics.PoolAllocations = sPoolAllocations.load(std::memory_order_relaxed);
+		statistics.ArenaAllocations = sArenaAllocations.load(std::memory_order_relaxed);
+		return statistics;
+	}
+
+	inline void Allocator::ResetStatistics()
+	{
+		sSystemAllocations.store(0, std::memory_order_relaxed);
+		sSystemDeallocations.store(0, std::memory_order_relaxed);
+		sPoolAllocations.store(0, std::memory_order_relaxed);
+		sArenaAllocations.store(0, std::memory_order_relaxed);
+	}
+
+	inline Arena* Allocator::GetArena()
+	{
+		return spArena;
+	}
+
+	inline void* Allocator::allocate(const size_t& size, Arena* arena)
+	{
+		if (arena != nullptr)
+		{
+			return arena->Allocate(size);
+		}
+		if (MemoryPool::sbDestroyed)
+		{
+			return systemAllocate(size);
+		}
+		return MemoryPool::Instance().Allocate(size);
+	}
+
+	inline void Allocator::deallocate(void* block, const size_t& size, Arena* arena, MemoryPoolMailbox* owner)
+	{
+		if (arena != nullptr)
+			return;
+
+		if (owner != nullptr && size <= MemoryPool::MAX_POOLED_SIZE && (MemoryPool::sbDestroyed || owner != MemoryPool::Instance().mpMailbox))
+		{
+			MemoryPool::post(*owner, block, size);
+			return;
+		}
+		if (MemoryPool::sbDestroyed)
+		{
+			systemDeallocate(block);
+			return;
+		}
+		MemoryPool::Instance().Deallocate(block, size);
+	}
+
+	inline void* Allocator::systemAllocate(const size_t& size)
+	{
+		sSystemAllocations.fetch_add(1, std::memory_order_relaxed);
+		return ::operator new(size, std::align_val_t(ALIGNMENT));
+	}
+
+	inline void Allocator::systemDeallocate(void* block)
+	{
+		sSystemDeallocations.fetch_add(1, std::memory_order_relaxed);
+		::operator delete(block, std::align_val_t(ALIGNMENT));
+	}
+
+	inline MemoryPool::MemoryPool()
+		: mpMailbox(MemoryPoolMailbox::Open())
+	{
+		for (unsigned int i = 0; i < SIZE_CLASS_COUNT; ++i)
+		{
+			mFreeLists[i] = nullptr;
+			mFreeCounts[i] = 0;
+		}
+	}
+
+	inline MemoryPool::~MemoryPool()
+	{
+		Release();
+		MemoryPoolMailbox::Close(mpMailbox);
+		sbDestroyed = true;
+	}
+
+	inline MemoryPool& MemoryPool::Instance()
+	{
+		static thread_local MemoryPool instance;
+		return instance;
+	}
+
+	inline void* MemoryPool::Allocate(const size_t& size)
+	{
+		if (size > MAX_POOLED_SIZE)
+		{
+			return Allocator::systemAllocate(size);
+		}
+
+		const unsigned int index = sizeClass(size);
+		if (mFreeLists[index] == nullptr && mpMailbox->Head.load(std::memory_order_relaxed) != nullptr)
+		{
+			drain();
+		}
+		FreeBlock* block = mFreeLists[index];
+		if (block != nullptr)
+		{
+			mFreeLists[index] = block->Next;
+			--mFreeCounts[index];
+			Allocator::sPoolAllocations.fetch_add(1, std::memory_order_relaxed);
+			return block;
+		}
+		return Allocator::systemAllocate(static_cast<size_t>(1) << (index + MIN_CLASS_SHIFT));
+	}
+
+	inline void MemoryPool::Deallocate(void* block, const size_t& size)
+	{
+		if (size > MAX_POOLED_SIZE)
+		{
+			Allocator::systemDeallocate(block);
+			return;
+		}
+
+		const unsigned int index = sizeClass(size);
+		if (mFreeCounts[index] >= capacity(index))
+		{
+			Allocator::systemDeallocate(block);
+			return;
+		}
+		FreeBlock* freeBlock = static_cast<FreeBlock*>(block);
+		freeBlock->Next = mFreeLists[index];
+		mFreeLists[index] = freeBlock;
+		++mFreeCounts[index];
+	}
+
+	inline void MemoryPool::Release()
+	{
+		drain();
+		for (unsigned int i = 0; i < SIZE_CLASS_COUNT; ++i)
+		{
+			while (mFreeLists[i] != nullptr)
+			{
+				FreeBlock* next = mFreeLists[i]->Next;
+				Allocator::systemDeallocate(mFreeLists[i]);
+				mFreeLists[i] = next;
+			}
+			mFreeCounts[i] = 0;
+		}
+	}
+
+	inline void MemoryPool::drain()
+	{
+		FreeBlock* block = mpMailbox->Head.exchange(nullptr, std::memory_order_acquire);
+		while (block != nullptr)
+		{
+			FreeBlock* next = block->Next;
+			Deallocate(block, static_cast<size_t>(1) << (block->Class + MIN_CLASS_SHIFT));
+			block = next;
+		}
+	}
+
+	inline void MemoryPool::post(MemoryPoolMailbox& mailbox, void* block, const size_t& size)
+	{
+		FreeBlock* freeBlock = static_cast<FreeBlock*>(block);
+		freeBlock->Class = sizeClass(size);
+		FreeBlock* head = mailbox.Head.load(std::memory_order_relaxed);
+		do
+		{
+			if (head == &MemoryPoolMailbox::sClosed)
+			{
+				Allocator::systemDeallocate(block);
+				return;
+			}
+			freeBlock->Next = head;
+		} while (!mailbox.Head.compare_exchange_weak(head, freeBlock, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	inline unsigned int MemoryPool::sizeClass(const size_t& size)
+	{
+		unsigned int index = 0;
+		while ((static_cast<size_t>(1) << (index + MIN_CLASS_SHIFT)) < size)
+		{
+			++index;
+		}
+		return index;
+	}
+
+	inline size_t MemoryPool::capacity(const unsigned int& index)
+	{
+		const size_t blocks = MAX_CACHED_BYTES >> (index + MIN_CLASS_SHIFT);
+		return blocks > MIN_CACHED_BLOCKS ? blocks : MIN_CACHED_BLOCKS;
+	}
+
+	inline MemoryPoolMailbox* MemoryPoolMailbox::Open()
+	{
+		MemoryPoolMailbox* mailbox = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(sMutex);
+			if (spFree != nullptr)
+			{
+				mailbox = spFree;
+				spFree = mailbox->NextFree;
+			}
+		}
+		if (mailbox == nullptr)
+		{
+			mailbox = new MemoryPoolMailbox();
+		}
+		mailbox->NextFree = nullptr;
+		mailbox->Head.store(nullptr, std::memory_order_release);
+		return mailbox;
+	}
+
+	// Posts racing with the close either land before it, and are freed here, or see it and free their block themselves.
+	inline void MemoryPoolMailbox::Close(MemoryPoolMailbox* mailbox)
+	{
+		MemoryPool::FreeBlock* block = mailbox->Head.exchange(&sClosed, std::memory_order_acquire);
+		while (block != nullptr)
+		{
+			MemoryPool::FreeBlock* next = block->Next;
+			Allocator::systemDeallocate(block);
+			block = next;
+		}
+		std::lock_guard<std::mutex> lock(sMutex);
+		mailbox->NextFree = spFree;
+		spFree = mailbox;
+	}
+
+	inline Arena::Arena(const size_t& blockSize)
+		: mBlockIndex(0)
+		, mBlockUsed(0)
+		, mUsedSize(0)
+		, mBlockSize((blockSize + Allocator::ALIGNMENT - 1) / Allocator::ALIGNMENT * Allocator::ALIGNMENT)
+	{
+	}
+
+	inline Arena::~Arena()
+	{
+		for (const Block& block : mBlocks)
+		{
+			Allocator::systemDeallocate(block.Data);
+		}
+	}
+
+	inline void* Arena::Allocate(const size_t& size)
+	{
+		const size_t alignedSize = (size + Allocator::ALIGNMENT - 1) / Allocator::ALIGNMENT * Allocator::ALIGNMENT;
+		while (mBlockIndex < mBlocks.size() && mBlockUsed + alignedSize > mBlocks[mBlockIndex].Size)
+		{
+			++mBlockIndex;
+			mBlockUsed = 0;
+		}
+		if (mBlockIndex == mBlocks.size())
+		{
+			const size_t blockSize = alignedSize > mBlockSize ? alignedSize : mBlockSize;
+			mBlocks.push_back(Block{ static_cast<char*>(Allocator::systemAllocate(blockSize)), blockSize });
+			mBlockUsed = 0;
+		}
+
+		void* block = mBlocks[mBlockIndex].Data + mBlockUsed;
+		mBlockUsed += alignedSize;
+		mUsedSize += alignedSize;
+		Allocator::sArenaAllocations.fetch_add(1, std::memory_order_relaxed);
+		return block;
+	}
+
+	inline void Arena::Reset()
+	{
+		mBlockIndex = 0;
+		mBlockUsed = 0;
+		mUsedSize = 0;
+	}
+
+	inline size_t Arena::GetUsedSize() const
+	{
+		return mUsedSize;
+	}
+
+	inline size_t Arena::GetCapacity() const
+	{
+		size_t capacity = 0;
+		for (const Block& block : mBlocks)
+		{
+			capacity += block.Size;
+		}
+		return capacity;
+	}
+
+	inline ArenaScope::ArenaScope(Arena& arena)
+		: mpPrevious(Allocator::spArena)
+	{
+		Allocator::spArena = &arena;
+	}
+
+	inline ArenaScope::~ArenaScope()
+	{
+		Allocator::spArena = mpPrevious;
+	}
+}
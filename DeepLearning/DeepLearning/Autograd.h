@@ -0,0 +1,859 @@
+#pragma once
+#include<algorithm>
+#include<cmath>
+#include<functional>
+#include<limits>
+#include<memory>
+#include<vector>
+#include "Allocator.h"
+#include "Layer.h"
+
+namespace numpy
+{
+	template<typename T>
+	class Tape;
+
+	// Handle to a value recorded on a Tape; copying it copies two words. The default-constructed handle is invalid, and so is
+	// the result of an operation whose operands are invalid or whose shapes do not fit.
+	template<typename T>
+	class Variable final
+	{
+		friend class Tape<T>;
+	public:
+		Variable();
+		~Variable() = default;
+
+		bool IsValid() const;
+		// Empty once Backward has released it; the values of Constant and Parameter leaves are kept.
+		const Ndarray<T>& GetValue() const;
+		// dL/dv after Backward. Only Parameter leaves keep theirs, until the tape's next Clear.
+		const Ndarray<T>& GetGradient() const;
+
+		friend Variable<T> operator+(const Variable<T>& lhs, const Variable<T>& rhs)
+		{
+			return lhs.mpTape == nullptr ? Variable<T>() : lhs.mpTape->Add(lhs, rhs);
+		}
+
+		friend Variable<T> operator*(const Variable<T>& lhs, const Variable<T>& rhs)
+		{
+			return lhs.mpTape == nullptr ? Variable<T>() : lhs.mpTape->Multiply(lhs, rhs);
+		}
+	private:
+		Variable(Tape<T>* pTape, const unsigned int& index);
+
+		Tape<T>* mpTape;
+		unsigned int mIndex;
+	};
+
+	// Reverse-mode automatic differentiation. Each operation computes its value at once and appends a node to the tape; Backward
+	// walks the nodes in reverse and accumulates gradients into the operands. A node's value is released as soon as the last
+	// backward step reading it has run, and every gradient buffer, temporaries included, is bumped from an arena that Clear
+	// resets, so a steady-state training step takes no memory from the system.
+	//
+	// Add and Multiply broadcast an operand whose shape is a suffix of the other's, such as a bias row over a batch.
+	template<typename T>
+	class Tape final
+	{
+	public:
+		// A piece of the graph run by Checkpoint: it records operations on the tape it is given, over the given inputs.
+		using Segment = std::function<Variable<T>(Tape<T>&, const std::vector<Variable<T>>&)>;
+
+		Tape();
+		Tape(const Tape<T>& rhs) = delete;
+		Tape<T>& operator=(const Tape<T>& rhs) = delete;
+		~Tape() = default;
+
+		// Leaves. The value is referenced, not copied, so it must stay alive and unchanged until Backward has run.
+		Variable<T> Constant(const Ndarray<T>& value);
+		Variable<T> Parameter(const Ndarray<T>& value);
+
+		Variable<T> Add(const Variable<T>& a, const Variable<T>& b);
+		Variable<T> Multiply(const Variable<T>& a, const Variable<T>& b);
+		// Matrix product of two 2-D values.
+		Variable<T> Dot(const Variable<T>& a, const Variable<T>& b);
+		// Reductions over every element give a value of shape { 1 }.
+		Variable<T> Sum(const Variable<T>& a);
+		Variable<T> Sum(const Variable<T>& a, const int& axis);
+		Variable<T> Mean(const Variable<T>& a);
+		Variable<T> Mean(const Variable<T>& a, const int& axis);
+		Variable<T> Relu(const Variable<T>& a);
+		Variable<T> Sigmoid(const Variable<T>& a);
+		Variable<T> Tanh(const Variable<T>& a);
+		// Mean softmax cross-entropy of (batch x classes) logits against target rows; the target takes no gradient.
+		Variable<T> SoftmaxCrossEntropy(const Variable<T>& logits, const Ndarray<T>& target);
+		// Gradient checkpointing: runs segment over inputs and keeps only its output. Backward runs segment again to rebuild the
+		// values inside it, so they occupy memory only while the segment's own gradients are taken. Parameters used inside the
+		// segment must be passed in inputs to receive gradients.
+		Variable<T> Checkpoint(const Segment& segment, const std::vector<Variable<T>>& inputs);
+
+		// Fills the gradients of every Parameter that loss depends on; loss must hold a single element. The tape can be
+		// differentiated once: intermediate values and gradients are released on the way.
+		bool Backward(const Variable<T>& loss);
+		// Forgets every node and resets the arena, invalidating all gradients. The tape's buffers keep their capacity.
+		void Clear();
+
+		size_t GetNodeCount() const;
+		// Bytes held by recorded values, leaves excluded; what Backward has not yet released.
+		size_t GetSavedSize() const;
+		const Arena& GetArena() const;
+	private:
+		friend class Variable<T>;
+
+		enum class Operation
+		{
+			Constant,
+			Parameter,
+			Add,
+			Multiply,
+			Dot,
+			Sum,
+			SumAxis,
+			Mean,
+			MeanAxis,
+			Relu,
+			Sigmoid,
+			Tanh,
+			SoftmaxCrossEntropy,
+			Checkpoint,
+		};
+
+		struct Node
+		{
+			Operation Op;
+			unsigned int Inputs[2];
+			int Axis;
+			// Backward steps still to read Value; it is released when this reaches 0.
+			unsigned int Uses;
+			bool bRequiresGradient;
+			InlineArray<size_t, Ndarray<T>::MAX_INLINE_DIMENSION> ArraySize;
+			Ndarray<T> Value;
+			// Operation-specific state, such as the softmax cross-entropy gradient.
+			Ndarray<T> Saved;
+			Ndarray<T> Gradient;
+		};
+
+		struct CheckpointRecord
+		{
+			Segment Function;
+			size_t FirstInput;
+			size_t InputCount;
+		};
+
+		static constexpr unsigned int NONE = std::numeric_limits<unsigned int>::max();
+
+		// Scratch tapes run checkpointed segments; they share the arena of the tape that owns them.
+		explicit Tape(Arena* pArena);
+
+		bool owns(const Variable<T>& v) const;
+		static bool isSuffix(const Ndarray<T>& shorter, const Ndarray<T>& longer);
+		Variable<T> leaf(const Operation& op, const Ndarray<T>& value);
+		// Appends a node, or returns an invalid Variable when value is empty.
+		Variable<T> record(const Operation& op, Ndarray<T>&& value, const unsigned int& a, const unsigned int& b);
+		void retain(const unsigned int& index);
+		void release(const unsigned int& index);
+		Variable<T> reduce(const Operation& op, const Variable<T>& a, const int& axis);
+		Variable<T> activation(const Operation& op, const Variable<T>& a);
+		Tape<T>& scratch();
+		// Records segment on the scratch tape over the values of the given nodes; the output is a Variable of the scratch tape.
+		Variable<T> runSegment(const CheckpointRecord& checkpoint, const bool& bRequiresGradient);
+
+		bool backward(const unsigned int& root, Ndarray<T>&& seed);
+		void backwardNode(const unsigned int& index);
+		void backwardCheckpoint(const unsigned int& index);
+		// Compact array of node's shape with uninitialised elements, from the current arena.
+		Ndarray<T> allocate(const unsigned int& index) const;
+		// gradient summed over the leading axes the node was broadcast along.
+		Ndarray<T> unbroadcast(const unsigned int& index, Ndarray<T>&& gradient) const;
+		void accumulate(const unsigned int& index, Ndarray<T>&& gradient);
+
+		// Declared first so that it outlives the gradients allocated from it.
+		std::unique_ptr<Arena> mpOwnedArena;
+		Arena* mpArena;
+		std::vector<Node> mNodes;
+		std::vector<CheckpointRecord> mCheckpoints;
+		std::vector<unsigned int> mCheckpointInputs;
+		// Leaves handed to a segment, kept to reuse their capacity.
+		std::vector<Variable<T>> mSegmentInputs;
+		std::unique_ptr<Tape<T>> mpScratch;
+		bool mbDifferentiated;
+	};
+
+	template<typename T>
+	inline Variable<T>::Variable()
+		: mpTape(nullptr)
+		, mIndex(0)
+	{
+	}
+
+	template<typename T>
+	inline Variable<T>::Variable(Tape<T>* pTape, const unsigned int& index)
+		: mpTape(pTape)
+		, mIndex(index)
+	{
+	}
+
+	template<typename T>
+	inline bool Variable<T>::IsValid() const
+	{
+		return mpTape != nullptr;
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& Variable<T>::GetValue() const
+	{
+		static const Ndarray<T> empty;
+		return mpTape == nullptr ? empty : mpTape->mNodes[mIndex].Value;
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& Variable<T>::GetGradient() const
+	{
+		static const Ndarray<T> empty;
+		return mpTape == nullptr ? empty : mpTape->mNodes[mIndex].Gradient;
+	}
+
+	template<typename T>
+	Tape<T>::Tape()
+		: mpOwnedArena(std::make_unique<Arena>())
+		, mpArena(mpOwnedArena.get())
+		, mbDifferentiated(false)
+	{
+	}
+
+	template<typename T>
+	Tape<T>::Tape(Arena* pArena)
+		: mpArena(pArena)
+		, mbDifferentiated(false)
+	{
+	}
+
+	template<typename T>
+	inline Variable<T> Tape<T>::Constant(const Ndarray<T>& value)
+	{
+		return leaf(Operation::Constant, value);
+	}
+
+	template<typename T>
+	inline Variable<T> Tape<T>::Parameter(const Ndarray<T>& value)
+	{
+		return leaf(Operation::Parameter, value);
+	}
+
+	template<typename T>
+	Variable<T> Tape<T>::Add(const Variable<T>& a, const Variable<T>& b)
+	{
+		if (!owns(a) || !owns(b))
+			return Variable<T>();
+		const Ndarray<T>& lhs = mNodes[a.mIndex].Value;
+		const Ndarray<T>& rhs = mNodes[b.mIndex].Value;
+		if (!isSuffix(rhs, lhs) && !isSuffix(lhs, rhs))
+			return Variable<T>();
+
+		Ndarray<T> value;
+		Numpy<T>::Add(value, lhs, rhs);
+		return record(Operation::Add, std::move(value), a.mIndex, b.mIndex);
+	}
+
+	template<typename T>
+	Variable<T> Tape<T>::Multiply(const Variable<T>& a, const Variable<T>& b)
+	{
+		if (!owns(a) || !owns(b))
+			return Variable<T>();
+		const Ndarray<T>& lhs = mNodes[a.mIndex].Value;
+		const Ndarray<T>& rhs = mNodes[b.mIndex].Value;
+		if (!isSuffix(rhs, lhs) && !isSuffix(lhs, rhs))
+			return Variable<T>();
+
+		Ndarray<T> value;
+		Numpy<T>::Multiply(value, lhs, rhs);
+		const Variable<T> result = record(Operation::Multiply, std::move(value), a.mIndex, b.mIndex);
+		// Each operand's gradient reads the other operand.
+		if (result.IsValid() && mNodes[b.mIndex].bRequiresGradient)
+			retain(a.mIndex);
+		if (result.IsValid() && mNodes[a.mIndex].bRequiresGradient)
+			retain(b.mIndex);
+		return result;
+	}
+
+	template<typename T>
+	Variable<T> Tape<T>::Dot(const Variable<T>& a, const Variable<T>& b)
+	{
+		if (!owns(a) || !owns(b))
+			return Variable<T>();
+		const Ndarray<T>& lhs = mNodes[a.mIndex].Value;
+		const Ndarray<T>& rhs = mNodes[b.mIndex].Value;
+		if (lhs.GetDimension() != 2u || rhs.GetDimension() != 2u || lhs.GetArraySize(1) != rhs.GetArraySize(0))
+			return Variable<T>();
+
+		Ndarray<T> value;
+		Numpy<T>::Dot(value, lhs, rhs);
+		const Variable<T> result = record(Operation::Dot, std::move(value), a.mIndex, b.mIndex);
+		if (result.IsValid() && mNodes[b.mIndex].bRequiresGradient)
+			retain(a.mIndex);
+		if (result.IsValid() && mNodes[a.mIndex].bRequiresGradient)
+			retain(b.mIndex);
+		return result;
+	}
+
+	template<typename T>
+	inline Variable<T> Tape<T>::Sum(const Variable<T>& a)
+	{
+		return reduce(Operation::Sum, a, 0);
+	}
+
+	template<typename T>
+	inline Variable<T> Tape<T>::Sum(const Variable<T>& a, const int& axis)
+	{
+		return reduce(Operation::SumAxis, a, axis);
+	}
+
+	template<typename T>
+	inline Variable<T> Tape<T>::Mean(const Variable<T>& a)
+	{
+		return reduce(Operation::Mean, a, 0);
+	}
+
+	template<typename T>
+	inline Variable<T> Tape<T>::Mean(const Variable<T>& a, const int& axis)
+	{
+		return reduce(Operation::MeanAxis, a, axis);
+	}
+
+	template<typename T>
+	inline Variable<T> Tape<T>::Relu(const Variable<T>& a)
+	{
+		return activation(Operation::Relu, a);
+	}
+
+	template<typename T>
+	inline Variable<T> Tape<T>::Sigmoid(const Variable<T>& a)
+	{
+		return activation(Operation::Sigmoid, a);
+	}
+
+	template<typename T>
+	inline Variable<T> Tape<T>::Tanh(const Variable<T>& a)
+	{
+		return activation(Operation::Tanh, a);
+	}
+
+	template<typename T>
+	Variable<T> Tape<T>::SoftmaxCrossEntropy(const Variable<T>& logits, const Ndarray<T>& target)
+	{
+		if (!owns(logits))
+			return Variable<T>();
+
+		numpy::SoftmaxCrossEntropy<T> loss;
+		const T value = loss.Forward(mNodes[logits.mIndex].Value, target);
+		if (loss.Backward().GetTotalSize() == 0u)
+			return Variable<T>();
+
+		const Variable<T> result = record(Operation::SoftmaxCrossEntropy, Ndarray<T>({ 1 }, value), logits.mIndex, NONE);
+		if (mNodes[result.mIndex].bRequiresGradient)
+		{
+			mNodes[result.mIndex].Saved = loss.Backward();
+		}
+		return result;
+	}
+
+	template<typename T>
+	Variable<T> Tape<T>::Checkpoint(const Segment& segment, const std::vector<Variable<T>>& inputs)
+	{
+		bool bRequiresGradient = false;
+		for (const Variable<T>& input : inputs)
+		{
+			if (!owns(input))
+				return Variable<T>();
+			bRequiresGradient = bRequiresGradient || mNodes[input.mIndex].bRequiresGradient;
+		}
+
+		CheckpointRecord checkpoint = { segment, mCheckpointInputs.size(), inputs.size() };
+		for (const Variable<T>& input : inputs)
+		{
+			mCheckpointInputs.push_back(input.mIndex);
+		}
+
+		// Only the output survives; everything else the segment recorded goes with the scratch tape's Clear.
+		Tape<T>& segmentTape = scratch();
+		const Variable<T> output = runSegment(checkpoint, false);
+		Ndarray<T> value = segmentTape.owns(output) ? std::move(segmentTape.mNodes[output.mIndex].Value) : Ndarray<T>();
+		segmentTape.Clear();
+		if (value.GetTotalSize() == 0u)
+		{
+			mCheckpointInputs.resize(checkpoint.FirstInput);
+			return Variable<T>();
+		}
+
+		const Variable<T> result = record(Operation::Checkpoint, std::move(value), NONE, NONE);
+		Node& node = mNodes[result.mIndex];
+		node.Axis = static_cast<int>(mCheckpoints.size());
+		node.bRequiresGradient = bRequiresGradient;
+		mCheckpoints.push_back(std::move(checkpoint));
+		if (bRequiresGradient)
+		{
+			// Backward runs the segment again over the inputs' values.
+			for (const Variable<T>& input : inputs)
+			{
+				retain(input.mIndex);
+			}
+		}
+		return result;
+	}
+
+	template<typename T>
+	bool Tape<T>::Backward(const Variable<T>& loss)
+	{
+		if (!owns(loss) || mNodes[loss.mIndex].Value.GetTotalSize() != 1u)
+			return false;
+
+		Ndarray<T> seed;
+		{
+			ArenaScope scope(*mpArena);
+			seed = allocate(loss.mIndex);
+		}
+		seed.GetData()[0] = static_cast<T>(1);
+		return backward(loss.mIndex, std::move(seed));
+	}
+
+	template<typename T>
+	void Tape<T>::Clear()
+	{
+		mNodes.clear();
+		mCheckpoints.clear();
+		mCheckpointInputs.clear();
+		mbDifferentiated = false;
+		if (mpOwnedArena != nullptr)
+		{
+			mpOwnedArena->Reset();
+		}
+	}
+
+	template<typename T>
+	inline size_t Tape<T>::GetNodeCount() const
+	{
+		return mNodes.size();
+	}
+
+	template<typename T>
+	size_t Tape<T>::GetSavedSize() const
+	{
+		size_t size = 0;
+		for (const Node& node : mNodes)
+		{
+			if (node.Op != Operation::Constant && node.Op != Operation::Parameter)
+			{
+				size += (node.Value.GetTotalSize() + node.Saved.GetTotalSize()) * sizeof(T);
+			}
+		}
+		return size;
+	}
+
+	template<typename T>
+	inline const Arena& Tape<T>::GetArena() const
+	{
+		return *mpArena;
+	}
+
+	template<typename T>
+	inline bool Tape<T>::owns(const Variable<T>& v) const
+	{
+		return v.mpTape == this && v.mIndex < mNodes.size() && mNodes[v.mIndex].Value.GetTotalSize() != 0u;
+	}
+
+	template<typename T>
+	bool Tape<T>::isSuffix(const Ndarray<T>& shorter, const Ndarray<T>& longer)
+	{
+		if (shorter.GetDimension() > longer.GetDimension())
+			return false;
+		const unsigned int offset = longer.GetDimension() - shorter.GetDimension();
+		for (unsigned int i = 0; i < shorter.GetDimension(); ++i)
+		{
+			if (shorter.GetArraySize(i) != longer.GetArraySize(offset + i))
+				return false;
+		}
+		return true;
+	}
+
+	template<typename T>
+	Variable<T> Tape<T>::leaf(const Operation& op, const Ndarray<T>& value)
+	{
+		if (value.GetTotalSize() == 0u)
+			return Variable<T>();
+		// A view over the whole of value, sharing its storage.
+		return record(op, value.Slice(0, 0, value.GetArraySize(0)), NONE, NONE);
+	}
+
+	template<typename T>
+	Variable<T> Tape<T>::record(const Operation& op, Ndarray<T>&& value, const unsigned int& a, const unsigned int& b)
+	{
+		if (value.GetTotalSize() == 0u || mNodes.size() >= NONE)
+			return Variable<T>();
+
+		mNodes.emplace_back();
+		Node& node = mNodes.back();
+		node.Op = op;
+		node.Inputs[0] = a;
+		node.Inputs[1] = b;
+		node.Axis = 0;
+		node.Uses = 0;
+		node.bRequiresGradient = op == Operation::Parameter
+			|| (a != NONE && mNodes[a].bRequiresGradient) || (b != NONE && mNodes[b].bRequiresGradient);
+		node.ArraySize.Resize(value.GetDimension());
+		for (unsigned int i = 0; i < value.GetDimension(); ++i)
+		{
+			node.ArraySize[i] = value.GetArraySize(i);
+		}
+		node.Value = std::move(value);
+		return Variable<T>(this, static_cast<unsigned int>(mNodes.size() - 1));
+	}
+
+	template<typename T>
+	inline void Tape<T>::retain(const unsigned int& index)
+	{
+		++mNodes[index].Uses;
+	}
+
+	template<typename T>
+	inline void Tape<T>::release(const unsigned int& index)
+	{
+		Node& node = mNodes[index];
+		if (node.Uses > 0u && --node.Uses == 0u && node.Op != Operation::Constant && node.Op != Operation::Parameter)
+		{
+			node.Value = Ndarray<T>();
+		}
+	}
+
+	template<typename T>
+	Variable<T> Tape<T>::reduce(const Operation& op, const Variable<T>& a, const int& axis)
+	{
+		if (!owns(a))
+			return Variable<T>();
+		const Ndarray<T>& input = mNodes[a.mIndex].Value;
+
+		Ndarray<T> value;
+		switch (op)
+		{
+		case Operation::Sum:
+			value = Ndarray<T>({ 1 }, Numpy<T>::Sum(input));
+			break;
+		case Operation::Mean:
+			value = Ndarray<T>({ 1 }, Numpy<T>::Mean(input));
+			break;
+		case Operation::SumAxis:
+			value = Numpy<T>::Sum(input, axis);
+			break;
+		default:
+			value = Numpy<T>::Mean(input, axis);
+			break;
+		}
+
+		const Variable<T> result = record(op, std::move(value), a.mIndex, NONE);
+		if (result.IsValid())
+		{
+			mNodes[result.mIndex].Axis = axis < 0 ? axis + static_cast<int>(input.GetDimension()) : axis;
+		}
+		return result;
+	}
+
+	template<typename T>
+	Variable<T> Tape<T>::activation(const Operation& op, const Variable<T>& a)
+	{
+		if (!owns(a))
+			return Variable<T>();
+		const Ndarray<T>& input = mNodes[a.mIndex].Value;
+
+		Ndarray<T> value;
+		if (op == Operation::Relu)
+		{
+			Numpy<T>::Maximum(value, input, static_cast<T>(0));
+		}
+		else if (op == Operation::Sigmoid)
+		{
+			Numpy<T>::Sigmoid(value, input);
+		}
+		else
+		{
+			Numpy<T>::Tanh(value, input);
+		}
+
+		// All three derivatives are functions of the output, so the input's value is not kept for them.
+		const Variable<T> result = record(op, std::move(value), a.mIndex, NONE);
+		if (result.IsValid() && mNodes[result.mIndex].bRequiresGradient)
+			retain(result.mIndex);
+		return result;
+	}
+
+	template<typename T>
+	Tape<T>& Tape<T>::scratch()
+	{
+		if (mpScratch == nullptr)
+		{
+			mpScratch = std::unique_ptr<Tape<T>>(new Tape<T>(mpArena));
+		}
+		return *mpScratch;
+	}
+
+	template<typename T>
+	Variable<T> Tape<T>::runSegment(const CheckpointRecord& checkpoint, const bool& bRequiresGradient)
+	{
+		Tape<T>& segmentTape = scratch();
+		segmentTape.Clear();
+		segmentTape.mSegmentInputs.clear();
+		for (size_t i = 0; i < checkpoint.InputCount; ++i)
+		{
+			const Node& input = mNodes[mCheckpointInputs[checkpoint.FirstInput + i]];
+			segmentTape.mSegmentInputs.push_back(bRequiresGradient && input.bRequiresGradient
+				? segmentTape.Parameter(input.Value) : segmentTape.Constant(input.Value));
+		}
+		return checkpoint.Function(segmentTape, segmentTape.mSegmentInputs);
+	}
+
+	template<typename T>
+	bool Tape<T>::backward(const unsigned int& root, Ndarray<T>&& seed)
+	{
+		if (mbDifferentiated || !mNodes[root].bRequiresGradient)
+			return false;
+		mbDifferentiated = true;
+
+		// Values no backward step reads are not needed any more.
+		for (unsigned int i = 0; i < mNodes.size(); ++i)
+		{
+			if (mNodes[i].Uses == 0u && mNodes[i].Op != Operation::Constant && mNodes[i].Op != Operation::Parameter)
+			{
+				mNodes[i].Value = Ndarray<T>();
+			}
+		}
+
+		mNodes[root].Gradient = std::move(seed);
+		for (unsigned int i = root + 1; i > 0; --i)
+		{
+			const unsigned int index = i - 1;
+			Node& node = mNodes[index];
+			if (node.Gradient.GetTotalSize() == 0u || node.Op == Operation::Parameter || node.Op == Operation::Constant)
+				continue;
+
+			if (node.Op == Operation::Checkpoint)
+			{
+				// The recomputed values come from the pool rather than the arena, so they are returned as the segment's
+				// backward releases them.
+				backwardCheckpoint(index);
+			}
+			else
+			{
+				ArenaScope scope(*mpArena);
+				backwardNode(index);
+			}
+			mNodes[index].Gradient = Ndarray<T>();
+			mNodes[index].Saved = Ndarray<T>();
+		}
+		return true;
+	}
+
+	template<typename T>
+	void Tape<T>::backwardNode(const unsigned int& index)
+	{
+		Node& node = mNodes[index];
+		const unsigned int a = node.Inputs[0];
+		const unsigned int b = node.Inputs[1];
+		const bool bGradientA = a != NONE && mNodes[a].bRequiresGradient;
+		const bool bGradientB = b != NONE && mNodes[b].bRequiresGradient;
+		Ndarray<T> gradient = std::move(node.Gradient);
+		const T* g = gradient.GetData();
+
+		switch (node.Op)
+		{
+		case Operation::Add:
+			if (bGradientB)
+			{
+				accumulate(b, unbroadcast(b, bGradientA ? Ndarray<T>(gradient) : std::move(gradient)));
+			}
+			if (bGradientA)
+			{
+				accumulate(a, unbroadcast(a, std::move(gradient)));
+			}
+			break;
+		case Operation::Multiply:
+		case Operation::Dot:
+		{
+			const Ndarray<T>& lhs = mNodes[a].Value;
+			const Ndarray<T>& rhs = mNodes[b].Value;
+			Ndarray<T> gradientA;
+			Ndarray<T> gradientB;
+			if (node.Op == Operation::Multiply)
+			{
+				if (bGradientA)
+					Numpy<T>::Multiply(gradientA, gradient, rhs);
+				if (bGradientB)
+					Numpy<T>::Multiply(gradientB, gradient, lhs);
+			}
+			else
+			{
+				if (bGradientA)
+					Numpy<T>::Dot(gradientA, gradient, rhs.Transpose());
+				if (bGradientB)
+					Numpy<T>::Dot(gradientB, lhs.Transpose(), gradient);
+			}
+			if (bGradientA)
+			{
+				accumulate(a, unbroadcast(a, std::move(gradientA)));
+				release(b);
+			}
+			if (bGradientB)
+			{
+				accumulate(b, unbroadcast(b, std::move(gradientB)));
+				release(a);
+			}
+			break;
+		}
+		case Operation::Sum:
+		case Operation::Mean:
+		{
+			Ndarray<T> gradientA = allocate(a);
+			const T scale = node.Op == Operation::Sum ? static_cast<T>(1) : static_cast<T>(1) / static_cast<T>(gradientA.GetTotalSize());
+			const T value = static_cast<T>(g[0] * scale);
+			std::fill(gradientA.GetData(), gradientA.GetData() + gradientA.GetTotalSize(), value);
+			accumulate(a, std::move(gradientA));
+			break;
+		}
+		case Operation::SumAxis:
+		case Operation::MeanAxis:
+		{
+			// The input is [outer][length][inner] and the gradient [outer][inner]; every reduced element receives its sum's.
+			const Node& input = mNodes[a];
+			const unsigned int axis = static_cast<unsigned int>(node.Axis);
+			size_t outer = 1;
+			size_t inner = 1;
+			for (unsigned int i = 0; i < axis; ++i)
+			{
+				outer *= input.ArraySize[i];
+			}
+			for (unsigned int i = axis + 1; i < input.ArraySize.GetSize(); ++i)
+			{
+				inner *= input.ArraySize[i];
+			}
+			const size_t length = input.ArraySize[axis];
+			const T scale = node.Op == Operation::SumAxis ? static_cast<T>(1) : static_cast<T>(1) / static_cast<T>(length);
+
+			Ndarray<T> gradientA = allocate(a);
+			T* out = gradientA.GetData();
+			for (size_t o = 0; o < outer; ++o)
+			{
+				for (size_t l = 0; l < length; ++l)
+				{
+					for (size_t i = 0; i < inner; ++i)
+					{
+						out[(o * length + l) * inner + i] = static_cast<T>(g[o * inner + i] * scale);
+					}
+				}
+			}
+			accumulate(a, std::move(gradientA));
+			break;
+		}
+		case Operation::Relu:
+		case Operation::Sigmoid:
+		case Operation::Tanh:
+		{
+			const T* y = node.Value.GetData();
+			Ndarray<T> gradientA = allocate(a);
+			T* out = gradientA.GetData();
+			for (size_t i = 0; i < gradientA.GetTotalSize(); ++i)
+			{
+				out[i] = node.Op == Operation::Relu ? (y[i] > 0 ? g[i] : static_cast<T>(0))
+					: node.Op == Operation::Sigmoid ? static_cast<T>(g[i] * y[i] * (1 - y[i]))
+					: static_cast<T>(g[i] * (1 - y[i] * y[i]));
+			}
+			accumulate(a, std::move(gradientA));
+			release(index);
+			break;
+		}
+		case Operation::SoftmaxCrossEntropy:
+		{
+			// Saved is y - t per row; the loss is the batch mean.
+			Ndarray<T> gradientA;
+			Numpy<T>::Multiply(gradientA, node.Saved, static_cast<T>(g[0] / static_cast<T>(node.Saved.GetArraySize(0))));
+			accumulate(a, std::move(gradientA));
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	template<typename T>
+	void Tape<T>::backwardCheckpoint(const unsigned int& index)
+	{
+		const CheckpointRecord& checkpoint = mCheckpoints[static_cast<size_t>(mNodes[index].Axis)];
+		Tape<T>& segmentTape = scratch();
+		const Variable<T> output = runSegment(checkpoint, true);
+		if (segmentTape.owns(output) && segmentTape.backward(output.mIndex, std::move(mNodes[index].Gradient)))
+		{
+			for (size_t i = 0; i < checkpoint.InputCount; ++i)
+			{
+				const unsigned int input = mCheckpointInputs[checkpoint.FirstInput + i];
+				Ndarray<T>& gradient = segmentTape.mNodes[segmentTape.mSegmentInputs[i].mIndex].Gradient;
+				if (mNodes[input].bRequiresGradient && gradient.GetTotalSize() != 0u)
+				{
+					accumulate(input, std::move(gradient));
+				}
+			}
+		}
+		segmentTape.Clear();
+		for (size_t i = 0; i < checkpoint.InputCount; ++i)
+		{
+			release(mCheckpointInputs[checkpoint.FirstInput + i]);
+		}
+	}
+
+	template<typename T>
+	inline Ndarray<T> Tape<T>::allocate(const unsigned int& index) const
+	{
+		const Node& node = mNodes[index];
+		size_t totalSize = 1;
+		for (unsigned int i = 0; i < node.ArraySize.GetSize(); ++i)
+		{
+			totalSize *= node.ArraySize[i];
+		}
+		return Ndarray<T>(Allocator::AllocateShared<T>(totalSize), node.ArraySize.GetSize(), node.ArraySize.Get());
+	}
+
+	template<typename T>
+	Ndarray<T> Tape<T>::unbroadcast(const unsigned int& index, Ndarray<T>&& gradient) const
+	{
+		const Node& node = mNodes[index];
+		size_t inner = 1;
+		for (unsigned int i = 0; i < node.ArraySize.GetSize(); ++i)
+		{
+			inner *= node.ArraySize[i];
+		}
+		if (inner == gradient.GetTotalSize())
+			return std::move(gradient);
+
+		Ndarray<T> result = allocate(index);
+		const size_t outer = gradient.GetTotalSize() / inner;
+		const T* g = gradient.GetData();
+		T* out = result.GetData();
+		std::copy(g, g + inner, out);
+		for (size_t o = 1; o < outer; ++o)
+		{
+			for (size_t i = 0; i < inner; ++i)
+			{
+				out[i] += g[o * inner + i];
+			}
+		}
+		return result;
+	}
+
+	template<typename T>
+	void Tape<T>::accumulate(const unsigned int& index, Ndarray<T>&& gradient)
+	{
+		Node& node = mNodes[index];
+		if (node.Gradient.GetTotalSize() == 0u)
+		{
+			node.Gradient = std::move(gradient);
+		}
+		else
+		{
+			node.Gradient += gradient;
+		}
+	}
+}
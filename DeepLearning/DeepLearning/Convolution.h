@@ -0,0 +1,840 @@
+#pragma once
+#include<algorithm>
+#include "Numpy.h"
+#include "Profiler.h"
+
+namespace numpy
+{
+	// Memory order of a batch of images: NCHW stores each channel as a contiguous plane, NHWC stores each pixel's channels together.
+	enum class ImageLayout
+	{
+		Nchw,
+		Nhwc,
+	};
+
+	enum class ConvolutionAlgorithm
+	{
+		// Winograd for 3x3 stride-1 kernels with enough channels to pay for its transforms, im2col otherwise.
+		Auto,
+		// Patches unrolled into a matrix that one GEMM multiplies by the weights.
+		Im2col,
+		// F(2x2, 3x3): a 2x2 output tile takes 16 multiplies per channel instead of 36, run as 16 batched GEMMs. 3x3 stride 1 only.
+		Winograd,
+		// The textbook loop nest, the reference the others are checked against.
+		Direct,
+	};
+
+	// Weights are (filters, channels, kernel height, kernel width) for NCHW and (kernel height, kernel width, channels, filters)
+	// for NHWC, so either im2col matrix meets them in a GEMM without a transpose. Padding adds zeros on every side.
+	struct ConvolutionParameters
+	{
+		unsigned int Stride = 1;
+		unsigned int Padding = 0;
+		ImageLayout Layout = ImageLayout::Nchw;
+	};
+
+	// 2-D convolution and max pooling over 4-D batches of images. As in Numpy, invalid shapes leave the empty array in out, and
+	// out is written in place when it already has the result's shape and is contiguous.
+	template<typename T>
+	class Convolution final
+	{
+	public:
+		using Compute = typename ComputeType<T>::Type;
+
+		Convolution() = delete;
+		~Convolution() = delete;
+
+		// out = x * weight + bias, then ReLU when bRelu. bias is empty or has one element per filter.
+		static void Forward(Ndarray<T>& out, const Ndarray<T>& x, const Ndarray<T>& weight, const Ndarray<T>& bias,
+			const ConvolutionParameters& parameters, const bool& bRelu, const ConvolutionAlgorithm& algorithm = ConvolutionAlgorithm::Auto);
+		// Forward through im2col that also leaves the im2col matrix of x in columns, for BackwardWeight.
+		static void Forward(Ndarray<T>& out, Ndarray<T>& columns, const Ndarray<T>& x, const Ndarray<T>& weight, const Ndarray<T>& bias,
+			const ConvolutionParameters& parameters, const bool& bRelu);
+		// The im2col matrix of x for weight's kernel: (batch, channels * kh * kw, out pixels) for NCHW and
+		// (batch, out pixels, kh * kw * channels) for NHWC. BackwardWeight reads it, so a layer keeps the one Forward made.
+		static void Im2col(Ndarray<T>& columns, const Ndarray<T>& x, const Ndarray<T>& weight, const ConvolutionParameters& parameters);
+		// dL/dweight from the im2col matrix of the input and gradOutput, the gradient at x * weight + bias.
+		static void BackwardWeight(Ndarray<T>& gradWeight, const Ndarray<T>& columns, const Ndarray<T>& gradOutput, const Ndarray<T>& weight,
+			const ConvolutionParameters& parameters);
+		// dL/dx for an input of x's shape.
+		static void BackwardData(Ndarray<T>& gradInput, const Ndarray<T>& gradOutput, const Ndarray<T>& weight, const Ndarray<T>& x,
+			const ConvolutionParameters& parameters);
+
+		// Maximum of every size x size window, windows stride apart without padding. indices receives the flat offset in x of
+		// each maximum, the first one on ties.
+		static void MaxPool(Ndarray<T>& out, Ndarray<size_t>& indices, const Ndarray<T>& x, const unsigned int& size, const unsigned int& stride,
+			const ImageLayout& layout);
+		// dL/dx: every gradOutput element added at its maximum's offset, 0 elsewhere.
+		static void MaxPoolBackward(Ndarray<T>& gradInput, const Ndarray<T>& gradOutput, const Ndarray<size_t>& indices, const Ndarray<T>& x);
+
+		// Auto picks Winograd from this many input and output channels; below it the transforms cost more than they save.
+		static constexpr size_t WINOGRAD_MIN_CHANNELS = 32;
+		// Elements of transformed tiles and products Winograd keeps per block of tiles.
+		static constexpr size_t WINOGRAD_BLOCK_SIZE = size_t(1) << 18;
+	private:
+		struct Geometry
+		{
+			ImageLayout Layout;
+			size_t Batch;
+			size_t Channels;
+			size_t Height;
+			size_t Width;
+			size_t Filters;
+			size_t KernelHeight;
+			size_t KernelWidth;
+			size_t Stride;
+			size_t Padding;
+			size_t OutHeight;
+			size_t OutWidth;
+			// Output pixels per image and elements per patch, the inner sizes of the GEMMs.
+			size_t Pixels;
+			size_t PatchSize;
+		};
+
+		// False unless x is a 4-D batch, weight a 4-D kernel over x's channels, and the kernel fits in the padded image.
+		static bool geometry(const Ndarray<T>& x, const Ndarray<T>& weight, const ConvolutionParameters& parameters, Geometry& g);
+		static void outputShape(const Geometry& g, const size_t& channels, size_t* arraySize);
+		// Where to write a result of the given shape: out's elements when it has the shape, is contiguous and shares storage with
+		// neither operand, otherwise a new array left in result for store.
+		static T* target(Ndarray<T>& out, Ndarray<T>& result, const unsigned int& dimension, const size_t* arraySize,
+			const Ndarray<T>& first, const Ndarray<T>& second);
+		static void store(Ndarray<T>& out, Ndarray<T>& result);
+		static bool isBias(const Ndarray<T>& bias, const Geometry& g);
+		// 2 * batch * pixels * filters * patch, what a profiled call reports whichever algorithm runs.
+		static std::uint64_t flops(const Geometry& g);
+		// Bias data for Forward, copied into storage when it shares out's storage, since out is written before every bias
+		// element has been read.
+		static const T* biasData(const Ndarray<T>& out, const Ndarray<T>& bias, Ndarray<T>& storage);
+		// a itself when it is contiguous, otherwise a compact copy held in storage.
+		static const Ndarray<T>& contiguous(const Ndarray<T>& a, Ndarray<T>& storage);
+
+		static void im2col(const Geometry& g, const T* x, T* columns);
+		// out from the im2col matrix of the input.
+		static void multiply(const Geometry& g, const T* columns, const T* weight, const T* bias, const bool& bRelu, T* out);
+		// Adds every column back at the pixel it was read from; x must start zeroed.
+		static void col2im(const Geometry& g, const T* columns, T* x);
+		static void direct(const Geometry& g, const T* x, const T* weight, const T* bias, const bool& bRelu, T* out);
+		static void winograd(const Geometry& g, const T* x, const T* weight, const T* bias, const bool& bRelu, T* out);
+		// Bias and ReLU over NCHW output planes, which the GEMM epilogue cannot add since its bias runs along columns.
+		static void planeEpilogue(const Geometry& g, const T* bias, const bool& bRelu, T* out);
+	};
+
+	template<typename T>
+	void Convolution<T>::Forward(Ndarray<T>& out, const Ndarray<T>& x, const Ndarray<T>& weight, const Ndarray<T>& bias,
+		const ConvolutionParameters& parameters, const bool& bRelu, const ConvolutionAlgorithm& algorithm)
+	{
+		Geometry g;
+		if (!geometry(x, weight, parameters, g) || !isBias(bias, g))
+		{
+			out = Ndarray<T>();
+			return;
+		}
+		const bool bWinogradShape = g.KernelHeight == 3u && g.KernelWidth == 3u && g.Stride == 1u;
+		if (algorithm == ConvolutionAlgorithm::Winograd && !bWinogradShape)
+		{
+			out = Ndarray<T>();
+			return;
+		}
+		NUMPY_PROFILE_SCOPE("Convolution::Forward", (x.mTotalSize + weight.mTotalSize + g.Batch * g.Pixels * g.Filters) * sizeof(T), flops(g));
+		ConvolutionAlgorithm chosen = algorithm;
+		if (algorithm == ConvolutionAlgorithm::Auto)
+		{
+			chosen = bWinogradShape && g.Channels >= WINOGRAD_MIN_CHANNELS && g.Filters >= WINOGRAD_MIN_CHANNELS
+				? ConvolutionAlgorithm::Winograd : ConvolutionAlgorithm::Im2col;
+		}
+
+		Ndarray<T> storage[3];
+		const T* source = contiguous(x, storage[0]).GetData();
+		const T* kernel = contiguous(weight, storage[1]).GetData();
+		const T* offset = biasData(out, bias, storage[2]);
+
+		size_t arraySize[4];
+		outputShape(g, g.Filters, arraySize);
+		Ndarray<T> result;
+		T* output = target(out, result, 4u, arraySize, x, weight);
+		if (chosen == ConvolutionAlgorithm::Direct)
+		{
+			direct(g, source, kernel, offset, bRelu, output);
+		}
+		else if (chosen == ConvolutionAlgorithm::Winograd)
+		{
+			winograd(g, source, kernel, offset, bRelu, output);
+		}
+		else
+		{
+			const size_t columnsSize[3] = { g.Batch, g.PatchSize, g.Pixels };
+			Ndarray<T> columns = Ndarray<T>::uninitialized(3u, columnsSize);
+			im2col(g, source, columns.GetData());
+			multiply(g, columns.GetData(), kernel, offset, bRelu, output);
+		}
+		store(out, result);
+	}
+
+	template<typename T>
+	void Convolution<T>::Forward(Ndarray<T>& out, Ndarray<T>& columns, const Ndarray<T>& x, const Ndarray<T>& weight, const Ndarray<T>& bias,
+		const ConvolutionParameters& parameters, const bool& bRelu)
+	{
+		Geometry g;
+		if (!geometry(x, weight, parameters, g) || !isBias(bias, g))
+		{
+			out = Ndarray<T>();
+			columns = Ndarray<T>();
+			return;
+		}
+
+		NUMPY_PROFILE_SCOPE("Convolution::Forward", (x.mTotalSize + weight.mTotalSize + g.Batch * g.Pixels * g.Filters) * sizeof(T), flops(g));
+		Im2col(columns, x, weight, parameters);
+		Ndarray<T> storage[2];
+		const T* kernel = contiguous(weight, storage[0]).GetData();
+		const T* offset = biasData(out, bias, storage[1]);
+		size_t arraySize[4];
+		outputShape(g, g.Filters, arraySize);
+		Ndarray<T> result;
+		T* output = target(out, result, 4u, arraySize, columns, weight);
+		multiply(g, columns.GetData(), kernel, offset, bRelu, output);
+		store(out, result);
+	}
+
+	template<typename T>
+	void Convolution<T>::Im2col(Ndarray<T>& columns, const Ndarray<T>& x, const Ndarray<T>& weight, const ConvolutionParameters& parameters)
+	{
+		Geometry g;
+		if (!geometry(x, weight, parameters, g))
+		{
+			columns = Ndarray<T>();
+			return;
+		}
+
+		Ndarray<T> storage;
+		const T* source = contiguous(x, storage).GetData();
+		const size_t arraySize[3] = { g.Batch, g.Layout == ImageLayout::Nchw ? g.PatchSize : g.Pixels,
+			g.Layout == ImageLayout::Nchw ? g.Pixels : g.PatchSize };
+		Ndarray<T> result;
+		T* output = target(columns, result, 3u, arraySize, x, x);
+		im2col(g, source, output);
+		store(columns, result);
+	}
+
+	template<typename T>
+	void Convolution<T>::BackwardWeight(Ndarray<T>& gradWeight, const Ndarray<T>& columns, const Ndarray<T>& gradOutput, const Ndarray<T>& weight,
+		const ConvolutionParameters& parameters)
+	{
+		if (columns.mDimension != 3u || gradOutput.mDimension != 4u || weight.mDimension != 4u)
+		{
+			gradWeight = Ndarray<T>();
+			return;
+		}
+		const bool bNchw = parameters.Layout == ImageLayout::Nchw;
+		const size_t batch = columns.mArraySize[0];
+		const size_t patchSize = columns.mArraySize[bNchw ? 1u : 2u];
+		const size_t pixels = columns.mArraySize[bNchw ? 2u : 1u];
+		const size_t filters = weight.mArraySize[bNchw ? 0u : 3u];
+		const size_t outputPixels = gradOutput.mArraySize[bNchw ? 2u : 1u] * gradOutput.mArraySize[bNchw ? 3u : 2u];
+		if (patchSize != weight.mTotalSize / filters || gradOutput.mArraySize[0] != batch || outputPixels != pixels
+			|| gradOutput.mArraySize[bNchw ? 1u : 3u] != filters)
+		{
+			gradWeight = Ndarray<T>();
+			return;
+		}
+
+		NUMPY_PROFILE_SCOPE("Convolution::BackwardWeight", (columns.mTotalSize + gradOutput.mTotalSize + weight.mTotalSize) * sizeof(T),
+			static_cast<std::uint64_t>(batch) * pixels * filters * patchSize * 2u);
+		Ndarray<T> storage[2];
+		const T* columnData = contiguous(columns, storage[0]).GetData();
+		const T* gradient = contiguous(gradOutput, storage[1]).GetData();
+		Ndarray<T> result;
+		T* output = target(gradWeight, result, 4u, weight.mArraySize.Get(), columns, gradOutput);
+		if (!bNchw)
+		{
+			// (patch, batch * pixels) . (batch * pixels, filters), the im2col matrix read transposed.
+			Gemm<T>::Multiply(patchSize, filters, batch * pixels, columnData, 1, patchSize, gradient, filters, 1, output, filters);
+		}
+		else
+		{
+			// (filters, pixels) . (pixels, patch) per image, then summed over the batch.
+			const size_t partialSize[3] = { batch, filters, patchSize };
+			Ndarray<T> partial = Ndarray<T>::uninitialized(3u, partialSize);
+			T* partialData = partial.GetData();
+			Gemm<T>::MultiplyBatched(batch, filters, patchSize, pixels, gradient, filters * pixels, pixels, 1,
+				columnData, patchSize * pixels, 1, pixels, partialData, filters * patchSize, patchSize);
+			const size_t size = filters * patchSize;
+			std::copy(partialData, partialData + size, output);
+			for (size_t n = 1; n < batch; ++n)
+			{
+				const T* image = partialData + n * size;
+				for (size_t i = 0; i < size; ++i)
+				{
+					output[i] = static_cast<T>(static_cast<Compute>(output[i]) + static_cast<Compute>(image[i]));
+				}
+			}
+		}
+		store(gradWeight, result);
+	}
+
+	template<typename T>
+	void Convolution<T>::BackwardData(Ndarray<T>& gradInput, const Ndarray<T>& gradOutput, const Ndarray<T>& weight, const Ndarray<T>& x,
+		const ConvolutionParameters& parameters)
+	{
+		Geometry g;
+		size_t arraySize[4];
+		if (geometry(x, weight, parameters, g))
+		{
+			outputShape(g, g.Filters, arraySize);
+		}
+		if (g.Batch == 0 || gradOutput.mDimension != 4u || !std::equal(arraySize, arraySize + 4, gradOutput.mArraySize.Get()))
+		{
+			gradInput = Ndarray<T>();
+			return;
+		}
+
+		NUMPY_PROFILE_SCOPE("Convolution::BackwardData", (gradOutput.mTotalSize + weight.mTotalSize + x.mTotalSize) * sizeof(T), flops(g));
+		Ndarray<T> storage[2];
+		const T* gradient = contiguous(gradOutput, storage[0]).GetData();
+		const T* kernel = contiguous(weight, storage[1]).GetData();
+		const size_t columnsSize[3] = { g.Batch, g.PatchSize, g.Pixels };
+		Ndarray<T> columns = Ndarray<T>::uninitialized(3u, columnsSize);
+		if (g.Layout == ImageLayout::Nhwc)
+		{
+			// (batch * pixels, filters) . (filters, patch), the weights read transposed.
+			Gemm<T>::Multiply(g.Batch * g.Pixels, g.PatchSize, g.Filters, gradient, g.Filters, 1, kernel, 1, g.Filters,
+				columns.GetData(), g.PatchSize);
+		}
+		else
+		{
+			// (patch, filters) . (filters, pixels) per image.
+			Gemm<T>::MultiplyBatched(g.Batch, g.PatchSize, g.Pixels, g.Filters, kernel, 0, 1, g.PatchSize,
+				gradient, g.Filters * g.Pixels, g.Pixels, 1, columns.GetData(), g.PatchSize * g.Pixels, g.Pixels);
+		}
+
+		Ndarray<T> result;
+		T* output = target(gradInput, result, 4u, x.mArraySize.Get(), gradOutput, weight);
+		std::fill(output, output + x.mTotalSize, static_cast<T>(0));
+		col2im(g, columns.GetData(), output);
+		store(gradInput, result);
+	}
+
+	template<typename T>
+	void Convolution<T>::MaxPool(Ndarray<T>& out, Ndarray<size_t>& indices, const Ndarray<T>& x, const unsigned int& size, const unsigned int& stride,
+		const ImageLayout& layout)
+	{
+		const bool bNchw = layout == ImageLayout::Nchw;
+		if (x.mDimension != 4u || size == 0u || stride == 0u
+			|| x.mArraySize[bNchw ? 2u : 1u] < size || x.mArraySize[bNchw ? 3u : 2u] < size)
+		{
+			out = Ndarray<T>();
+			indices = Ndarray<size_t>();
+			return;
+		}
+
+		NUMPY_PROFILE_SCOPE("Convolution::MaxPool", x.mTotalSize * sizeof(T));
+		Geometry g;
+		g.Layout = layout;
+		g.Batch = x.mArraySize[0];
+		g.Channels = x.mArraySize[bNchw ? 1u : 3u];
+		g.Height = x.mArraySize[bNchw ? 2u : 1u];
+		g.Width = x.mArraySize[bNchw ? 3u : 2u];
+		g.OutHeight = (g.Height - size) / stride + 1;
+		g.OutWidth = (g.Width - size) / stride + 1;
+		size_t arraySize[4];
+		outputShape(g, g.Channels, arraySize);
+
+		Ndarray<T> storage;
+		const T* source = contiguous(x, storage).GetData();
+		Ndarray<T> result;
+		T* output = target(out, result, 4u, arraySize, x, x);
+		const bool bIndices = indices.mDimension == 4u && std::equal(arraySize, arraySize + 4, indices.mArraySize.Get()) && indices.IsContiguous();
+		if (!bIndices)
+		{
+			indices = Ndarray<size_t>::uninitialized(4u, arraySize);
+		}
+		size_t* index = indices.GetData();
+
+		// Element (c, h, w) of an image and the step between neighbouring channels, by layout.
+		const size_t channelStride = bNchw ? g.Height * g.Width : 1;
+		const size_t rowStride = bNchw ? g.Width : g.Width * g.Channels;
+		const size_t columnStride = bNchw ? 1 : g.Channels;
+		const size_t imageSize = g.Channels * g.Height * g.Width;
+		const size_t outputImageSize = g.Channels * g.OutHeight * g.OutWidth;
+		ParallelElements(g.Batch, std::max<size_t>(1, ELEMENTWISE_GRAIN / imageSize), [&](size_t begin, size_t end)
+		{
+			for (size_t n = begin; n < end; ++n)
+			{
+				for (size_t c = 0; c < g.Channels; ++c)
+				{
+					for (size_t oh = 0; oh < g.OutHeight; ++oh)
+					{
+						for (size_t ow = 0; ow < g.OutWidth; ++ow)
+						{
+							size_t best = n * imageSize + c * channelStride + oh * stride * rowStride + ow * stride * columnStride;
+							for (size_t kh = 0; kh < size; ++kh)
+							{
+								const size_t row = n * imageSize + c * channelStride + (oh * stride + kh) * rowStride + ow * stride * columnStride;
+								for (size_t kw = 0; kw < size; ++kw)
+								{
+									const size_t offset = row + kw * columnStride;
+									best = source[offset] > source[best] ? offset : best;
+								}
+							}
+							const size_t o = n * outputImageSize + (bNchw ? (c * g.OutHeight + oh) * g.OutWidth + ow : (oh * g.OutWidth + ow) * g.Channels + c);
+							output[o] = source[best];
+							index[o] = best;
+						}
+					}
+				}
+			}
+		});
+		store(out, result);
+	}
+
+	template<typename T>
+	void Convolution<T>::MaxPoolBackward(Ndarray<T>& gradInput, const Ndarray<T>& gradOutput, const Ndarray<size_t>& indices, const Ndarray<T>& x)
+	{
+		if (gradOutput.mDimension != 4u || !indices.IsContiguous() || !gradOutput.hasShape(indices) || x.mTotalSize == 0u)
+		{
+			gradInput = Ndarray<T>();
+			return;
+		}
+
+		NUMPY_PROFILE_SCOPE("Convolution::MaxPoolBackward", (gradOutput.mTotalSize + x.mTotalSize) * sizeof(T));
+		Ndarray<T> storage;
+		const T* gradient = contiguous(gradOutput, storage).GetData();
+		Ndarray<T> result;
+		T* output = target(gradInput, result, 4u, x.mArraySize.Get(), gradOutput, gradOutput);
+		std::fill(output, output + x.mTotalSize, static_cast<T>(0));
+		const size_t* index = indices.GetData();
+		for (size_t i = 0; i < gradOutput.mTotalSize; ++i)
+		{
+			output[index[i]] = static_cast<T>(static_cast<Compute>(output[index[i]]) + static_cast<Compute>(gradient[i]));
+		}
+		store(gradInput, result);
+	}
+
+	template<typename T>
+	bool Convolution<T>::geometry(const Ndarray<T>& x, const Ndarray<T>& weight, const ConvolutionParameters& parameters, Geometry& g)
+	{
+		g.Batch = 0;
+		if (x.mDimension != 4u || weight.mDimension != 4u || parameters.Stride == 0u)
+			return false;
+
+		const bool bNchw = parameters.Layout == ImageLayout::Nchw;
+		g.Layout = parameters.Layout;
+		g.Channels = x.mArraySize[bNchw ? 1u : 3u];
+		g.Height = x.mArraySize[bNchw ? 2u : 1u];
+		g.Width = x.mArraySize[bNchw ? 3u : 2u];
+		g.Filters = weight.mArraySize[bNchw ? 0u : 3u];
+		g.KernelHeight = weight.mArraySize[bNchw ? 2u : 0u];
+		g.KernelWidth = weight.mArraySize[bNchw ? 3u : 1u];
+		g.Stride = parameters.Stride;
+		g.Padding = parameters.Padding;
+		if (weight.mArraySize[bNchw ? 1u : 2u] != g.Channels
+			|| g.Height + 2 * g.Padding < g.KernelHeight || g.Width + 2 * g.Padding < g.KernelWidth)
+			return false;
+
+		g.OutHeight = (g.Height + 2 * g.Padding - g.KernelHeight) / g.Stride + 1;
+		g.OutWidth = (g.Width + 2 * g.Padding - g.KernelWidth) / g.Stride + 1;
+		g.Pixels = g.OutHeight * g.OutWidth;
+		g.PatchSize = g.Channels * g.KernelHeight * g.KernelWidth;
+		g.Batch = x.mArraySize[0];
+		return true;
+	}
+
+	template<typename T>
+	inline void Convolution<T>::outputShape(const Geometry& g, const size_t& channels, size_t* arraySize)
+	{
+		const bool bNchw = g.Layout == ImageLayout::Nchw;
+		arraySize[0] = g.Batch;
+		arraySize[bNchw ? 1u : 3u] = channels;
+		arraySize[bNchw ? 2u : 1u] = g.OutHeight;
+		arraySize[bNchw ? 3u : 2u] = g.OutWidth;
+	}
+
+	template<typename T>
+	T* Convolution<T>::target(Ndarray<T>& out, Ndarray<T>& result, const unsigned int& dimension, const size_t* arraySize,
+		const Ndarray<T>& first, const Ndarray<T>& second)
+	{
+		if (out.mDimension == dimension && std::equal(arraySize, arraySize + dimension, out.mArraySize.Get()) && out.IsContiguous()
+			&& out.mArray != first.mArray && out.mArray != second.mArray)
+			return out.GetData();
+
+		result = Ndarray<T>::uninitialized(dimension, arraySize);
+		return result.GetData();
+	}
+
+	template<typename T>
+	inline void Convolution<T>::store(Ndarray<T>& out, Ndarray<T>& result)
+	{
+		if (result.mTotalSize == 0u)
+			return;
+		if (out.hasShape(result))
+		{
+			out.assign(result);
+			return;
+		}
+		out = std::move(result);
+	}
+
+	template<typename T>
+	inline bool Convolution<T>::isBias(const Ndarray<T>& bias, const Geometry& g)
+	{
+		return bias.mTotalSize == 0u || (bias.mDimension == 1u && bias.mArraySize[0] == g.Filters);
+	}
+
+	template<typename T>
+	inline std::uint64_t Convolution<T>::flops(const Geometry& g)
+	{
+		return static_cast<std::uint64_t>(g.Batch) * g.Pixels * g.Filters * g.PatchSize * 2u;
+	}
+
+	template<typename T>
+	inline const T* Convolution<T>::biasData(const Ndarray<T>& out, const Ndarray<T>& bias, Ndarray<T>& storage)
+	{
+		if (bias.mTotalSize == 0u)
+			return nullptr;
+		if (out.mArray == bias.mArray)
+		{
+			storage = Ndarray<T>(bias);
+			return storage.GetData();
+		}
+		return contiguous(bias, storage).GetData();
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& Convolution<T>::contiguous(const Ndarray<T>& a, Ndarray<T>& storage)
+	{
+		if (a.IsContiguous())
+			return a;
+		storage = Ndarray<T>(a);
+		return storage;
+	}
+
+	template<typename T>
+	void Convolution<T>::im2col(const Geometry& g, const T* x, T* columns)
+	{
+		const size_t imageSize = g.Channels * g.Height * g.Width;
+		const size_t columnsSize = g.PatchSize * g.Pixels;
+		ParallelElements(g.Batch, std::max<size_t>(1, ELEMENTWISE_GRAIN / columnsSize), [&](size_t begin, size_t end)
+		{
+			for (size_t n = begin; n < end; ++n)
+			{
+				const T* image = x + n * imageSize;
+				T* column = columns + n * columnsSize;
+				if (g.Layout == ImageLayout::Nchw)
+				{
+					// Row (c, kh, kw) holds that kernel tap over every output pixel, read along image rows.
+					for (size_t c = 0; c < g.Channels; ++c)
+					{
+						for (size_t kh = 0; kh < g.KernelHeight; ++kh)
+						{
+							for (size_t kw = 0; kw < g.KernelWidth; ++kw)
+							{
+								for (size_t oh = 0; oh < g.OutHeight; ++oh)
+								{
+									const size_t ih = oh * g.Stride + kh;
+									const bool bRow = ih >= g.Padding && ih - g.Padding < g.Height;
+									const T* row = image + (c * g.Height + (bRow ? ih - g.Padding : 0)) * g.Width;
+									for (size_t ow = 0; ow < g.OutWidth; ++ow)
+									{
+										const size_t iw = ow * g.Stride + kw;
+										column[ow] = bRow && iw >= g.Padding && iw - g.Padding < g.Width ? row[iw - g.Padding] : static_cast<T>(0);
+									}
+									column += g.OutWidth;
+								}
+							}
+						}
+					}
+				}
+				else
+				{
+					// Row (oh, ow) holds the patch under that output pixel, each tap's channels copied as one run.
+					for (size_t oh = 0; oh < g.OutHeight; ++oh)
+					{
+						for (size_t ow = 0; ow < g.OutWidth; ++ow)
+						{
+							for (size_t kh = 0; kh < g.KernelHeight; ++kh)
+							{
+								const size_t ih = oh * g.Stride + kh;
+								for (size_t kw = 0; kw < g.KernelWidth; ++kw)
+								{
+									const size_t iw = ow * g.Stride + kw;
+									if (ih >= g.Padding && ih - g.Padding < g.Height && iw >= g.Padding && iw - g.Padding < g.Width)
+									{
+										const T* pixel = image + ((ih - g.Padding) * g.Width + iw - g.Padding) * g.Channels;
+										std::copy(pixel, pixel + g.Channels, column);
+									}
+									else
+									{
+										std::fill(column, column + g.Channels, static_cast<T>(0));
+									}
+									column += g.Channels;
+								}
+							}
+						}
+					}
+				}
+			}
+		});
+	}
+
+	template<typename T>
+	void Convolution<T>::multiply(const Geometry& g, const T* columns, const T* weight, const T* bias, const bool& bRelu, T* out)
+	{
+		if (g.Layout == ImageLayout::Nhwc)
+		{
+			// (batch * pixels, patch) . (patch, filters) is the NHWC output, bias and ReLU in the epilogue.
+			GemmFusion<T> fusion;
+			fusion.Bias = bias;
+			fusion.bRelu = bRelu;
+			Gemm<T>::Multiply(g.Batch * g.Pixels, g.Filters, g.PatchSize, columns, g.PatchSize, 1, weight, g.Filters, 1, out, g.Filters, fusion);
+			return;
+		}
+		// (filters, patch) . (patch, pixels) per image is that image's NCHW output.
+		Gemm<T>::MultiplyBatched(g.Batch, g.Filters, g.Pixels, g.PatchSize, weight, 0, g.PatchSize, 1,
+			columns, g.PatchSize * g.Pixels, g.Pixels, 1, out, g.Filters * g.Pixels, g.Pixels);
+		planeEpilogue(g, bias, bRelu, out);
+	}
+
+	template<typename T>
+	void Convolution<T>::col2im(const Geometry& g, const T* columns, T* x)
+	{
+		// Images are disjoint, so they are split across threads; within one the adds follow im2col's reads.
+		const size_t imageSize = g.Channels * g.Height * g.Width;
+		const size_t columnsSize = g.PatchSize * g.Pixels;
+		ParallelElements(g.Batch, std::max<size_t>(1, ELEMENTWISE_GRAIN / columnsSize), [&](size_t begin, size_t end)
+		{
+			for (size_t n = begin; n < end; ++n)
+			{
+				T* image = x + n * imageSize;
+				const T* column = columns + n * columnsSize;
+				for (size_t p = 0; p < g.Pixels; ++p)
+				{
+					const size_t oh = p / g.OutWidth;
+					const size_t ow = p % g.OutWidth;
+					for (size_t c = 0; c < g.Channels; ++c)
+					{
+						for (size_t kh = 0; kh < g.KernelHeight; ++kh)
+						{
+							const size_t ih = oh * g.Stride + kh;
+							if (ih < g.Padding || ih - g.Padding >= g.Height)
+								continue;
+							for (size_t kw = 0; kw < g.KernelWidth; ++kw)
+							{
+								const size_t iw = ow * g.Stride + kw;
+								if (iw < g.Padding || iw - g.Padding >= g.Width)
+									continue;
+								const bool bNchw = g.Layout == ImageLayout::Nchw;
+								const size_t tap = (kh * g.KernelWidth + kw);
+								const T value = bNchw ? column[(c * g.KernelHeight * g.KernelWidth + tap) * g.Pixels + p] : column[p * g.PatchSize + tap * g.Channels + c];
+								T& pixel = bNchw ? image[(c * g.Height + ih - g.Padding) * g.Width + iw - g.Padding]
+									: image[((ih - g.Padding) * g.Width + iw - g.Padding) * g.Channels + c];
+								pixel = static_cast<T>(static_cast<Compute>(pixel) + static_cast<Compute>(value));
+							}
+						}
+					}
+				}
+			}
+		});
+	}
+
+	template<typename T>
+	void Convolution<T>::direct(const Geometry& g, const T* x, const T* weight, const T* bias, const bool& bRelu, T* out)
+	{
+		const bool bNchw = g.Layout == ImageLayout::Nchw;
+		for (size_t n = 0; n < g.Batch; ++n)
+		{
+			for (size_t o = 0; o < g.Filters; ++o)
+			{
+				for (size_t oh = 0; oh < g.OutHeight; ++oh)
+				{
+					for (size_t ow = 0; ow < g.OutWidth; ++ow)
+					{
+						Compute sum = bias != nullptr ? static_cast<Compute>(bias[o]) : static_cast<Compute>(0);
+						for (size_t c = 0; c < g.Channels; ++c)
+						{
+							for (size_t kh = 0; kh < g.KernelHeight; ++kh)
+							{
+								const size_t ih = oh * g.Stride + kh;
+								for (size_t kw = 0; kw < g.KernelWidth; ++kw)
+								{
+									const size_t iw = ow * g.Stride + kw;
+									if (ih < g.Padding || ih - g.Padding >= g.Height || iw < g.Padding || iw - g.Padding >= g.Width)
+										continue;
+									const size_t h = ih - g.Padding;
+									const size_t w = iw - g.Padding;
+									const T& value = bNchw ? x[((n * g.Channels + c) * g.Height + h) * g.Width + w] : x[((n * g.Height + h) * g.Width + w) * g.Channels + c];
+									const T& tap = bNchw ? weight[((o * g.Channels + c) * g.KernelHeight + kh) * g.KernelWidth + kw]
+										: weight[((kh * g.KernelWidth + kw) * g.Channels + c) * g.Filters + o];
+									sum += static_cast<Compute>(value) * static_cast<Compute>(tap);
+								}
+							}
+						}
+						sum = bRelu && sum < 0 ? static_cast<Compute>(0) : sum;
+						out[bNchw ? ((n * g.Filters + o) * g.OutHeight + oh) * g.OutWidth + ow : ((n * g.OutHeight + oh) * g.OutWidth + ow) * g.Filters + o] = static_cast<T>(sum);
+					}
+				}
+			}
+		}
+	}
+
+	template<typename T>
+	void Convolution<T>::winograd(const Geometry& g, const T* x, const T* weight, const T* bias, const bool& bRelu, T* out)
+	{
+		// Y = A^T [(G g G^T) . (B^T d B)] A over 4x4 input tiles d with stride 2: the elementwise products of the 16 transformed
+		// positions, summed over channels, are 16 GEMMs of (tiles, channels) . (channels, filters). Tiles go through in blocks
+		// whose transformed inputs and products stay in cache between the transforms and the GEMMs.
+		const bool bNchw = g.Layout == ImageLayout::Nchw;
+		const size_t tilesHigh = (g.OutHeight + 1) / 2;
+		const size_t tilesWide = (g.OutWidth + 1) / 2;
+		const size_t imageTiles = tilesHigh * tilesWide;
+		const size_t totalTiles = g.Batch * imageTiles;
+		const size_t tiles = std::min(totalTiles, std::max<size_t>(16, WINOGRAD_BLOCK_SIZE / (16 * (g.Channels + g.Filters))));
+		const size_t transformedSize[3] = { 16, tiles, g.Channels };
+		const size_t filterSize[3] = { 16, g.Channels, g.Filters };
+		const size_t productSize[3] = { 16, tiles, g.Filters };
+		Ndarray<T> transformed = Ndarray<T>::uninitialized(3u, transformedSize);
+		Ndarray<T> filter = Ndarray<T>::uninitialized(3u, filterSize);
+		Ndarray<T> product = Ndarray<T>::uninitialized(3u, productSize);
+		T* v = transformed.GetData();
+		T* u = filter.GetData();
+		T* m = product.GetData();
+
+		// U = G g G^T, G = [1 0 0; 1/2 1/2 1/2; 1/2 -1/2 1/2; 0 0 1].
+		for (size_t o = 0; o < g.Filters; ++o)
+		{
+			for (size_t c = 0; c < g.Channels; ++c)
+			{
+				Compute tap[3][3];
+				for (size_t kh = 0; kh < 3; ++kh)
+				{
+					for (size_t kw = 0; kw < 3; ++kw)
+					{
+						tap[kh][kw] = static_cast<Compute>(bNchw ? weight[((o * g.Channels + c) * 3 + kh) * 3 + kw] : weight[((kh * 3 + kw) * g.Channels + c) * g.Filters + o]);
+					}
+				}
+				Compute left[4][3];
+				for (size_t j = 0; j < 3; ++j)
+				{
+					left[0][j] = tap[0][j];
+					left[1][j] = (tap[0][j] + tap[1][j] + tap[2][j]) * static_cast<Compute>(0.5);
+					left[2][j] = (tap[0][j] - tap[1][j] + tap[2][j]) * static_cast<Compute>(0.5);
+					left[3][j] = tap[2][j];
+				}
+				for (size_t i = 0; i < 4; ++i)
+				{
+					const Compute row[4] = { left[i][0], (left[i][0] + left[i][1] + left[i][2]) * static_cast<Compute>(0.5),
+						(left[i][0] - left[i][1] + left[i][2]) * static_cast<Compute>(0.5), left[i][2] };
+					for (size_t j = 0; j < 4; ++j)
+					{
+						u[((i * 4 + j) * g.Channels + c) * g.Filters + o] = static_cast<T>(row[j]);
+					}
+				}
+			}
+		}
+
+		const size_t imageSize = g.Channels * g.Height * g.Width;
+		for (size_t first = 0; first < totalTiles; first += tiles)
+		{
+			const size_t blockTiles = std::min(tiles, totalTiles - first);
+			// V = B^T d B, B^T = [1 0 -1 0; 0 1 1 0; 0 -1 1 0; 0 1 0 -1].
+			ParallelElements(blockTiles, std::max<size_t>(1, ELEMENTWISE_GRAIN / (16 * g.Channels)), [&](size_t begin, size_t end)
+			{
+				for (size_t t = begin; t < end; ++t)
+				{
+					const size_t n = (first + t) / imageTiles;
+					const size_t top = (first + t) % imageTiles / tilesWide * 2;
+					const size_t left = (first + t) % imageTiles % tilesWide * 2;
+					const T* image = x + n * imageSize;
+					for (size_t c = 0; c < g.Channels; ++c)
+					{
+						Compute d[4][4];
+						for (size_t i = 0; i < 4; ++i)
+						{
+							const size_t ih = top + i;
+							for (size_t j = 0; j < 4; ++j)
+							{
+								const size_t iw = left + j;
+								const bool bInside = ih >= g.Padding && ih - g.Padding < g.Height && iw >= g.Padding && iw - g.Padding < g.Width;
+								d[i][j] = !bInside ? static_cast<Compute>(0) : static_cast<Compute>(bNchw
+									? image[(c * g.Height + ih - g.Padding) * g.Width + iw - g.Padding] : image[((ih - g.Padding) * g.Width + iw - g.Padding) * g.Channels + c]);
+							}
+						}
+						Compute rows[4][4];
+						for (size_t j = 0; j < 4; ++j)
+						{
+							rows[0][j] = d[0][j] - d[2][j];
+							rows[1][j] = d[1][j] + d[2][j];
+							rows[2][j] = d[2][j] - d[1][j];
+							rows[3][j] = d[1][j] - d[3][j];
+						}
+						for (size_t i = 0; i < 4; ++i)
+						{
+							const Compute row[4] = { rows[i][0] - rows[i][2], rows[i][1] + rows[i][2], rows[i][2] - rows[i][1], rows[i][1] - rows[i][3] };
+							for (size_t j = 0; j < 4; ++j)
+							{
+								v[((i * 4 + j) * tiles + t) * g.Channels + c] = static_cast<T>(row[j]);
+							}
+						}
+					}
+				}
+			});
+
+			Gemm<T>::MultiplyBatched(16, blockTiles, g.Filters, g.Channels, v, tiles * g.Channels, g.Channels, 1,
+				u, g.Channels * g.Filters, g.Filters, 1, m, tiles * g.Filters, g.Filters);
+
+			// Y = A^T M A, A^T = [1 1 1 0; 0 1 -1 -1], clipped at the image's last row and column.
+			ParallelElements(blockTiles, std::max<size_t>(1, ELEMENTWISE_GRAIN / (16 * g.Filters)), [&](size_t begin, size_t end)
+			{
+				for (size_t t = begin; t < end; ++t)
+				{
+					const size_t n = (first + t) / imageTiles;
+					const size_t top = (first + t) % imageTiles / tilesWide * 2;
+					const size_t left = (first + t) % imageTiles % tilesWide * 2;
+					for (size_t o = 0; o < g.Filters; ++o)
+					{
+						Compute rows[2][4];
+						for (size_t j = 0; j < 4; ++j)
+						{
+							const Compute m0 = static_cast<Compute>(m[(j * tiles + t) * g.Filters + o]);
+							const Compute m1 = static_cast<Compute>(m[((4 + j) * tiles + t) * g.Filters + o]);
+							const Compute m2 = static_cast<Compute>(m[((8 + j) * tiles + t) * g.Filters + o]);
+							const Compute m3 = static_cast<Compute>(m[((12 + j) * tiles + t) * g.Filters + o]);
+							rows[0][j] = m0 + m1 + m2;
+							rows[1][j] = m1 - m2 - m3;
+						}
+						const Compute offset = bias != nullptr ? static_cast<Compute>(bias[o]) : static_cast<Compute>(0);
+						for (size_t i = 0; i < 2 && top + i < g.OutHeight; ++i)
+						{
+							const Compute y[2] = { rows[i][0] + rows[i][1] + rows[i][2] + offset, rows[i][1] - rows[i][2] - rows[i][3] + offset };
+							for (size_t j = 0; j < 2 && left + j < g.OutWidth; ++j)
+							{
+								const Compute value = bRelu && y[j] < 0 ? static_cast<Compute>(0) : y[j];
+								const size_t oh = top + i;
+								const size_t ow = left + j;
+								out[bNchw ? ((n * g.Filters + o) * g.OutHeight + oh) * g.OutWidth + ow : ((n * g.OutHeight + oh) * g.OutWidth + ow) * g.Filters + o] = static_cast<T>(value);
+							}
+						}
+					}
+				}
+			});
+		}
+	}
+
+	template<typename T>
+	void Convolution<T>::planeEpilogue(const Geometry& g, const T* bias, const bool& bRelu, T* out)
+	{
+		if (bias == nullptr && !bRelu)
+			return;
+		ParallelElements(g.Batch * g.Filters, std::max<size_t>(1, ELEMENTWISE_GRAIN / g.Pixels), [&](size_t begin, size_t end)
+		{
+			for (size_t plane = begin; plane < end; ++plane)
+			{
+				const Compute offset = bias != nullptr ? static_cast<Compute>(bias[plane % g.Filters]) : static_cast<Compute>(0);
+				T* pixel = out + plane * g.Pixels;
+				for (size_t p = 0; p < g.Pixels; ++p)
+				{
+					const Compute value = static_cast<Compute>(pixel[p]) + offset;
+					pixel[p] = static_cast<T>(bRelu && value < 0 ? static_cast<Compute>(0) : value);
+				}
+			}
+		});
+	}
+}
@@ -0,0 +1,383 @@
+#pragma once
+#include<algorithm>
+#include<atomic>
+#include<condition_variable>
+#include<memory>
+#include<mutex>
+#include<numeric>
+#include<random>
+#include<thread>
+#include<vector>
+#include "Numpy.h"
+
+namespace numpy
+{
+	// Bounded single-producer single-consumer queue of slot indices. TryPush and TryPop are lock-free; Push and Pop sleep on
+	// a condition variable only when the queue is full or empty, and the other side takes the mutex only when someone sleeps.
+	class SlotQueue final
+	{
+	public:
+		explicit SlotQueue(const unsigned int& capacity);
+		SlotQueue(const SlotQueue& rhs) = delete;
+		SlotQueue& operator=(const SlotQueue& rhs) = delete;
+		~SlotQueue() = default;
+
+		bool TryPush(const unsigned int& value);
+		bool TryPop(unsigned int& value);
+		// Block until done; false once Stop has been called.
+		bool Push(const unsigned int& value);
+		bool Pop(unsigned int& value);
+		void Stop();
+	private:
+		bool push(const unsigned int& value);
+		bool pop(unsigned int& value);
+		void notify();
+
+		std::vector<unsigned int> mValues;
+		unsigned long long mCapacity;
+		// Producer and consumer counters on separate cache lines; the size is mTail - mHead.
+		alignas(64) std::atomic<unsigned long long> mHead;
+		alignas(64) std::atomic<unsigned long long> mTail;
+		std::atomic<unsigned int> mWaiters;
+		std::atomic<bool> mbStop;
+		std::mutex mMutex;
+		std::condition_variable mCondition;
+	};
+
+	inline SlotQueue::SlotQueue(const unsigned int& capacity)
+		: mValues(std::max(1u, capacity))
+		, mCapacity(std::max(1u, capacity))
+		, mHead(0)
+		, mTail(0)
+		, mWaiters(0)
+		, mbStop(false)
+	{
+	}
+
+	inline bool SlotQueue::TryPush(const unsigned int& value)
+	{
+		if (!push(value))
+			return false;
+		notify();
+		return true;
+	}
+
+	inline bool SlotQueue::TryPop(unsigned int& value)
+	{
+		if (!pop(value))
+			return false;
+		notify();
+		return true;
+	}
+
+	inline bool SlotQueue::push(const unsigned int& value)
+	{
+		const unsigned long long tail = mTail.load(std::memory_order_relaxed);
+		if (tail - mHead.load(std::memory_order_acquire) == mCapacity)
+			return false;
+		mValues[tail % mCapacity] = value;
+		// Sequentially consistent with the load of mWaiters in notify, so a sleeper either sees the value or gets notified.
+		mTail.store(tail + 1);
+		return true;
+	}
+
+	inline bool SlotQueue::pop(unsigned int& value)
+	{
+		const unsigned long long head = mHead.load(std::memory_order_relaxed);
+		if (head == mTail.load(std::memory_order_acquire))
+			return false;
+		value = mValues[head % mCapacity];
+		mHead.store(head + 1);
+		return true;
+	}
+
+	inline bool SlotQueue::Push(const unsigned int& value)
+	{
+		if (TryPush(value))
+			return true;
+
+		std::unique_lock<std::mutex> lock(mMutex);
+		mWaiters.fetch_add(1);
+		bool bPushed = false;
+		mCondition.wait(lock, [this, &value, &bPushed]() { bPushed = push(value); return bPushed || mbStop.load(); });
+		mWaiters.fetch_sub(1);
+		lock.unlock();
+		if (bPushed)
+		{
+			notify();
+		}
+		return bPushed;
+	}
+
+	inline bool SlotQueue::Pop(unsigned int& value)
+	{
+		if (TryPop(value))
+			return true;
+
+		std::unique_lock<std::mutex> lock(mMutex);
+		mWaiters.fetch_add(1);
+		bool bPopped = false;
+		mCondition.wait(lock, [this, &value, &bPopped]() { bPopped = pop(value); return bPopped || mbStop.load(); });
+		mWaiters.fetch_sub(1);
+		lock.unlock();
+		if (bPopped)
+		{
+			notify();
+		}
+		return bPopped;
+	}
+
+	inline void SlotQueue::Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mbStop.store(true);
+		}
+		mCondition.notify_all();
+	}
+
+	inline void SlotQueue::notify()
+	{
+		if (mWaiters.load() == 0u)
+			return;
+		// Taking the mutex orders the notification after the sleeper's predicate check.
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+		}
+		mCondition.notify_all();
+	}
+
+	// Mini-batches gathered ahead of the training thread. Each worker thread owns a set of pre-allocated batch buffers that
+	// cycle between a free and a ready SlotQueue, and gathers batch w, w + workers, ... with Numpy::Take straight into them, so
+	// up to prefetch batches are in flight and Next only swaps buffers. Batches come out in the same order whatever the number
+	// of workers; the permutation of each epoch depends only on seed and the epoch number.
+	//
+	// With chunkRows set, the permutation shuffles chunks of that many consecutive samples and the samples within each chunk, so
+	// the workers read one chunk at a time. Over a memory-mapped source (Npy<T>::Map) that streams a data set larger than memory
+	// from disk: pages are faulted in by the workers ahead of use and the kernel drops clean ones behind.
+	template<typename T>
+	class DataLoader final
+	{
+	public:
+		// sources are (samples x ...) arrays with the same number of samples, such as inputs and targets. Contiguous sources are
+		// referenced rather than copied, so they must outlive the loader.
+		DataLoader(const std::vector<const Ndarray<T>*>& sources, const unsigned int& batchSize, const unsigned int& prefetch = 2,
+			const unsigned int& seed = 0, const unsigned int& chunkRows = 0, const unsigned int& workerCount = 1);
+		DataLoader(const DataLoader& rhs) = delete;
+		DataLoader& operator=(const DataLoader& rhs) = delete;
+		~DataLoader();
+
+		// The next mini-batch, one array per source, valid until the next call. Returns nullptr once at the end of each epoch and
+		// starts the next epoch on the following call. Samples left over after the last full batch are skipped for that epoch.
+		const std::vector<Ndarray<T>>* Next();
+
+		size_t GetBatchCount() const;
+		// Calls to Next that found their batch not ready yet and had to wait for a worker.
+		unsigned long long GetStallCount() const;
+	private:
+		struct Worker
+		{
+			explicit Worker(const unsigned int& slotCount);
+
+			SlotQueue Free;
+			SlotQueue Ready;
+			std::vector<size_t> Permutation;
+			unsigned long long PermutationEpoch;
+			std::thread Thread;
+		};
+
+		void workerLoop(const unsigned int& index);
+		void permute(const unsigned long long& epoch, std::vector<size_t>& permutation) const;
+
+		std::vector<const Ndarray<T>*> mSources;
+		// Compact copies of strided sources, which Take would otherwise compact on every batch.
+		std::vector<Ndarray<T>> mCompactSources;
+		unsigned int mBatchSize;
+		size_t mSampleCount;
+		size_t mBatchCount;
+		unsigned int mSeed;
+		unsigned int mChunkRows;
+		std::vector<std::vector<Ndarray<T>>> mSlots;
+		std::vector<std::unique_ptr<Worker>> mWorkers;
+
+		// Consumer state, touched only by the thread calling Next.
+		unsigned long long mNextBatch;
+		unsigned int mCurrentSlot;
+		bool mbEpochEnd;
+		unsigned long long mStallCount;
+
+		static constexpr unsigned int NONE = ~0u;
+	};
+
+	template<typename T>
+	DataLoader<T>::Worker::Worker(const unsigned int& slotCount)
+		: Free(slotCount)
+		, Ready(slotCount)
+		, PermutationEpoch(~0ull)
+	{
+	}
+
+	template<typename T>
+	DataLoader<T>::DataLoader(const std::vector<const Ndarray<T>*>& sources, const unsigned int& batchSize, const unsigned int& prefetch,
+		const unsigned int& seed, const unsigned int& chunkRows, const unsigned int& workerCount)
+		: mSources(sources)
+		, mCompactSources(sources.size())
+		, mBatchSize(batchSize)
+		, mSampleCount(0)
+		, mBatchCount(0)
+		, mSeed(seed)
+		, mChunkRows(chunkRows)
+		, mNextBatch(0)
+		, mCurrentSlot(NONE)
+		, mbEpochEnd(false)
+		, mStallCount(0)
+	{
+		bool bValid = !sources.empty() && batchSize != 0u;
+		for (size_t s = 0; s < sources.size() && bValid; ++s)
+		{
+			bValid = sources[s]->GetDimension() != 0u && sources[s]->GetArraySize(0) == sources[0]->GetArraySize(0);
+			if (bValid && !sources[s]->IsContiguous())
+			{
+				mCompactSources[s] = *sources[s];
+				mSources[s] = &mCompactSources[s];
+			}
+		}
+		if (!bValid || sources[0]->GetArraySize(0) < batchSize)
+			return;
+		mSampleCount = sources[0]->GetArraySize(0);
+		mBatchCount = mSampleCount / batchSize;
+
+		const unsigned int threads = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(workerCount, mBatchCount)));
+		const unsigned int slotsPerWorker = std::max(1u, (std::max(1u, prefetch) + threads - 1) / threads);
+		std::vector<size_t> first(batchSize);
+		std::iota(first.begin(), first.end(), size_t(0));
+		mSlots.resize(static_cast<size_t>(threads) * slotsPerWorker);
+		for (std::vector<Ndarray<T>>& slot : mSlots)
+		{
+			slot.resize(mSources.size());
+			for (size_t s = 0; s < mSources.size(); ++s)
+			{
+				Numpy<T>::Take(slot[s], *mSources[s], first.data(), batchSize);
+			}
+		}
+
+		for (unsigned int w = 0; w < threads; ++w)
+		{
+			mWorkers.push_back(std::make_unique<Worker>(slotsPerWorker));
+			for (unsigned int i = 0; i < slotsPerWorker; ++i)
+			{
+				mWorkers[w]->Free.TryPush(w * slotsPerWorker + i);
+			}
+		}
+		for (unsigned int w = 0; w < threads; ++w)
+		{
+			mWorkers[w]->Thread = std::thread(&DataLoader<T>::workerLoop, this, w);
+		}
+	}
+
+	template<typename T>
+	DataLoader<T>::~DataLoader()
+	{
+		for (std::unique_ptr<Worker>& worker : mWorkers)
+		{
+			worker->Free.Stop();
+			worker->Ready.Stop();
+		}
+		for (std::unique_ptr<Worker>& worker : mWorkers)
+		{
+			worker->Thread.join();
+		}
+	}
+
+	template<typename T>
+	const std::vector<Ndarray<T>>* DataLoader<T>::Next()
+	{
+		const unsigned int workerCount = static_cast<unsigned int>(mWorkers.size());
+		if (mCurrentSlot != NONE)
+		{
+			mWorkers[(mNextBatch - 1) % workerCount]->Free.Push(mCurrentSlot);
+			mCurrentSlot = NONE;
+		}
+		if (mbEpochEnd || mBatchCount == 0u)
+		{
+			mbEpochEnd = false;
+			return nullptr;
+		}
+
+		Worker& worker = *mWorkers[mNextBatch % workerCount];
+		unsigned int slot = NONE;
+		if (!worker.Ready.TryPop(slot))
+		{
+			++mStallCount;
+			worker.Ready.Pop(slot);
+		}
+		mCurrentSlot = slot;
+		++mNextBatch;
+		mbEpochEnd = mNextBatch % mBatchCount == 0u;
+		return &mSlots[slot];
+	}
+
+	template<typename T>
+	inline size_t DataLoader<T>::GetBatchCount() const
+	{
+		return mBatchCount;
+	}
+
+	template<typename T>
+	inline unsigned long long DataLoader<T>::GetStallCount() const
+	{
+		return mStallCount;
+	}
+
+	template<typename T>
+	void DataLoader<T>::workerLoop(const unsigned int& index)
+	{
+		Worker& worker = *mWorkers[index];
+		const unsigned int workerCount = static_cast<unsigned int>(mWorkers.size());
+		unsigned int slot = NONE;
+		for (unsigned long long batch = index; worker.Free.Pop(slot); batch += workerCount)
+		{
+			const unsigned long long epoch = batch / mBatchCount;
+			if (worker.PermutationEpoch != epoch)
+			{
+				permute(epoch, worker.Permutation);
+				worker.PermutationEpoch = epoch;
+			}
+
+			const size_t* indices = worker.Permutation.data() + (batch % mBatchCount) * mBatchSize;
+			for (size_t s = 0; s < mSources.size(); ++s)
+			{
+				Numpy<T>::Take(mSlots[slot][s], *mSources[s], indices, mBatchSize);
+			}
+			if (!worker.Ready.Push(slot))
+				return;
+		}
+	}
+
+	template<typename T>
+	void DataLoader<T>::permute(const unsigned long long& epoch, std::vector<size_t>& permutation) const
+	{
+		std::seed_seq sequence = { mSeed, static_cast<unsigned int>(epoch), static_cast<unsigned int>(epoch >> 32) };
+		std::mt19937 engine(sequence);
+		permutation.resize(mSampleCount);
+		if (mChunkRows == 0u || mChunkRows >= mSampleCount)
+		{
+			std::iota(permutation.begin(), permutation.end(), size_t(0));
+			std::shuffle(permutation.begin(), permutation.end(), engine);
+			return;
+		}
+
+		std::vector<size_t> chunks((mSampleCount + mChunkRows - 1) / mChunkRows);
+		std::iota(chunks.begin(), chunks.end(), size_t(0));
+		std::shuffle(chunks.begin(), chunks.end(), engine);
+		size_t* cursor = permutation.data();
+		for (const size_t& chunk : chunks)
+		{
+			const size_t begin = chunk * mChunkRows;
+			const size_t end = std::min(mSampleCount, begin + mChunkRows);
+			std::iota(cursor, cursor + (end - begin), begin);
+			std::shuffle(cursor, cursor + (end - begin), engine);
+			cursor += end - begin;
+		}
+	}
+}
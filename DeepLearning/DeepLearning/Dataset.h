@@ -0,0 +1,114 @@
+#pragma once
+#include<algorithm>
+#include<cmath>
+#include<cstdlib>
+#include<fstream>
+#include<numeric>
+#include<random>
+#include<string>
+#include<vector>
+#include "Numpy.h"
+
+namespace numpy
+{
+	// Loading and preparing labelled samples for classification.
+	template<typename T>
+	class Dataset final
+	{
+	public:
+		Dataset() = delete;
+		~Dataset() = delete;
+
+		// Reads lines of comma-separated numbers whose last column is the class label, the layout of scikit-learn's digits.csv.
+		// Lines that do not parse, such as a header, are skipped. Returns false when the file cannot be read or has no samples.
+		static bool LoadCsv(const std::string& path, Ndarray<T>& x, Ndarray<unsigned int>& labels);
+		// (samples x classCount) rows with a 1 in the column of each label.
+		static Ndarray<T> OneHot(const Ndarray<unsigned int>& labels, const unsigned int& classCount);
+		// Shuffled split in the manner of train_test_split: ceil(testFraction * samples) random rows go to the test set.
+		static void Split(const Ndarray<T>& x, const Ndarray<T>& t, const double& testFraction, const unsigned int& seed,
+			Ndarray<T>& xTrain, Ndarray<T>& xTest, Ndarray<T>& tTrain, Ndarray<T>& tTest);
+	};
+
+	template<typename T>
+	bool Dataset<T>::LoadCsv(const std::string& path, Ndarray<T>& x, Ndarray<unsigned int>& labels)
+	{
+		std::ifstream file(path);
+		if (!file)
+			return false;
+
+		std::vector<T> values;
+		std::vector<unsigned int> classes;
+		std::vector<double> row;
+		unsigned int features = 0;
+		std::string line;
+		while (std::getline(file, line))
+		{
+			row.clear();
+			const char* cursor = line.c_str();
+			char* end = nullptr;
+			for (;;)
+			{
+				const double value = std::strtod(cursor, &end);
+				if (end == cursor)
+					break;
+				row.push_back(value);
+				cursor = end;
+				while (*cursor == ',' || *cursor == ' ' || *cursor == '\r')
+				{
+					++cursor;
+				}
+			}
+			if (*cursor != '\0' || row.size() < 2u || (features != 0u && row.size() - 1u != features))
+				continue;
+
+			features = static_cast<unsigned int>(row.size() - 1u);
+			for (unsigned int i = 0; i < features; ++i)
+			{
+				values.push_back(static_cast<T>(row[i]));
+			}
+			classes.push_back(static_cast<unsigned int>(row[features]));
+		}
+		if (classes.empty())
+			return false;
+
+		const unsigned int count = static_cast<unsigned int>(classes.size());
+		const unsigned int arraySize[] = { count, features };
+		x = Ndarray<T>({ count, features });
+		std::copy(values.begin(), values.end(), x.GetData());
+		labels = Ndarray<unsigned int>(1u, count, arraySize, classes.data());
+		return true;
+	}
+
+	template<typename T>
+	Ndarray<T> Dataset<T>::OneHot(const Ndarray<unsigned int>& labels, const unsigned int& classCount)
+	{
+		if (labels.GetDimension() != 1u || classCount == 0u)
+			return Ndarray<T>();
+
+		Ndarray<T> t({ labels.GetTotalSize(), classCount }, 0);
+		for (size_t i = 0; i < labels.GetTotalSize(); ++i)
+		{
+			if (labels.At(i) < classCount)
+			{
+				t.At(i * classCount + labels.At(i)) = 1;
+			}
+		}
+		return t;
+	}
+
+	template<typename T>
+	void Dataset<T>::Split(const Ndarray<T>& x, const Ndarray<T>& t, const double& testFraction, const unsigned int& seed,
+		Ndarray<T>& xTrain, Ndarray<T>& xTest, Ndarray<T>& tTrain, Ndarray<T>& tTest)
+	{
+		const size_t count = x.GetDimension() == 0u ? 0 : x.GetArraySize(0);
+		std::vector<size_t> order(count);
+		std::iota(order.begin(), order.end(), size_t(0));
+		std::shuffle(order.begin(), order.end(), std::mt19937(seed));
+
+		const size_t testCount = std::min(count, static_cast<size_t>(std::ceil(testFraction * count)));
+		Numpy<T>::Take(xTest, x, order.data(), testCount);
+		Numpy<T>::Take(tTest, t, order.data(), testCount);
+		Numpy<T>::Take(xTrain, x, order.data() + testCount, count - testCount);
+		Numpy<T>::Take(tTrain, t, order.data() + testCount, count - testCount);
+	}
+}
@@ -0,0 +1,827 @@
+#pragma once
+#include<algorithm>
+#include<atomic>
+#include<cerrno>
+#include<condition_variable>
+#include<cstdint>
+#include<cstdlib>
+#include<cstring>
+#include<deque>
+#include<mutex>
+#include<new>
+#include<string>
+#include<thread>
+#include<type_traits>
+#include<utility>
+#include<vector>
+#include "Ndarray.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include<windows.h>
+#else
+#include<fcntl.h>
+#include<spawn.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<sys/wait.h>
+#include<unistd.h>
+
+extern char** environ;
+#endif
+
+namespace numpy
+{
+	// The processes of one data-parallel job on this host, exchanging data through a shared memory segment with no network
+	// involved. Each process owns a staging buffer in the segment, written only by itself and read only by itself and the next
+	// rank, and a progress counter the others wait on. AllReduce runs as a ring over those buffers: P - 1 reduce-scatter steps,
+	// each adding the previous rank's copy of one chunk into this rank's, then P - 1 all-gather steps passing the summed chunks
+	// on, so every process moves 2 (P - 1) / P of the data whatever the group size.
+	//
+	// The launching process is rank 0 and starts the others as copies of its own executable, which find the group through the
+	// NUMPY_GROUP_NAME and NUMPY_GROUP_RANK environment variables. Every process must make the same collective calls in the same
+	// order. Once a process has exited with a failure, or the launcher has gone, collective calls return false rather than
+	// waiting forever.
+	class ProcessGroup final
+	{
+	public:
+		// Starts a group of size processes: this one as rank 0, and size - 1 copies of this executable run with arguments. Unless
+		// NUMPY_NUM_THREADS is set, every process, this one included, gets hardware threads / size pool threads. In a process
+		// started by such a launch, joins that group instead, whatever size is. Collective calls stage up to bufferBytes per step.
+		explicit ProcessGroup(const unsigned int& size = 1, const std::vector<std::string>& arguments = {}, const size_t& bufferBytes = DEFAULT_BUFFER_BYTES);
+		ProcessGroup(const ProcessGroup& rhs) = delete;
+		ProcessGroup& operator=(const ProcessGroup& rhs) = delete;
+		// Joins the other processes when this one launched them.
+		~ProcessGroup();
+
+		// Whether this process was started by a ProcessGroup launch.
+		static bool IsWorker();
+
+		// false when the segment could not be created or mapped or a process could not be started; collective calls then fail.
+		bool IsValid() const;
+		unsigned int GetRank() const;
+		unsigned int GetSize() const;
+		// This rank's rows [begin, end) when rows are split as evenly as possible.
+		void GetShard(const size_t& rows, size_t& begin, size_t& end) const;
+
+		// Sums data over the group in place; every rank ends with the same bits.
+		template<typename T>
+		bool AllReduce(T* data, const size_t& count);
+		// The same over pieces summed as one vector, so small arrays share transfers.
+		template<typename T>
+		bool AllReduce(const std::vector<std::pair<T*, size_t>>& pieces);
+		// Copies root's data to every rank.
+		template<typename T>
+		bool Broadcast(T* data, const size_t& count, const unsigned int& root = 0);
+		bool Barrier();
+		// On the launcher, waits for the other processes and returns whether all of them exited with status 0; true elsewhere.
+		// The group is over afterwards and collective calls fail.
+		bool Join();
+
+		static constexpr size_t DEFAULT_BUFFER_BYTES = static_cast<size_t>(1) << 22;
+	private:
+		struct alignas(64) Counter
+		{
+			std::atomic<std::uint64_t> Value;
+		};
+
+		// Start of the segment, followed by one Counter per rank and then one buffer per rank.
+		struct alignas(64) Header
+		{
+			std::atomic<std::uint32_t> Failed;
+			std::uint32_t Size;
+			std::uint64_t BufferBytes;
+			std::uint64_t Launcher;
+			Counter Arrived;
+		};
+
+		static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::uint32_t>::is_always_lock_free,
+			"counters shared between processes must be lock-free");
+
+		bool create(const size_t& bufferBytes);
+		bool attach(const char* name, const unsigned int& rank);
+		bool map(const size_t& bytes);
+		bool launch(const std::vector<std::string>& arguments, const unsigned int& threadCount);
+		// Collects workers that have exited; with bBlock, waits for all of them.
+		void reapWorkers(const bool& bBlock);
+		Counter& progress(const unsigned int& rank) const;
+		char* buffer(const unsigned int& rank) const;
+		// Whether collective calls may still run.
+		bool isOpen() const;
+		bool isFailed();
+		// Waits until counter reaches value; false once the group has failed.
+		bool wait(const Counter& counter, const std::uint64_t& value);
+		// One ring all-reduce of elements [offset, offset + count) of the concatenated pieces, count fitting in a buffer.
+		template<typename T>
+		bool reduceWindow(const std::vector<std::pair<T*, size_t>>& pieces, const size_t& offset, const size_t& count);
+		// Copies elements [offset, offset + count) of the concatenated pieces to staging, or back from it.
+		template<typename T>
+		static void copyWindow(const std::vector<std::pair<T*, size_t>>& pieces, const size_t& offset, const size_t& count, T* staging, const bool& bGather);
+
+		unsigned int mRank;
+		unsigned int mSize;
+		bool mbValid;
+		bool mbJoined;
+		bool mbJoinResult;
+		std::string mName;
+		Header* mHeader;
+		size_t mSegmentBytes;
+		size_t mBufferBytes;
+		// Ring all-reduce windows and barriers this process has completed.
+		std::uint64_t mWindows;
+		std::uint64_t mBarriers;
+		// Exit status of each launched worker, -1 while it runs.
+		std::vector<int> mStatus;
+#ifdef _WIN32
+		HANDLE mMapping;
+		std::vector<HANDLE> mWorkers;
+		HANDLE mLauncher;
+#else
+		std::vector<pid_t> mWorkers;
+#endif
+	};
+
+	inline ProcessGroup::ProcessGroup(const unsigned int& size, const std::vector<std::string>& arguments, const size_t& bufferBytes)
+		: mRank(0)
+		, mSize(1)
+		, mbValid(true)
+		, mbJoined(false)
+		, mbJoinResult(true)
+		, mHeader(nullptr)
+		, mSegmentBytes(0)
+		, mBufferBytes(0)
+		, mWindows(0)
+		, mBarriers(0)
+#ifdef _WIN32
+		, mMapping(nullptr)
+		, mLauncher(nullptr)
+#endif
+	{
+		const char* name = std::getenv("NUMPY_GROUP_NAME");
+		const char* rank = std::getenv("NUMPY_GROUP_RANK");
+		if (name != nullptr && rank != nullptr)
+		{
+			mbValid = attach(name, static_cast<unsigned int>(std::strtoul(rank, nullptr, 10)));
+			return;
+		}
+		if (size <= 1u)
+			return;
+
+		mSize = size;
+		unsigned int threadCount = 0;
+		if (std::getenv("NUMPY_NUM_THREADS") == nullptr)
+		{
+			threadCount = std::max(1u, std::thread::hardware_concurrency() / size);
+			ThreadPool::Instance().SetThreadCount(threadCount);
+		}
+		mbValid = create(bufferBytes) && launch(arguments, threadCount);
+		if (!mbValid && mHeader != nullptr)
+		{
+			mHeader->Failed.store(1);
+		}
+	}
+
+	inline ProcessGroup::~ProcessGroup()
+	{
+		Join();
+		if (mHeader == nullptr)
+			return;
+#ifdef _WIN32
+		UnmapViewOfFile(mHeader);
+		CloseHandle(mMapping);
+		if (mLauncher != nullptr)
+		{
+			CloseHandle(mLauncher);
+		}
+#else
+		munmap(mHeader, mSegmentBytes);
+		if (mRank == 0)
+		{
+			shm_unlink(mName.c_str());
+		}
+#endif
+	}
+
+	inline bool ProcessGroup::IsWorker()
+	{
+		return std::getenv("NUMPY_GROUP_NAME") != nullptr && std::getenv("NUMPY_GROUP_RANK") != nullptr;
+	}
+
+	inline bool ProcessGroup::IsValid() const
+	{
+		return mbValid;
+	}
+
+	inline unsigned int ProcessGroup::GetRank() const
+	{
+		return mRank;
+	}
+
+	inline unsigned int ProcessGroup::GetSize() const
+	{
+		return mSize;
+	}
+
+	inline void ProcessGroup::GetShard(const size_t& rows, size_t& begin, size_t& end) const
+	{
+		begin = rows * mRank / mSize;
+		end = rows * (mRank + 1) / mSize;
+	}
+
+	template<typename T>
+	inline bool ProcessGroup::AllReduce(T* data, const size_t& count)
+	{
+		return AllReduce(std::vector<std::pair<T*, size_t>>{ { data, count } });
+	}
+
+	template<typename T>
+	bool ProcessGroup::AllReduce(const std::vector<std::pair<T*, size_t>>& pieces)
+	{
+		static_assert(std::is_arithmetic<T>::value, "AllReduce sums arithmetic elements");
+		if (!isOpen())
+			return false;
+		if (mSize == 1u)
+			return true;
+
+		size_t total = 0;
+		for (const std::pair<T*, size_t>& piece : pieces)
+		{
+			total += piece.second;
+		}
+		// A ring moves 2 (P - 1) / P of the data through each rank and adds (P - 1) / P of it.
+		NUMPY_PROFILE_SCOPE("ProcessGroup::AllReduce", static_cast<std::uint64_t>(total) * sizeof(T) * 2u * (mSize - 1u) / mSize,
+			static_cast<std::uint64_t>(total) * (mSize - 1u) / mSize);
+		const size_t window = mBufferBytes / sizeof(T);
+		for (size_t offset = 0; offset < total; offset += window)
+		{
+			if (!reduceWindow(pieces, offset, std::min(window, total - offset)))
+				return false;
+		}
+		return true;
+	}
+
+	template<typename T>
+	bool ProcessGroup::Broadcast(T* data, const size_t& count, const unsigned int& root)
+	{
+		if (!isOpen() || root >= mSize)
+			return false;
+		if (mSize == 1u)
+			return true;
+
+		// The first barrier of each window lets root overwrite its buffer, the second lets the others read it.
+		T* staging = reinterpret_cast<T*>(buffer(root));
+		const size_t window = mBufferBytes / sizeof(T);
+		for (size_t offset = 0; offset < count; offset += window)
+		{
+			const size_t size = std::min(window, count - offset);
+			if (!Barrier())
+				return false;
+			if (mRank == root)
+			{
+				std::copy(data + offset, data + offset + size, staging);
+			}
+			if (!Barrier())
+				return false;
+			if (mRank != root)
+			{
+				std::copy(staging, staging + size, data + offset);
+			}
+		}
+		return Barrier();
+	}
+
+	inline bool ProcessGroup::Barrier()
+	{
+		if (!isOpen())
+			return false;
+		if (mSize == 1u)
+			return true;
+
+		++mBarriers;
+		mHeader->Arrived.Value.fetch_add(1);
+		return wait(mHeader->Arrived, mBarriers * mSize);
+	}
+
+	inline bool ProcessGroup::Join()
+	{
+		if (mbJoined || mRank != 0 || mWorkers.empty())
+		{
+			mbJoined = true;
+			return mbJoinResult;
+		}
+
+		reapWorkers(true);
+		mbJoined = true;
+		for (const int& status : mStatus)
+		{
+			mbJoinResult = mbJoinResult && status == 0;
+		}
+		mHeader->Failed.store(1);
+		return mbJoinResult;
+	}
+
+	inline bool ProcessGroup::create(const size_t& bufferBytes)
+	{
+		static std::atomic<unsigned int> sequence(0);
+		// Whole cache lines, so no two ranks' buffers share one.
+		mBufferBytes = std::max<size_t>(64, (bufferBytes + 63) / 64 * 64);
+		const size_t bytes = sizeof(Header) + mSize * (sizeof(Counter) + mBufferBytes);
+#ifdef _WIN32
+		const unsigned long long process = GetCurrentProcessId();
+		mName = "Local\\numpy-group-" + std::to_string(process) + "-" + std::to_string(sequence++);
+		mMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(static_cast<unsigned long long>(bytes) >> 32),
+			static_cast<DWORD>(bytes), mName.c_str());
+		if (mMapping == nullptr)
+			return false;
+#else
+		const unsigned long long process = static_cast<unsigned long long>(getpid());
+		mName = "/numpy-group-" + std::to_string(process) + "-" + std::to_string(sequence++);
+		const int descriptor = shm_open(mName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (descriptor < 0)
+			return false;
+		const bool bSized = ftruncate(descriptor, static_cast<off_t>(bytes)) == 0;
+		if (bSized)
+		{
+			mHeader = static_cast<Header*>(mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0));
+		}
+		close(descriptor);
+		if (!bSized || mHeader == MAP_FAILED)
+		{
+			mHeader = nullptr;
+			shm_unlink(mName.c_str());
+			return false;
+		}
+		mSegmentBytes = bytes;
+#endif
+		if (!map(bytes))
+			return false;
+
+		// The segment starts zeroed; the counters are constructed over it before any worker exists.
+		new (mHeader) Header();
+		mHeader->Size = mSize;
+		mHeader->BufferBytes = mBufferBytes;
+		mHeader->Launcher = process;
+		for (unsigned int r = 0; r < mSize; ++r)
+		{
+			new (&progress(r)) Counter();
+		}
+		return true;
+	}
+
+	inline bool ProcessGroup::attach(const char* name, const unsigned int& rank)
+	{
+		mName = name;
+		mRank = rank;
+#ifdef _WIN32
+		mMapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+		if (mMapping == nullptr || !map(0))
+			return false;
+#else
+		const int descriptor = shm_open(name, O_RDWR, 0);
+		if (descriptor < 0)
+			return false;
+		struct stat status;
+		void* data = MAP_FAILED;
+		if (fstat(descriptor, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(Header))
+		{
+			mSegmentBytes = static_cast<size_t>(status.st_size);
+			data = mmap(nullptr, mSegmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+		}
+		close(descriptor);
+		if (data == MAP_FAILED)
+			return false;
+		mHeader = static_cast<Header*>(data);
+#endif
+		mSize = mHeader->Size;
+		mBufferBytes = static_cast<size_t>(mHeader->BufferBytes);
+		if (mRank >= mSize)
+			return false;
+#ifdef _WIN32
+		mLauncher = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(mHeader->Launcher));
+#else
+		// Started by the launcher, so a different parent means the launcher has gone.
+		if (static_cast<std::uint64_t>(getppid()) != mHeader->Launcher)
+			return false;
+#endif
+		return true;
+	}
+
+	inline bool ProcessGroup::map(const size_t& bytes)
+	{
+#ifdef _WIN32
+		void* data = MapViewOfFile(mMapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+		if (data == nullptr)
+			return false;
+		mHeader = static_cast<Header*>(data);
+		MEMORY_BASIC_INFORMATION region;
+		mSegmentBytes = VirtualQuery(data, &region, sizeof(region)) != 0 ? static_cast<size_t>(region.RegionSize) : bytes;
+		return true;
+#else
+		return mHeader != nullptr && mSegmentBytes >= bytes;
+#endif
+	}
+
+	inline bool ProcessGroup::launch(const std::vector<std::string>& arguments, const unsigned int& threadCount)
+	{
+		mStatus.assign(mSize - 1, -1);
+		const std::string group = "NUMPY_GROUP_NAME=" + mName;
+		const std::string threads = "NUMPY_NUM_THREADS=" + std::to_string(threadCount);
+#ifdef _WIN32
+		char path[MAX_PATH];
+		const DWORD length = GetModuleFileNameA(nullptr, path, MAX_PATH);
+		if (length == 0 || length == MAX_PATH)
+			return false;
+
+		// Quoted so that the child's argv splits back into the same strings: backslashes are doubled only before a quote.
+		const auto quote = [](const std::string& argument)
+		{
+			std::string quoted = "\"";
+			size_t backslashes = 0;
+			for (const char& c : argument)
+			{
+				if (c == '\\')
+				{
+					++backslashes;
+					continue;
+				}
+				quoted.append(c == '"' ? backslashes * 2 + 1 : backslashes, '\\');
+				quoted += c;
+				backslashes = 0;
+			}
+			quoted.append(backslashes * 2, '\\');
+			return quoted + '"';
+		};
+		std::string commandLine = quote(path);
+		for (const std::string& argument : arguments)
+		{
+			commandLine += ' ' + quote(argument);
+		}
+
+		// This process's environment without the variables set below, as "name=value\0" strings.
+		std::string environment;
+		char* strings = GetEnvironmentStringsA();
+		for (const char* variable = strings; variable != nullptr && *variable != '\0'; variable += std::strlen(variable) + 1)
+		{
+			if (std::strncmp(variable, "NUMPY_GROUP_", 12) != 0 && (threadCount == 0 || std::strncmp(variable, "NUMPY_NUM_THREADS=", 18) != 0))
+			{
+				environment.append(variable, std::strlen(variable) + 1);
+			}
+		}
+		FreeEnvironmentStringsA(strings);
+		environment.append(group.c_str(), group.size() + 1);
+		if (threadCount != 0)
+		{
+			environment.append(threads.c_str(), threads.size() + 1);
+		}
+
+		for (unsigned int r = 1; r < mSize; ++r)
+		{
+			const std::string rank = "NUMPY_GROUP_RANK=" + std::to_string(r);
+			std::string block = environment;
+			block.append(rank.c_str(), rank.size() + 1);
+			block += '\0';
+			std::string line = commandLine;
+			STARTUPINFOA startup = {};
+			startup.cb = sizeof(startup);
+			PROCESS_INFORMATION process = {};
+			if (!CreateProcessA(path, &line[0], nullptr, nullptr, FALSE, 0, &block[0], nullptr, &startup, &process))
+				return false;
+			CloseHandle(process.hThread);
+			mWorkers.push_back(process.hProcess);
+		}
+#else
+		char path[4096];
+		const ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+		if (length <= 0)
+			return false;
+		path[length] = '\0';
+
+		std::vector<char*> argv;
+		argv.push_back(path);
+		for (const std::string& argument : arguments)
+		{
+			argv.push_back(const_cast<char*>(argument.c_str()));
+		}
+		argv.push_back(nullptr);
+
+		std::vector<char*> environment;
+		for (char** variable = environ; *variable != nullptr; ++variable)
+		{
+			if (std::strncmp(*variable, "NUMPY_GROUP_", 12) != 0 && (threadCount == 0 || std::strncmp(*variable, "NUMPY_NUM_THREADS=", 18) != 0))
+			{
+				environment.push_back(*variable);
+			}
+		}
+		environment.push_back(const_cast<char*>(group.c_str()));
+		if (threadCount != 0)
+		{
+			environment.push_back(const_cast<char*>(threads.c_str()));
+		}
+		environment.push_back(nullptr);
+		environment.push_back(nullptr);
+
+		for (unsigned int r = 1; r < mSize; ++r)
+		{
+			const std::string rank = "NUMPY_GROUP_RANK=" + std::to_string(r);
+			environment[environment.size() - 2] = const_cast<char*>(rank.c_str());
+			pid_t worker = 0;
+			if (posix_spawn(&worker, path, nullptr, nullptr, argv.data(), environment.data()) != 0)
+				return false;
+			mWorkers.push_back(worker);
+		}
+#endif
+		return true;
+	}
+
+	inline void ProcessGroup::reapWorkers(const bool& bBlock)
+	{
+		for (size_t w = 0; w < mWorkers.size(); ++w)
+		{
+			if (mStatus[w] != -1)
+				continue;
+#ifdef _WIN32
+			if (WaitForSingleObject(mWorkers[w], bBlock ? INFINITE : 0) != WAIT_OBJECT_0)
+				continue;
+			DWORD code = 1;
+			GetExitCodeProcess(mWorkers[w], &code);
+			CloseHandle(mWorkers[w]);
+			mStatus[w] = code == 0 ? 0 : 1;
+#else
+			int status = 0;
+			const pid_t result = waitpid(mWorkers[w], &status, bBlock ? 0 : WNOHANG);
+			if (result == 0 || (result < 0 && errno == EINTR))
+				continue;
+			mStatus[w] = result > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+#endif
+			if (mStatus[w] != 0)
+			{
+				mHeader->Failed.store(1);
+			}
+		}
+	}
+
+	inline ProcessGroup::Counter& ProcessGroup::progress(const unsigned int& rank) const
+	{
+		return reinterpret_cast<Counter*>(reinterpret_cast<char*>(mHeader) + sizeof(Header))[rank];
+	}
+
+	inline char* ProcessGroup::buffer(const unsigned int& rank) const
+	{
+		return reinterpret_cast<char*>(mHeader) + sizeof(Header) + mSize * sizeof(Counter) + rank * mBufferBytes;
+	}
+
+	inline bool ProcessGroup::isOpen() const
+	{
+		return mbValid && !mbJoined && (mHeader == nullptr || mHeader->Failed.load() == 0);
+	}
+
+	inline bool ProcessGroup::isFailed()
+	{
+		if (mHeader->Failed.load() != 0)
+			return true;
+		if (mRank == 0)
+		{
+			reapWorkers(false);
+		}
+		else
+		{
+#ifdef _WIN32
+			if (mLauncher != nullptr && WaitForSingleObject(mLauncher, 0) == WAIT_OBJECT_0)
+				return true;
+#else
+			if (static_cast<std::uint64_t>(getppid()) != mHeader->Launcher)
+				return true;
+#endif
+		}
+		return mHeader->Failed.load() != 0;
+	}
+
+	inline bool ProcessGroup::wait(const Counter& counter, const std::uint64_t& value)
+	{
+		for (unsigned int spin = 0; counter.Value.load(std::memory_order_acquire) < value; ++spin)
+		{
+			// The processes may outnumber the CPUs, so after a short spin the time slice is given up.
+			if (spin < 64u)
+				continue;
+			if (spin % 1024u == 0u && isFailed())
+				return false;
+			std::this_thread::yield();
+		}
+		return true;
+	}
+
+	template<typename T>
+	bool ProcessGroup::reduceWindow(const std::vector<std::pair<T*, size_t>>& pieces, const size_t& offset, const size_t& count)
+	{
+		// Each window advances every rank's counter by 2P - 1: one for loading the buffer and one per ring step. Chunk c is
+		// [count * c / P, count * (c + 1) / P).
+		const std::uint64_t base = mWindows * (2 * mSize - 1);
+		++mWindows;
+		const unsigned int previous = (mRank + mSize - 1) % mSize;
+		const unsigned int next = (mRank + 1) % mSize;
+		Counter& own = progress(mRank);
+		T* staging = reinterpret_cast<T*>(buffer(mRank));
+		const T* left = reinterpret_cast<const T*>(buffer(previous));
+
+		// The next rank, the only other reader of this buffer, has finished the last window.
+		if (!wait(progress(next), base))
+			return false;
+		copyWindow(pieces, offset, count, staging, true);
+		own.Value.store(base + 1, std::memory_order_release);
+
+		// Reduce-scatter: step s adds the previous rank's partial sum of chunk rank - s, which it completed in its step s - 1.
+		// Afterwards this rank holds the full sum of chunk rank + 1.
+		for (unsigned int step = 1; step < mSize; ++step)
+		{
+			if (!wait(progress(previous), base + step))
+				return false;
+			const unsigned int chunk = (mRank + mSize - step) % mSize;
+			const size_t end = count * (chunk + 1) / mSize;
+			for (size_t i = count * chunk / mSize; i < end; ++i)
+			{
+				staging[i] += left[i];
+			}
+			own.Value.store(base + 1 + step, std::memory_order_release);
+		}
+
+		// All-gather: step s copies the summed chunk rank + 1 - s from the previous rank, once the next rank has read this rank's
+		// partial sum of that chunk in its reduce-scatter step s.
+		for (unsigned int step = 1; step < mSize; ++step)
+		{
+			if (!wait(progress(previous), base + mSize + step - 1) || !wait(progress(next), base + 1 + step))
+				return false;
+			const unsigned int chunk = (mRank + mSize + 1 - step) % mSize;
+			std::copy(left + count * chunk / mSize, left + count * (chunk + 1) / mSize, staging + count * chunk / mSize);
+			own.Value.store(base + mSize + step, std::memory_order_release);
+		}
+		copyWindow(pieces, offset, count, staging, false);
+		return true;
+	}
+
+	template<typename T>
+	void ProcessGroup::copyWindow(const std::vector<std::pair<T*, size_t>>& pieces, const size_t& offset, const size_t& count, T* staging, const bool& bGather)
+	{
+		size_t start = 0;
+		for (const std::pair<T*, size_t>& piece : pieces)
+		{
+			const size_t begin = std::max(start, offset);
+			const size_t end = std::min(start + piece.second, offset + count);
+			if (begin < end)
+			{
+				T* data = piece.first - start;
+				if (bGather)
+				{
+					std::copy(data + begin, data + end, staging + (begin - offset));
+				}
+				else
+				{
+					std::copy(staging + (begin - offset), staging + (end - offset), data + begin);
+				}
+			}
+			start += piece.second;
+			if (start >= offset + count)
+				break;
+		}
+	}
+
+	// Sums gradients over a ProcessGroup while backward is still running. Push hands over each gradient as soon as it is final;
+	// gradients are packed into buckets of about bucketBytes, and a full bucket is summed on a communication thread while the
+	// caller computes the gradients of earlier layers, so small gradients share one transfer and large ones overlap with compute.
+	template<typename T>
+	class GradientReducer final
+	{
+	public:
+		explicit GradientReducer(ProcessGroup& group, const size_t& bucketBytes = DEFAULT_BUCKET_BYTES);
+		GradientReducer(const GradientReducer& rhs) = delete;
+		GradientReducer& operator=(const GradientReducer& rhs) = delete;
+		~GradientReducer();
+
+		// gradient must be contiguous and left alone until Wait returns. Every process pushes gradients of the same sizes in the
+		// same order.
+		void Push(Ndarray<T>& gradient);
+		// Sends the last partial bucket and returns once every gradient pushed holds its sum over the group; false when the group
+		// has failed.
+		bool Wait();
+
+		static constexpr size_t DEFAULT_BUCKET_BYTES = static_cast<size_t>(1) << 18;
+	private:
+		using Bucket = std::vector<std::pair<T*, size_t>>;
+
+		void submit();
+		void communicationLoop();
+
+		ProcessGroup& mGroup;
+		size_t mBucketSize;
+		Bucket mFilling;
+		size_t mFillingSize;
+		std::deque<Bucket> mQueue;
+		// Buckets submitted and not yet summed.
+		size_t mOutstanding;
+		bool mbFailed;
+		bool mbStop;
+		std::mutex mMutex;
+		std::condition_variable mWakeCondition;
+		std::condition_variable mDoneCondition;
+		std::thread mThread;
+	};
+
+	template<typename T>
+	GradientReducer<T>::GradientReducer(ProcessGroup& group, const size_t& bucketBytes)
+		: mGroup(group)
+		, mBucketSize(std::max<size_t>(1, bucketBytes / sizeof(T)))
+		, mFillingSize(0)
+		, mOutstanding(0)
+		, mbFailed(!group.IsValid())
+		, mbStop(false)
+	{
+		if (group.GetSize() > 1u)
+		{
+			mThread = std::thread(&GradientReducer<T>::communicationLoop, this);
+		}
+	}
+
+	template<typename T>
+	GradientReducer<T>::~GradientReducer()
+	{
+		if (!mThread.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mbStop = true;
+		}
+		mWakeCondition.notify_one();
+		mThread.join();
+	}
+
+	template<typename T>
+	void GradientReducer<T>::Push(Ndarray<T>& gradient)
+	{
+		if (!mThread.joinable())
+			return;
+		mFilling.emplace_back(gradient.GetData(), gradient.GetTotalSize());
+		mFillingSize += gradient.GetTotalSize();
+		if (mFillingSize >= mBucketSize)
+		{
+			submit();
+		}
+	}
+
+	template<typename T>
+	bool GradientReducer<T>::Wait()
+	{
+		if (!mThread.joinable())
+			return !mbFailed;
+		if (!mFilling.empty())
+		{
+			submit();
+		}
+		std::unique_lock<std::mutex> lock(mMutex);
+		mDoneCondition.wait(lock, [this]() { return mOutstanding == 0; });
+		return !mbFailed;
+	}
+
+	template<typename T>
+	void GradientReducer<T>::submit()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mQueue.push_back(std::move(mFilling));
+			++mOutstanding;
+		}
+		mWakeCondition.notify_one();
+		mFilling.clear();
+		mFillingSize = 0;
+	}
+
+	template<typename T>
+	void GradientReducer<T>::communicationLoop()
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		while (true)
+		{
+			mWakeCondition.wait(lock, [this]() { return mbStop || !mQueue.empty(); });
+			if (mQueue.empty())
+				return;
+
+			const Bucket bucket = std::move(mQueue.front());
+			mQueue.pop_front();
+			const bool bFailed = mbFailed;
+			lock.unlock();
+			// After a failure the remaining buckets are dropped: the group cannot complete them.
+			const bool bReduced = !bFailed && mGroup.AllReduce(bucket);
+			lock.lock();
+			mbFailed = mbFailed || !bReduced;
+			if (--mOutstanding == 0)
+			{
+				mDoneCondition.notify_all();
+			}
+		}
+	}
+}
@@ -0,0 +1,469 @@
+#pragma once
+#include<algorithm>
+#include<iostream>
+#include<limits>
+#include<type_traits>
+#include<utility>
+#include "InlineArray.h"
+#include "Simd.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+namespace numpy
+{
+	template<typename T>
+	class Ndarray;
+
+	// CRTP base of Ndarray and of the lazy nodes the arithmetic operators build.
+	// Nodes hold arrays by reference, so an expression has to be evaluated (assigned, converted to an Ndarray or Eval()'d)
+	// before the arrays it names go out of scope; temporaries such as Numpy<T>::Dot(x, w) in Dot(x, w) + b live long enough
+	// when the whole expression is evaluated in the same statement.
+	template<typename E>
+	class Expression
+	{
+	public:
+		const E& Self() const
+		{
+			return static_cast<const E&>(*this);
+		}
+
+		// Materialises the expression in a single pass.
+		auto Eval() const
+		{
+			return Ndarray<typename E::ValueType>(Self());
+		}
+	};
+
+	template<typename E>
+	struct ExpressionOperand
+	{
+		using Type = const E;
+	};
+
+	template<typename T>
+	struct ExpressionOperand<Ndarray<T>>
+	{
+		using Type = const Ndarray<T>&;
+	};
+
+	// Evaluators are by-value snapshots of an expression (raw data pointers and scalars) taken right before the loop,
+	// so the compiler can keep them in registers instead of reloading them through the array objects after every store.
+	template<typename T>
+	struct ArrayEvaluator
+	{
+		const T* Data;
+
+		const T& At(const size_t& index) const
+		{
+			return Data[index];
+		}
+	};
+
+	template<typename T>
+	struct StridedEvaluator
+	{
+		const T* Data;
+		size_t Stride;
+
+		const T& At(const size_t& index) const
+		{
+			return Data[index * Stride];
+		}
+	};
+
+	template<typename S>
+	struct ScalarEvaluator
+	{
+		S Value;
+
+		const S& At(const size_t&) const
+		{
+			return Value;
+		}
+	};
+
+	template<ElementwiseOperation Op, typename V, typename LE, typename RE>
+	struct BinaryEvaluator
+	{
+		LE Lhs;
+		RE Rhs;
+
+		V At(const size_t& index) const
+		{
+			return static_cast<V>(simd::Apply<Op>(Lhs.At(index), Rhs.At(index)));
+		}
+	};
+
+	template<typename S>
+	class ScalarExpression final : public Expression<ScalarExpression<S>>
+	{
+	public:
+		using ValueType = S;
+		static constexpr bool IS_SCALAR = true;
+		static constexpr unsigned int OPERATIONS = 0;
+		static constexpr unsigned int ARRAYS = 0;
+
+		explicit ScalarExpression(const S& value)
+			: mValue(value)
+		{
+		}
+
+		bool IsValid() const { return true; }
+		template<typename V>
+		bool Overlaps(const Ndarray<V>&) const { return false; }
+		bool IsContiguous() const { return true; }
+		unsigned int GetDimension() const { return 0; }
+		size_t GetTotalSize() const { return 1; }
+		size_t GetArraySize(const unsigned int&) const { return 1; }
+		const S& GetValue() const { return mValue; }
+		ScalarEvaluator<S> GetEvaluator() const { return ScalarEvaluator<S>{ mValue }; }
+		ScalarEvaluator<S> GetRowEvaluator(const size_t*, const unsigned int&) const { return ScalarEvaluator<S>{ mValue }; }
+	private:
+		S mValue;
+	};
+
+	// Scalar loop over evaluator.At(i). Rows that fit use a 32-bit counter, which keeps the strided index arithmetic narrow.
+	template<typename Evaluator, typename T>
+	inline void FillRow(const Evaluator& evaluator, T* out, const size_t& size)
+	{
+		if (size <= std::numeric_limits<unsigned int>::max())
+		{
+			const unsigned int count = static_cast<unsigned int>(size);
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				out[i] = evaluator.At(i);
+			}
+			return;
+		}
+		for (size_t i = 0; i < size; ++i)
+		{
+			out[i] = evaluator.At(i);
+		}
+	}
+
+	// A single operation on two array rows covers the broadcasting cases that matter: equal rows and row vectors (stride 1),
+	// and column vectors or size-1 axes (stride 0, one value per row). Those run as SIMD kernels instead of the strided loop.
+	template<ElementwiseOperation Op, typename T>
+	inline void FillRow(const BinaryEvaluator<Op, T, StridedEvaluator<T>, StridedEvaluator<T>>& evaluator, T* out, const size_t& size)
+	{
+		const StridedEvaluator<T>& lhs = evaluator.Lhs;
+		const StridedEvaluator<T>& rhs = evaluator.Rhs;
+		if (lhs.Stride == 1 && rhs.Stride == 1)
+		{
+			ElementwiseKernel<T>::template Binary<Op>(lhs.Data, rhs.Data, out, size);
+		}
+		else if (lhs.Stride == 1 && rhs.Stride == 0)
+		{
+			ElementwiseKernel<T>::template Scalar<Op>(lhs.Data, *rhs.Data, out, size);
+		}
+		// Maximum is not swapped: with NaNs its result depends on the operand order.
+		else if (lhs.Stride == 0 && rhs.Stride == 1 && Op != ElementwiseOperation::Maximum)
+		{
+			ElementwiseKernel<T>::template Scalar<Op>(rhs.Data, *lhs.Data, out, size);
+		}
+		else
+		{
+			FillRow<decltype(evaluator), T>(evaluator, out, size);
+		}
+	}
+
+	template<ElementwiseOperation Op, typename T, typename S>
+	inline void FillRow(const BinaryEvaluator<Op, T, StridedEvaluator<T>, ScalarEvaluator<S>>& evaluator, T* out, const size_t& size)
+	{
+		if constexpr (std::is_same<decltype(simd::Apply<Op>(std::declval<T>(), std::declval<S>())), T>::value)
+		{
+			if (evaluator.Lhs.Stride == 1)
+			{
+				ElementwiseKernel<T>::template Scalar<Op>(evaluator.Lhs.Data, static_cast<T>(evaluator.Rhs.Value), out, size);
+				return;
+			}
+		}
+		FillRow<decltype(evaluator), T>(evaluator, out, size);
+	}
+
+	// Element-wise passes are split across the thread pool in blocks of this many elements once there are at least two blocks;
+	// anything smaller stays on the calling thread, where it costs less than a fork and join.
+	constexpr size_t ELEMENTWISE_GRAIN = size_t(1) << 15;
+
+	// body(begin, end) over [0, count), in parallel chunks of grain items when count is at least two chunks.
+	template<typename Body>
+	inline void ParallelElements(const size_t& count, const size_t& grain, const Body& body)
+	{
+		if (count < 2 * grain || ThreadPool::Instance().GetThreadCount() == 1u)
+		{
+			body(size_t(0), count);
+			return;
+		}
+		ThreadPool::Instance().ParallelFor(count, grain, body);
+	}
+
+	// Row-major walk for strided or broadcast sources: each output row asks the source for a row evaluator
+	// (per operand a pointer and an inner stride, 0 when the operand is broadcast along the row) and fills the row in one go,
+	// so index arithmetic is paid per row rather than per element. Large outputs are split into runs of rows. The shape and
+	// index live inline like an Ndarray's, so a pass of ordinary rank does not touch the heap.
+	template<typename E, typename T>
+	void EvaluateRows(const E& source, T* out)
+	{
+		using Index = InlineArray<size_t, Ndarray<T>::MAX_INLINE_DIMENSION>;
+		const unsigned int dimension = source.GetDimension();
+		if (source.GetTotalSize() == 0)
+			return;
+
+		Index arraySize(dimension == 0 ? 1u : dimension);
+		arraySize[0] = 1;
+		for (unsigned int i = 0; i < dimension; ++i)
+		{
+			arraySize[i] = source.GetArraySize(i);
+		}
+		const size_t columns = arraySize[arraySize.GetSize() - 1];
+		const size_t rows = source.GetTotalSize() / columns;
+
+		ParallelElements(rows, std::max<size_t>(1, ELEMENTWISE_GRAIN / columns), [&](size_t begin, size_t end)
+		{
+			Index index(arraySize.GetSize());
+			std::fill(index.Get(), index.Get() + index.GetSize(), size_t(0));
+			size_t rest = begin;
+			for (unsigned int axis = dimension == 0 ? 0u : dimension - 1; axis-- > 0;)
+			{
+				index[axis] = rest % arraySize[axis];
+				rest /= arraySize[axis];
+			}
+
+			for (size_t row = begin; row < end; ++row)
+			{
+				FillRow(source.GetRowEvaluator(index.Get(), dimension), out + row * columns, columns);
+
+				for (unsigned int axis = dimension == 0 ? 0u : dimension - 1; axis-- > 0;)
+				{
+					if (++index[axis] < arraySize[axis])
+						break;
+					index[axis] = 0;
+				}
+			}
+		});
+	}
+
+	template<ElementwiseOperation Op, typename L, typename R>
+	class BinaryExpression final : public Expression<BinaryExpression<Op, L, R>>
+	{
+	public:
+		using ValueType = typename std::conditional<L::IS_SCALAR, typename R::ValueType, typename L::ValueType>::type;
+		static constexpr bool IS_SCALAR = L::IS_SCALAR && R::IS_SCALAR;
+		// Operation nodes and array leaves, for the flops and bytes a profiled evaluation reports.
+		static constexpr unsigned int OPERATIONS = 1u + L::OPERATIONS + R::OPERATIONS;
+		static constexpr unsigned int ARRAYS = L::ARRAYS + R::ARRAYS;
+
+		BinaryExpression(const L& lhs, const R& rhs)
+			: mLhs(lhs)
+			, mRhs(rhs)
+		{
+		}
+
+		bool IsValid() const;
+		template<typename V>
+		bool Overlaps(const Ndarray<V>& target) const
+		{
+			return mLhs.Overlaps(target) || mRhs.Overlaps(target);
+		}
+		bool IsContiguous() const;
+		unsigned int GetDimension() const;
+		size_t GetTotalSize() const;
+		size_t GetArraySize(const unsigned int& axis) const;
+
+		auto GetEvaluator() const
+		{
+			using LE = decltype(mLhs.GetEvaluator());
+			using RE = decltype(mRhs.GetEvaluator());
+			return BinaryEvaluator<Op, ValueType, LE, RE>{ mLhs.GetEvaluator(), mRhs.GetEvaluator() };
+		}
+
+		// index has one entry per axis of a dimension-rank output; operands of lower rank are aligned to its last axes.
+		auto GetRowEvaluator(const size_t* index, const unsigned int& dimension) const
+		{
+			using LE = decltype(mLhs.GetRowEvaluator(index, dimension));
+			using RE = decltype(mRhs.GetRowEvaluator(index, dimension));
+			return BinaryEvaluator<Op, ValueType, LE, RE>{ mLhs.GetRowEvaluator(index, dimension), mRhs.GetRowEvaluator(index, dimension) };
+		}
+
+		// Writes all GetTotalSize() elements to out in row-major order: the SIMD kernels for a single array-array or
+		// array-scalar operation, one fused loop over the evaluator for anything longer, and rows for strided or broadcast operands.
+		void EvaluateTo(ValueType* out) const;
+	private:
+		template<typename O>
+		static size_t operandSize(const O& operand, const unsigned int& axis, const unsigned int& dimension);
+		bool isBroadcast() const;
+
+		typename ExpressionOperand<L>::Type mLhs;
+		typename ExpressionOperand<R>::Type mRhs;
+	};
+
+	// NumPy broadcasting: shapes are matched from the last axis, and a size of 1 or a missing leading axis stretches to the other side.
+	// Shapes whose broadcast result would not fit in size_t are rejected too.
+	template<ElementwiseOperation Op, typename L, typename R>
+	inline bool BinaryExpression<Op, L, R>::IsValid() const
+	{
+		if (!mLhs.IsValid() || !mRhs.IsValid())
+			return false;
+
+		const unsigned int dimension = GetDimension();
+		size_t totalSize = 1;
+		for (unsigned int i = 0; i < dimension; ++i)
+		{
+			const size_t lhsSize = operandSize(mLhs, i, dimension);
+			const size_t rhsSize = operandSize(mRhs, i, dimension);
+			if (lhsSize != rhsSize && lhsSize != 1 && rhsSize != 1)
+				return false;
+			const size_t size = lhsSize == 1 ? rhsSize : lhsSize;
+			if (size != 0 && totalSize > std::numeric_limits<size_t>::max() / sizeof(ValueType) / size)
+				return false;
+			totalSize *= size;
+		}
+
+		return true;
+	}
+
+	template<ElementwiseOperation Op, typename L, typename R>
+	inline bool BinaryExpression<Op, L, R>::IsContiguous() const
+	{
+		return mLhs.IsContiguous() && mRhs.IsContiguous() && !isBroadcast();
+	}
+
+	template<ElementwiseOperation Op, typename L, typename R>
+	inline unsigned int BinaryExpression<Op, L, R>::GetDimension() const
+	{
+		return mLhs.GetDimension() < mRhs.GetDimension() ? mRhs.GetDimension() : mLhs.GetDimension();
+	}
+
+	template<ElementwiseOperation Op, typename L, typename R>
+	inline size_t BinaryExpression<Op, L, R>::GetTotalSize() const
+	{
+		if (!isBroadcast())
+			return L::IS_SCALAR ? mRhs.GetTotalSize() : mLhs.GetTotalSize();
+
+		size_t totalSize = 1;
+		for (unsigned int i = 0; i < GetDimension(); ++i)
+		{
+			totalSize *= GetArraySize(i);
+		}
+		return totalSize;
+	}
+
+	template<ElementwiseOperation Op, typename L, typename R>
+	inline size_t BinaryExpression<Op, L, R>::GetArraySize(const unsigned int& axis) const
+	{
+		const unsigned int dimension = GetDimension();
+		const size_t lhsSize = operandSize(mLhs, axis, dimension);
+		return lhsSize == 1 ? operandSize(mRhs, axis, dimension) : lhsSize;
+	}
+
+	template<ElementwiseOperation Op, typename L, typename R>
+	template<typename O>
+	inline size_t BinaryExpression<Op, L, R>::operandSize(const O& operand, const unsigned int& axis, const unsigned int& dimension)
+	{
+		const unsigned int lead = dimension - operand.GetDimension();
+		return axis < lead ? 1 : operand.GetArraySize(axis - lead);
+	}
+
+	// True when an array operand has to be stretched, i.e. the operands cannot be walked as flat ranges of the same length.
+	template<ElementwiseOperation Op, typename L, typename R>
+	inline bool BinaryExpression<Op, L, R>::isBroadcast() const
+	{
+		if (L::IS_SCALAR || R::IS_SCALAR)
+			return false;
+		if (mLhs.GetDimension() != mRhs.GetDimension())
+			return true;
+		for (unsigned int i = 0; i < mLhs.GetDimension(); ++i)
+			if (mLhs.GetArraySize(i) != mRhs.GetArraySize(i))
+				return true;
+
+		return false;
+	}
+
+	template<ElementwiseOperation Op, typename L, typename R>
+	void BinaryExpression<Op, L, R>::EvaluateTo(ValueType* out) const
+	{
+		// Every array leaf is counted as read in full, broadcast ones included.
+		NUMPY_PROFILE_SCOPE("Expression::Evaluate", static_cast<std::uint64_t>(GetTotalSize()) * sizeof(ValueType) * (ARRAYS + 1u),
+			static_cast<std::uint64_t>(GetTotalSize()) * OPERATIONS);
+		if (!IsContiguous())
+		{
+			EvaluateRows(*this, out);
+			return;
+		}
+
+		ParallelElements(GetTotalSize(), ELEMENTWISE_GRAIN, [this, out](size_t begin, size_t end)
+		{
+			if constexpr (std::is_same<L, Ndarray<ValueType>>::value && std::is_same<R, Ndarray<ValueType>>::value)
+			{
+				ElementwiseKernel<ValueType>::template Binary<Op>(mLhs.GetData() + begin, mRhs.GetData() + begin, out + begin, end - begin);
+			}
+			else if constexpr (std::is_same<L, Ndarray<ValueType>>::value && R::IS_SCALAR
+				&& std::is_same<decltype(simd::Apply<Op>(std::declval<ValueType>(), std::declval<typename R::ValueType>())), ValueType>::value)
+			{
+				ElementwiseKernel<ValueType>::template Scalar<Op>(mLhs.GetData() + begin, static_cast<ValueType>(mRhs.GetValue()), out + begin, end - begin);
+			}
+			else
+			{
+				const auto evaluator = GetEvaluator();
+				for (size_t i = begin; i < end; ++i)
+				{
+					out[i] = evaluator.At(i);
+				}
+			}
+		});
+	}
+
+	template<typename L, typename R>
+	inline BinaryExpression<ElementwiseOperation::Add, L, R> operator+(const Expression<L>& lhs, const Expression<R>& rhs)
+	{
+		return BinaryExpression<ElementwiseOperation::Add, L, R>(lhs.Self(), rhs.Self());
+	}
+
+	template<typename L>
+	inline BinaryExpression<ElementwiseOperation::Add, L, ScalarExpression<int>> operator+(const Expression<L>& lhs, const int& rhs)
+	{
+		return BinaryExpression<ElementwiseOperation::Add, L, ScalarExpression<int>>(lhs.Self(), ScalarExpression<int>(rhs));
+	}
+
+	template<typename L>
+	inline BinaryExpression<ElementwiseOperation::Add, L, ScalarExpression<float>> operator+(const Expression<L>& lhs, const float& rhs)
+	{
+		return BinaryExpression<ElementwiseOperation::Add, L, ScalarExpression<float>>(lhs.Self(), ScalarExpression<float>(rhs));
+	}
+
+	template<typename L, typename R>
+	inline BinaryExpression<ElementwiseOperation::Multiply, L, R> operator*(const Expression<L>& lhs, const Expression<R>& rhs)
+	{
+		return BinaryExpression<ElementwiseOperation::Multiply, L, R>(lhs.Self(), rhs.Self());
+	}
+
+	template<typename L>
+	inline BinaryExpression<ElementwiseOperation::Multiply, L, ScalarExpression<int>> operator*(const Expression<L>& lhs, const int& rhs)
+	{
+		return BinaryExpression<ElementwiseOperation::Multiply, L, ScalarExpression<int>>(lhs.Self(), ScalarExpression<int>(rhs));
+	}
+
+	template<typename L>
+	inline BinaryExpression<ElementwiseOperation::Multiply, L, ScalarExpression<float>> operator*(const Expression<L>& lhs, const float& rhs)
+	{
+		return BinaryExpression<ElementwiseOperation::Multiply, L, ScalarExpression<float>>(lhs.Self(), ScalarExpression<float>(rhs));
+	}
+
+	template<typename L, typename R>
+	inline bool operator==(const Expression<L>& lhs, const Expression<R>& rhs)
+	{
+		return lhs.Eval() == rhs.Eval();
+	}
+
+	template<typename L, typename R>
+	inline bool operator!=(const Expression<L>& lhs, const Expression<R>& rhs)
+	{
+		return !(lhs == rhs);
+	}
+
+	template<typename E>
+	inline std::ostream& operator<<(std::ostream& os, const Expression<E>& rhs)
+	{
+		return os << rhs.Eval();
+	}
+}
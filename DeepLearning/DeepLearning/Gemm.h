@@ -0,0 +1,571 @@
+#pragma once
+#include<algorithm>
+#include<type_traits>
+#include<vector>
+#include "Half.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+namespace numpy
+{
+	// Work folded into Gemm::Multiply so that neither an operand nor the result has to be traversed a second time.
+	template<typename T>
+	struct GemmFusion
+	{
+		// Elements of a (b) whose mask entry is not positive are read as 0 while packing. A mask is addressed with its
+		// operand's strides; a ReLU output used as the mask applies the ReLU derivative.
+		const T* MaskA = nullptr;
+		const T* MaskB = nullptr;
+		// Added to every row of c (length n), then ReLU, after the last k block while the tile is still in the accumulators.
+		const T* Bias = nullptr;
+		bool bRelu = false;
+	};
+
+	// Blocked matrix multiplication in the Goto/BLIS style:
+	// B is packed into KC x NC panels that stay in L2/L3, A into MC x KC blocks that stay in L2,
+	// and an MR x NR micro-kernel keeps its accumulators in registers while streaming both packed panels from L1.
+	// For a float Compute the micro-kernel follows Simd::GetLevel(): 8 x 32 with AVX-512 and 6 x 16 with AVX2 and FMA, each
+	// wide enough to keep both FMA ports busy; other levels and types use the portable MR x NR loop.
+	// Operands are packed into ComputeType<T>, so BFloat16 and Float16 are read at half the bandwidth but multiplied and
+	// summed in float; their partial sums stay in float across k blocks and are rounded to T once.
+	template<typename T>
+	class Gemm final
+	{
+	public:
+		using Compute = typename ComputeType<T>::Type;
+
+		Gemm() = delete;
+		~Gemm() = delete;
+
+		// c[m x n] = a[m x k] * b[k x n]. a and b are addressed through element strides, so transposed and sliced
+		// views are packed straight from their storage; c is row-major with leading dimension ldc.
+		// Sizes and strides are 64-bit; counters inside a block stay 32-bit since blocks are at most MC x KC x NC.
+		static void Multiply(const size_t& m, const size_t& n, const size_t& k,
+			const T* a, const size_t& rowStrideA, const size_t& columnStrideA,
+			const T* b, const size_t& rowStrideB, const size_t& columnStrideB,
+			T* c, const size_t& ldc, const GemmFusion<T>& fusion = GemmFusion<T>());
+		// c[i] = a[i] * b[i] for i < batch, each as in Multiply, the matrices of an operand batchStride elements apart.
+		// A batchStrideB of 0 shares one b across the batch: each B panel is packed once and used for every entry.
+		static void MultiplyBatched(const size_t& batch, const size_t& m, const size_t& n, const size_t& k,
+			const T* a, const size_t& batchStrideA, const size_t& rowStrideA, const size_t& columnStrideA,
+			const T* b, const size_t& batchStrideB, const size_t& rowStrideB, const size_t& columnStrideB,
+			T* c, const size_t& batchStrideC, const size_t& ldc, const GemmFusion<T>& fusion = GemmFusion<T>());
+
+		// Tile of the portable micro-kernel; MAX_MR and MAX_NR bound the tiles of every level.
+		static constexpr unsigned int MR = 4;
+		static constexpr unsigned int NR = 8;
+		static constexpr unsigned int MAX_MR = 8;
+		static constexpr unsigned int MAX_NR = 32;
+		static constexpr unsigned int MC = 128;
+		static constexpr unsigned int KC = 256;
+		static constexpr unsigned int NC = 4096;
+		// Below this many multiply-adds the whole product runs on the calling thread.
+		static constexpr unsigned long long PARALLEL_THRESHOLD = 1ull << 18;
+	private:
+		// The micro-kernel of one level: Tile sums the kc rank-1 updates of an Mr-row sliver of packed A and an Nr-column sliver
+		// of packed B into acc, Mr x Nr row-major. Both operands are packed for the tile of the kernel in use.
+		struct Kernel
+		{
+			unsigned int Mr;
+			unsigned int Nr;
+			void (*Tile)(const unsigned int& kc, const Compute* packedA, const Compute* packedB, Compute* acc);
+		};
+
+		static Kernel kernel();
+		static void scalarTile(const unsigned int& kc, const Compute* packedA, const Compute* packedB, Compute* acc);
+
+		// Multiply writing c as C, which is T or, for partial sums of a storage-only T, Compute. With batch > 1 it computes
+		// batch products sharing b, the entries of a and c batchStrideA and batchStrideC elements apart.
+		template<typename C>
+		static void multiply(const size_t& m, const size_t& n, const size_t& k,
+			const T* a, const size_t& rowStrideA, const size_t& columnStrideA,
+			const T* b, const size_t& rowStrideB, const size_t& columnStrideB,
+			C* c, const size_t& ldc, const GemmFusion<T>& fusion,
+			const size_t& batch = 1, const size_t& batchStrideA = 0, const size_t& batchStrideC = 0);
+		static void packA(const unsigned int& mc, const unsigned int& kc, const T* a, const size_t& rowStride, const size_t& columnStride,
+			const T* mask, const unsigned int& tileRows, Compute* buffer);
+		static void packB(const unsigned int& kc, const unsigned int& nc, const T* b, const size_t& rowStride, const size_t& columnStride,
+			const T* mask, const unsigned int& tileColumns, Compute* buffer);
+		template<typename C>
+		static void macroKernel(const Kernel& kernel, const unsigned int& mc, const unsigned int& nBegin, const unsigned int& nEnd,
+			const unsigned int& kc, const Compute* packedA, const Compute* packedB, C* c, const size_t& ldc, const bool& bAccumulate,
+			const T* bias, const bool& bRelu);
+		template<typename C>
+		static void microKernel(const Kernel& kernel, const unsigned int& kc, const Compute* packedA, const Compute* packedB, C* c,
+			const size_t& ldc, const unsigned int& mr, const unsigned int& nr, const bool& bAccumulate, const T* bias, const bool& bRelu);
+
+		template<typename U>
+		static U* threadBuffer(std::vector<U>& buffer, const size_t& size);
+	};
+
+	namespace simd
+	{
+#if NUMPY_SIMD_X86
+		// 8 x 32 float tile: 16 ZMM accumulators, two B vectors per k and a broadcast of each A value. The accumulators are named
+		// rather than an array so that they stay in registers without relying on the loop over rows being unrolled.
+		NUMPY_TARGET_AVX512 inline void Avx512GemmTile(const unsigned int& kc, const float* a, const float* b, float* acc)
+		{
+			__m512 sum00 = _mm512_setzero_ps();
+			__m512 sum01 = _mm512_setzero_ps();
+			__m512 sum10 = _mm512_setzero_ps();
+			__m512 sum11 = _mm512_setzero_ps();
+			__m512 sum20 = _mm512_setzero_ps();
+			__m512 sum21 = _mm512_setzero_ps();
+			__m512 sum30 = _mm512_setzero_ps();
+			__m512 sum31 = _mm512_setzero_ps();
+			__m512 sum40 = _mm512_setzero_ps();
+			__m512 sum41 = _mm512_setzero_ps();
+			__m512 sum50 = _mm512_setzero_ps();
+			__m512 sum51 = _mm512_setzero_ps();
+			__m512 sum60 = _mm512_setzero_ps();
+			__m512 sum61 = _mm512_setzero_ps();
+			__m512 sum70 = _mm512_setzero_ps();
+			__m512 sum71 = _mm512_setzero_ps();
+			for (unsigned int p = 0; p < kc; ++p, a += 8, b += 32)
+			{
+				const __m512 b0 = _mm512_loadu_ps(b);
+				const __m512 b1 = _mm512_loadu_ps(b + 16);
+				const __m512 a0 = _mm512_set1_ps(a[0]);
+				sum00 = _mm512_fmadd_ps(a0, b0, sum00);
+				sum01 = _mm512_fmadd_ps(a0, b1, sum01);
+				const __m512 a1 = _mm512_set1_ps(a[1]);
+				sum10 = _mm512_fmadd_ps(a1, b0, sum10);
+				sum11 = _mm512_fmadd_ps(a1, b1, sum11);
+				const __m512 a2 = _mm512_set1_ps(a[2]);
+				sum20 = _mm512_fmadd_ps(a2, b0, sum20);
+				sum21 = _mm512_fmadd_ps(a2, b1, sum21);
+				const __m512 a3 = _mm512_set1_ps(a[3]);
+				sum30 = _mm512_fmadd_ps(a3, b0, sum30);
+				sum31 = _mm512_fmadd_ps(a3, b1, sum31);
+				const __m512 a4 = _mm512_set1_ps(a[4]);
+				sum40 = _mm512_fmadd_ps(a4, b0, sum40);
+				sum41 = _mm512_fmadd_ps(a4, b1, sum41);
+				const __m512 a5 = _mm512_set1_ps(a[5]);
+				sum50 = _mm512_fmadd_ps(a5, b0, sum50);
+				sum51 = _mm512_fmadd_ps(a5, b1, sum51);
+				const __m512 a6 = _mm512_set1_ps(a[6]);
+				sum60 = _mm512_fmadd_ps(a6, b0, sum60);
+				sum61 = _mm512_fmadd_ps(a6, b1, sum61);
+				const __m512 a7 = _mm512_set1_ps(a[7]);
+				sum70 = _mm512_fmadd_ps(a7, b0, sum70);
+				sum71 = _mm512_fmadd_ps(a7, b1, sum71);
+			}
+			_mm512_storeu_ps(acc + 0, sum00);
+			_mm512_storeu_ps(acc + 16, sum01);
+			_mm512_storeu_ps(acc + 32, sum10);
+			_mm512_storeu_ps(acc + 48, sum11);
+			_mm512_storeu_ps(acc + 64, sum20);
+			_mm512_storeu_ps(acc + 80, sum21);
+			_mm512_storeu_ps(acc + 96, sum30);
+			_mm512_storeu_ps(acc + 112, sum31);
+			_mm512_storeu_ps(acc + 128, sum40);
+			_mm512_storeu_ps(acc + 144, sum41);
+			_mm512_storeu_ps(acc + 160, sum50);
+			_mm512_storeu_ps(acc + 176, sum51);
+			_mm512_storeu_ps(acc + 192, sum60);
+			_mm512_storeu_ps(acc + 208, sum61);
+			_mm512_storeu_ps(acc + 224, sum70);
+			_mm512_storeu_ps(acc + 240, sum71);
+		}
+
+		// 6 x 16 float tile: 12 YMM accumulators, the most that leave room for the B vectors and the broadcast.
+		NUMPY_TARGET_AVX2_FMA inline void Avx2GemmTile(const unsigned int& kc, const float* a, const float* b, float* acc)
+		{
+			__m256 sum00 = _mm256_setzero_ps();
+			__m256 sum01 = _mm256_setzero_ps();
+			__m256 sum10 = _mm256_setzero_ps();
+			__m256 sum11 = _mm256_setzero_ps();
+			__m256 sum20 = _mm256_setzero_ps();
+			__m256 sum21 = _mm256_setzero_ps();
+			__m256 sum30 = _mm256_setzero_ps();
+			__m256 sum31 = _mm256_setzero_ps();
+			__m256 sum40 = _mm256_setzero_ps();
+			__m256 sum41 = _mm256_setzero_ps();
+			__m256 sum50 = _mm256_setzero_ps();
+			__m256 sum51 = _mm256_setzero_ps();
+			for (unsigned int p = 0; p < kc; ++p, a += 6, b += 16)
+			{
+				const __m256 b0 = _mm256_loadu_ps(b);
+				const __m256 b1 = _mm256_loadu_ps(b + 8);
+				const __m256 a0 = _mm256_broadcast_ss(a + 0);
+				sum00 = _mm256_fmadd_ps(a0, b0, sum00);
+				sum01 = _mm256_fmadd_ps(a0, b1, sum01);
+				const __m256 a1 = _mm256_broadcast_ss(a + 1);
+				sum10 = _mm256_fmadd_ps(a1, b0, sum10);
+				sum11 = _mm256_fmadd_ps(a1, b1, sum11);
+				const __m256 a2 = _mm256_broadcast_ss(a + 2);
+				sum20 = _mm256_fmadd_ps(a2, b0, sum20);
+				sum21 = _mm256_fmadd_ps(a2, b1, sum21);
+				const __m256 a3 = _mm256_broadcast_ss(a + 3);
+				sum30 = _mm256_fmadd_ps(a3, b0, sum30);
+				sum31 = _mm256_fmadd_ps(a3, b1, sum31);
+				const __m256 a4 = _mm256_broadcast_ss(a + 4);
+				sum40 = _mm256_fmadd_ps(a4, b0, sum40);
+				sum41 = _mm256_fmadd_ps(a4, b1, sum41);
+				const __m256 a5 = _mm256_broadcast_ss(a + 5);
+				sum50 = _mm256_fmadd_ps(a5, b0, sum50);
+				sum51 = _mm256_fmadd_ps(a5, b1, sum51);
+			}
+			_mm256_storeu_ps(acc + 0, sum00);
+			_mm256_storeu_ps(acc + 8, sum01);
+			_mm256_storeu_ps(acc + 16, sum10);
+			_mm256_storeu_ps(acc + 24, sum11);
+			_mm256_storeu_ps(acc + 32, sum20);
+			_mm256_storeu_ps(acc + 40, sum21);
+			_mm256_storeu_ps(acc + 48, sum30);
+			_mm256_storeu_ps(acc + 56, sum31);
+			_mm256_storeu_ps(acc + 64, sum40);
+			_mm256_storeu_ps(acc + 72, sum41);
+			_mm256_storeu_ps(acc + 80, sum50);
+			_mm256_storeu_ps(acc + 88, sum51);
+		}
+#endif
+	}
+
+	template<typename T>
+	typename Gemm<T>::Kernel Gemm<T>::kernel()
+	{
+#if NUMPY_SIMD_X86
+		if constexpr (std::is_same<Compute, float>::value)
+		{
+			const SimdLevel level = Simd::GetLevel();
+			if (level == SimdLevel::AVX512)
+				return Kernel{ 8, 32, simd::Avx512GemmTile };
+			if (level == SimdLevel::AVX2 && Simd::IsFmaSupported())
+				return Kernel{ 6, 16, simd::Avx2GemmTile };
+		}
+#endif
+		return Kernel{ MR, NR, scalarTile };
+	}
+
+	template<typename T>
+	void Gemm<T>::scalarTile(const unsigned int& kc, const Compute* packedA, const Compute* packedB, Compute* acc)
+	{
+		// Fixed trip counts let the compiler keep sums in vector registers and unroll the rank-1 updates.
+		Compute sums[MR][NR] = {};
+		for (unsigned int p = 0; p < kc; ++p)
+		{
+			for (unsigned int i = 0; i < MR; ++i)
+			{
+				const Compute valueA = packedA[i];
+				for (unsigned int j = 0; j < NR; ++j)
+				{
+					sums[i][j] += valueA * packedB[j];
+				}
+			}
+			packedA += MR;
+			packedB += NR;
+		}
+		for (unsigned int i = 0; i < MR; ++i)
+		{
+			std::copy(sums[i], sums[i] + NR, acc + i * NR);
+		}
+	}
+
+	template<typename T>
+	void Gemm<T>::Multiply(const size_t& m, const size_t& n, const size_t& k,
+		const T* a, const size_t& rowStrideA, const size_t& columnStrideA,
+		const T* b, const size_t& rowStrideB, const size_t& columnStrideB,
+		T* c, const size_t& ldc, const GemmFusion<T>& fusion)
+	{
+		if constexpr (!std::is_same<T, Compute>::value)
+		{
+			if (k > KC && m != 0 && n != 0)
+			{
+				// c would round every k block's partial sum to T, so they are kept in a Compute buffer and rounded once.
+				static thread_local std::vector<Compute> sPartial;
+				Compute* partial = threadBuffer(sPartial, m * n);
+				multiply(m, n, k, a, rowStrideA, columnStrideA, b, rowStrideB, columnStrideB, partial, n, fusion);
+				for (size_t i = 0; i < m; ++i)
+				{
+					std::copy(partial + i * n, partial + (i + 1) * n, c + i * ldc);
+				}
+				return;
+			}
+		}
+		multiply(m, n, k, a, rowStrideA, columnStrideA, b, rowStrideB, columnStrideB, c, ldc, fusion);
+	}
+
+	template<typename T>
+	void Gemm<T>::MultiplyBatched(const size_t& batch, const size_t& m, const size_t& n, const size_t& k,
+		const T* a, const size_t& batchStrideA, const size_t& rowStrideA, const size_t& columnStrideA,
+		const T* b, const size_t& batchStrideB, const size_t& rowStrideB, const size_t& columnStrideB,
+		T* c, const size_t& batchStrideC, const size_t& ldc, const GemmFusion<T>& fusion)
+	{
+		if (batch == 0 || m == 0 || n == 0)
+			return;
+		const bool bSharedB = batchStrideB == 0 || batch == 1;
+		if (bSharedB && (batch == 1 || (batchStrideA == m * rowStrideA && batchStrideC == m * ldc)))
+		{
+			// Entries of a and c that continue each other row after row are one taller product.
+			Multiply(batch * m, n, k, a, rowStrideA, columnStrideA, b, rowStrideB, columnStrideB, c, ldc, fusion);
+			return;
+		}
+		if (bSharedB && (std::is_same<T, Compute>::value || k <= KC))
+		{
+			multiply(m, n, k, a, rowStrideA, columnStrideA, b, rowStrideB, columnStrideB, c, ldc, fusion, batch, batchStrideA, batchStrideC);
+			return;
+		}
+
+		// Each entry has its own b: small products run whole on separate threads, larger ones in turn with their own parallelism.
+		auto entry = [&](size_t i)
+		{
+			GemmFusion<T> entryFusion = fusion;
+			entryFusion.MaskA = fusion.MaskA != nullptr ? fusion.MaskA + i * batchStrideA : nullptr;
+			entryFusion.MaskB = fusion.MaskB != nullptr ? fusion.MaskB + i * batchStrideB : nullptr;
+			Multiply(m, n, k, a + i * batchStrideA, rowStrideA, columnStrideA, b + i * batchStrideB, rowStrideB, columnStrideB,
+				c + i * batchStrideC, ldc, entryFusion);
+		};
+		ThreadPool& pool = ThreadPool::Instance();
+		const double work = static_cast<double>(m) * n * std::max<size_t>(k, 1);
+		if (work < PARALLEL_THRESHOLD && work * batch >= PARALLEL_THRESHOLD && pool.GetThreadCount() > 1)
+		{
+			const size_t grain = std::max<size_t>(1, static_cast<size_t>(PARALLEL_THRESHOLD / 8 / work));
+			pool.ParallelFor(batch, grain, [&entry](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					entry(i);
+				}
+			});
+			return;
+		}
+		for (size_t i = 0; i < batch; ++i)
+		{
+			entry(i);
+		}
+	}
+
+	template<typename T>
+	template<typename C>
+	void Gemm<T>::multiply(const size_t& m, const size_t& n, const size_t& k,
+		const T* a, const size_t& rowStrideA, const size_t& columnStrideA,
+		const T* b, const size_t& rowStrideB, const size_t& columnStrideB,
+		C* c, const size_t& ldc, const GemmFusion<T>& fusion,
+		const size_t& batch, const size_t& batchStrideA, const size_t& batchStrideC)
+	{
+		if (m == 0 || n == 0 || batch == 0)
+			return;
+		if (k == 0)
+		{
+			for (size_t e = 0; e < batch; ++e)
+			{
+				for (size_t i = 0; i < m; ++i)
+				{
+					for (size_t j = 0; j < n; ++j)
+					{
+						const Compute value = fusion.Bias != nullptr ? static_cast<Compute>(fusion.Bias[j]) : static_cast<Compute>(0);
+						c[e * batchStrideC + i * ldc + j] = static_cast<C>(fusion.bRelu && value < 0 ? static_cast<Compute>(0) : value);
+					}
+				}
+			}
+			return;
+		}
+
+		ThreadPool& pool = ThreadPool::Instance();
+		const bool bParallel = static_cast<double>(m) * n * k * batch >= PARALLEL_THRESHOLD && pool.GetThreadCount() > 1;
+
+		// Read once, so every block of this product is packed for and run by the same kernel.
+		const Kernel tile = kernel();
+		static thread_local std::vector<Compute> sPackedB;
+		const unsigned int ncMax = static_cast<unsigned int>(std::min<size_t>(NC, (n + tile.Nr - 1) / tile.Nr * tile.Nr));
+		const unsigned int kcMax = static_cast<unsigned int>(std::min<size_t>(KC, k));
+		Compute* packedB = threadBuffer(sPackedB, static_cast<size_t>(ncMax) * kcMax);
+
+		for (size_t jc = 0; jc < n; jc += NC)
+		{
+			const unsigned int nc = static_cast<unsigned int>(std::min<size_t>(NC, n - jc));
+			const unsigned int panelCount = (nc + tile.Nr - 1) / tile.Nr;
+
+			for (size_t pc = 0; pc < k; pc += KC)
+			{
+				const unsigned int kc = static_cast<unsigned int>(std::min<size_t>(KC, k - pc));
+				const bool bAccumulate = pc != 0;
+				const bool bLast = pc + kc == k;
+				const T* bias = bLast && fusion.Bias != nullptr ? fusion.Bias + jc : nullptr;
+				const bool bRelu = bLast && fusion.bRelu;
+
+				const size_t offsetB = pc * rowStrideB + jc * columnStrideB;
+				packB(kc, nc, b + offsetB, rowStrideB, columnStrideB, fusion.MaskB != nullptr ? fusion.MaskB + offsetB : nullptr, tile.Nr, packedB);
+
+				// Tasks are MC row blocks of every entry, further split along N when there are fewer row blocks than threads
+				// (tall-skinny B, short A).
+				const size_t entryBlockCount = (m + MC - 1) / MC;
+				const size_t blockCount = entryBlockCount * batch;
+				unsigned int chunkCount = 1;
+				if (bParallel && blockCount < pool.GetThreadCount())
+				{
+					chunkCount = std::min(panelCount, static_cast<unsigned int>((pool.GetThreadCount() + blockCount - 1) / blockCount));
+				}
+				const unsigned int panelsPerChunk = (panelCount + chunkCount - 1) / chunkCount;
+				chunkCount = (panelCount + panelsPerChunk - 1) / panelsPerChunk;
+
+				auto task = [&](size_t t)
+				{
+					static thread_local std::vector<Compute> sPackedA;
+
+					const size_t block = t / chunkCount;
+					const size_t entry = block / entryBlockCount;
+					const size_t ic = (block % entryBlockCount) * MC;
+					const unsigned int mc = static_cast<unsigned int>(std::min<size_t>(MC, m - ic));
+					const unsigned int nBegin = static_cast<unsigned int>(t % chunkCount) * panelsPerChunk * tile.Nr;
+					const unsigned int nEnd = std::min(nc, nBegin + panelsPerChunk * tile.Nr);
+
+					// MC is not a multiple of every tile height, so the last sliver may run past it.
+					Compute* packedA = threadBuffer(sPackedA, static_cast<size_t>(MC + MAX_MR) * KC);
+					const size_t offsetA = entry * batchStrideA + ic * rowStrideA + pc * columnStrideA;
+					packA(mc, kc, a + offsetA, rowStrideA, columnStrideA, fusion.MaskA != nullptr ? fusion.MaskA + offsetA : nullptr, tile.Mr, packedA);
+					macroKernel(tile, mc, nBegin, nEnd, kc, packedA, packedB, c + entry * batchStrideC + ic * ldc + jc, ldc, bAccumulate, bias, bRelu);
+				};
+
+				if (bParallel)
+				{
+					pool.ParallelFor(blockCount * chunkCount, 1, [&task](size_t begin, size_t end)
+					{
+						for (size_t t = begin; t < end; ++t)
+						{
+							task(t);
+						}
+					});
+				}
+				else
+				{
+					for (size_t t = 0; t < blockCount * chunkCount; ++t)
+					{
+						task(t);
+					}
+				}
+			}
+		}
+	}
+
+	template<typename T>
+	void Gemm<T>::packA(const unsigned int& mc, const unsigned int& kc, const T* a, const size_t& rowStride, const size_t& columnStride,
+		const T* mask, const unsigned int& tileRows, Compute* buffer)
+	{
+		// tileRows-row slivers stored column by column, the last sliver zero padded.
+		for (unsigned int i = 0; i < mc; i += tileRows)
+		{
+			const unsigned int mr = std::min(tileRows, mc - i);
+			for (unsigned int p = 0; p < kc; ++p)
+			{
+				for (unsigned int r = 0; r < mr; ++r)
+				{
+					const size_t index = static_cast<size_t>(i + r) * rowStride + static_cast<size_t>(p) * columnStride;
+					buffer[r] = mask == nullptr || mask[index] > 0 ? static_cast<Compute>(a[index]) : static_cast<Compute>(0);
+				}
+				for (unsigned int r = mr; r < tileRows; ++r)
+				{
+					buffer[r] = 0;
+				}
+				buffer += tileRows;
+			}
+		}
+	}
+
+	template<typename T>
+	void Gemm<T>::packB(const unsigned int& kc, const unsigned int& nc, const T* b, const size_t& rowStride, const size_t& columnStride,
+		const T* mask, const unsigned int& tileColumns, Compute* buffer)
+	{
+		// tileColumns-column slivers stored row by row, the last sliver zero padded.
+		for (unsigned int j = 0; j < nc; j += tileColumns)
+		{
+			const unsigned int nr = std::min(tileColumns, nc - j);
+			for (unsigned int p = 0; p < kc; ++p)
+			{
+				const size_t offset = static_cast<size_t>(p) * rowStride + static_cast<size_t>(j) * columnStride;
+				const T* row = b + offset;
+				if (mask != nullptr)
+				{
+					const T* maskRow = mask + offset;
+					for (unsigned int r = 0; r < nr; ++r)
+					{
+						buffer[r] = maskRow[static_cast<size_t>(r) * columnStride] > 0 ? static_cast<Compute>(row[static_cast<size_t>(r) * columnStride]) : static_cast<Compute>(0);
+					}
+				}
+				else if (columnStride == 1)
+				{
+					for (unsigned int r = 0; r < nr; ++r)
+					{
+						buffer[r] = static_cast<Compute>(row[r]);
+					}
+				}
+				else
+				{
+					for (unsigned int r = 0; r < nr; ++r)
+					{
+						buffer[r] = static_cast<Compute>(row[static_cast<size_t>(r) * columnStride]);
+					}
+				}
+				for (unsigned int r = nr; r < tileColumns; ++r)
+				{
+					buffer[r] = 0;
+				}
+				buffer += tileColumns;
+			}
+		}
+	}
+
+	template<typename T>
+	template<typename C>
+	void Gemm<T>::macroKernel(const Kernel& kernel, const unsigned int& mc, const unsigned int& nBegin, const unsigned int& nEnd,
+		const unsigned int& kc, const Compute* packedA, const Compute* packedB, C* c, const size_t& ldc, const bool& bAccumulate,
+		const T* bias, const bool& bRelu)
+	{
+		for (unsigned int j = nBegin; j < nEnd; j += kernel.Nr)
+		{
+			const unsigned int nr = std::min(kernel.Nr, nEnd - j);
+			const Compute* panelB = packedB + static_cast<size_t>(j) * kc;
+			for (unsigned int i = 0; i < mc; i += kernel.Mr)
+			{
+				const unsigned int mr = std::min(kernel.Mr, mc - i);
+				microKernel(kernel, kc, packedA + static_cast<size_t>(i) * kc, panelB, c + static_cast<size_t>(i) * ldc + j, ldc, mr, nr, bAccumulate,
+					bias != nullptr ? bias + j : nullptr, bRelu);
+			}
+		}
+	}
+
+	template<typename T>
+	template<typename C>
+	void Gemm<T>::microKernel(const Kernel& kernel, const unsigned int& kc, const Compute* packedA, const Compute* packedB, C* c,
+		const size_t& ldc, const unsigned int& mr, const unsigned int& nr, const bool& bAccumulate, const T* bias, const bool& bRelu)
+	{
+		alignas(64) Compute acc[MAX_MR * MAX_NR];
+		kernel.Tile(kc, packedA, packedB, acc);
+
+		// Epilogue: earlier k blocks, bias and ReLU on the accumulators, so c is written once with the activated value.
+		for (unsigned int i = 0; i < mr; ++i)
+		{
+			const Compute* sums = acc + static_cast<size_t>(i) * kernel.Nr;
+			C* row = c + static_cast<size_t>(i) * ldc;
+			for (unsigned int j = 0; j < nr; ++j)
+			{
+				Compute value = sums[j];
+				if (bAccumulate)
+				{
+					value += static_cast<Compute>(row[j]);
+				}
+				if (bias != nullptr)
+				{
+					value += static_cast<Compute>(bias[j]);
+				}
+				if (bRelu && value < 0)
+				{
+					value = 0;
+				}
+				row[j] = static_cast<C>(value);
+			}
+		}
+	}
+
+	template<typename T>
+	template<typename U>
+	U* Gemm<T>::threadBuffer(std::vector<U>& buffer, const size_t& size)
+	{
+		if (buffer.size() < size)
+		{
+			buffer.resize(size);
+		}
+		return buffer.data();
+	}
+}
@@ -0,0 +1,798 @@
+#pragma once
+#include<algorithm>
+#include<cmath>
+#include<initializer_list>
+#include<limits>
+#include<memory>
+#include<vector>
+#include "Allocator.h"
+#include "Numpy.h"
+
+namespace numpy
+{
+	template<typename T>
+	class Graph;
+
+	// Handle to a node of a Graph. The default-constructed handle is invalid, and so is the result of an operation whose
+	// operands are invalid or whose shapes do not fit.
+	template<typename T>
+	class Symbol final
+	{
+		friend class Graph<T>;
+	public:
+		Symbol();
+		~Symbol() = default;
+
+		bool IsValid() const;
+
+		friend Symbol<T> operator+(const Symbol<T>& lhs, const Symbol<T>& rhs)
+		{
+			return lhs.mpGraph == nullptr ? Symbol<T>() : lhs.mpGraph->Add(lhs, rhs);
+		}
+
+		friend Symbol<T> operator*(const Symbol<T>& lhs, const Symbol<T>& rhs)
+		{
+			return lhs.mpGraph == nullptr ? Symbol<T>() : lhs.mpGraph->Multiply(lhs, rhs);
+		}
+	private:
+		Symbol(Graph<T>* pGraph, const unsigned int& index);
+
+		Graph<T>* mpGraph;
+		unsigned int mIndex;
+	};
+
+	template<typename T>
+	class CompiledGraph;
+
+	// A model captured as a graph of Ndarray operations on fixed shapes, to be compiled once and run many times. Nothing is
+	// computed while the graph is built; shapes are checked as each node is added.
+	//
+	// Add and Multiply broadcast an operand whose shape is a suffix of the other's, such as a bias row over a batch.
+	template<typename T>
+	class Graph final
+	{
+		friend class CompiledGraph<T>;
+	public:
+		Graph() = default;
+		Graph(const Graph<T>& rhs) = delete;
+		Graph<T>& operator=(const Graph<T>& rhs) = delete;
+		~Graph() = default;
+
+		// Inputs are numbered in the order they are declared; Run takes them in that order.
+		Symbol<T> Input(const std::initializer_list<size_t>& arraySize);
+		// value is copied.
+		Symbol<T> Constant(const Ndarray<T>& value);
+
+		Symbol<T> Add(const Symbol<T>& a, const Symbol<T>& b);
+		Symbol<T> Multiply(const Symbol<T>& a, const Symbol<T>& b);
+		// Matrix product of two 2-D nodes.
+		Symbol<T> Dot(const Symbol<T>& a, const Symbol<T>& b);
+		Symbol<T> Relu(const Symbol<T>& a);
+		Symbol<T> Sigmoid(const Symbol<T>& a);
+		Symbol<T> Tanh(const Symbol<T>& a);
+		// Softmax along the last axis.
+		Symbol<T> Softmax(const Symbol<T>& a);
+
+		// Fuses, plans and allocates the nodes that outputs depend on. Returns an empty CompiledGraph when an output is invalid
+		// or is an Input or Constant.
+		CompiledGraph<T> Compile(const std::initializer_list<Symbol<T>>& outputs) const;
+
+		size_t GetNodeCount() const;
+	private:
+		enum class Operation
+		{
+			Input,
+			Constant,
+			Add,
+			Multiply,
+			Dot,
+			Relu,
+			Sigmoid,
+			Tanh,
+			Softmax,
+		};
+
+		struct Node
+		{
+			Operation Op;
+			unsigned int Inputs[2];
+			InlineArray<size_t, Ndarray<T>::MAX_INLINE_DIMENSION> ArraySize;
+			size_t TotalSize;
+			// The copy held by a Constant.
+			Ndarray<T> Value;
+		};
+
+		static constexpr unsigned int NONE = std::numeric_limits<unsigned int>::max();
+
+		bool owns(const Symbol<T>& s) const;
+		bool isSuffix(const unsigned int& shorter, const unsigned int& longer) const;
+		Symbol<T> add(const Operation& op, const unsigned int& a, const unsigned int& b, const size_t* arraySize, const unsigned int& dimension);
+		Symbol<T> elementwise(const Operation& op, const Symbol<T>& a, const Symbol<T>& b);
+		Symbol<T> unary(const Operation& op, const Symbol<T>& a);
+
+		std::vector<Node> mNodes;
+		std::vector<unsigned int> mInputs;
+	};
+
+	// A Graph after fusion and memory planning.
+	//
+	// Fusion: a chain of element-wise nodes, each the only consumer of the one before, runs as one step over its producer's
+	// output, in cache-sized blocks that stay in L1 from one operation to the next. Behind a Dot, a bias row and a following
+	// ReLU go into the GEMM epilogue and the rest of the chain runs on the product in place.
+	//
+	// Planning: every step's output gets an offset in one workspace allocated here, from the steps between its definition and
+	// its last use; outputs whose lifetimes do not overlap share memory, and an element-wise step or softmax whose source dies
+	// with it writes over that source. Run therefore allocates nothing.
+	template<typename T>
+	class CompiledGraph final
+	{
+		friend class Graph<T>;
+	public:
+		CompiledGraph();
+		// Run reads through pointers into the graph's own views, so it moves but does not copy.
+		CompiledGraph(const CompiledGraph<T>& rhs) = delete;
+		CompiledGraph(CompiledGraph<T>&& rhs) = default;
+		CompiledGraph<T>& operator=(const CompiledGraph<T>& rhs) = delete;
+		CompiledGraph<T>& operator=(CompiledGraph<T>&& rhs) = default;
+		~CompiledGraph() = default;
+
+		bool IsValid() const;
+		// inputs follow the graph's Input order and must have the declared shapes and be contiguous; they are read, not copied.
+		bool Run(const std::initializer_list<const Ndarray<T>*>& inputs);
+		// A view into the workspace, overwritten by the next Run.
+		const Ndarray<T>& GetOutput(const unsigned int& index) const;
+
+		size_t GetStepCount() const;
+		size_t GetWorkspaceSize() const;
+		// Bytes the graph's node outputs would take if each were its own array, as when the model runs layer by layer.
+		size_t GetUnplannedSize() const;
+	private:
+		enum class Kind
+		{
+			Dot,
+			Elementwise,
+			Softmax,
+		};
+
+		// An element-wise operation applied to a step's output in place; Operand is the node read by Add and Multiply.
+		struct PostOperation
+		{
+			typename Graph<T>::Operation Op;
+			unsigned int Operand;
+		};
+
+		struct Step
+		{
+			Kind Type;
+			// Dot reads A and B; Elementwise and Softmax read A.
+			unsigned int A;
+			unsigned int B;
+			unsigned int Bias;
+			bool bRelu;
+			unsigned int FirstPostOperation;
+			unsigned int PostOperationCount;
+			// The node whose value the step leaves in its output, and that output's index in mValues.
+			unsigned int Tail;
+			unsigned int Output;
+		};
+
+		// Elements per block of a fused chain: a block of the output and of each operand stays in L1 across the chain.
+		static constexpr size_t BLOCK = 1024;
+		static constexpr unsigned int NONE = Graph<T>::NONE;
+
+		void runDot(const Step& step);
+		void runElementwise(const Step& step);
+		void runSoftmax(const Step& step);
+		void applyChain(const Step& step, T* out, const size_t& begin, const size_t& end) const;
+
+		std::vector<Step> mSteps;
+		std::vector<PostOperation> mPostOperations;
+		// Per graph node: the array holding its value during Run, or nullptr when it is fused away.
+		std::vector<const Ndarray<T>*> mOperands;
+		// Views into the workspace for step outputs, and views of the graph's constants.
+		std::vector<Ndarray<T>> mValues;
+		std::vector<unsigned int> mInputs;
+		std::vector<unsigned int> mOutputs;
+		std::vector<InlineArray<size_t, Ndarray<T>::MAX_INLINE_DIMENSION>> mInputShapes;
+		std::shared_ptr<T[]> mWorkspace;
+		size_t mWorkspaceSize;
+		size_t mUnplannedSize;
+	};
+
+	template<typename T>
+	inline Symbol<T>::Symbol()
+		: mpGraph(nullptr)
+		, mIndex(0)
+	{
+	}
+
+	template<typename T>
+	inline Symbol<T>::Symbol(Graph<T>* pGraph, const unsigned int& index)
+		: mpGraph(pGraph)
+		, mIndex(index)
+	{
+	}
+
+	template<typename T>
+	inline bool Symbol<T>::IsValid() const
+	{
+		return mpGraph != nullptr;
+	}
+
+	template<typename T>
+	Symbol<T> Graph<T>::Input(const std::initializer_list<size_t>& arraySize)
+	{
+		const std::vector<size_t> sizes(arraySize);
+		const Symbol<T> result = add(Operation::Input, NONE, NONE, sizes.data(), static_cast<unsigned int>(sizes.size()));
+		if (result.IsValid())
+		{
+			mInputs.push_back(result.mIndex);
+		}
+		return result;
+	}
+
+	template<typename T>
+	Symbol<T> Graph<T>::Constant(const Ndarray<T>& value)
+	{
+		std::vector<size_t> sizes(value.GetDimension());
+		for (unsigned int i = 0; i < value.GetDimension(); ++i)
+		{
+			sizes[i] = value.GetArraySize(i);
+		}
+		const Symbol<T> result = add(Operation::Constant, NONE, NONE, sizes.data(), value.GetDimension());
+		if (result.IsValid())
+		{
+			mNodes[result.mIndex].Value = value;
+		}
+		return result;
+	}
+
+	template<typename T>
+	inline Symbol<T> Graph<T>::Add(const Symbol<T>& a, const Symbol<T>& b)
+	{
+		return elementwise(Operation::Add, a, b);
+	}
+
+	template<typename T>
+	inline Symbol<T> Graph<T>::Multiply(const Symbol<T>& a, const Symbol<T>& b)
+	{
+		return elementwise(Operation::Multiply, a, b);
+	}
+
+	template<typename T>
+	Symbol<T> Graph<T>::Dot(const Symbol<T>& a, const Symbol<T>& b)
+	{
+		if (!owns(a) || !owns(b))
+			return Symbol<T>();
+		const Node& lhs = mNodes[a.mIndex];
+		const Node& rhs = mNodes[b.mIndex];
+		if (lhs.ArraySize.GetSize() != 2u || rhs.ArraySize.GetSize() != 2u || lhs.ArraySize[1] != rhs.ArraySize[0])
+			return Symbol<T>();
+
+		const size_t arraySize[2] = { lhs.ArraySize[0], rhs.ArraySize[1] };
+		return add(Operation::Dot, a.mIndex, b.mIndex, arraySize, 2u);
+	}
+
+	template<typename T>
+	inline Symbol<T> Graph<T>::Relu(const Symbol<T>& a)
+	{
+		return unary(Operation::Relu, a);
+	}
+
+	template<typename T>
+	inline Symbol<T> Graph<T>::Sigmoid(const Symbol<T>& a)
+	{
+		return unary(Operation::Sigmoid, a);
+	}
+
+	template<typename T>
+	inline Symbol<T> Graph<T>::Tanh(const Symbol<T>& a)
+	{
+		return unary(Operation::Tanh, a);
+	}
+
+	template<typename T>
+	inline Symbol<T> Graph<T>::Softmax(const Symbol<T>& a)
+	{
+		return unary(Operation::Softmax, a);
+	}
+
+	template<typename T>
+	inline size_t Graph<T>::GetNodeCount() const
+	{
+		return mNodes.size();
+	}
+
+	template<typename T>
+	inline bool Graph<T>::owns(const Symbol<T>& s) const
+	{
+		return s.mpGraph == this && s.mIndex < mNodes.size();
+	}
+
+	template<typename T>
+	bool Graph<T>::isSuffix(const unsigned int& shorter, const unsigned int& longer) const
+	{
+		const Node& s = mNodes[shorter];
+		const Node& l = mNodes[longer];
+		if (s.ArraySize.GetSize() > l.ArraySize.GetSize())
+			return false;
+		const unsigned int offset = l.ArraySize.GetSize() - s.ArraySize.GetSize();
+		for (unsigned int i = 0; i < s.ArraySize.GetSize(); ++i)
+		{
+			if (s.ArraySize[i] != l.ArraySize[offset + i])
+				return false;
+		}
+		return true;
+	}
+
+	template<typename T>
+	Symbol<T> Graph<T>::add(const Operation& op, const unsigned int& a, const unsigned int& b, const size_t* arraySize, const unsigned int& dimension)
+	{
+		// The same limits as Ndarray: no 0 axis, and an element count whose byte size fits in size_t.
+		size_t totalSize = 1;
+		bool bValid = dimension != 0u && mNodes.size() < NONE;
+		for (unsigned int i = 0; i < dimension && bValid; ++i)
+		{
+			bValid = arraySize[i] != 0u && totalSize <= std::numeric_limits<size_t>::max() / sizeof(T) / arraySize[i];
+			totalSize *= bValid ? arraySize[i] : 1u;
+		}
+		if (!bValid)
+			return Symbol<T>();
+
+		mNodes.emplace_back();
+		Node& node = mNodes.back();
+		node.Op = op;
+		node.Inputs[0] = a;
+		node.Inputs[1] = b;
+		node.ArraySize.Resize(dimension);
+		for (unsigned int i = 0; i < dimension; ++i)
+		{
+			node.ArraySize[i] = arraySize[i];
+		}
+		node.TotalSize = totalSize;
+		return Symbol<T>(this, static_cast<unsigned int>(mNodes.size() - 1));
+	}
+
+	template<typename T>
+	Symbol<T> Graph<T>::elementwise(const Operation& op, const Symbol<T>& a, const Symbol<T>& b)
+	{
+		if (!owns(a) || !owns(b))
+			return Symbol<T>();
+		// The result takes the longer operand's shape.
+		const unsigned int longer = isSuffix(b.mIndex, a.mIndex) ? a.mIndex : isSuffix(a.mIndex, b.mIndex) ? b.mIndex : NONE;
+		if (longer == NONE)
+			return Symbol<T>();
+
+		const Node& shape = mNodes[longer];
+		const InlineArray<size_t, Ndarray<T>::MAX_INLINE_DIMENSION> arraySize(shape.ArraySize);
+		return add(op, a.mIndex, b.mIndex, arraySize.Get(), arraySize.GetSize());
+	}
+
+	template<typename T>
+	Symbol<T> Graph<T>::unary(const Operation& op, const Symbol<T>& a)
+	{
+		if (!owns(a))
+			return Symbol<T>();
+		const InlineArray<size_t, Ndarray<T>::MAX_INLINE_DIMENSION> arraySize(mNodes[a.mIndex].ArraySize);
+		return add(op, a.mIndex, NONE, arraySize.Get(), arraySize.GetSize());
+	}
+
+	template<typename T>
+	CompiledGraph<T> Graph<T>::Compile(const std::initializer_list<Symbol<T>>& outputs) const
+	{
+		using Compiled = CompiledGraph<T>;
+		using Step = typename Compiled::Step;
+		using PostOperation = typename Compiled::PostOperation;
+		const unsigned int nodeCount = static_cast<unsigned int>(mNodes.size());
+		for (const Symbol<T>& output : outputs)
+		{
+			if (!owns(output) || mNodes[output.mIndex].Op == Operation::Input || mNodes[output.mIndex].Op == Operation::Constant)
+				return Compiled();
+		}
+
+		// Uses per node among the nodes the outputs depend on. An output counts once more, so no chain runs over it.
+		std::vector<unsigned int> uses(nodeCount, 0u);
+		std::vector<bool> bLive(nodeCount, false);
+		for (const Symbol<T>& output : outputs)
+		{
+			bLive[output.mIndex] = true;
+			++uses[output.mIndex];
+		}
+		for (unsigned int n = nodeCount; n > 0; --n)
+		{
+			for (unsigned int j = 0; j < 2u && bLive[n - 1]; ++j)
+			{
+				const unsigned int input = mNodes[n - 1].Inputs[j];
+				if (input != NONE)
+				{
+					bLive[input] = true;
+					++uses[input];
+				}
+			}
+		}
+
+		// Fusion, in node order. stepOf[n] is the step whose output holds n's value; a node continues the chain of its source
+		// when it is the source's only consumer and everything else it reads is ready before that step runs.
+		Compiled compiled;
+		std::vector<unsigned int> stepOf(nodeCount, NONE);
+		std::vector<std::vector<PostOperation>> chains;
+		for (unsigned int n = 0; n < nodeCount; ++n)
+		{
+			const Node& node = mNodes[n];
+			if (!bLive[n] || node.Op == Operation::Input || node.Op == Operation::Constant)
+				continue;
+			compiled.mUnplannedSize += node.TotalSize * sizeof(T);
+
+			Step step = { Compiled::Kind::Elementwise, node.Inputs[0], node.Inputs[1], NONE, false, 0u, 0u, n, 0u };
+			if (node.Op == Operation::Dot || node.Op == Operation::Softmax)
+			{
+				step.Type = node.Op == Operation::Dot ? Compiled::Kind::Dot : Compiled::Kind::Softmax;
+				stepOf[n] = static_cast<unsigned int>(compiled.mSteps.size());
+				compiled.mSteps.push_back(step);
+				chains.emplace_back();
+				continue;
+			}
+
+			auto continues = [&](const unsigned int& source)
+			{
+				return stepOf[source] != NONE && uses[source] == 1u && compiled.mSteps[stepOf[source]].Tail == source;
+			};
+			// The source has the result's shape; Add and Multiply commute, so either operand may be it.
+			unsigned int source = node.Inputs[0];
+			unsigned int operand = node.Inputs[1];
+			if (operand != NONE && (!isSuffix(operand, source) || (isSuffix(source, operand) && !continues(source) && continues(operand))))
+			{
+				std::swap(source, operand);
+			}
+
+			const unsigned int producer = stepOf[source];
+			if (continues(source) && (operand == NONE || stepOf[operand] == NONE || stepOf[operand] < producer))
+			{
+				Step& chain = compiled.mSteps[producer];
+				const bool bEpilogue = chain.Type == Compiled::Kind::Dot && chains[producer].empty() && !chain.bRelu;
+				if (bEpilogue && node.Op == Operation::Add && chain.Bias == NONE && mNodes[operand].ArraySize.GetSize() == 1u)
+				{
+					chain.Bias = operand;
+				}
+				else if (bEpilogue && node.Op == Operation::Relu && chain.Bias != NONE)
+				{
+					chain.bRelu = true;
+				}
+				else
+				{
+					chains[producer].push_back({ node.Op, operand });
+				}
+				chain.Tail = n;
+				stepOf[n] = producer;
+				continue;
+			}
+
+			step.A = source;
+			step.B = NONE;
+			stepOf[n] = static_cast<unsigned int>(compiled.mSteps.size());
+			compiled.mSteps.push_back(step);
+			chains.push_back({ { node.Op, operand } });
+		}
+		for (size_t s = 0; s < chains.size(); ++s)
+		{
+			compiled.mSteps[s].FirstPostOperation = static_cast<unsigned int>(compiled.mPostOperations.size());
+			compiled.mSteps[s].PostOperationCount = static_cast<unsigned int>(chains[s].size());
+			compiled.mPostOperations.insert(compiled.mPostOperations.end(), chains[s].begin(), chains[s].end());
+		}
+
+		// Liveness: a step's output lives from the step to the last step reading it; outputs live to the end.
+		const unsigned int stepCount = static_cast<unsigned int>(compiled.mSteps.size());
+		std::vector<unsigned int> lastUse(stepCount);
+		for (unsigned int s = 0; s < stepCount; ++s)
+		{
+			lastUse[s] = s;
+		}
+		auto read = [&](const unsigned int& node, const unsigned int& s)
+		{
+			if (node != NONE && stepOf[node] != NONE)
+			{
+				lastUse[stepOf[node]] = std::max(lastUse[stepOf[node]], s);
+			}
+		};
+		for (unsigned int s = 0; s < stepCount; ++s)
+		{
+			const Step& step = compiled.mSteps[s];
+			read(step.A, s);
+			read(step.B, s);
+			read(step.Bias, s);
+			for (unsigned int i = 0; i < step.PostOperationCount; ++i)
+			{
+				read(compiled.mPostOperations[step.FirstPostOperation + i].Operand, s);
+			}
+		}
+		for (const Symbol<T>& output : outputs)
+		{
+			lastUse[stepOf[output.mIndex]] = stepCount;
+		}
+
+		// An element-wise step or softmax whose source dies with it and is not read again by the chain writes over the source.
+		// buffer[s] is the first step of the run of steps sharing s's memory, and end[] the last step that memory is needed by.
+		std::vector<unsigned int> buffer(stepCount);
+		std::vector<unsigned int> end(stepCount);
+		for (unsigned int s = 0; s < stepCount; ++s)
+		{
+			const Step& step = compiled.mSteps[s];
+			buffer[s] = s;
+			const unsigned int source = step.Type == Compiled::Kind::Dot ? NONE : stepOf[step.A];
+			bool bInPlace = source != NONE && lastUse[source] == s && mNodes[step.A].TotalSize == mNodes[step.Tail].TotalSize;
+			for (unsigned int i = 0; i < step.PostOperationCount && bInPlace; ++i)
+			{
+				bInPlace = compiled.mPostOperations[step.FirstPostOperation + i].Operand != step.A;
+			}
+			if (bInPlace)
+			{
+				buffer[s] = buffer[source];
+			}
+			end[buffer[s]] = lastUse[s];
+		}
+
+		// Offsets, largest buffer first, each at the lowest address clear of every placed buffer alive at the same time.
+		const size_t alignment = std::max<size_t>(1, Allocator::ALIGNMENT / sizeof(T));
+		std::vector<size_t> size(stepCount, 0);
+		std::vector<size_t> offset(stepCount, 0);
+		std::vector<unsigned int> order;
+		for (unsigned int s = 0; s < stepCount; ++s)
+		{
+			if (buffer[s] == s)
+			{
+				size[s] = (mNodes[compiled.mSteps[s].Tail].TotalSize + alignment - 1) / alignment * alignment;
+				order.push_back(s);
+			}
+		}
+		std::stable_sort(order.begin(), order.end(), [&](const unsigned int& lhs, const unsigned int& rhs) { return size[lhs] > size[rhs]; });
+		size_t workspaceSize = 0;
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			const unsigned int s = order[i];
+			size_t candidate = 0;
+			for (bool bMoved = true; bMoved;)
+			{
+				bMoved = false;
+				for (size_t j = 0; j < i; ++j)
+				{
+					const unsigned int placed = order[j];
+					const bool bAlive = placed <= end[s] && s <= end[placed];
+					if (bAlive && candidate < offset[placed] + size[placed] && offset[placed] < candidate + size[s])
+					{
+						candidate = offset[placed] + size[placed];
+						bMoved = true;
+					}
+				}
+			}
+			offset[s] = candidate;
+			workspaceSize = std::max(workspaceSize, candidate + size[s]);
+		}
+
+		// Views: one per step output, then one per constant. mOperands points at them, so mValues is not resized afterwards.
+		compiled.mWorkspaceSize = workspaceSize * sizeof(T);
+		compiled.mWorkspace = workspaceSize == 0u ? nullptr : Allocator::AllocateShared<T>(workspaceSize);
+		compiled.mValues.reserve(stepCount + nodeCount);
+		compiled.mOperands.assign(nodeCount, nullptr);
+		for (unsigned int s = 0; s < stepCount; ++s)
+		{
+			Step& step = compiled.mSteps[s];
+			const Node& tail = mNodes[step.Tail];
+			const std::shared_ptr<T[]> storage(compiled.mWorkspace, compiled.mWorkspace.get() + offset[buffer[s]]);
+			step.Output = static_cast<unsigned int>(compiled.mValues.size());
+			compiled.mValues.emplace_back(storage, tail.ArraySize.GetSize(), tail.ArraySize.Get());
+			compiled.mOperands[step.Tail] = &compiled.mValues.back();
+		}
+		for (unsigned int n = 0; n < nodeCount; ++n)
+		{
+			if (bLive[n] && mNodes[n].Op == Operation::Constant)
+			{
+				compiled.mValues.push_back(mNodes[n].Value.Slice(0, 0, mNodes[n].Value.GetArraySize(0)));
+				compiled.mOperands[n] = &compiled.mValues.back();
+			}
+		}
+		for (const unsigned int input : mInputs)
+		{
+			compiled.mInputs.push_back(input);
+			compiled.mInputShapes.push_back(mNodes[input].ArraySize);
+		}
+		for (const Symbol<T>& output : outputs)
+		{
+			compiled.mOutputs.push_back(compiled.mSteps[stepOf[output.mIndex]].Output);
+		}
+		return compiled;
+	}
+
+	template<typename T>
+	CompiledGraph<T>::CompiledGraph()
+		: mWorkspaceSize(0)
+		, mUnplannedSize(0)
+	{
+	}
+
+	template<typename T>
+	inline bool CompiledGraph<T>::IsValid() const
+	{
+		return !mSteps.empty();
+	}
+
+	template<typename T>
+	bool CompiledGraph<T>::Run(const std::initializer_list<const Ndarray<T>*>& inputs)
+	{
+		if (mSteps.empty() || inputs.size() != mInputs.size())
+			return false;
+
+		size_t k = 0;
+		for (const Ndarray<T>* input : inputs)
+		{
+			const InlineArray<size_t, Ndarray<T>::MAX_INLINE_DIMENSION>& arraySize = mInputShapes[k];
+			bool bValid = input != nullptr && input->GetDimension() == arraySize.GetSize() && input->IsContiguous();
+			for (unsigned int i = 0; i < arraySize.GetSize() && bValid; ++i)
+			{
+				bValid = input->GetArraySize(i) == arraySize[i];
+			}
+			if (!bValid)
+				return false;
+			mOperands[mInputs[k++]] = input;
+		}
+
+		for (const Step& step : mSteps)
+		{
+			switch (step.Type)
+			{
+			case Kind::Dot:
+				runDot(step);
+				break;
+			case Kind::Elementwise:
+				runElementwise(step);
+				break;
+			default:
+				runSoftmax(step);
+				break;
+			}
+		}
+		return true;
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& CompiledGraph<T>::GetOutput(const unsigned int& index) const
+	{
+		return mValues[mOutputs[index]];
+	}
+
+	template<typename T>
+	inline size_t CompiledGraph<T>::GetStepCount() const
+	{
+		return mSteps.size();
+	}
+
+	template<typename T>
+	inline size_t CompiledGraph<T>::GetWorkspaceSize() const
+	{
+		return mWorkspaceSize;
+	}
+
+	template<typename T>
+	inline size_t CompiledGraph<T>::GetUnplannedSize() const
+	{
+		return mUnplannedSize;
+	}
+
+	template<typename T>
+	void CompiledGraph<T>::runDot(const Step& step)
+	{
+		Ndarray<T>& out = mValues[step.Output];
+		if (step.Bias != NONE)
+		{
+			Numpy<T>::Dot(out, *mOperands[step.A], *mOperands[step.B], *mOperands[step.Bias], step.bRelu);
+		}
+		else
+		{
+			Numpy<T>::Dot(out, *mOperands[step.A], *mOperands[step.B]);
+		}
+		if (step.PostOperationCount != 0u)
+		{
+			T* data = out.GetData();
+			ParallelElements(out.GetTotalSize(), ELEMENTWISE_GRAIN, [this, &step, data](size_t begin, size_t end)
+			{
+				for (size_t block = begin; block < end; block += BLOCK)
+				{
+					applyChain(step, data, block, std::min(end, block + BLOCK));
+				}
+			});
+		}
+	}
+
+	template<typename T>
+	void CompiledGraph<T>::runElementwise(const Step& step)
+	{
+		Ndarray<T>& out = mValues[step.Output];
+		T* data = out.GetData();
+		const T* source = mOperands[step.A]->GetData();
+		ParallelElements(out.GetTotalSize(), ELEMENTWISE_GRAIN, [this, &step, data, source](size_t begin, size_t end)
+		{
+			for (size_t block = begin; block < end; block += BLOCK)
+			{
+				const size_t blockEnd = std::min(end, block + BLOCK);
+				if (data != source)
+				{
+					std::copy(source + block, source + blockEnd, data + block);
+				}
+				applyChain(step, data, block, blockEnd);
+			}
+		});
+	}
+
+	template<typename T>
+	void CompiledGraph<T>::runSoftmax(const Step& step)
+	{
+		Ndarray<T>& out = mValues[step.Output];
+		const Ndarray<T>& input = *mOperands[step.A];
+		const size_t columns = out.GetArraySize(out.GetDimension() - 1);
+		T* data = out.GetData();
+		const T* source = input.GetData();
+		ParallelElements(out.GetTotalSize() / columns, std::max<size_t>(1, ELEMENTWISE_GRAIN / columns), [this, &step, data, source, columns](size_t begin, size_t end)
+		{
+			for (size_t r = begin; r < end; ++r)
+			{
+				MathKernel<T>::Softmax(source + r * columns, data + r * columns, columns);
+				applyChain(step, data, r * columns, (r + 1) * columns);
+			}
+		});
+	}
+
+	template<typename T>
+	void CompiledGraph<T>::applyChain(const Step& step, T* out, const size_t& begin, const size_t& end) const
+	{
+		using Operation = typename Graph<T>::Operation;
+		for (unsigned int p = 0; p < step.PostOperationCount; ++p)
+		{
+			const PostOperation& operation = mPostOperations[step.FirstPostOperation + p];
+			switch (operation.Op)
+			{
+			case Operation::Add:
+			case Operation::Multiply:
+			{
+				// A broadcast operand repeats every size elements; it is walked in runs that do not wrap.
+				const T* operand = mOperands[operation.Operand]->GetData();
+				const size_t size = mOperands[operation.Operand]->GetTotalSize();
+				const bool bAdd = operation.Op == Operation::Add;
+				for (size_t i = begin, j = begin % size; i < end;)
+				{
+					const size_t count = std::min(end - i, size - j);
+					T* target = out + i;
+					const T* value = operand + j;
+					if (bAdd)
+					{
+						for (size_t c = 0; c < count; ++c)
+						{
+							target[c] += value[c];
+						}
+					}
+					else
+					{
+						for (size_t c = 0; c < count; ++c)
+						{
+							target[c] *= value[c];
+						}
+					}
+					i += count;
+					j = 0;
+				}
+				break;
+			}
+			case Operation::Relu:
+				for (size_t i = begin; i < end; ++i)
+				{
+					out[i] = out[i] > 0 ? out[i] : static_cast<T>(0);
+				}
+				break;
+			case Operation::Sigmoid:
+				MathKernel<T>::Sigmoid(out + begin, out + begin, end - begin);
+				break;
+			default:
+				MathKernel<T>::Tanh(out + begin, out + begin, end - begin);
+				break;
+			}
+		}
+	}
+}
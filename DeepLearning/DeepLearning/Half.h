@@ -0,0 +1,143 @@
+#pragma once
+#include<cstdint>
+#include<cstring>
+
+namespace numpy
+{
+	// 16-bit floating-point storage types. They convert to float implicitly and from float with rounding to nearest even, so
+	// Ndarray<BFloat16> or Ndarray<Float16> holds half the bytes of Ndarray<float> while arithmetic on the elements happens in float.
+
+	// bfloat16: float's sign and 8-bit exponent with a 7-bit mantissa, so it covers float's whole range.
+	class BFloat16 final
+	{
+	public:
+		BFloat16() = default;
+		BFloat16(const float& value);
+
+		operator float() const;
+
+		static BFloat16 FromBits(const std::uint16_t& bits);
+		std::uint16_t GetBits() const;
+	private:
+		std::uint16_t mBits;
+	};
+
+	// IEEE 754 binary16: 5-bit exponent and 10-bit mantissa. Magnitudes above 65504 become infinity.
+	class Float16 final
+	{
+	public:
+		Float16() = default;
+		Float16(const float& value);
+
+		operator float() const;
+
+		static Float16 FromBits(const std::uint16_t& bits);
+		std::uint16_t GetBits() const;
+	private:
+		std::uint16_t mBits;
+	};
+
+	// Type sums of T are accumulated in; the 16-bit storage types accumulate in float.
+	template<typename T>
+	struct ComputeType
+	{
+		using Type = T;
+	};
+
+	template<>
+	struct ComputeType<BFloat16>
+	{
+		using Type = float;
+	};
+
+	template<>
+	struct ComputeType<Float16>
+	{
+		using Type = float;
+	};
+
+	namespace half
+	{
+		inline std::uint32_t ToBits(const float& value)
+		{
+			std::uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			return bits;
+		}
+
+		inline float FromBits(const std::uint32_t& bits)
+		{
+			float value;
+			std::memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+	}
+
+	inline BFloat16::BFloat16(const float& value)
+	{
+		const std::uint32_t bits = half::ToBits(value);
+		if ((bits & 0x7FFFFFFFu) > 0x7F800000u)
+		{
+			// NaN stays NaN; rounding could carry its payload into the exponent.
+			mBits = static_cast<std::uint16_t>((bits >> 16) | 0x0040u);
+			return;
+		}
+		mBits = static_cast<std::uint16_t>((bits + 0x7FFFu + ((bits >> 16) & 1u)) >> 16);
+	}
+
+	inline BFloat16::operator float() const
+	{
+		return half::FromBits(static_cast<std::uint32_t>(mBits) << 16);
+	}
+
+	inline BFloat16 BFloat16::FromBits(const std::uint16_t& bits)
+	{
+		BFloat16 result;
+		result.mBits = bits;
+		return result;
+	}
+
+	inline std::uint16_t BFloat16::GetBits() const
+	{
+		return mBits;
+	}
+
+	inline Float16::Float16(const float& value)
+	{
+		// Branch-free conversion: scaling by 2^112 then 2^-110 rounds the mantissa in the FPU, and adding a power of two
+		// aligned to the target exponent leaves the half's exponent and mantissa in the low bits.
+		const std::uint32_t bits = half::ToBits(value);
+		const std::uint32_t shifted = bits + bits;
+		const std::uint32_t sign = bits & 0x80000000u;
+		float base = (half::FromBits(bits & 0x7FFFFFFFu) * 0x1.0p+112f) * 0x1.0p-110f;
+		std::uint32_t bias = shifted & 0xFF000000u;
+		bias = bias < 0x71000000u ? 0x71000000u : bias;
+		base = half::FromBits((bias >> 1) + 0x07800000u) + base;
+		const std::uint32_t result = half::ToBits(base);
+		const std::uint32_t nonSign = ((result >> 13) & 0x00007C00u) + (result & 0x00000FFFu);
+		mBits = static_cast<std::uint16_t>((sign >> 16) | (shifted > 0xFF000000u ? 0x7E00u : nonSign));
+	}
+
+	inline Float16::operator float() const
+	{
+		const std::uint32_t bits = static_cast<std::uint32_t>(mBits) << 16;
+		const std::uint32_t sign = bits & 0x80000000u;
+		const std::uint32_t shifted = bits + bits;
+		// Normal numbers rebias the exponent by a multiplication, subnormals are read off a float with a fixed exponent.
+		const float normal = half::FromBits((shifted >> 4) + (0xE0u << 23)) * 0x1.0p-112f;
+		const float subnormal = half::FromBits((shifted >> 17) | (126u << 23)) - 0.5f;
+		return half::FromBits(sign | (shifted < (1u << 27) ? half::ToBits(subnormal) : half::ToBits(normal)));
+	}
+
+	inline Float16 Float16::FromBits(const std::uint16_t& bits)
+	{
+		Float16 result;
+		result.mBits = bits;
+		return result;
+	}
+
+	inline std::uint16_t Float16::GetBits() const
+	{
+		return mBits;
+	}
+}
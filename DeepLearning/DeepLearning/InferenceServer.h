@@ -0,0 +1,770 @@
+#pragma once
+#include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<condition_variable>
+#include<cstdint>
+#include<cstring>
+#include<deque>
+#include<iterator>
+#include<list>
+#include<mutex>
+#include<string>
+#include<thread>
+#include<vector>
+#include "Mlp.h"
+#include "Profiler.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include<winsock2.h>
+#include<afunix.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "Ws2_32.lib")
+#endif
+#else
+#include<cerrno>
+#include<fcntl.h>
+#include<sys/socket.h>
+#include<sys/stat.h>
+#include<sys/un.h>
+#include<unistd.h>
+#endif
+
+namespace numpy
+{
+	// Blocking stream sockets in the local (Unix domain) namespace, named by a file system path: AF_UNIX on POSIX systems and
+	// on Windows 10 1803 and later.
+	class LocalSocket final
+	{
+	public:
+#ifdef _WIN32
+		using Handle = SOCKET;
+#else
+		using Handle = int;
+#endif
+		LocalSocket() = delete;
+		~LocalSocket() = delete;
+
+		// INVALID on failure. Listen replaces a socket file left at path that nothing listens on; any other file there, or a
+		// socket still being served, is a failure and left alone.
+		static Handle Listen(const std::string& path);
+		static Handle Connect(const std::string& path);
+		// Retries errors of a single pending connection and, after a pause, a shortage of descriptors or memory, so INVALID means
+		// the listener itself failed or was shut down.
+		static Handle Accept(const Handle& listener);
+		// The whole buffer or false.
+		static bool Send(const Handle& socket, const void* data, const size_t& size);
+		static bool Receive(const Handle& socket, void* data, const size_t& size);
+		// Makes calls blocked on the socket in other threads return.
+		static void Shutdown(const Handle& socket);
+		static void Close(const Handle& socket);
+		static void Remove(const std::string& path);
+
+#ifdef _WIN32
+		static constexpr Handle INVALID = INVALID_SOCKET;
+#else
+		static constexpr Handle INVALID = -1;
+#endif
+	private:
+		static Handle open(const std::string& path, sockaddr_un& address);
+		// true when nothing is at path or it was a stale socket and is now removed.
+		static bool clearStale(const std::string& path);
+	};
+
+	struct InferenceStatistics
+	{
+		unsigned long long Requests;
+		unsigned long long Rows;
+		// Rows / Batches is the mean batch the requests were coalesced into.
+		unsigned long long Batches;
+	};
+
+	// Serves a frozen Mlp to concurrent callers with dynamic batching. Requests queue up, and one batching thread takes the
+	// queued rows, up to the maximum batch, once that many are waiting or the oldest request has waited the latency budget. It
+	// gathers them into an input allocated up front, runs a single Predict, whose layer buffers were sized for the maximum batch
+	// when the server started, and copies each request's logits back, so a request costs a share of one GEMM per layer instead
+	// of a 1-row GEMM of its own and steady-state serving allocates nothing. A budget of 0 never waits: rows that arrive while a
+	// batch runs form the next one.
+	//
+	// Requests come from threads of this process through Infer or, after Listen, from other processes through InferenceClient.
+	template<typename T>
+	class InferenceServer final
+	{
+	public:
+		// Loads an archive written by Mlp::Save; the server is invalid when that fails or maxBatch is 0.
+		explicit InferenceServer(const std::string& modelPath, const unsigned int& maxBatch = DEFAULT_MAX_BATCH,
+			const std::chrono::microseconds& budget = std::chrono::microseconds(DEFAULT_BUDGET_MICROSECONDS));
+		InferenceServer(const InferenceServer& rhs) = delete;
+		InferenceServer& operator=(const InferenceServer& rhs) = delete;
+		// Stops accepting requests, closes the socket and its connections, and returns once the queued requests are answered.
+		~InferenceServer();
+
+		bool IsValid() const;
+		size_t GetInputSize() const;
+		size_t GetOutputSize() const;
+		unsigned int GetMaxBatch() const;
+
+		// input holds rows x GetInputSize() values and output receives rows x GetOutputSize() logits, both row-major. Blocks until
+		// the batch holding the rows has run. false when the server is invalid or stopping, or rows is 0 or above the maximum batch.
+		bool Infer(const T* input, const size_t& rows, T* output);
+		// Serves InferenceClient connections at path as well, one thread per connection. false when the server is invalid or
+		// already listening, or path cannot be bound.
+		bool Listen(const std::string& path);
+
+		InferenceStatistics GetStatistics() const;
+		void ResetStatistics();
+
+		static constexpr unsigned int DEFAULT_MAX_BATCH = 64;
+		static constexpr long long DEFAULT_BUDGET_MICROSECONDS = 200;
+	private:
+		// Lives on the caller's stack until bDone, which the batching thread sets and signals under mMutex.
+		struct Request
+		{
+			const T* Input;
+			size_t Rows;
+			T* Output;
+			std::chrono::steady_clock::time_point Arrival;
+			bool bDone;
+			std::condition_variable Done;
+		};
+
+		void batchLoop();
+		void run(const std::vector<Request*>& batch, const size_t& rows);
+		// A connection and the thread serving it, which closes the socket and hands its own thread to mFinished when done.
+		struct Connection
+		{
+			LocalSocket::Handle Socket;
+			std::thread Thread;
+		};
+
+		void acceptLoop();
+		void serveConnection(const typename std::list<Connection>::iterator connection);
+		void serve(const LocalSocket::Handle connection);
+
+		Mlp<T> mModel;
+		bool mbValid;
+		size_t mInputSize;
+		size_t mOutputSize;
+		unsigned int mMaxBatch;
+		std::chrono::microseconds mBudget;
+		// maxBatch x inputs; a batch is gathered into its leading rows.
+		Ndarray<T> mBatch;
+
+		mutable std::mutex mMutex;
+		std::condition_variable mCondition;
+		std::deque<Request*> mQueue;
+		size_t mQueuedRows;
+		bool mbStop;
+		InferenceStatistics mStatistics;
+		std::thread mBatcher;
+
+		std::string mPath;
+		LocalSocket::Handle mListener;
+		std::atomic<bool> mbClosing;
+		std::thread mAcceptor;
+		std::mutex mConnectionMutex;
+		std::condition_variable mConnectionsClosed;
+		std::list<Connection> mConnections;
+		// The last connection thread to finish; the next one to finish joins it, so at most one is left unjoined.
+		std::thread mFinished;
+	};
+
+	// One connection to an InferenceServer listening on a local socket. Calls on one client must not overlap; concurrent callers
+	// each use their own client, and the server batches their requests together.
+	template<typename T>
+	class InferenceClient final
+	{
+	public:
+		InferenceClient();
+		InferenceClient(const InferenceClient& rhs) = delete;
+		InferenceClient& operator=(const InferenceClient& rhs) = delete;
+		~InferenceClient();
+
+		// Learns the model's input and output sizes from the server; false when nothing serves path or it serves another element type.
+		bool Connect(const std::string& path);
+		bool IsConnected() const;
+		size_t GetInputSize() const;
+		size_t GetOutputSize() const;
+
+		// As InferenceServer::Infer. A failed call closes the connection.
+		bool Infer(const T* input, const size_t& rows, T* output);
+	private:
+		void close();
+
+		LocalSocket::Handle mSocket;
+		size_t mInputSize;
+		size_t mOutputSize;
+		unsigned int mMaxBatch;
+		// Row count followed by the rows, sent as one message.
+		std::vector<char> mMessage;
+	};
+
+	inline LocalSocket::Handle LocalSocket::Listen(const std::string& path)
+	{
+		sockaddr_un address;
+		const Handle listener = open(path, address);
+		if (listener == INVALID)
+			return INVALID;
+
+		if (!clearStale(path) || bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+		{
+			Close(listener);
+			return INVALID;
+		}
+		return listener;
+	}
+
+	inline LocalSocket::Handle LocalSocket::Connect(const std::string& path)
+	{
+		sockaddr_un address;
+		const Handle socket = open(path, address);
+		if (socket == INVALID)
+			return INVALID;
+
+		if (connect(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+		{
+			Close(socket);
+			return INVALID;
+		}
+		return socket;
+	}
+
+	inline LocalSocket::Handle LocalSocket::Accept(const Handle& listener)
+	{
+		while (true)
+		{
+			const Handle socket = accept(listener, nullptr, nullptr);
+#ifdef _WIN32
+			if (socket != INVALID)
+				return socket;
+			const int error = WSAGetLastError();
+			if (error == WSAEINTR || error == WSAECONNRESET)
+				continue;
+			if (error != WSAEMFILE && error != WSAENOBUFS)
+				return INVALID;
+#else
+			if (socket != INVALID)
+			{
+				fcntl(socket, F_SETFD, FD_CLOEXEC);
+				return socket;
+			}
+			if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO)
+				continue;
+			if (errno != EMFILE && errno != ENFILE && errno != ENOBUFS && errno != ENOMEM)
+				return INVALID;
+#endif
+			// Out of descriptors or memory until connections close; the pending connection waits in the backlog meanwhile.
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+
+	inline bool LocalSocket::Send(const Handle& socket, const void* data, const size_t& size)
+	{
+		const char* bytes = static_cast<const char*>(data);
+		size_t sent = 0;
+		while (sent < size)
+		{
+#ifdef _WIN32
+			const int count = send(socket, bytes + sent, static_cast<int>(std::min<size_t>(size - sent, 1u << 30)), 0);
+#elif defined(MSG_NOSIGNAL)
+			// A peer that has gone away is an error here, not a SIGPIPE.
+			const ssize_t count = send(socket, bytes + sent, size - sent, MSG_NOSIGNAL);
+#else
+			const ssize_t count = send(socket, bytes + sent, size - sent, 0);
+#endif
+			if (count <= 0)
+			{
+#ifndef _WIN32
+				if (count < 0 && errno == EINTR)
+					continue;
+#endif
+				return false;
+			}
+			sent += static_cast<size_t>(count);
+		}
+		return true;
+	}
+
+	inline bool LocalSocket::Receive(const Handle& socket, void* data, const size_t& size)
+	{
+		char* bytes = static_cast<char*>(data);
+		size_t received = 0;
+		while (received < size)
+		{
+#ifdef _WIN32
+			const int count = recv(socket, bytes + received, static_cast<int>(std::min<size_t>(size - received, 1u << 30)), 0);
+#else
+			const ssize_t count = recv(socket, bytes + received, size - received, 0);
+#endif
+			if (count <= 0)
+			{
+#ifndef _WIN32
+				if (count < 0 && errno == EINTR)
+					continue;
+#endif
+				return false;
+			}
+			received += static_cast<size_t>(count);
+		}
+		return true;
+	}
+
+	inline void LocalSocket::Shutdown(const Handle& socket)
+	{
+#ifdef _WIN32
+		shutdown(socket, SD_BOTH);
+#else
+		shutdown(socket, SHUT_RDWR);
+#endif
+	}
+
+	inline void LocalSocket::Close(const Handle& socket)
+	{
+#ifdef _WIN32
+		closesocket(socket);
+#else
+		::close(socket);
+#endif
+	}
+
+	inline void LocalSocket::Remove(const std::string& path)
+	{
+#ifdef _WIN32
+		DeleteFileA(path.c_str());
+#else
+		unlink(path.c_str());
+#endif
+	}
+
+	inline bool LocalSocket::clearStale(const std::string& path)
+	{
+#ifdef _WIN32
+		// Windows keeps AF_UNIX socket files as reparse points.
+		const DWORD attributes = GetFileAttributesA(path.c_str());
+		if (attributes == INVALID_FILE_ATTRIBUTES)
+			return GetLastError() == ERROR_FILE_NOT_FOUND;
+		if ((attributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0u)
+			return false;
+#else
+		struct stat status;
+		if (lstat(path.c_str(), &status) != 0)
+			return errno == ENOENT;
+		if (!S_ISSOCK(status.st_mode))
+			return false;
+#endif
+		sockaddr_un address;
+		const Handle probe = open(path, address);
+		if (probe == INVALID)
+			return false;
+		const bool bConnected = connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+#ifdef _WIN32
+		const bool bRefused = !bConnected && WSAGetLastError() == WSAECONNREFUSED;
+#else
+		const bool bRefused = !bConnected && errno == ECONNREFUSED;
+#endif
+		Close(probe);
+		if (!bRefused)
+			return false;
+		Remove(path);
+		return true;
+	}
+
+	inline LocalSocket::Handle LocalSocket::open(const std::string& path, sockaddr_un& address)
+	{
+#ifdef _WIN32
+		static const bool bStarted = []()
+		{
+			WSADATA data;
+			return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+		}();
+		if (!bStarted)
+			return INVALID;
+#endif
+		std::memset(&address, 0, sizeof(address));
+		if (path.empty() || path.size() >= sizeof(address.sun_path))
+			return INVALID;
+		address.sun_family = AF_UNIX;
+		std::memcpy(address.sun_path, path.c_str(), path.size());
+
+		const Handle socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+#ifndef _WIN32
+		if (socket != INVALID)
+		{
+			// Processes a ProcessGroup starts do not inherit it.
+			fcntl(socket, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+			const int bNoSignal = 1;
+			setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &bNoSignal, sizeof(bNoSignal));
+#endif
+		}
+#endif
+		return socket;
+	}
+
+	template<typename T>
+	InferenceServer<T>::InferenceServer(const std::string& modelPath, const unsigned int& maxBatch, const std::chrono::microseconds& budget)
+		: mModel({})
+		, mbValid(false)
+		, mInputSize(0)
+		, mOutputSize(0)
+		, mMaxBatch(maxBatch)
+		, mBudget(budget)
+		, mQueuedRows(0)
+		, mbStop(false)
+		, mStatistics()
+		, mListener(LocalSocket::INVALID)
+		, mbClosing(false)
+	{
+		if (maxBatch == 0u || !mModel.Load(modelPath))
+			return;
+
+		mInputSize = mModel.GetLayer(0).GetWeight().GetArraySize(0);
+		mOutputSize = mModel.GetLayer(mModel.GetLayerCount() - 1u).GetWeight().GetArraySize(1);
+		// One run at the full batch sizes every layer buffer Predict keeps.
+		mBatch = Ndarray<T>({ static_cast<size_t>(maxBatch), mInputSize }, static_cast<T>(0));
+		mModel.Predict(mBatch);
+		mbValid = true;
+		mBatcher = std::thread(&InferenceServer<T>::batchLoop, this);
+	}
+
+	template<typename T>
+	InferenceServer<T>::~InferenceServer()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mbStop = true;
+		}
+		mbClosing.store(true);
+		if (mAcceptor.joinable())
+		{
+			// A connection of our own wakes the blocked accept, which then sees mbClosing.
+			const LocalSocket::Handle wake = LocalSocket::Connect(mPath);
+			if (wake != LocalSocket::INVALID)
+			{
+				LocalSocket::Close(wake);
+			}
+			LocalSocket::Shutdown(mListener);
+			mAcceptor.join();
+		}
+		if (mListener != LocalSocket::INVALID)
+		{
+			LocalSocket::Close(mListener);
+			LocalSocket::Remove(mPath);
+		}
+		{
+			std::unique_lock<std::mutex> lock(mConnectionMutex);
+			for (const Connection& connection : mConnections)
+			{
+				LocalSocket::Shutdown(connection.Socket);
+			}
+			mConnectionsClosed.wait(lock, [this]() { return mConnections.empty(); });
+		}
+		if (mFinished.joinable())
+		{
+			mFinished.join();
+		}
+
+		mCondition.notify_all();
+		if (mBatcher.joinable())
+		{
+			mBatcher.join();
+		}
+	}
+
+	template<typename T>
+	inline bool InferenceServer<T>::IsValid() const
+	{
+		return mbValid;
+	}
+
+	template<typename T>
+	inline size_t InferenceServer<T>::GetInputSize() const
+	{
+		return mInputSize;
+	}
+
+	template<typename T>
+	inline size_t InferenceServer<T>::GetOutputSize() const
+	{
+		return mOutputSize;
+	}
+
+	template<typename T>
+	inline unsigned int InferenceServer<T>::GetMaxBatch() const
+	{
+		return mMaxBatch;
+	}
+
+	template<typename T>
+	bool InferenceServer<T>::Infer(const T* input, const size_t& rows, T* output)
+	{
+		if (!mbValid || rows == 0u || rows > mMaxBatch)
+			return false;
+
+		Request request;
+		request.Input = input;
+		request.Rows = rows;
+		request.Output = output;
+		request.Arrival = std::chrono::steady_clock::now();
+		request.bDone = false;
+
+		std::unique_lock<std::mutex> lock(mMutex);
+		if (mbStop)
+			return false;
+		mQueue.push_back(&request);
+		mQueuedRows += rows;
+		// The batching thread waits either for a first request or for a full batch.
+		if (mQueue.size() == 1u || mQueuedRows >= mMaxBatch)
+		{
+			mCondition.notify_one();
+		}
+		request.Done.wait(lock, [&request]() { return request.bDone; });
+		return true;
+	}
+
+	template<typename T>
+	bool InferenceServer<T>::Listen(const std::string& path)
+	{
+		if (!mbValid || mListener != LocalSocket::INVALID)
+			return false;
+
+		mListener = LocalSocket::Listen(path);
+		if (mListener == LocalSocket::INVALID)
+			return false;
+		mPath = path;
+		mAcceptor = std::thread(&InferenceServer<T>::acceptLoop, this);
+		return true;
+	}
+
+	template<typename T>
+	InferenceStatistics InferenceServer<T>::GetStatistics() const
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mStatistics;
+	}
+
+	template<typename T>
+	void InferenceServer<T>::ResetStatistics()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStatistics = InferenceStatistics();
+	}
+
+	template<typename T>
+	void InferenceServer<T>::batchLoop()
+	{
+		std::vector<Request*> batch;
+		batch.reserve(mMaxBatch);
+		std::unique_lock<std::mutex> lock(mMutex);
+		while (true)
+		{
+			mCondition.wait(lock, [this]() { return mbStop || !mQueue.empty(); });
+			// Stopping, the queue is drained before the thread ends.
+			if (mQueue.empty())
+				return;
+			// A deadline already passed skips the timed wait, which costs a timer's slack even when it expired.
+			const std::chrono::steady_clock::time_point deadline = mQueue.front()->Arrival + mBudget;
+			if (deadline > std::chrono::steady_clock::now())
+			{
+				mCondition.wait_until(lock, deadline, [this]() { return mbStop || mQueuedRows >= mMaxBatch; });
+			}
+
+			size_t rows = 0;
+			while (!mQueue.empty() && rows + mQueue.front()->Rows <= mMaxBatch)
+			{
+				rows += mQueue.front()->Rows;
+				batch.push_back(mQueue.front());
+				mQueue.pop_front();
+			}
+			mQueuedRows -= rows;
+			lock.unlock();
+			run(batch, rows);
+			lock.lock();
+
+			mStatistics.Requests += batch.size();
+			mStatistics.Rows += rows;
+			mStatistics.Batches += 1;
+			for (Request* request : batch)
+			{
+				request->bDone = true;
+				request->Done.notify_one();
+			}
+			batch.clear();
+		}
+	}
+
+	template<typename T>
+	void InferenceServer<T>::run(const std::vector<Request*>& batch, const size_t& rows)
+	{
+		NUMPY_PROFILE_SCOPE("InferenceServer::Batch", (mInputSize + mOutputSize) * rows * sizeof(T) * 2u);
+		T* input = mBatch.GetData();
+		for (const Request* request : batch)
+		{
+			input = std::copy(request->Input, request->Input + request->Rows * mInputSize, input);
+		}
+
+		const Ndarray<T>& logits = mModel.Predict(mBatch.Slice(0, 0, rows));
+		const T* output = logits.GetData();
+		for (const Request* request : batch)
+		{
+			for (size_t r = 0; r < request->Rows; ++r, output += logits.GetStride(0))
+			{
+				std::copy(output, output + mOutputSize, request->Output + r * mOutputSize);
+			}
+		}
+	}
+
+	template<typename T>
+	void InferenceServer<T>::acceptLoop()
+	{
+		while (true)
+		{
+			const LocalSocket::Handle connection = LocalSocket::Accept(mListener);
+			if (connection == LocalSocket::INVALID)
+				return;
+			if (mbClosing.load())
+			{
+				LocalSocket::Close(connection);
+				return;
+			}
+			// The thread cannot finish, and erase its entry, before the entry holds it.
+			std::lock_guard<std::mutex> lock(mConnectionMutex);
+			mConnections.push_back(Connection{ connection, std::thread() });
+			mConnections.back().Thread = std::thread(&InferenceServer<T>::serveConnection, this, std::prev(mConnections.end()));
+		}
+	}
+
+	template<typename T>
+	void InferenceServer<T>::serveConnection(const typename std::list<Connection>::iterator connection)
+	{
+		serve(connection->Socket);
+
+		std::thread previous;
+		{
+			std::lock_guard<std::mutex> lock(mConnectionMutex);
+			LocalSocket::Close(connection->Socket);
+			previous = std::move(mFinished);
+			mFinished = std::move(connection->Thread);
+			mConnections.erase(connection);
+			mConnectionsClosed.notify_all();
+		}
+		// The destructor joins this thread through mFinished before the server goes away.
+		if (previous.joinable())
+		{
+			previous.join();
+		}
+	}
+
+	// Protocol, in the host's byte order: on connecting, the server sends the input size, the output size, the element size and
+	// the maximum batch as four uint32. Each request is a uint32 row count followed by its rows; the reply repeats the count,
+	// then the logits, or is a 0 count, after which the server closes the connection.
+	template<typename T>
+	void InferenceServer<T>::serve(const LocalSocket::Handle connection)
+	{
+		const std::uint32_t hello[4] = { static_cast<std::uint32_t>(mInputSize), static_cast<std::uint32_t>(mOutputSize),
+			static_cast<std::uint32_t>(sizeof(T)), mMaxBatch };
+		if (!LocalSocket::Send(connection, hello, sizeof(hello)))
+			return;
+
+		std::vector<T> input(mMaxBatch * mInputSize);
+		std::vector<char> reply(sizeof(std::uint32_t) + mMaxBatch * mOutputSize * sizeof(T));
+		std::uint32_t rows = 0;
+		while (LocalSocket::Receive(connection, &rows, sizeof(rows)))
+		{
+			// Rows of a refused request are not read, so the connection cannot continue.
+			const bool bAccepted = rows != 0u && rows <= mMaxBatch && LocalSocket::Receive(connection, input.data(), rows * mInputSize * sizeof(T));
+			T* output = reinterpret_cast<T*>(reply.data() + sizeof(std::uint32_t));
+			const std::uint32_t count = bAccepted && Infer(input.data(), rows, output) ? rows : 0u;
+			std::memcpy(reply.data(), &count, sizeof(count));
+			if (!LocalSocket::Send(connection, reply.data(), sizeof(count) + count * mOutputSize * sizeof(T)) || count == 0u)
+				return;
+		}
+	}
+
+	template<typename T>
+	InferenceClient<T>::InferenceClient()
+		: mSocket(LocalSocket::INVALID)
+		, mInputSize(0)
+		, mOutputSize(0)
+		, mMaxBatch(0)
+	{
+	}
+
+	template<typename T>
+	InferenceClient<T>::~InferenceClient()
+	{
+		close();
+	}
+
+	template<typename T>
+	bool InferenceClient<T>::Connect(const std::string& path)
+	{
+		close();
+		mSocket = LocalSocket::Connect(path);
+		std::uint32_t hello[4];
+		if (mSocket == LocalSocket::INVALID || !LocalSocket::Receive(mSocket, hello, sizeof(hello)) || hello[2] != sizeof(T))
+		{
+			close();
+			return false;
+		}
+		mInputSize = hello[0];
+		mOutputSize = hello[1];
+		mMaxBatch = hello[3];
+		mMessage.resize(sizeof(std::uint32_t) + mMaxBatch * mInputSize * sizeof(T));
+		return true;
+	}
+
+	template<typename T>
+	inline bool InferenceClient<T>::IsConnected() const
+	{
+		return mSocket != LocalSocket::INVALID;
+	}
+
+	template<typename T>
+	inline size_t InferenceClient<T>::GetInputSize() const
+	{
+		return mInputSize;
+	}
+
+	template<typename T>
+	inline size_t InferenceClient<T>::GetOutputSize() const
+	{
+		return mOutputSize;
+	}
+
+	template<typename T>
+	bool InferenceClient<T>::Infer(const T* input, const size_t& rows, T* output)
+	{
+		if (!IsConnected() || rows == 0u || rows > mMaxBatch)
+			return false;
+
+		const std::uint32_t count = static_cast<std::uint32_t>(rows);
+		std::memcpy(mMessage.data(), &count, sizeof(count));
+		std::memcpy(mMessage.data() + sizeof(count), input, rows * mInputSize * sizeof(T));
+		std::uint32_t reply = 0;
+		if (!LocalSocket::Send(mSocket, mMessage.data(), sizeof(count) + rows * mInputSize * sizeof(T))
+			|| !LocalSocket::Receive(mSocket, &reply, sizeof(reply)) || reply != count
+			|| !LocalSocket::Receive(mSocket, output, rows * mOutputSize * sizeof(T)))
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	template<typename T>
+	void InferenceClient<T>::close()
+	{
+		if (mSocket != LocalSocket::INVALID)
+		{
+			LocalSocket::Close(mSocket);
+			mSocket = LocalSocket::INVALID;
+		}
+	}
+}
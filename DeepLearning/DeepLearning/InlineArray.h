@@ -0,0 +1,142 @@
+#pragma once
+#include<memory>
+
+namespace numpy
+{
+	// Storage for shapes and strides: up to N elements live inside the object, so arrays of ordinary rank never touch the heap for metadata.
+	template<typename T, unsigned int N>
+	class InlineArray final
+	{
+	public:
+		InlineArray();
+		explicit InlineArray(const unsigned int& size);
+		InlineArray(const InlineArray<T, N>& rhs);
+		InlineArray(InlineArray<T, N>&& rhs);
+		~InlineArray() = default;
+
+		InlineArray<T, N>& operator=(const InlineArray<T, N>& rhs);
+		InlineArray<T, N>& operator=(InlineArray<T, N>&& rhs);
+
+		T& operator[](const unsigned int& index);
+		const T& operator[](const unsigned int& index) const;
+
+		// Existing elements are not preserved.
+		void Resize(const unsigned int& size);
+		unsigned int GetSize() const;
+		T* Get();
+		const T* Get() const;
+	private:
+		unsigned int mSize;
+		T mInline[N];
+		std::unique_ptr<T[]> mHeap;
+	};
+
+	template<typename T, unsigned int N>
+	inline InlineArray<T, N>::InlineArray()
+		: mSize(0)
+		, mHeap(nullptr)
+	{
+	}
+
+	template<typename T, unsigned int N>
+	inline InlineArray<T, N>::InlineArray(const unsigned int& size)
+		: InlineArray()
+	{
+		Resize(size);
+	}
+
+	template<typename T, unsigned int N>
+	inline InlineArray<T, N>::InlineArray(const InlineArray<T, N>& rhs)
+		: InlineArray()
+	{
+		*this = rhs;
+	}
+
+	template<typename T, unsigned int N>
+	inline InlineArray<T, N>::InlineArray(InlineArray<T, N>&& rhs)
+		: InlineArray()
+	{
+		*this = std::move(rhs);
+	}
+
+	template<typename T, unsigned int N>
+	inline InlineArray<T, N>& InlineArray<T, N>::operator=(const InlineArray<T, N>& rhs)
+	{
+		if (this == &rhs)
+		{
+			return *this;
+		}
+		Resize(rhs.mSize);
+		const T* source = rhs.Get();
+		T* target = Get();
+		for (unsigned int i = 0; i < mSize; ++i)
+		{
+			target[i] = source[i];
+		}
+		return *this;
+	}
+
+	template<typename T, unsigned int N>
+	inline InlineArray<T, N>& InlineArray<T, N>::operator=(InlineArray<T, N>&& rhs)
+	{
+		if (this == &rhs)
+		{
+			return *this;
+		}
+		if (rhs.mHeap != nullptr)
+		{
+			mSize = rhs.mSize;
+			mHeap = std::move(rhs.mHeap);
+		}
+		else
+		{
+			*this = static_cast<const InlineArray<T, N>&>(rhs);
+		}
+		rhs.mSize = 0;
+		return *this;
+	}
+
+	template<typename T, unsigned int N>
+	inline T& InlineArray<T, N>::operator[](const unsigned int& index)
+	{
+		return Get()[index];
+	}
+
+	template<typename T, unsigned int N>
+	inline const T& InlineArray<T, N>::operator[](const unsigned int& index) const
+	{
+		return Get()[index];
+	}
+
+	template<typename T, unsigned int N>
+	inline void InlineArray<T, N>::Resize(const unsigned int& size)
+	{
+		if (size > N && (mHeap == nullptr || size > mSize))
+		{
+			mHeap = std::make_unique<T[]>(size);
+		}
+		else if (size <= N)
+		{
+			mHeap = nullptr;
+		}
+		mSize = size;
+	}
+
+	template<typename T, unsigned int N>
+	inline unsigned int InlineArray<T, N>::GetSize() const
+	{
+		return mSize;
+	}
+
+	template<typename T, unsigned int N>
+	inline T* InlineArray<T, N>::Get()
+	{
+		return mHeap != nullptr ? mHeap.get() : mInline;
+	}
+
+	template<typename T, unsigned int N>
+	inline const T* InlineArray<T, N>::Get() const
+	{
+		return mHeap != nullptr ? mHeap.get() : mInline;
+	}
+}
@@ -0,0 +1,561 @@
+#pragma once
+#include<cmath>
+#include<random>
+#include<algorithm>
+#include "Convolution.h"
+#include "Numpy.h"
+#include "Profiler.h"
+
+namespace numpy
+{
+	enum class Activation
+	{
+		Identity,
+		Relu,
+	};
+
+	// Fully connected layer y = activation(x . w + b) over a batch of rows. Forward is one GEMM with b and the activation in its
+	// epilogue; Backward folds the ReLU derivative into the packing of both gradient GEMMs, so dL/du is never stored.
+	template<typename T>
+	class Dense final
+	{
+	public:
+		// Weights are He-initialised for ReLU and Xavier-initialised otherwise; biases start at 0.
+		Dense(const unsigned int& inputSize, const unsigned int& outputSize, const Activation& activation, const unsigned int& seed = 0);
+		~Dense() = default;
+
+		// x is (batch x inputSize) and is referenced, not copied, until the next Forward.
+		const Ndarray<T>& Forward(const Ndarray<T>& x);
+		// Forward for inference: nothing is kept for Backward, and out is written in place when it already has the result's shape.
+		void Infer(const Ndarray<T>& x, Ndarray<T>& out) const;
+		// gradOutput is dL/dy for the last Forward. Fills the weight and bias gradients and returns dL/dx.
+		const Ndarray<T>& Backward(const Ndarray<T>& gradOutput);
+		// Plain gradient descent step.
+		void Update(const T& eta);
+
+		Ndarray<T>& GetWeight();
+		Ndarray<T>& GetBias();
+		const Ndarray<T>& GetWeight() const;
+		const Ndarray<T>& GetBias() const;
+		const Ndarray<T>& GetOutput() const;
+		const Ndarray<T>& GetGradWeight() const;
+		const Ndarray<T>& GetGradBias() const;
+		// Writable, for gradients summed over processes before Update.
+		Ndarray<T>& GetGradWeight();
+		Ndarray<T>& GetGradBias();
+		const Ndarray<T>& GetGradInput() const;
+	private:
+		void sumGradBias(const Ndarray<T>& gradOutput, const bool& bMasked);
+
+		Activation mActivation;
+		Ndarray<T> mWeight;
+		Ndarray<T> mBias;
+		// x.Transpose(): a view sharing x's storage, which is the form the weight gradient GEMM reads it in.
+		Ndarray<T> mInputTranspose;
+		Ndarray<T> mOutput;
+		Ndarray<T> mGradWeight;
+		Ndarray<T> mGradBias;
+		Ndarray<T> mGradInput;
+	};
+
+	// Softmax output and cross-entropy loss as one kernel over each row: the row is shifted by its maximum before exp and the
+	// loss is taken from log-softmax (u - max - log(sum)), so large logits neither overflow nor need the log(y + 1e-7) guard.
+	template<typename T>
+	class SoftmaxCrossEntropy final
+	{
+	public:
+		SoftmaxCrossEntropy() = default;
+		~SoftmaxCrossEntropy() = default;
+
+		// logits and target are (batch x classes); target rows are one-hot or any distribution. Returns the loss averaged over
+		// the batch, and keeps the probabilities and the gradient for Backward.
+		T Forward(const Ndarray<T>& logits, const Ndarray<T>& target);
+		// dL/du = y - t per sample, not divided by the batch size.
+		const Ndarray<T>& Backward() const;
+		const Ndarray<T>& GetProbability() const;
+		// The loss of Forward alone, computed without storing anything.
+		static T Loss(const Ndarray<T>& logits, const Ndarray<T>& target);
+	private:
+		static bool isValid(const Ndarray<T>& logits, const Ndarray<T>& target);
+		// Loss of one row; y and gradient receive the probabilities and y - t unless they are nullptr.
+		static T row(const T* u, const size_t& uStride, const T* t, const size_t& tStride, const size_t& columns, T* y, T* gradient);
+
+		Ndarray<T> mProbability;
+		Ndarray<T> mGradient;
+	};
+
+	// 2-D convolution layer y = activation(x * w + b) over a batch of images, weights laid out as ConvolutionParameters describes.
+	// Forward runs through im2col and keeps the patch matrix for the weight gradient; Infer keeps nothing and lets
+	// Convolution pick the algorithm.
+	template<typename T>
+	class Conv2D final
+	{
+	public:
+		// Weights are He-initialised for ReLU and Xavier-initialised otherwise over the channels * kernelSize^2 inputs of a filter.
+		Conv2D(const unsigned int& channels, const unsigned int& filters, const unsigned int& kernelSize, const ConvolutionParameters& parameters,
+			const Activation& activation, const unsigned int& seed = 0);
+		~Conv2D() = default;
+
+		// x is referenced, not copied, until the next Forward.
+		const Ndarray<T>& Forward(const Ndarray<T>& x);
+		void Infer(const Ndarray<T>& x, Ndarray<T>& out) const;
+		const Ndarray<T>& Backward(const Ndarray<T>& gradOutput);
+		void Update(const T& eta);
+
+		Ndarray<T>& GetWeight();
+		Ndarray<T>& GetBias();
+		const Ndarray<T>& GetOutput() const;
+		const Ndarray<T>& GetGradWeight() const;
+		const Ndarray<T>& GetGradBias() const;
+		const Ndarray<T>& GetGradInput() const;
+	private:
+		ConvolutionParameters mParameters;
+		Activation mActivation;
+		Ndarray<T> mWeight;
+		Ndarray<T> mBias;
+		// A view of the last input, for its shape.
+		Ndarray<T> mInput;
+		Ndarray<T> mColumns;
+		Ndarray<T> mOutput;
+		// gradOutput with the ReLU derivative applied.
+		Ndarray<T> mGradPreActivation;
+		Ndarray<T> mGradWeight;
+		Ndarray<T> mGradBias;
+		Ndarray<T> mGradInput;
+	};
+
+	// Max pooling over size x size windows, stride apart, remembering where each maximum came from for Backward.
+	template<typename T>
+	class MaxPool2D final
+	{
+	public:
+		MaxPool2D(const unsigned int& size, const unsigned int& stride, const ImageLayout& layout);
+		~MaxPool2D() = default;
+
+		const Ndarray<T>& Forward(const Ndarray<T>& x);
+		const Ndarray<T>& Backward(const Ndarray<T>& gradOutput);
+
+		const Ndarray<T>& GetOutput() const;
+		const Ndarray<T>& GetGradInput() const;
+	private:
+		unsigned int mSize;
+		unsigned int mStride;
+		ImageLayout mLayout;
+		Ndarray<T> mInput;
+		Ndarray<T> mOutput;
+		Ndarray<size_t> mIndices;
+		Ndarray<T> mGradInput;
+	};
+
+	template<typename T>
+	Dense<T>::Dense(const unsigned int& inputSize, const unsigned int& outputSize, const Activation& activation, const unsigned int& seed)
+		: mActivation(activation)
+		, mWeight({ inputSize, outputSize })
+		, mBias({ outputSize }, 0)
+	{
+		const double scale = activation == Activation::Relu ? std::sqrt(2.0 / inputSize) : 1.0 / std::sqrt(static_cast<double>(inputSize));
+		std::mt19937 engine(seed);
+		std::normal_distribution<double> distribution(0.0, scale);
+		T* weight = mWeight.GetData();
+		for (size_t i = 0; i < mWeight.GetTotalSize(); ++i)
+		{
+			weight[i] = static_cast<T>(distribution(engine));
+		}
+	}
+
+	template<typename T>
+	const Ndarray<T>& Dense<T>::Forward(const Ndarray<T>& x)
+	{
+		NUMPY_PROFILE_SCOPE("Dense::Forward");
+		mInputTranspose = x.Transpose();
+		Numpy<T>::Dot(mOutput, x, mWeight, mBias, mActivation == Activation::Relu);
+		return mOutput;
+	}
+
+	template<typename T>
+	inline void Dense<T>::Infer(const Ndarray<T>& x, Ndarray<T>& out) const
+	{
+		Numpy<T>::Dot(out, x, mWeight, mBias, mActivation == Activation::Relu);
+	}
+
+	template<typename T>
+	const Ndarray<T>& Dense<T>::Backward(const Ndarray<T>& gradOutput)
+	{
+		NUMPY_PROFILE_SCOPE("Dense::Backward");
+		// y > 0 exactly where u > 0, so the stored output doubles as the ReLU derivative mask.
+		const Ndarray<T> none;
+		const bool bMasked = mActivation == Activation::Relu;
+		const Ndarray<T>& mask = bMasked ? mOutput : none;
+
+		Numpy<T>::MaskedDot(mGradWeight, mInputTranspose, gradOutput, none, mask);
+		Numpy<T>::MaskedDot(mGradInput, gradOutput, mWeight.Transpose(), mask, none);
+		sumGradBias(gradOutput, bMasked);
+		return mGradInput;
+	}
+
+	template<typename T>
+	void Dense<T>::Update(const T& eta)
+	{
+		NUMPY_PROFILE_SCOPE("Dense::Update");
+		mWeight -= mGradWeight * eta;
+		mBias -= mGradBias * eta;
+	}
+
+	template<typename T>
+	inline Ndarray<T>& Dense<T>::GetWeight()
+	{
+		return mWeight;
+	}
+
+	template<typename T>
+	inline Ndarray<T>& Dense<T>::GetBias()
+	{
+		return mBias;
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& Dense<T>::GetWeight() const
+	{
+		return mWeight;
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& Dense<T>::GetBias() const
+	{
+		return mBias;
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& Dense<T>::GetOutput() const
+	{
+		return mOutput;
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& Dense<T>::GetGradWeight() const
+	{
+		return mGradWeight;
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& Dense<T>::GetGradBias() const
+	{
+		return mGradBias;
+	}
+
+	template<typename T>
+	inline Ndarray<T>& Dense<T>::GetGradWeight()
+	{
+		return mGradWeight;
+	}
+
+	template<typename T>
+	inline Ndarray<T>& Dense<T>::GetGradBias()
+	{
+		return mGradBias;
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& Dense<T>::GetGradInput() const
+	{
+		return mGradInput;
+	}
+
+	template<typename T>
+	void Dense<T>::sumGradBias(const Ndarray<T>& gradOutput, const bool& bMasked)
+	{
+		const size_t rows = gradOutput.GetArraySize(0);
+		const size_t columns = gradOutput.GetArraySize(1);
+		if (mGradBias.GetDimension() != 1u || mGradBias.GetArraySize(0) != columns)
+		{
+			mGradBias = Ndarray<T>({ columns });
+		}
+
+		const T* grad = gradOutput.GetData();
+		const size_t rowStride = gradOutput.GetStride(0);
+		const size_t columnStride = gradOutput.GetStride(1);
+		const T* output = mOutput.GetData();
+		T* gradBias = mGradBias.GetData();
+		std::fill(gradBias, gradBias + columns, static_cast<T>(0));
+		for (size_t r = 0; r < rows; ++r)
+		{
+			const T* gradRow = grad + r * rowStride;
+			const T* outputRow = output + r * columns;
+			for (unsigned int c = 0; c < columns; ++c)
+			{
+				if (!bMasked || outputRow[c] > 0)
+				{
+					gradBias[c] += gradRow[static_cast<size_t>(c) * columnStride];
+				}
+			}
+		}
+	}
+
+	template<typename T>
+	T SoftmaxCrossEntropy<T>::Forward(const Ndarray<T>& logits, const Ndarray<T>& target)
+	{
+		if (!isValid(logits, target))
+		{
+			mProbability = Ndarray<T>();
+			mGradient = Ndarray<T>();
+			return 0;
+		}
+
+		const size_t rows = logits.GetArraySize(0);
+		const size_t columns = logits.GetArraySize(1);
+		NUMPY_PROFILE_SCOPE("SoftmaxCrossEntropy::Forward", static_cast<std::uint64_t>(rows) * columns * sizeof(T) * 4u);
+		if (mProbability.GetDimension() != 2u || mProbability.GetArraySize(0) != rows || mProbability.GetArraySize(1) != columns)
+		{
+			mProbability = Ndarray<T>({ rows, columns });
+			mGradient = Ndarray<T>({ rows, columns });
+		}
+
+		double loss = 0.0;
+		for (size_t r = 0; r < rows; ++r)
+		{
+			loss += row(logits.GetData() + r * logits.GetStride(0), logits.GetStride(1),
+				target.GetData() + r * target.GetStride(0), target.GetStride(1), columns,
+				mProbability.GetData() + r * columns, mGradient.GetData() + r * columns);
+		}
+		return static_cast<T>(loss / rows);
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& SoftmaxCrossEntropy<T>::Backward() const
+	{
+		return mGradient;
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& SoftmaxCrossEntropy<T>::GetProbability() const
+	{
+		return mProbability;
+	}
+
+	template<typename T>
+	T SoftmaxCrossEntropy<T>::Loss(const Ndarray<T>& logits, const Ndarray<T>& target)
+	{
+		if (!isValid(logits, target))
+			return 0;
+
+		const size_t rows = logits.GetArraySize(0);
+		double loss = 0.0;
+		for (size_t r = 0; r < rows; ++r)
+		{
+			loss += row(logits.GetData() + r * logits.GetStride(0), logits.GetStride(1),
+				target.GetData() + r * target.GetStride(0), target.GetStride(1), logits.GetArraySize(1), nullptr, nullptr);
+		}
+		return static_cast<T>(loss / rows);
+	}
+
+	template<typename T>
+	inline bool SoftmaxCrossEntropy<T>::isValid(const Ndarray<T>& logits, const Ndarray<T>& target)
+	{
+		return logits.GetDimension() == 2u && target.GetDimension() == 2u && logits.GetArraySize(0) != 0u
+			&& logits.GetArraySize(0) == target.GetArraySize(0) && logits.GetArraySize(1) == target.GetArraySize(1);
+	}
+
+	template<typename T>
+	T SoftmaxCrossEntropy<T>::row(const T* u, const size_t& uStride, const T* t, const size_t& tStride, const size_t& columns, T* y, T* gradient)
+	{
+		// logSum is log(sum(exp(u))); MathKernel computes it in the same pass over a contiguous row that finds the maximum.
+		T logSum;
+		if (uStride == 1)
+		{
+			logSum = y != nullptr ? MathKernel<T>::Softmax(u, y, columns) : MathKernel<T>::LogSumExp(u, columns);
+		}
+		else
+		{
+			T max = u[0];
+			for (unsigned int c = 1; c < columns; ++c)
+			{
+				max = std::max(max, u[static_cast<size_t>(c) * uStride]);
+			}
+			T sum = 0;
+			for (unsigned int c = 0; c < columns; ++c)
+			{
+				const T e = std::exp(u[static_cast<size_t>(c) * uStride] - max);
+				sum += e;
+				if (y != nullptr)
+				{
+					y[c] = e;
+				}
+			}
+			if (y != nullptr)
+			{
+				const T inverse = static_cast<T>(1) / sum;
+				for (unsigned int c = 0; c < columns; ++c)
+				{
+					y[c] *= inverse;
+				}
+			}
+			logSum = max + std::log(sum);
+		}
+
+		T loss = 0;
+		for (unsigned int c = 0; c < columns; ++c)
+		{
+			const T targetValue = t[static_cast<size_t>(c) * tStride];
+			loss -= targetValue * (u[static_cast<size_t>(c) * uStride] - logSum);
+		}
+		if (y != nullptr)
+		{
+			for (unsigned int c = 0; c < columns; ++c)
+			{
+				gradient[c] = y[c] - t[static_cast<size_t>(c) * tStride];
+			}
+		}
+		return loss;
+	}
+
+	template<typename T>
+	Conv2D<T>::Conv2D(const unsigned int& channels, const unsigned int& filters, const unsigned int& kernelSize, const ConvolutionParameters& parameters,
+		const Activation& activation, const unsigned int& seed)
+		: mParameters(parameters)
+		, mActivation(activation)
+		, mWeight(parameters.Layout == ImageLayout::Nchw ? Ndarray<T>({ filters, channels, kernelSize, kernelSize })
+			: Ndarray<T>({ kernelSize, kernelSize, channels, filters }))
+		, mBias({ filters }, 0)
+	{
+		const double inputSize = static_cast<double>(channels) * kernelSize * kernelSize;
+		const double scale = activation == Activation::Relu ? std::sqrt(2.0 / inputSize) : 1.0 / std::sqrt(inputSize);
+		std::mt19937 engine(seed);
+		std::normal_distribution<double> distribution(0.0, scale);
+		T* weight = mWeight.GetData();
+		for (size_t i = 0; i < mWeight.GetTotalSize(); ++i)
+		{
+			weight[i] = static_cast<T>(distribution(engine));
+		}
+	}
+
+	template<typename T>
+	const Ndarray<T>& Conv2D<T>::Forward(const Ndarray<T>& x)
+	{
+		NUMPY_PROFILE_SCOPE("Conv2D::Forward");
+		mInput = x.Slice(0, 0, x.GetDimension() == 0u ? 0 : x.GetArraySize(0));
+		Convolution<T>::Forward(mOutput, mColumns, x, mWeight, mBias, mParameters, mActivation == Activation::Relu);
+		return mOutput;
+	}
+
+	template<typename T>
+	inline void Conv2D<T>::Infer(const Ndarray<T>& x, Ndarray<T>& out) const
+	{
+		Convolution<T>::Forward(out, x, mWeight, mBias, mParameters, mActivation == Activation::Relu);
+	}
+
+	template<typename T>
+	const Ndarray<T>& Conv2D<T>::Backward(const Ndarray<T>& gradOutput)
+	{
+		NUMPY_PROFILE_SCOPE("Conv2D::Backward");
+		if (gradOutput.GetDimension() != 4u || gradOutput.GetTotalSize() != mOutput.GetTotalSize())
+		{
+			mGradInput = Ndarray<T>();
+			return mGradInput;
+		}
+
+		// One pass applies the ReLU derivative (y > 0 exactly where the pre-activation is) and sums the bias gradient.
+		mGradPreActivation = gradOutput;
+		const size_t filters = mBias.GetTotalSize();
+		const size_t pixels = mOutput.GetTotalSize() / mOutput.GetArraySize(0) / filters;
+		const bool bNchw = mParameters.Layout == ImageLayout::Nchw;
+		if (mGradBias.GetTotalSize() != filters)
+		{
+			mGradBias = Ndarray<T>({ filters });
+		}
+		T* gradient = mGradPreActivation.GetData();
+		const T* output = mOutput.GetData();
+		T* gradBias = mGradBias.GetData();
+		std::fill(gradBias, gradBias + filters, static_cast<T>(0));
+		for (size_t i = 0; i < mOutput.GetTotalSize(); ++i)
+		{
+			if (mActivation == Activation::Relu && !(output[i] > 0))
+			{
+				gradient[i] = 0;
+			}
+			gradBias[bNchw ? i / pixels % filters : i % filters] += gradient[i];
+		}
+
+		Convolution<T>::BackwardWeight(mGradWeight, mColumns, mGradPreActivation, mWeight, mParameters);
+		Convolution<T>::BackwardData(mGradInput, mGradPreActivation, mWeight, mInput, mParameters);
+		return mGradInput;
+	}
+
+	template<typename T>
+	void Conv2D<T>::Update(const T& eta)
+	{
+		NUMPY_PROFILE_SCOPE("Conv2D::Update");
+		mWeight -= mGradWeight * eta;
+		mBias -= mGradBias * eta;
+	}
+
+	template<typename T>
+	inline Ndarray<T>& Conv2D<T>::GetWeight()
+	{
+		return mWeight;
+	}
+
+	template<typename T>
+	inline Ndarray<T>& Conv2D<T>::GetBias()
+	{
+		return mBias;
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& Conv2D<T>::GetOutput() const
+	{
+		return mOutput;
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& Conv2D<T>::GetGradWeight() const
+	{
+		return mGradWeight;
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& Conv2D<T>::GetGradBias() const
+	{
+		return mGradBias;
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& Conv2D<T>::GetGradInput() const
+	{
+		return mGradInput;
+	}
+
+	template<typename T>
+	MaxPool2D<T>::MaxPool2D(const unsigned int& size, const unsigned int& stride, const ImageLayout& layout)
+		: mSize(size)
+		, mStride(stride)
+		, mLayout(layout)
+	{
+	}
+
+	template<typename T>
+	const Ndarray<T>& MaxPool2D<T>::Forward(const Ndarray<T>& x)
+	{
+		mInput = x.Slice(0, 0, x.GetDimension() == 0u ? 0 : x.GetArraySize(0));
+		Convolution<T>::MaxPool(mOutput, mIndices, x, mSize, mStride, mLayout);
+		return mOutput;
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& MaxPool2D<T>::Backward(const Ndarray<T>& gradOutput)
+	{
+		Convolution<T>::MaxPoolBackward(mGradInput, gradOutput, mIndices, mInput);
+		return mGradInput;
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& MaxPool2D<T>::GetOutput() const
+	{
+		return mOutput;
+	}
+
+	template<typename T>
+	inline const Ndarray<T>& MaxPool2D<T>::GetGradInput() const
+	{
+		return mGradInput;
+	}
+}
@@ -0,0 +1,234 @@
+#pragma once
+#include<initializer_list>
+#include<limits>
+#include<map>
+#include<string>
+#include<utility>
+#include<vector>
+#include "Distributed.h"
+#include "Layer.h"
+#include "Npy.h"
+
+namespace numpy
+{
+	// Multilayer perceptron classifier: ReLU hidden layers, a linear output layer and softmax cross-entropy. Training and
+	// inference keep separate buffers between calls, so evaluating a whole data set between mini-batches reshapes neither and
+	// steady-state training allocates nothing.
+	template<typename T>
+	class Mlp final
+	{
+	public:
+		// sizes = { inputs, hidden sizes..., classes }.
+		Mlp(const std::initializer_list<unsigned int>& sizes, const unsigned int& seed = 0);
+		~Mlp() = default;
+
+		// One SGD step on a mini-batch; returns the batch loss before the update.
+		T TrainBatch(const Ndarray<T>& x, const Ndarray<T>& t, const T& eta);
+		// One data-parallel SGD step: x and t are this process's rows of the mini-batch, and each layer's gradients go to reducer
+		// as soon as Backward has produced them, so they are summed over the group while the layers before run Backward. Every
+		// process then applies the same update. Returns the loss of this process's rows, or NaN with the weights unchanged when
+		// the group has failed.
+		T TrainBatch(const Ndarray<T>& x, const Ndarray<T>& t, const T& eta, GradientReducer<T>& reducer);
+		// Output-layer logits; their argmax is the predicted class. Valid until the next Predict or Evaluate.
+		const Ndarray<T>& Predict(const Ndarray<T>& x);
+		// Mean cross-entropy over x, with the fraction of rows whose predicted class is the argmax of t in accuracy.
+		T Evaluate(const Ndarray<T>& x, const Ndarray<T>& t, T& accuracy);
+
+		// The weights and biases as an .npz archive of "weight0", "bias0", "weight1", ... in layer order.
+		bool Save(const std::string& path) const;
+		// Replaces the layers with those of an archive Save wrote, sized by its shapes. false, with the model unchanged, when the
+		// file cannot be read or its shapes do not chain from layer to layer.
+		bool Load(const std::string& path);
+
+		unsigned int GetLayerCount() const;
+		Dense<T>& GetLayer(const unsigned int& index);
+	private:
+		// Forward and backward over the batch, calling layerDone(layer) as each layer's gradients become final, last layer first.
+		template<typename F>
+		T backpropagate(const Ndarray<T>& x, const Ndarray<T>& t, const F& layerDone);
+
+		std::vector<Dense<T>> mLayers;
+		SoftmaxCrossEntropy<T> mLoss;
+		// Inference outputs per layer, grown to the largest batch seen; Predict writes into views of their leading rows.
+		std::vector<Ndarray<T>> mInference;
+		std::vector<Ndarray<T>> mInferenceViews;
+	};
+
+	template<typename T>
+	Mlp<T>::Mlp(const std::initializer_list<unsigned int>& sizes, const unsigned int& seed)
+	{
+		const std::vector<unsigned int> layerSizes(sizes);
+		mLayers.reserve(layerSizes.size());
+		for (size_t i = 1; i < layerSizes.size(); ++i)
+		{
+			const Activation activation = i + 1 < layerSizes.size() ? Activation::Relu : Activation::Identity;
+			mLayers.emplace_back(layerSizes[i - 1], layerSizes[i], activation, seed + static_cast<unsigned int>(i));
+		}
+		mInference.resize(mLayers.size());
+		mInferenceViews.resize(mLayers.size());
+	}
+
+	template<typename T>
+	T Mlp<T>::TrainBatch(const Ndarray<T>& x, const Ndarray<T>& t, const T& eta)
+	{
+		const T loss = backpropagate(x, t, [](Dense<T>&) {});
+		for (Dense<T>& layer : mLayers)
+		{
+			layer.Update(eta);
+		}
+		return loss;
+	}
+
+	template<typename T>
+	T Mlp<T>::TrainBatch(const Ndarray<T>& x, const Ndarray<T>& t, const T& eta, GradientReducer<T>& reducer)
+	{
+		const T loss = backpropagate(x, t, [&reducer](Dense<T>& layer)
+		{
+			reducer.Push(layer.GetGradWeight());
+			reducer.Push(layer.GetGradBias());
+		});
+		if (!reducer.Wait())
+			return std::numeric_limits<T>::quiet_NaN();
+
+		for (Dense<T>& layer : mLayers)
+		{
+			layer.Update(eta);
+		}
+		return loss;
+	}
+
+	template<typename T>
+	template<typename F>
+	T Mlp<T>::backpropagate(const Ndarray<T>& x, const Ndarray<T>& t, const F& layerDone)
+	{
+		const Ndarray<T>* y = &x;
+		for (Dense<T>& layer : mLayers)
+		{
+			y = &layer.Forward(*y);
+		}
+		const T loss = mLoss.Forward(*y, t);
+
+		const Ndarray<T>* grad = &mLoss.Backward();
+		for (size_t i = mLayers.size(); i > 0; --i)
+		{
+			grad = &mLayers[i - 1].Backward(*grad);
+			layerDone(mLayers[i - 1]);
+		}
+		return loss;
+	}
+
+	template<typename T>
+	const Ndarray<T>& Mlp<T>::Predict(const Ndarray<T>& x)
+	{
+		const size_t rows = x.GetDimension() == 0u ? 0 : x.GetArraySize(0);
+		const Ndarray<T>* y = &x;
+		for (size_t i = 0; i < mLayers.size(); ++i)
+		{
+			const size_t columns = mLayers[i].GetWeight().GetArraySize(1);
+			if (mInference[i].GetDimension() != 2u || mInference[i].GetArraySize(0) < rows)
+			{
+				mInference[i] = Ndarray<T>({ rows, columns });
+				mInferenceViews[i] = Ndarray<T>();
+			}
+			if (mInferenceViews[i].GetDimension() != 2u || mInferenceViews[i].GetArraySize(0) != rows)
+			{
+				mInferenceViews[i] = mInference[i].Slice(0, 0, rows);
+			}
+			mLayers[i].Infer(*y, mInferenceViews[i]);
+			y = &mInferenceViews[i];
+		}
+		return *y;
+	}
+
+	template<typename T>
+	T Mlp<T>::Evaluate(const Ndarray<T>& x, const Ndarray<T>& t, T& accuracy)
+	{
+		const Ndarray<T>& logits = Predict(x);
+		const T loss = SoftmaxCrossEntropy<T>::Loss(logits, t);
+		if (logits.GetDimension() != 2u || !t.IsContiguous())
+		{
+			accuracy = 0;
+			return loss;
+		}
+
+		// Argmax per row without materialising the index arrays.
+		const size_t rows = logits.GetArraySize(0);
+		const size_t columns = logits.GetArraySize(1);
+		const T* target = t.GetData();
+		unsigned int correct = 0;
+		for (size_t r = 0; r < rows; ++r)
+		{
+			const T* predicted = logits.GetData() + r * logits.GetStride(0);
+			const T* expected = target + r * columns;
+			unsigned int best = 0;
+			unsigned int label = 0;
+			for (unsigned int c = 1; c < columns; ++c)
+			{
+				best = predicted[best] < predicted[c] ? c : best;
+				label = expected[label] < expected[c] ? c : label;
+			}
+			correct += best == label ? 1u : 0u;
+		}
+		accuracy = rows == 0u ? static_cast<T>(0) : static_cast<T>(correct) / static_cast<T>(rows);
+		return loss;
+	}
+
+	template<typename T>
+	bool Mlp<T>::Save(const std::string& path) const
+	{
+		std::vector<std::pair<std::string, Ndarray<T>>> arrays;
+		for (size_t i = 0; i < mLayers.size(); ++i)
+		{
+			arrays.emplace_back("weight" + std::to_string(i), mLayers[i].GetWeight());
+			arrays.emplace_back("bias" + std::to_string(i), mLayers[i].GetBias());
+		}
+		return Npy<T>::SaveNpz(path, arrays);
+	}
+
+	template<typename T>
+	bool Mlp<T>::Load(const std::string& path)
+	{
+		std::map<std::string, Ndarray<T>> arrays = Npy<T>::LoadNpz(path);
+		size_t count = 0;
+		while (arrays.count("weight" + std::to_string(count)) != 0u)
+		{
+			++count;
+		}
+		if (count == 0u)
+			return false;
+
+		std::vector<Dense<T>> layers;
+		layers.reserve(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			Ndarray<T>& weight = arrays["weight" + std::to_string(i)];
+			Ndarray<T>& bias = arrays["bias" + std::to_string(i)];
+			if (weight.GetDimension() != 2u || bias.GetDimension() != 1u || bias.GetArraySize(0) != weight.GetArraySize(1)
+				|| (i != 0u && weight.GetArraySize(0) != layers.back().GetWeight().GetArraySize(1)))
+				return false;
+
+			// As in the constructor, the hidden layers are ReLU and the last is linear.
+			layers.emplace_back(static_cast<unsigned int>(weight.GetArraySize(0)), static_cast<unsigned int>(weight.GetArraySize(1)),
+				i + 1u < count ? Activation::Relu : Activation::Identity);
+			layers.back().GetWeight() = std::move(weight);
+			layers.back().GetBias() = std::move(bias);
+		}
+
+		mLayers = std::move(layers);
+		mInference.assign(mLayers.size(), Ndarray<T>());
+		mInferenceViews.assign(mLayers.size(), Ndarray<T>());
+		return true;
+	}
+
+	template<typename T>
+	inline unsigned int Mlp<T>::GetLayerCount() const
+	{
+		return static_cast<unsigned int>(mLayers.size());
+	}
+
+	template<typename T>
+	inline Dense<T>& Mlp<T>::GetLayer(const unsigned int& index)
+	{
+		return mLayers[index];
+	}
+}
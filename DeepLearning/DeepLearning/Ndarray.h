@@ -1,46 +1,124 @@
 #pragma once
+#include<algorithm>
 #include<memory>
 #include<cassert>
 #include<iostream>
 #include<initializer_list>
+#include<limits>
+#include<type_traits>
+#include "Allocator.h"
+#include "Expression.h"
+#include "InlineArray.h"
 
 namespace numpy
 {
 	template<typename T>
 	class Numpy;
+	template<typename T>
+	class Convolution;
+
+	// Enables the overloads taking a shape as a built-in unsigned int array, whose length is part of its type. A braced list
+	// never deduces A, so those still go to the initializer_list overloads.
+	template<typename A>
+	using EnableIfShapeArray = typename std::enable_if<std::rank<A>::value == 1
+		&& std::is_same<typename std::remove_cv<typename std::remove_extent<A>::type>::type, unsigned int>::value>::type;
 
 	template<typename T>
-	class Ndarray final
+	class Ndarray final : public Expression<Ndarray<T>>
 	{
-		friend class Numpy<T>;
+		template<typename U>
+		friend class Numpy;
+		template<typename U>
+		friend class Convolution;
+		template<typename U>
+		friend class Ndarray;
 	public:
+		using ValueType = T;
+		static constexpr bool IS_SCALAR = false;
+		static constexpr unsigned int OPERATIONS = 0;
+		static constexpr unsigned int ARRAYS = 1;
+		// Shapes and strides up to this rank are stored inside the array object.
+		static constexpr unsigned int MAX_INLINE_DIMENSION = 6;
+
+		// Sizes, strides and element indices are 64-bit. A shape whose element count or byte size does not fit in size_t, or
+		// that has a 0 axis, makes an empty array.
 		Ndarray();
-		Ndarray(const std::initializer_list<int>& arraySize, const T& value);
-		Ndarray(const std::initializer_list<int>& arraySize);
-		Ndarray(const unsigned int& dimension, const unsigned int& totalSize, const std::unique_ptr<unsigned int[]>& arraySize, const std::unique_ptr<T[]>& array);
-		Ndarray(const unsigned int& dimension, const unsigned int& totalSize, const unsigned int* arraySize, const unsigned int* array);
+		Ndarray(const std::initializer_list<size_t>& arraySize, const T& value);
+		Ndarray(const std::initializer_list<size_t>& arraySize);
+		// Shapes given as int or unsigned int variables, which would narrow in a size_t list; a negative size makes an empty array.
+		template<typename I, typename = typename std::enable_if<std::is_integral<I>::value && !std::is_same<I, size_t>::value>::type>
+		Ndarray(const std::initializer_list<I>& arraySize, const T& value);
+		template<typename I, typename = typename std::enable_if<std::is_integral<I>::value && !std::is_same<I, size_t>::value>::type>
+		Ndarray(const std::initializer_list<I>& arraySize);
+		Ndarray(const unsigned int& dimension, const size_t& totalSize, const std::unique_ptr<unsigned int[]>& arraySize, const std::unique_ptr<T[]>& array);
+		Ndarray(const unsigned int& dimension, const size_t& totalSize, const unsigned int* arraySize, const unsigned int* array);
+		// Wraps storage owned elsewhere, such as a memory-mapped file, as a compact array without copying; the last owner of
+		// storage releases it through its deleter.
+		Ndarray(const std::shared_ptr<T[]>& storage, const unsigned int& dimension, const size_t* arraySize);
 		Ndarray(const Ndarray<T>& rhs);
 		Ndarray(Ndarray<T>&& rhs);
+		template<typename E>
+		Ndarray(const Expression<E>& expression);
 		~Ndarray() = default;
 
 		Ndarray<T>& operator=(const Ndarray<T>& rhs);
 		Ndarray<T>& operator=(Ndarray<T>&& rhs);
+		template<typename E>
+		Ndarray<T>& operator=(const Expression<E>& expression);
+		// Like a = a + rhs, but evaluated into this array's elements when the shape is unchanged, so views write through.
+		template<typename E>
+		Ndarray<T>& operator+=(const Expression<E>& rhs);
+		template<typename E>
+		Ndarray<T>& operator-=(const Expression<E>& rhs);
+		template<typename E>
+		Ndarray<T>& operator*=(const Expression<E>& rhs);
+		Ndarray<T>& operator+=(const T& rhs);
+		Ndarray<T>& operator-=(const T& rhs);
+		Ndarray<T>& operator*=(const T& rhs);
 		bool operator==(const Ndarray<T>& rhs) const;
 		bool operator!=(const Ndarray<T>& rhs) const;
-		Ndarray<T> operator+(const Ndarray<T>& rhs) const;
-		Ndarray<T> operator+(const int& rhs) const;
-		Ndarray<T> operator+(const float& rhs) const;
-		Ndarray<T> operator*(const Ndarray<T>& rhs) const;
-		Ndarray<T> operator*(const int& rhs) const;
-		Ndarray<T> operator*(const float& rhs) const;
 
-		void Reshape(const unsigned int* arraySize);
+		T& At(const size_t& index);
+		const T& At(const size_t& index) const;
+		unsigned int GetDimension() const;
+		size_t GetTotalSize() const;
+		size_t GetArraySize(const unsigned int& axis) const;
+		size_t GetStride(const unsigned int& axis) const;
+		// First element of this array or view; only walkable as a flat range when IsContiguous().
+		T* GetData();
+		const T* GetData() const;
+		bool IsContiguous() const;
+		// False for an empty array, which as an operand makes the whole expression evaluate to an empty array rather than broadcast.
+		bool IsValid() const;
+		// True when this array reads target's storage through a different layout, so evaluating into target in place could
+		// overwrite elements before they are read.
+		template<typename V>
+		bool Overlaps(const Ndarray<V>& target) const;
+		ArrayEvaluator<T> GetEvaluator() const;
+		// Evaluator over the row at index of a dimension-rank broadcast output; axes of size 1 get stride 0.
+		StridedEvaluator<T> GetRowEvaluator(const size_t* index, const unsigned int& dimension) const;
+		void EvaluateTo(T* out) const;
+
+		// In place, and only when the new shape has the same element count.
+		template<typename A, typename = EnableIfShapeArray<A>>
+		void Reshape(const A& arraySize);
+
+		// Views share this array's storage and cost O(dimension); writes through a view are visible in the array.
+		Ndarray<T> Slice(const unsigned int& axis, const size_t& begin, const size_t& end, const size_t& step = 1) const;
+		Ndarray<T> Transpose() const;
+		Ndarray<T> Transpose(const std::initializer_list<int>& axes) const;
+		// A view when the layout allows it, otherwise a reshaped copy. One size may be -1 to infer it.
+		Ndarray<T> Reshape(const std::initializer_list<long long>& arraySize) const;
+		Ndarray<T> BroadcastTo(const std::initializer_list<size_t>& arraySize) const;
+		// Compact copy with every element converted to U, like NumPy's astype; Ndarray<float>::AsType<BFloat16>() halves the storage.
+		template<typename U>
+		Ndarray<U> AsType() const;
 
 		friend std::ostream& operator<<(std::ostream& os, const Ndarray<T>& rhs)
 		{
-			for (unsigned int i = 0; i < rhs.mTotalSize; ++i)
+			for (size_t i = 0; i < rhs.mTotalSize; ++i)
 			{
-				unsigned int size = 1;
+				size_t size = 1;
 				for (unsigned int j = rhs.mDimension; j > 0; --j)
 				{
 					size *= rhs.mArraySize[j - 1];
@@ -49,7 +127,7 @@ namespace numpy
 						os << "[";
 					}
 				}
-				os << rhs.mArray[i];
+				os << rhs.At(i);
 
 				size = 1;
 				for (unsigned int j = rhs.mDimension; j > 0; --j)
@@ -71,84 +149,95 @@ namespace numpy
 			return os;
 		}
 	private:
+		using Shape = InlineArray<size_t, MAX_INLINE_DIMENSION>;
+
+		// Compact array of the given shape with uninitialised elements, from Allocator.
+		static Ndarray<T> uninitialized(const unsigned int& dimension, const size_t* arraySize);
+		// Makes this a compact array of the given shape with uninitialised elements, or the empty array when the shape does not fit.
+		void allocate(const unsigned int& dimension, const size_t* arraySize);
+		// total *= size, false when the product of a shape, or its size in bytes, would overflow.
+		static bool multiplySize(size_t& total, const size_t& size);
+
+		// Storage is reused by assignment only when nothing else can observe it: no views, compact, and the same element count.
+		template<typename E>
+		bool canReuseStorage(const E& source) const;
+		template<typename E>
+		bool hasShape(const E& source) const;
+		template<typename E>
+		void adoptShape(const E& source);
+		// Writes source into this array's elements if the shapes match, otherwise rebinds like operator=.
+		template<typename E>
+		Ndarray<T>& assign(const E& source);
+
+		void setCompactStrides();
+		// Makes this the empty array.
+		void clear();
+		size_t offsetOf(size_t index) const;
+		Ndarray<T> view(const unsigned int& dimension, const size_t* arraySize, const size_t* strides, const size_t& offset) const;
+
 		unsigned int mDimension;
-		unsigned int mTotalSize;
-		std::unique_ptr<unsigned int[]> mArraySize;
-		std::unique_ptr<T[]> mArray;
+		size_t mTotalSize;
+		Shape mArraySize;
+		// Element steps per axis and the element offset of the first element inside mArray, which views share.
+		Shape mStrides;
+		size_t mOffset;
+		std::shared_ptr<T[]> mArray;
 	};
 
 	template<typename T>
 	Ndarray<T>::Ndarray()
 		: mDimension(0)
 		, mTotalSize(0)
-		, mArraySize(nullptr)
+		, mOffset(0)
 		, mArray(nullptr)
 	{
 	}
 
 	template<typename T>
-	inline Ndarray<T>::Ndarray(const std::initializer_list<int>& arraySize, const T& value)
+	inline Ndarray<T>::Ndarray(const std::initializer_list<size_t>& arraySize, const T& value)
+		: Ndarray()
 	{
-		int i = 0;
-		mDimension = arraySize.size();
-		mArraySize = std::make_unique<unsigned int[]>(mDimension);
-		mTotalSize = 1;
-		for (auto a : arraySize)
-		{
-			mArraySize[i] = static_cast<unsigned int>(a);
-			mTotalSize *= mArraySize[i];
-			if (mArraySize[i++] == 0)
-			{
-				mDimension = 0;
-				mTotalSize = 0;
-				mArraySize = nullptr;
-				mArray = nullptr;
-				return;
-			}
-		}
+		allocate(static_cast<unsigned int>(arraySize.size()), arraySize.begin());
+		std::fill(mArray.get(), mArray.get() + mTotalSize, value);
+	}
 
-		
-		mArray = std::make_unique<T[]>(mTotalSize);
-		for (unsigned int i = 0; i < mTotalSize; ++i)
-		{
-			mArray[i] = value;
-		}
+	template<typename T>
+	inline Ndarray<T>::Ndarray(const std::initializer_list<size_t>& arraySize)
+		: Ndarray(arraySize, static_cast<T>(0))
+	{
 	}
 
 	template<typename T>
-	inline Ndarray<T>::Ndarray(const std::initializer_list<int>& arraySize)
+	template<typename I, typename>
+	inline Ndarray<T>::Ndarray(const std::initializer_list<I>& arraySize, const T& value)
+		: Ndarray()
 	{
-		int i = 0;
-		mDimension = arraySize.size();
-		mArraySize = std::make_unique<unsigned int[]>(mDimension);
-		mTotalSize = 1;
-		for (auto a : arraySize)
+		Shape shape(static_cast<unsigned int>(arraySize.size()));
+		unsigned int axis = 0;
+		for (const I& size : arraySize)
 		{
-			mArraySize[i] = static_cast<unsigned int>(a);
-			mTotalSize *= mArraySize[i];
-			if (mArraySize[i++] == 0)
-			{
-				mDimension = 0;
-				mTotalSize = 0;
-				mArraySize = nullptr;
-				mArray = nullptr;
+			if (std::is_signed<I>::value && static_cast<long long>(size) < 0)
 				return;
-			}
+			shape[axis++] = static_cast<size_t>(size);
 		}
+		allocate(shape.GetSize(), shape.Get());
+		std::fill(mArray.get(), mArray.get() + mTotalSize, value);
+	}
 
-		mArray = std::make_unique<T[]>(mTotalSize);
-		for (unsigned int i = 0; i < mTotalSize; ++i)
-		{
-			mArray[i] = 0;
-		}
+	template<typename T>
+	template<typename I, typename>
+	inline Ndarray<T>::Ndarray(const std::initializer_list<I>& arraySize)
+		: Ndarray(arraySize, static_cast<T>(0))
+	{
 	}
 
 	template<typename T>
-	inline Ndarray<T>::Ndarray(const unsigned int& dimension, const unsigned int& totalSize, const std::unique_ptr<unsigned int[]>& arraySize, const std::unique_ptr<T[]>& array)
+	inline Ndarray<T>::Ndarray(const unsigned int& dimension, const size_t& totalSize, const std::unique_ptr<unsigned int[]>& arraySize, const std::unique_ptr<T[]>& array)
 		: mDimension(dimension)
 		, mTotalSize(totalSize)
+		, mOffset(0)
 	{
-		mArraySize = std::make_unique<unsigned int[]>(mDimension);
+		mArraySize.Resize(mDimension);
 		for (unsigned int i = 0; i < mDimension; ++i)
 		{
 			mArraySize[i] = arraySize[i];
@@ -156,32 +245,59 @@ namespace numpy
 			{
 				mDimension = 0;
 				mTotalSize = 0;
-				mArraySize = nullptr;
+				mArraySize.Resize(0);
+				mStrides.Resize(0);
 				mArray = nullptr;
 				return;
 			}
 		}
 
-		mArray = std::make_unique<T[]>(mTotalSize);
-		for (unsigned int i = 0; i < mTotalSize; ++i)
+		setCompactStrides();
+		mArray = Allocator::AllocateShared<T>(mTotalSize);
+		for (size_t i = 0; i < mTotalSize; ++i)
 		{
 			mArray[i] = array[i];
 		}
 	}
 
 	template<typename T>
-	Ndarray<T>::Ndarray(const unsigned int& dimension, const unsigned int& totalSize, const unsigned int* arraySize, const unsigned int* array)
+	Ndarray<T>::Ndarray(const std::shared_ptr<T[]>& storage, const unsigned int& dimension, const size_t* arraySize)
+		: mDimension(dimension)
+		, mTotalSize(1)
+		, mOffset(0)
+	{
+		mArraySize.Resize(mDimension);
+		bool bValid = mDimension != 0 && storage != nullptr;
+		for (unsigned int i = 0; i < mDimension; ++i)
+		{
+			mArraySize[i] = arraySize[i];
+			bValid = bValid && arraySize[i] != 0 && multiplySize(mTotalSize, arraySize[i]);
+		}
+		if (!bValid)
+		{
+			clear();
+			return;
+		}
+
+		setCompactStrides();
+		mArray = storage;
+	}
+
+	template<typename T>
+	Ndarray<T>::Ndarray(const unsigned int& dimension, const size_t& totalSize, const unsigned int* arraySize, const unsigned int* array)
 		: mDimension(dimension)
 		, mTotalSize(totalSize)
+		, mOffset(0)
 	{
-		mArraySize = std::make_unique<unsigned int[]>(mDimension);
+		mArraySize.Resize(mDimension);
 		for (unsigned int i = 0; i < mDimension; ++i)
 		{
 			mArraySize[i] = arraySize[i];
 		}
 
-		mArray = std::make_unique<T[]>(mTotalSize);
-		for (unsigned int i = 0; i < mTotalSize; ++i)
+		setCompactStrides();
+		mArray = Allocator::AllocateShared<T>(mTotalSize);
+		for (size_t i = 0; i < mTotalSize; ++i)
 		{
 			mArray[i] = array[i];
 		}
@@ -191,50 +307,75 @@ namespace numpy
 	Ndarray<T>::Ndarray(const Ndarray<T>& rhs)
 		: mDimension(rhs.mDimension)
 		, mTotalSize(rhs.mTotalSize)
+		, mOffset(0)
 	{
-		mArraySize = std::make_unique<unsigned int[]>(mDimension);
+		// Copies are always compact, whatever the layout of the source view.
+		mArraySize.Resize(mDimension);
 		for (unsigned int i = 0; i < mDimension; ++i)
 		{
 			mArraySize[i] = rhs.mArraySize[i];
 		}
-		mArray = std::make_unique<T[]>(mTotalSize);
-		for (unsigned int i = 0; i < mTotalSize; ++i)
-		{
-			mArray[i] = rhs.mArray[i];
-		}
+		setCompactStrides();
+		mArray = Allocator::AllocateShared<T>(mTotalSize);
+		rhs.EvaluateTo(mArray.get());
 	}
 
 	template<typename T>
 	Ndarray<T>::Ndarray(Ndarray<T>&& rhs)
 		: mDimension(rhs.mDimension)
 		, mTotalSize(rhs.mTotalSize)
+		, mOffset(rhs.mOffset)
 	{
 		rhs.mDimension = 0u;
-		rhs.mTotalSize = 0u;
+		rhs.mTotalSize = 0;
+		rhs.mOffset = 0;
 		mArraySize = std::move(rhs.mArraySize);
+		mStrides = std::move(rhs.mStrides);
 		mArray = std::move(rhs.mArray);
 	}
 
 	template<typename T>
-	Ndarray<T>& Ndarray<T>::operator=(const Ndarray<T>& rhs)
+	template<typename E>
+	Ndarray<T>::Ndarray(const Expression<E>& expression)
+		: Ndarray()
 	{
-		if (this == &rhs)
+		static_assert(std::is_same<typename E::ValueType, T>::value, "expression value type must match the array");
+
+		const E& source = expression.Self();
+		if (!source.IsValid() || source.GetTotalSize() == 0)
 		{
-			return *this;
+			return;
 		}
-		mDimension = rhs.mDimension;
-		mTotalSize = rhs.mTotalSize;
-		mArraySize = std::make_unique<unsigned int[]>(mDimension);
+
+		mDimension = source.GetDimension();
+		mTotalSize = source.GetTotalSize();
+		mArraySize.Resize(mDimension);
 		for (unsigned int i = 0; i < mDimension; ++i)
 		{
-			mArraySize[i] = rhs.mArraySize[i];
+			mArraySize[i] = source.GetArraySize(i);
+		}
+
+		setCompactStrides();
+
+		// Left uninitialised: EvaluateTo writes every element in its single pass.
+		mArray = Allocator::AllocateShared<T>(mTotalSize);
+		source.EvaluateTo(mArray.get());
+	}
+
+	template<typename T>
+	Ndarray<T>& Ndarray<T>::operator=(const Ndarray<T>& rhs)
+	{
+		if (this == &rhs)
+		{
+			return *this;
 		}
-		mArray = std::make_unique<T[]>(mTotalSize);
-		for (unsigned int i = 0; i < mTotalSize; ++i)
+		if (!canReuseStorage(rhs))
 		{
-			mArray[i] = rhs.mArray[i];
+			return *this = Ndarray<T>(rhs);
 		}
 
+		rhs.EvaluateTo(GetData());
+		adoptShape(rhs);
 		return *this;
 	}
 
@@ -248,13 +389,74 @@ namespace numpy
 		mDimension = rhs.mDimension;
 		rhs.mDimension = 0u;
 		mTotalSize = rhs.mTotalSize;
-		rhs.mTotalSize = 0u;
+		rhs.mTotalSize = 0;
+		mOffset = rhs.mOffset;
+		rhs.mOffset = 0;
 		mArraySize = std::move(rhs.mArraySize);
+		mStrides = std::move(rhs.mStrides);
 		mArray = std::move(rhs.mArray);
 
 		return *this;
 	}
 
+	template<typename T>
+	template<typename E>
+	inline Ndarray<T>& Ndarray<T>::operator=(const Expression<E>& expression)
+	{
+		const E& source = expression.Self();
+		if (!canReuseStorage(source))
+		{
+			// Evaluated into fresh storage first, so the expression may read this array in any layout.
+			return *this = Ndarray<T>(source);
+		}
+
+		// An expression may still read this array element for element, which is safe in place.
+		source.EvaluateTo(GetData());
+		adoptShape(source);
+		return *this;
+	}
+
+	template<typename T>
+	template<typename E>
+	inline Ndarray<T>& Ndarray<T>::operator+=(const Expression<E>& rhs)
+	{
+		return assign(BinaryExpression<ElementwiseOperation::Add, Ndarray<T>, E>(*this, rhs.Self()));
+	}
+
+	template<typename T>
+	template<typename E>
+	inline Ndarray<T>& Ndarray<T>::operator-=(const Expression<E>& rhs)
+	{
+		// There is no subtraction node; adding rhs * -1 is exact and keeps the update a single fused pass.
+		using Negated = BinaryExpression<ElementwiseOperation::Multiply, E, ScalarExpression<T>>;
+		return assign(BinaryExpression<ElementwiseOperation::Add, Ndarray<T>, Negated>(*this, Negated(rhs.Self(), ScalarExpression<T>(static_cast<T>(-1)))));
+	}
+
+	template<typename T>
+	template<typename E>
+	inline Ndarray<T>& Ndarray<T>::operator*=(const Expression<E>& rhs)
+	{
+		return assign(BinaryExpression<ElementwiseOperation::Multiply, Ndarray<T>, E>(*this, rhs.Self()));
+	}
+
+	template<typename T>
+	inline Ndarray<T>& Ndarray<T>::operator+=(const T& rhs)
+	{
+		return assign(BinaryExpression<ElementwiseOperation::Add, Ndarray<T>, ScalarExpression<T>>(*this, ScalarExpression<T>(rhs)));
+	}
+
+	template<typename T>
+	inline Ndarray<T>& Ndarray<T>::operator-=(const T& rhs)
+	{
+		return assign(BinaryExpression<ElementwiseOperation::Add, Ndarray<T>, ScalarExpression<T>>(*this, ScalarExpression<T>(static_cast<T>(-rhs))));
+	}
+
+	template<typename T>
+	inline Ndarray<T>& Ndarray<T>::operator*=(const T& rhs)
+	{
+		return assign(BinaryExpression<ElementwiseOperation::Multiply, Ndarray<T>, ScalarExpression<T>>(*this, ScalarExpression<T>(rhs)));
+	}
+
 	template<typename T>
 	inline bool Ndarray<T>::operator==(const Ndarray<T>& rhs) const
 	{
@@ -265,8 +467,8 @@ namespace numpy
 		for (unsigned int i = 0; i < mDimension; ++i)
 			if (mArraySize[i] != rhs.mArraySize[i])
 				return false;
-		for (unsigned int i = 0; i < mTotalSize; ++i)
-			if (mArray[i] != rhs.mArray[i])
+		for (size_t i = 0; i < mTotalSize; ++i)
+			if (At(i) != rhs.At(i))
 				return false;
 
 		return true;
@@ -279,144 +481,505 @@ namespace numpy
 	}
 
 	template<typename T>
-	Ndarray<T> Ndarray<T>::operator+(const Ndarray<T>& rhs) const
+	inline T& Ndarray<T>::At(const size_t& index)
 	{
-		if (mDimension != rhs.mDimension)
-			return Ndarray<T>();
-		if (mTotalSize != rhs.mTotalSize)
-			return Ndarray<T>();
-		for (unsigned int i = 0; i < mDimension; ++i)
-			if (mArraySize[i] != rhs.mArraySize[i])
-				return Ndarray<T>();
+		assert(index < mTotalSize);
+		return mArray[offsetOf(index)];
+	}
 
-		std::unique_ptr<unsigned int[]> arraySize = std::make_unique<unsigned int[]>(mDimension);
-		for (unsigned int i = 0; i < mDimension; ++i)
+	template<typename T>
+	inline const T& Ndarray<T>::At(const size_t& index) const
+	{
+		assert(index < mTotalSize);
+		return mArray[offsetOf(index)];
+	}
+
+	template<typename T>
+	inline unsigned int Ndarray<T>::GetDimension() const
+	{
+		return mDimension;
+	}
+
+	template<typename T>
+	inline size_t Ndarray<T>::GetTotalSize() const
+	{
+		return mTotalSize;
+	}
+
+	template<typename T>
+	inline size_t Ndarray<T>::GetArraySize(const unsigned int& axis) const
+	{
+		assert(axis < mDimension);
+		return mArraySize[axis];
+	}
+
+	template<typename T>
+	inline size_t Ndarray<T>::GetStride(const unsigned int& axis) const
+	{
+		assert(axis < mDimension);
+		return mStrides[axis];
+	}
+
+	template<typename T>
+	inline T* Ndarray<T>::GetData()
+	{
+		return mArray.get() + mOffset;
+	}
+
+	template<typename T>
+	inline const T* Ndarray<T>::GetData() const
+	{
+		return mArray.get() + mOffset;
+	}
+
+	template<typename T>
+	bool Ndarray<T>::IsContiguous() const
+	{
+		size_t expected = 1;
+		for (unsigned int i = mDimension; i > 0; --i)
 		{
-			arraySize[i] = mArraySize[i];
+			if (mArraySize[i - 1] == 1)
+				continue;
+			if (mStrides[i - 1] != expected)
+				return false;
+			expected *= mArraySize[i - 1];
 		}
+		return true;
+	}
+
+	template<typename T>
+	inline bool Ndarray<T>::IsValid() const
+	{
+		return mTotalSize != 0;
+	}
 
-		std::unique_ptr<T[]> array = std::make_unique<T[]>(mTotalSize);
-		for (unsigned int i = 0; i < mTotalSize; ++i)
+	template<typename T>
+	template<typename V>
+	inline bool Ndarray<T>::Overlaps(const Ndarray<V>& target) const
+	{
+		if constexpr (!std::is_same<T, V>::value)
 		{
-			array[i] = mArray[i] + rhs.mArray[i];
+			return false;
 		}
+		else
+		{
+			if (mArray == nullptr || mArray != target.mArray)
+				return false;
+			if (mOffset != target.mOffset || mDimension != target.mDimension)
+				return true;
+			for (unsigned int i = 0; i < mDimension; ++i)
+				if (mArraySize[i] != target.mArraySize[i] || mStrides[i] != target.mStrides[i])
+					return true;
 
-		return Ndarray<T>(mDimension, mTotalSize, std::move(arraySize), std::move(array));
+			return false;
+		}
 	}
+
 	template<typename T>
-	inline Ndarray<T> Ndarray<T>::operator+(const int& rhs) const
+	inline ArrayEvaluator<T> Ndarray<T>::GetEvaluator() const
 	{
-		std::unique_ptr<unsigned int[]> arraySize = std::make_unique<unsigned int[]>(mDimension);
-		for (unsigned int i = 0; i < mDimension; ++i)
+		return ArrayEvaluator<T>{ GetData() };
+	}
+
+	template<typename T>
+	inline StridedEvaluator<T> Ndarray<T>::GetRowEvaluator(const size_t* index, const unsigned int& dimension) const
+	{
+		const unsigned int lead = dimension - mDimension;
+		const T* row = GetData();
+		for (unsigned int i = 0; i + 1 < mDimension; ++i)
 		{
-			arraySize[i] = mArraySize[i];
+			if (mArraySize[i] != 1)
+			{
+				row += index[lead + i] * mStrides[i];
+			}
 		}
+		if (mDimension == 0 || mArraySize[mDimension - 1] == 1)
+		{
+			return StridedEvaluator<T>{ row, 0 };
+		}
+		return StridedEvaluator<T>{ row, mStrides[mDimension - 1] };
+	}
+
+	template<typename T>
+	void Ndarray<T>::EvaluateTo(T* out) const
+	{
+		NUMPY_PROFILE_SCOPE("Ndarray::Copy", static_cast<std::uint64_t>(mTotalSize) * sizeof(T) * 2u);
+		if (IsContiguous())
+		{
+			const T* data = GetData();
+			ParallelElements(mTotalSize, ELEMENTWISE_GRAIN, [data, out](size_t begin, size_t end)
+			{
+				std::copy(data + begin, data + end, out + begin);
+			});
+		}
+		else
+		{
+			EvaluateRows(*this, out);
+		}
+	}
+
+	template<typename T>
+	template<typename A, typename>
+	void Ndarray<T>::Reshape(const A& arraySize)
+	{
+		const unsigned int dimension = static_cast<unsigned int>(std::extent<A>::value);
 
-		std::unique_ptr<T[]> array = std::make_unique<T[]>(mTotalSize);
-		for (unsigned int i = 0; i < mTotalSize; ++i)
+		size_t totalSize = 1;
+		Shape newArraySize(dimension);
+		for (unsigned int i = 0; i < dimension; ++i)
 		{
-			array[i] = mArray[i] + rhs;
+			newArraySize[i] = arraySize[i];
+			if (!multiplySize(totalSize, arraySize[i]))
+				return;
 		}
 
-		return Ndarray<T>(mDimension, mTotalSize, std::move(arraySize), std::move(array));
+		if (totalSize != mTotalSize || mTotalSize == 0)
+			return;
+
+		if (!IsContiguous())
+		{
+			*this = Ndarray<T>(*this);
+		}
+		mDimension = dimension;
+		mArraySize = std::move(newArraySize);
+		setCompactStrides();
 	}
+
 	template<typename T>
-	inline Ndarray<T> Ndarray<T>::operator+(const float& rhs) const
+	Ndarray<T> Ndarray<T>::Slice(const unsigned int& axis, const size_t& begin, const size_t& end, const size_t& step) const
 	{
-		std::unique_ptr<unsigned int[]> arraySize = std::make_unique<unsigned int[]>(mDimension);
+		if (axis >= mDimension || step == 0)
+			return Ndarray<T>();
+
+		const size_t last = end < mArraySize[axis] ? end : mArraySize[axis];
+		if (begin >= last)
+			return Ndarray<T>();
+
+		Shape arraySize(mDimension);
+		Shape strides(mDimension);
 		for (unsigned int i = 0; i < mDimension; ++i)
 		{
 			arraySize[i] = mArraySize[i];
+			strides[i] = mStrides[i];
 		}
+		arraySize[axis] = (last - begin + step - 1) / step;
+		strides[axis] = mStrides[axis] * step;
 
-		std::unique_ptr<T[]> array = std::make_unique<T[]>(mTotalSize);
-		for (unsigned int i = 0; i < mTotalSize; ++i)
+		return view(mDimension, arraySize.Get(), strides.Get(), mOffset + begin * mStrides[axis]);
+	}
+
+	template<typename T>
+	Ndarray<T> Ndarray<T>::Transpose() const
+	{
+		Shape arraySize(mDimension);
+		Shape strides(mDimension);
+		for (unsigned int i = 0; i < mDimension; ++i)
 		{
-			array[i] = mArray[i] + rhs;
+			arraySize[i] = mArraySize[mDimension - 1 - i];
+			strides[i] = mStrides[mDimension - 1 - i];
 		}
 
-		return Ndarray<T>(mDimension, mTotalSize, std::move(arraySize), std::move(array));
+		return view(mDimension, arraySize.Get(), strides.Get(), mOffset);
 	}
+
 	template<typename T>
-	inline Ndarray<T> Ndarray<T>::operator*(const Ndarray<T>& rhs) const
+	Ndarray<T> Ndarray<T>::Transpose(const std::initializer_list<int>& axes) const
 	{
-		if (mDimension != rhs.mDimension)
-			return Ndarray<T>();
-		if (mTotalSize != rhs.mTotalSize)
+		if (axes.size() != mDimension)
 			return Ndarray<T>();
+
+		Shape arraySize(mDimension);
+		Shape strides(mDimension);
+		InlineArray<bool, MAX_INLINE_DIMENSION> used(mDimension);
 		for (unsigned int i = 0; i < mDimension; ++i)
-			if (mArraySize[i] != rhs.mArraySize[i])
+		{
+			used[i] = false;
+		}
+		unsigned int i = 0;
+		for (int axis : axes)
+		{
+			if (axis < 0 || static_cast<unsigned int>(axis) >= mDimension || used[axis])
 				return Ndarray<T>();
+			used[axis] = true;
+			arraySize[i] = mArraySize[axis];
+			strides[i++] = mStrides[axis];
+		}
 
-		std::unique_ptr<unsigned int[]> arraySize = std::make_unique<unsigned int[]>(mDimension);
-		for (unsigned int i = 0; i < mDimension; ++i)
+		return view(mDimension, arraySize.Get(), strides.Get(), mOffset);
+	}
+
+	template<typename T>
+	Ndarray<T> Ndarray<T>::Reshape(const std::initializer_list<long long>& arraySize) const
+	{
+		const unsigned int dimension = static_cast<unsigned int>(arraySize.size());
+		Shape newArraySize(dimension);
+		size_t known = 1;
+		unsigned int inferred = dimension;
+		unsigned int i = 0;
+		for (const long long& size : arraySize)
 		{
-			arraySize[i] = mArraySize[i];
+			if (size < 0)
+			{
+				if (inferred != dimension)
+					return Ndarray<T>();
+				inferred = i;
+			}
+			else
+			{
+				newArraySize[i] = static_cast<size_t>(size);
+				if (!multiplySize(known, newArraySize[i]))
+					return Ndarray<T>();
+			}
+			++i;
+		}
+		if (inferred != dimension)
+		{
+			if (known == 0 || mTotalSize % known != 0)
+				return Ndarray<T>();
+			newArraySize[inferred] = mTotalSize / known;
+			known = mTotalSize;
 		}
+		if (known != mTotalSize || mTotalSize == 0)
+			return Ndarray<T>();
 
-		std::unique_ptr<T[]> array = std::make_unique<T[]>(mTotalSize);
-		for (unsigned int i = 0; i < mTotalSize; ++i)
+		Shape strides(dimension);
+		size_t stride = 1;
+		for (unsigned int j = dimension; j > 0; --j)
 		{
-			array[i] = mArray[i] * rhs.mArray[i];
+			strides[j - 1] = stride;
+			stride *= newArraySize[j - 1];
 		}
 
-		return Ndarray<T>(mDimension, mTotalSize, std::move(arraySize), std::move(array));
+		if (IsContiguous())
+		{
+			return view(dimension, newArraySize.Get(), strides.Get(), mOffset);
+		}
+
+		Ndarray<T> copy(*this);
+		return copy.view(dimension, newArraySize.Get(), strides.Get(), 0);
 	}
 
 	template<typename T>
-	inline Ndarray<T> Ndarray<T>::operator*(const int& rhs) const
+	Ndarray<T> Ndarray<T>::BroadcastTo(const std::initializer_list<size_t>& arraySize) const
 	{
-		std::unique_ptr<unsigned int[]> arraySize = std::make_unique<unsigned int[]>(mDimension);
-		for (unsigned int i = 0; i < mDimension; ++i)
+		// NumPy rules: sizes are matched from the last axis, and an axis of size 1 (or a missing leading axis) is repeated with stride 0.
+		const unsigned int dimension = static_cast<unsigned int>(arraySize.size());
+		if (dimension < mDimension)
+			return Ndarray<T>();
+
+		Shape newArraySize(dimension);
+		Shape strides(dimension);
+		unsigned int i = 0;
+		size_t totalSize = 1;
+		for (const size_t& size : arraySize)
 		{
-			arraySize[i] = mArraySize[i];
+			if (size == 0 || !multiplySize(totalSize, size))
+				return Ndarray<T>();
+			newArraySize[i] = size;
+			strides[i] = 0;
+			if (i >= dimension - mDimension)
+			{
+				const unsigned int axis = i - (dimension - mDimension);
+				if (mArraySize[axis] == newArraySize[i])
+					strides[i] = mStrides[axis];
+				else if (mArraySize[axis] != 1)
+					return Ndarray<T>();
+			}
+			++i;
+		}
+
+		return view(dimension, newArraySize.Get(), strides.Get(), mOffset);
+	}
+
+	template<typename T>
+	template<typename U>
+	Ndarray<U> Ndarray<T>::AsType() const
+	{
+		if (mTotalSize == 0)
+			return Ndarray<U>();
+
+		Ndarray<U> result = Ndarray<U>::uninitialized(mDimension, mArraySize.Get());
+		U* target = result.GetData();
+		if (IsContiguous())
+		{
+			const T* source = GetData();
+			for (size_t i = 0; i < mTotalSize; ++i)
+			{
+				target[i] = static_cast<U>(source[i]);
+			}
+			return result;
 		}
+		for (size_t i = 0; i < mTotalSize; ++i)
+		{
+			target[i] = static_cast<U>(mArray[offsetOf(i)]);
+		}
+		return result;
+	}
 
-		std::unique_ptr<T[]> array = std::make_unique<T[]>(mTotalSize);
-		for (unsigned int i = 0; i < mTotalSize; ++i)
+	template<typename T>
+	inline Ndarray<T> Ndarray<T>::uninitialized(const unsigned int& dimension, const size_t* arraySize)
+	{
+		Ndarray<T> result;
+		result.allocate(dimension, arraySize);
+		return result;
+	}
+
+	template<typename T>
+	void Ndarray<T>::allocate(const unsigned int& dimension, const size_t* arraySize)
+	{
+		mDimension = dimension;
+		mTotalSize = 1;
+		mOffset = 0;
+		mArraySize.Resize(dimension);
+		for (unsigned int i = 0; i < dimension; ++i)
 		{
-			array[i] = mArray[i] * rhs;
+			mArraySize[i] = arraySize[i];
+			if (arraySize[i] == 0 || !multiplySize(mTotalSize, arraySize[i]))
+			{
+				clear();
+				return;
+			}
 		}
+		setCompactStrides();
+		mArray = Allocator::AllocateShared<T>(mTotalSize);
+	}
+
+	template<typename T>
+	inline bool Ndarray<T>::multiplySize(size_t& total, const size_t& size)
+	{
+		// Two factors below 2^(digits / 2) cannot overflow, which spares the common case a division.
+		constexpr size_t LIMIT = std::numeric_limits<size_t>::max() / sizeof(T);
+		if (((total | size) >> (std::numeric_limits<size_t>::digits / 2)) != 0 && size != 0 && total > LIMIT / size)
+			return false;
+		total *= size;
+		return total <= LIMIT;
+	}
+
+	template<typename T>
+	template<typename E>
+	inline bool Ndarray<T>::canReuseStorage(const E& source) const
+	{
+		return mArray != nullptr && mArray.use_count() == 1 && IsContiguous()
+			&& source.IsValid() && source.GetTotalSize() == mTotalSize && !source.Overlaps(*this);
+	}
+
+	template<typename T>
+	template<typename E>
+	inline bool Ndarray<T>::hasShape(const E& source) const
+	{
+		if (source.GetDimension() != mDimension)
+			return false;
+		for (unsigned int i = 0; i < mDimension; ++i)
+			if (source.GetArraySize(i) != mArraySize[i])
+				return false;
 
-		return Ndarray<T>(mDimension, mTotalSize, std::move(arraySize), std::move(array));
+		return true;
 	}
 
 	template<typename T>
-	inline Ndarray<T> Ndarray<T>::operator*(const float& rhs) const
+	template<typename E>
+	void Ndarray<T>::adoptShape(const E& source)
 	{
-		std::unique_ptr<unsigned int[]> arraySize = std::make_unique<unsigned int[]>(mDimension);
+		if (hasShape(source))
+			return;
+
+		mDimension = source.GetDimension();
+		mArraySize.Resize(mDimension);
 		for (unsigned int i = 0; i < mDimension; ++i)
 		{
-			arraySize[i] = mArraySize[i];
+			mArraySize[i] = source.GetArraySize(i);
 		}
+		setCompactStrides();
+	}
 
-		std::unique_ptr<T[]> array = std::make_unique<T[]>(mTotalSize);
-		for (unsigned int i = 0; i < mTotalSize; ++i)
+	template<typename T>
+	template<typename E>
+	Ndarray<T>& Ndarray<T>::assign(const E& source)
+	{
+		if (mTotalSize == 0 || !source.IsValid() || !hasShape(source))
 		{
-			array[i] = mArray[i] * rhs;
+			return *this = Ndarray<T>(source);
 		}
 
-		return Ndarray<T>(mDimension, mTotalSize, std::move(arraySize), std::move(array));
+		if (IsContiguous() && !source.Overlaps(*this))
+		{
+			source.EvaluateTo(GetData());
+			return *this;
+		}
+
+		// Strided targets and overlapping reads go through a compact temporary.
+		const Ndarray<T> result(source);
+		for (size_t i = 0; i < mTotalSize; ++i)
+		{
+			At(i) = result.mArray[i];
+		}
+		return *this;
+	}
+
+	template<typename T>
+	void Ndarray<T>::setCompactStrides()
+	{
+		mStrides.Resize(mDimension);
+		size_t stride = 1;
+		for (unsigned int i = mDimension; i > 0; --i)
+		{
+			mStrides[i - 1] = stride;
+			stride *= mArraySize[i - 1];
+		}
 	}
 
+	template<typename T>
+	inline void Ndarray<T>::clear()
+	{
+		mDimension = 0;
+		mTotalSize = 0;
+		mOffset = 0;
+		mArraySize.Resize(0);
+		mStrides.Resize(0);
+		mArray = nullptr;
+	}
 
 	template<typename T>
-	void Ndarray<T>::Reshape(const unsigned int* arraySize)
+	inline size_t Ndarray<T>::offsetOf(size_t index) const
 	{
-		unsigned int dimension = static_cast<unsigned int>(sizeof(arraySize) / sizeof(arraySize[0]));
+		size_t offset = mOffset;
+		// Arrays below 2^32 elements split the index with 32-bit division, which is several times cheaper than 64-bit.
+		if (mTotalSize <= std::numeric_limits<unsigned int>::max())
+		{
+			unsigned int rest = static_cast<unsigned int>(index);
+			for (unsigned int i = mDimension; i > 0; --i)
+			{
+				const unsigned int size = static_cast<unsigned int>(mArraySize[i - 1]);
+				offset += (rest % size) * mStrides[i - 1];
+				rest /= size;
+			}
+			return offset;
+		}
+		for (unsigned int i = mDimension; i > 0; --i)
+		{
+			offset += (index % mArraySize[i - 1]) * mStrides[i - 1];
+			index /= mArraySize[i - 1];
+		}
+		return offset;
+	}
 
-		unsigned int totalSize = 1;
-		std::unique_ptr<unsigned int[]> newArraySize = std::make_unique<unsigned int[]>(dimension);
+	template<typename T>
+	Ndarray<T> Ndarray<T>::view(const unsigned int& dimension, const size_t* arraySize, const size_t* strides, const size_t& offset) const
+	{
+		Ndarray<T> result;
+		result.mDimension = dimension;
+		result.mTotalSize = 1;
+		result.mArraySize.Resize(dimension);
+		result.mStrides.Resize(dimension);
 		for (unsigned int i = 0; i < dimension; ++i)
 		{
-			newArraySize[i] = arraySize[i];
-			totalSize *= arraySize[i];
+			result.mArraySize[i] = arraySize[i];
+			result.mStrides[i] = strides[i];
+			result.mTotalSize *= arraySize[i];
 		}
+		result.mOffset = offset;
+		result.mArray = mArray;
 
-		if (totalSize != mTotalSize)
-			return;
-
-		mDimension = dimension;
-		mArraySize = std::move(newArraySize);
+		return result;
 	}
 }
\ No newline at end of file
@@ -0,0 +1,717 @@
+#pragma once
+#include<cstdint>
+#include<cstring>
+#include<fstream>
+#include<limits>
+#include<map>
+#include<memory>
+#include<string>
+#include<utility>
+#include<vector>
+#include "Half.h"
+#include "Ndarray.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include<windows.h>
+#else
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+#endif
+
+namespace numpy
+{
+	// A whole file mapped copy-on-write: pages are read from disk on first touch, and writes stay private to the process,
+	// so arrays over the mapping behave like ordinary arrays and never modify the file.
+	class MappedFile final
+	{
+	public:
+		MappedFile(const MappedFile& rhs) = delete;
+		MappedFile& operator=(const MappedFile& rhs) = delete;
+		~MappedFile();
+
+		// nullptr when the file cannot be opened or is empty.
+		static std::shared_ptr<MappedFile> Open(const std::string& path);
+
+		char* GetData() const;
+		size_t GetSize() const;
+	private:
+		MappedFile(char* data, const size_t& size);
+
+		char* mData;
+		size_t mSize;
+	};
+
+	inline MappedFile::MappedFile(char* data, const size_t& size)
+		: mData(data)
+		, mSize(size)
+	{
+	}
+
+	inline MappedFile::~MappedFile()
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(mData);
+#else
+		munmap(mData, mSize);
+#endif
+	}
+
+	inline std::shared_ptr<MappedFile> MappedFile::Open(const std::string& path)
+	{
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return nullptr;
+
+		LARGE_INTEGER size;
+		HANDLE mapping = nullptr;
+		if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+		{
+			mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+		}
+		CloseHandle(file);
+		if (mapping == nullptr)
+			return nullptr;
+
+		// The view keeps the mapping object alive after its handle is closed.
+		void* data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+		CloseHandle(mapping);
+		if (data == nullptr)
+			return nullptr;
+		return std::shared_ptr<MappedFile>(new MappedFile(static_cast<char*>(data), static_cast<size_t>(size.QuadPart)));
+#else
+		const int descriptor = open(path.c_str(), O_RDONLY);
+		if (descriptor < 0)
+			return nullptr;
+
+		struct stat status;
+		void* data = MAP_FAILED;
+		if (fstat(descriptor, &status) == 0 && status.st_size > 0)
+		{
+			data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0);
+		}
+		close(descriptor);
+		if (data == MAP_FAILED)
+			return nullptr;
+		return std::shared_ptr<MappedFile>(new MappedFile(static_cast<char*>(data), static_cast<size_t>(status.st_size)));
+#endif
+	}
+
+	inline char* MappedFile::GetData() const
+	{
+		return mData;
+	}
+
+	inline size_t MappedFile::GetSize() const
+	{
+		return mSize;
+	}
+
+	// NumPy's .npy format and .npz archives of them.
+	// Load and LoadNpz copy into new arrays, converting from any integer, floating-point (Float16 included) or bool dtype in either byte order.
+	// Map and MapNpz return arrays that point into a MappedFile when the data already has T's dtype, native byte order and
+	// alignment, so opening costs page faults on first touch instead of parsing; otherwise they fall back to a converting copy.
+	// Fortran-ordered data comes back as a transposed view. Shape () reads as shape (1), and a shape with a 0 axis, which is
+	// a valid file, reads as an empty array since Ndarray has no zero-length axes.
+	template<typename T>
+	class Npy final
+	{
+		static_assert(!std::is_same<T, BFloat16>::value, "NumPy has no bfloat16 dtype; save AsType<float>() or AsType<Float16>()");
+	public:
+		Npy() = delete;
+		~Npy() = delete;
+
+		// The data starts 64-byte aligned, like NumPy's own files.
+		static bool Save(const std::string& path, const Ndarray<T>& a);
+		static Ndarray<T> Load(const std::string& path);
+		static Ndarray<T> Map(const std::string& path);
+
+		// Members are named "<name>.npy" as numpy.savez does, stored uncompressed, with the local headers padded so every
+		// member's data is 64-byte aligned in the file and can be mapped. ZIP64 records are written when sizes need them.
+		static bool SaveNpz(const std::string& path, const std::vector<std::pair<std::string, Ndarray<T>>>& arrays);
+		// Keys drop the ".npy" suffix. Archives with compressed members (numpy.savez_compressed) are rejected with an empty map.
+		static std::map<std::string, Ndarray<T>> LoadNpz(const std::string& path);
+		static std::map<std::string, Ndarray<T>> MapNpz(const std::string& path);
+
+		static constexpr size_t ALIGNMENT = 64;
+	private:
+		struct Header
+		{
+			char Kind;
+			unsigned int ItemSize;
+			bool bSwap;
+			bool bFortran;
+			std::vector<size_t> Shape;
+			size_t DataOffset;
+		};
+
+		static bool parseHeader(const char* data, const size_t& size, Header& header);
+		static std::string headerText(const Ndarray<T>& a);
+		static Ndarray<T> read(const std::shared_ptr<MappedFile>& file, const size_t& offset, const size_t& size, const bool& bMap);
+		template<typename S>
+		static void convert(const char* source, T* target, const size_t& count, const bool& bSwap);
+		static bool convertAll(const Header& header, const char* source, T* target, const size_t& count);
+
+		static std::map<std::string, Ndarray<T>> readNpz(const std::string& path, const bool& bMap);
+		static const char* descriptor();
+		static bool isLittleEndian();
+		static unsigned int crc32(unsigned int crc, const char* data, const size_t& size);
+	};
+
+	template<typename T>
+	bool Npy<T>::Save(const std::string& path, const Ndarray<T>& a)
+	{
+		if (a.GetDimension() == 0u)
+			return false;
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		const std::string header = headerText(a);
+		file.write(header.data(), static_cast<std::streamsize>(header.size()));
+		const Ndarray<T> compact = a.IsContiguous() ? Ndarray<T>() : Ndarray<T>(a);
+		const T* data = a.IsContiguous() ? a.GetData() : compact.GetData();
+		file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(sizeof(T) * a.GetTotalSize()));
+		return static_cast<bool>(file);
+	}
+
+	template<typename T>
+	Ndarray<T> Npy<T>::Load(const std::string& path)
+	{
+		const std::shared_ptr<MappedFile> file = MappedFile::Open(path);
+		if (file == nullptr)
+			return Ndarray<T>();
+		return read(file, 0, file->GetSize(), false);
+	}
+
+	template<typename T>
+	Ndarray<T> Npy<T>::Map(const std::string& path)
+	{
+		const std::shared_ptr<MappedFile> file = MappedFile::Open(path);
+		if (file == nullptr)
+			return Ndarray<T>();
+		return read(file, 0, file->GetSize(), true);
+	}
+
+	template<typename T>
+	bool Npy<T>::SaveNpz(const std::string& path, const std::vector<std::pair<std::string, Ndarray<T>>>& arrays)
+	{
+		for (const std::pair<std::string, Ndarray<T>>& array : arrays)
+		{
+			if (array.second.GetDimension() == 0u)
+				return false;
+		}
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		struct Entry
+		{
+			std::string Name;
+			unsigned int Crc;
+			unsigned long long Size;
+			unsigned long long Offset;
+		};
+		std::vector<Entry> entries;
+		std::string buffer;
+		auto put16 = [&buffer](const unsigned long long& value) { buffer.push_back(static_cast<char>(value)); buffer.push_back(static_cast<char>(value >> 8)); };
+		auto put32 = [&put16](const unsigned long long& value) { put16(value & 0xFFFFu); put16(value >> 16 & 0xFFFFu); };
+		auto put64 = [&put32](const unsigned long long& value) { put32(value & 0xFFFFFFFFu); put32(value >> 32); };
+		const unsigned long long LIMIT = 0xFFFFFFFFull;
+
+		unsigned long long offset = 0;
+		for (const std::pair<std::string, Ndarray<T>>& array : arrays)
+		{
+			const std::string header = headerText(array.second);
+			const Ndarray<T> compact = array.second.IsContiguous() ? Ndarray<T>() : Ndarray<T>(array.second);
+			const char* data = reinterpret_cast<const char*>(array.second.IsContiguous() ? array.second.GetData() : compact.GetData());
+			const size_t dataSize = sizeof(T) * array.second.GetTotalSize();
+
+			Entry entry = { array.first + ".npy", 0, header.size() + dataSize, offset };
+			entry.Crc = crc32(crc32(0, header.data(), header.size()), data, dataSize);
+			const bool bZip64 = entry.Size >= LIMIT || entry.Offset >= LIMIT;
+
+			// The alignment field (id 0xD935, as zipalign uses) pads the local header so the .npy data, whose own header is
+			// a multiple of 64 bytes, starts on a 64-byte boundary.
+			const unsigned long long fixed = offset + 30 + entry.Name.size() + (bZip64 ? 20 : 0) + 4;
+			const unsigned long long padding = (ALIGNMENT - fixed % ALIGNMENT) % ALIGNMENT;
+
+			buffer.clear();
+			put32(0x04034b50u);
+			put16(bZip64 ? 45 : 20);
+			put16(0);
+			put16(0);
+			put16(0);
+			put16(0x21);
+			put32(entry.Crc);
+			put32(bZip64 ? LIMIT : entry.Size);
+			put32(bZip64 ? LIMIT : entry.Size);
+			put16(entry.Name.size());
+			put16((bZip64 ? 20 : 0) + 4 + padding);
+			buffer += entry.Name;
+			if (bZip64)
+			{
+				put16(0x0001);
+				put16(16);
+				put64(entry.Size);
+				put64(entry.Size);
+			}
+			put16(0xD935);
+			put16(padding);
+			buffer.append(static_cast<size_t>(padding), '\0');
+
+			file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+			file.write(header.data(), static_cast<std::streamsize>(header.size()));
+			file.write(data, static_cast<std::streamsize>(dataSize));
+			offset += buffer.size() + entry.Size;
+			entries.push_back(entry);
+		}
+
+		const unsigned long long directoryOffset = offset;
+		buffer.clear();
+		for (const Entry& entry : entries)
+		{
+			const bool bSizeZip64 = entry.Size >= LIMIT;
+			const bool bOffsetZip64 = entry.Offset >= LIMIT;
+			const unsigned int extraSize = (bSizeZip64 || bOffsetZip64 ? 4 : 0) + (bSizeZip64 ? 16 : 0) + (bOffsetZip64 ? 8 : 0);
+			put32(0x02014b50u);
+			put16(extraSize != 0 ? 45 : 20);
+			put16(extraSize != 0 ? 45 : 20);
+			put16(0);
+			put16(0);
+			put16(0);
+			put16(0x21);
+			put32(entry.Crc);
+			put32(bSizeZip64 ? LIMIT : entry.Size);
+			put32(bSizeZip64 ? LIMIT : entry.Size);
+			put16(entry.Name.size());
+			put16(extraSize);
+			put16(0);
+			put16(0);
+			put16(0);
+			put32(0);
+			put32(bOffsetZip64 ? LIMIT : entry.Offset);
+			buffer += entry.Name;
+			if (extraSize != 0)
+			{
+				put16(0x0001);
+				put16(extraSize - 4);
+				if (bSizeZip64)
+				{
+					put64(entry.Size);
+					put64(entry.Size);
+				}
+				if (bOffsetZip64)
+				{
+					put64(entry.Offset);
+				}
+			}
+		}
+		const unsigned long long directorySize = buffer.size();
+
+		const bool bZip64 = directoryOffset >= LIMIT || entries.size() >= 0xFFFFu;
+		if (bZip64)
+		{
+			const unsigned long long recordOffset = directoryOffset + directorySize;
+			put32(0x06064b50u);
+			put64(44);
+			put16(45);
+			put16(45);
+			put32(0);
+			put32(0);
+			put64(entries.size());
+			put64(entries.size());
+			put64(directorySize);
+			put64(directoryOffset);
+			put32(0x07064b50u);
+			put32(0);
+			put64(recordOffset);
+			put32(1);
+		}
+		put32(0x06054b50u);
+		put16(0);
+		put16(0);
+		put16(bZip64 ? 0xFFFFu : entries.size());
+		put16(bZip64 ? 0xFFFFu : entries.size());
+		put32(directorySize);
+		put32(bZip64 ? LIMIT : directoryOffset);
+		put16(0);
+		file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+		return static_cast<bool>(file);
+	}
+
+	template<typename T>
+	inline std::map<std::string, Ndarray<T>> Npy<T>::LoadNpz(const std::string& path)
+	{
+		return readNpz(path, false);
+	}
+
+	template<typename T>
+	inline std::map<std::string, Ndarray<T>> Npy<T>::MapNpz(const std::string& path)
+	{
+		return readNpz(path, true);
+	}
+
+	template<typename T>
+	bool Npy<T>::parseHeader(const char* data, const size_t& size, Header& header)
+	{
+		if (size < 10 || std::memcmp(data, "\x93NUMPY", 6) != 0)
+			return false;
+
+		// Version 1 stores the header length in 2 bytes, versions 2 and 3 in 4.
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+		size_t length = 0;
+		size_t begin = 0;
+		if (bytes[6] == 1)
+		{
+			length = bytes[8] | static_cast<size_t>(bytes[9]) << 8;
+			begin = 10;
+		}
+		else if ((bytes[6] == 2 || bytes[6] == 3) && size >= 12)
+		{
+			length = bytes[8] | static_cast<size_t>(bytes[9]) << 8 | static_cast<size_t>(bytes[10]) << 16 | static_cast<size_t>(bytes[11]) << 24;
+			begin = 12;
+		}
+		else
+		{
+			return false;
+		}
+		if (begin + length > size)
+			return false;
+
+		const std::string text(data + begin, length);
+		header.DataOffset = begin + length;
+
+		const size_t descr = text.find("'descr'");
+		const size_t descrBegin = descr == std::string::npos ? std::string::npos : text.find('\'', descr + 7);
+		if (descrBegin == std::string::npos || descrBegin + 3 >= text.size())
+			return false;
+		const char order = text[descrBegin + 1];
+		header.Kind = text[descrBegin + 2];
+		header.ItemSize = static_cast<unsigned int>(std::atoi(text.c_str() + descrBegin + 3));
+		header.bSwap = header.ItemSize > 1 && ((order == '<' && !isLittleEndian()) || (order == '>' && isLittleEndian()));
+		if (order != '<' && order != '>' && order != '|' && order != '=')
+			return false;
+
+		const size_t fortran = text.find("'fortran_order'");
+		header.bFortran = fortran != std::string::npos && text.compare(text.find(':', fortran) + 1, 5, " True") == 0;
+
+		const size_t shape = text.find("'shape'");
+		const size_t shapeBegin = shape == std::string::npos ? std::string::npos : text.find('(', shape);
+		const size_t shapeEnd = shapeBegin == std::string::npos ? std::string::npos : text.find(')', shapeBegin);
+		if (shapeEnd == std::string::npos)
+			return false;
+		header.Shape.clear();
+		const char* cursor = text.c_str() + shapeBegin + 1;
+		const char* end = text.c_str() + shapeEnd;
+		while (cursor < end)
+		{
+			char* next = nullptr;
+			const unsigned long long value = std::strtoull(cursor, &next, 10);
+			if (next == cursor)
+			{
+				++cursor;
+				continue;
+			}
+			header.Shape.push_back(static_cast<size_t>(value));
+			cursor = next;
+		}
+		if (header.Shape.empty())
+		{
+			header.Shape.push_back(1);
+		}
+		return true;
+	}
+
+	template<typename T>
+	std::string Npy<T>::headerText(const Ndarray<T>& a)
+	{
+		std::string text = std::string("{'descr': '") + descriptor() + "', 'fortran_order': False, 'shape': (";
+		for (unsigned int i = 0; i < a.GetDimension(); ++i)
+		{
+			text += std::to_string(a.GetArraySize(i)) + (a.GetDimension() == 1u ? ",)" : i + 1 < a.GetDimension() ? ", " : ")");
+		}
+		text += ", }";
+
+		// Spaces and a newline pad magic, version, length and dictionary to a multiple of ALIGNMENT.
+		const size_t total = (10 + text.size() + 1 + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+		text.append(total - 10 - text.size() - 1, ' ');
+		text += '\n';
+		const size_t length = text.size();
+		return std::string("\x93NUMPY\x01\x00", 8) + static_cast<char>(length & 0xFF) + static_cast<char>(length >> 8) + text;
+	}
+
+	template<typename T>
+	Ndarray<T> Npy<T>::read(const std::shared_ptr<MappedFile>& file, const size_t& offset, const size_t& size, const bool& bMap)
+	{
+		Header header;
+		const char* begin = file->GetData() + offset;
+		if (!parseHeader(begin, size, header))
+			return Ndarray<T>();
+
+		// The shape comes from the file, so its product is checked before it is trusted.
+		size_t count = 1;
+		for (const size_t& length : header.Shape)
+		{
+			if (length != 0 && count > std::numeric_limits<size_t>::max() / length)
+				return Ndarray<T>();
+			count *= length;
+		}
+		if (header.ItemSize == 0 || header.DataOffset > size || count > (size - header.DataOffset) / header.ItemSize)
+			return Ndarray<T>();
+		if (count == 0)
+			return Ndarray<T>();
+
+		// Fortran order is C order of the reversed shape; transposing that view restores the original axes.
+		std::vector<size_t> arraySize(header.Shape);
+		if (header.bFortran)
+		{
+			arraySize.assign(header.Shape.rbegin(), header.Shape.rend());
+		}
+		const unsigned int dimension = static_cast<unsigned int>(arraySize.size());
+		const char* data = begin + header.DataOffset;
+
+		Ndarray<T> result;
+		const bool bSameType = std::strcmp(descriptor() + 1, (std::string(1, header.Kind) + std::to_string(header.ItemSize)).c_str()) == 0;
+		if (bMap && bSameType && !header.bSwap && reinterpret_cast<uintptr_t>(data) % alignof(T) == 0)
+		{
+			result = Ndarray<T>(std::shared_ptr<T[]>(file, reinterpret_cast<T*>(const_cast<char*>(data))), dimension, arraySize.data());
+		}
+		else
+		{
+			std::shared_ptr<T[]> storage = Allocator::AllocateShared<T>(count);
+			if (!convertAll(header, data, storage.get(), count))
+				return Ndarray<T>();
+			result = Ndarray<T>(storage, dimension, arraySize.data());
+		}
+		if (header.bFortran)
+			return result.Transpose();
+		return result;
+	}
+
+	template<typename T>
+	template<typename S>
+	void Npy<T>::convert(const char* source, T* target, const size_t& count, const bool& bSwap)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			char bytes[sizeof(S)];
+			std::memcpy(bytes, source + i * sizeof(S), sizeof(S));
+			if (bSwap)
+			{
+				for (size_t j = 0; j < sizeof(S) / 2; ++j)
+				{
+					std::swap(bytes[j], bytes[sizeof(S) - 1 - j]);
+				}
+			}
+			S value;
+			std::memcpy(&value, bytes, sizeof(S));
+			target[i] = static_cast<T>(value);
+		}
+	}
+
+	template<typename T>
+	bool Npy<T>::convertAll(const Header& header, const char* source, T* target, const size_t& count)
+	{
+		switch (header.Kind)
+		{
+		case 'f':
+			if (header.ItemSize == 2)
+				return convert<Float16>(source, target, count, header.bSwap), true;
+			if (header.ItemSize == 4)
+				return convert<float>(source, target, count, header.bSwap), true;
+			if (header.ItemSize == 8)
+				return convert<double>(source, target, count, header.bSwap), true;
+			return false;
+		case 'i':
+			if (header.ItemSize == 1)
+				return convert<int8_t>(source, target, count, false), true;
+			if (header.ItemSize == 2)
+				return convert<int16_t>(source, target, count, header.bSwap), true;
+			if (header.ItemSize == 4)
+				return convert<int32_t>(source, target, count, header.bSwap), true;
+			if (header.ItemSize == 8)
+				return convert<int64_t>(source, target, count, header.bSwap), true;
+			return false;
+		case 'u':
+		case 'b':
+			if (header.ItemSize == 1)
+				return convert<uint8_t>(source, target, count, false), true;
+			if (header.ItemSize == 2)
+				return convert<uint16_t>(source, target, count, header.bSwap), true;
+			if (header.ItemSize == 4)
+				return convert<uint32_t>(source, target, count, header.bSwap), true;
+			if (header.ItemSize == 8)
+				return convert<uint64_t>(source, target, count, header.bSwap), true;
+			return false;
+		default:
+			return false;
+		}
+	}
+
+	template<typename T>
+	std::map<std::string, Ndarray<T>> Npy<T>::readNpz(const std::string& path, const bool& bMap)
+	{
+		std::map<std::string, Ndarray<T>> arrays;
+		const std::shared_ptr<MappedFile> file = MappedFile::Open(path);
+		if (file == nullptr || file->GetSize() < 22)
+			return arrays;
+
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(file->GetData());
+		const size_t size = file->GetSize();
+		auto get16 = [bytes](const size_t& at) { return static_cast<unsigned long long>(bytes[at] | bytes[at + 1] << 8); };
+		auto get32 = [&get16](const size_t& at) { return get16(at) | get16(at + 2) << 16; };
+		auto get64 = [&get32](const size_t& at) { return get32(at) | get32(at + 4) << 32; };
+
+		// The end-of-central-directory record is the last 22 bytes plus a comment of up to 65535.
+		size_t end = size - 22;
+		while (get32(end) != 0x06054b50u)
+		{
+			if (end == 0 || size - end > 22 + 0xFFFF)
+				return arrays;
+			--end;
+		}
+		unsigned long long count = get16(end + 10);
+		unsigned long long directory = get32(end + 16);
+		if ((count == 0xFFFFu || directory == 0xFFFFFFFFu) && end >= 20 && get32(end - 20) == 0x07064b50u)
+		{
+			const unsigned long long record = get64(end - 12);
+			if (record > size || 56 > size - record || get32(static_cast<size_t>(record)) != 0x06064b50u)
+				return arrays;
+			count = get64(static_cast<size_t>(record) + 32);
+			directory = get64(static_cast<size_t>(record) + 48);
+		}
+
+		// Offsets and lengths come from the file, so every bound is checked as a remaining length, which cannot wrap.
+		if (directory > size)
+			return arrays;
+		size_t at = static_cast<size_t>(directory);
+		for (unsigned long long i = 0; i < count; ++i)
+		{
+			if (at > size || 46 > size - at || get32(at) != 0x02014b50u)
+				return std::map<std::string, Ndarray<T>>();
+
+			const unsigned long long method = get16(at + 10);
+			unsigned long long memberSize = get32(at + 24);
+			unsigned long long local = get32(at + 42);
+			const size_t nameSize = static_cast<size_t>(get16(at + 28));
+			const size_t extraSize = static_cast<size_t>(get16(at + 30));
+			const size_t commentSize = static_cast<size_t>(get16(at + 32));
+			if (nameSize + extraSize > size - at - 46)
+				return std::map<std::string, Ndarray<T>>();
+			const size_t extraEnd = at + 46 + nameSize + extraSize;
+			std::string name(file->GetData() + at + 46, nameSize);
+
+			// ZIP64 extra field: the 64-bit values of whichever 32-bit fields are saturated, in this order. Every record and
+			// every value read from one must lie inside the extra field.
+			for (size_t extra = at + 46 + nameSize; extraEnd - extra >= 4; )
+			{
+				if (static_cast<size_t>(get16(extra + 2)) > extraEnd - extra - 4)
+					return std::map<std::string, Ndarray<T>>();
+				const size_t recordEnd = extra + 4 + static_cast<size_t>(get16(extra + 2));
+				if (get16(extra) == 0x0001u)
+				{
+					size_t field = extra + 4;
+					if (memberSize == 0xFFFFFFFFu)
+					{
+						if (field > recordEnd || 8 > recordEnd - field)
+							return std::map<std::string, Ndarray<T>>();
+						memberSize = get64(field);
+						field += 8;
+					}
+					if (get32(at + 20) == 0xFFFFFFFFu)
+					{
+						field += 8;
+					}
+					if (local == 0xFFFFFFFFu)
+					{
+						if (field > recordEnd || 8 > recordEnd - field)
+							return std::map<std::string, Ndarray<T>>();
+						local = get64(field);
+					}
+				}
+				extra = recordEnd;
+			}
+			at += 46 + nameSize + extraSize + commentSize;
+
+			// The local header repeats the name and has its own extra field; its lengths are only trusted behind its signature.
+			if (method != 0 || local > size || 30 > size - local || get32(static_cast<size_t>(local)) != 0x04034b50u)
+				return std::map<std::string, Ndarray<T>>();
+			const size_t localExtra = static_cast<size_t>(get16(static_cast<size_t>(local) + 26) + get16(static_cast<size_t>(local) + 28));
+			if (localExtra > size - static_cast<size_t>(local) - 30)
+				return std::map<std::string, Ndarray<T>>();
+			const size_t data = static_cast<size_t>(local) + 30 + localExtra;
+			if (memberSize > size - data)
+				return std::map<std::string, Ndarray<T>>();
+
+			if (name.size() > 4 && name.compare(name.size() - 4, 4, ".npy") == 0)
+			{
+				name.resize(name.size() - 4);
+			}
+			arrays[name] = read(file, data, static_cast<size_t>(memberSize), bMap);
+		}
+		return arrays;
+	}
+
+	template<typename T>
+	const char* Npy<T>::descriptor()
+	{
+		const bool bLittle = isLittleEndian();
+		if (std::is_same<T, float>::value)
+			return bLittle ? "<f4" : ">f4";
+		if (std::is_same<T, double>::value)
+			return bLittle ? "<f8" : ">f8";
+		if (std::is_same<T, Float16>::value)
+			return bLittle ? "<f2" : ">f2";
+		if (std::is_same<T, bool>::value)
+			return "|b1";
+		if (std::is_integral<T>::value && sizeof(T) == 1)
+			return std::is_signed<T>::value ? "|i1" : "|u1";
+		if (std::is_integral<T>::value && std::is_signed<T>::value)
+			return sizeof(T) == 2 ? (bLittle ? "<i2" : ">i2") : sizeof(T) == 4 ? (bLittle ? "<i4" : ">i4") : (bLittle ? "<i8" : ">i8");
+		return sizeof(T) == 2 ? (bLittle ? "<u2" : ">u2") : sizeof(T) == 4 ? (bLittle ? "<u4" : ">u4") : (bLittle ? "<u8" : ">u8");
+	}
+
+	template<typename T>
+	inline bool Npy<T>::isLittleEndian()
+	{
+		const unsigned int one = 1;
+		unsigned char first;
+		std::memcpy(&first, &one, 1);
+		return first == 1;
+	}
+
+	template<typename T>
+	unsigned int Npy<T>::crc32(unsigned int crc, const char* data, const size_t& size)
+	{
+		static const std::vector<unsigned int> sTable = []()
+		{
+			std::vector<unsigned int> table(256);
+			for (unsigned int i = 0; i < 256; ++i)
+			{
+				unsigned int value = i;
+				for (int bit = 0; bit < 8; ++bit)
+				{
+					value = value & 1u ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+				}
+				table[i] = value;
+			}
+			return table;
+		}();
+
+		crc = ~crc;
+		for (size_t i = 0; i < size; ++i)
+		{
+			crc = sTable[(crc ^ static_cast<unsigned char>(data[i])) & 0xFFu] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+}
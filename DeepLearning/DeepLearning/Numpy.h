@@ -1,7 +1,17 @@
 #pragma once
+#include<algorithm>
+#include<cmath>
+#include<cstdint>
 #include<memory>
 #include<initializer_list>
+#include<type_traits>
+#include<vector>
 #include "Ndarray.h"
+#include "Gemm.h"
+#include "Profiler.h"
+#include "QuantizedGemm.h"
+#include "Reduction.h"
+#include "SimdMath.h"
 
 namespace numpy
 {
@@ -13,12 +23,137 @@ namespace numpy
 		~Numpy() = delete;
 
 		//static Ndarray<T> Array(const unsigned int& dimension, const unsigned int* arraySize, const unsigned int* data);
-		static Ndarray<T> Zeros(const unsigned int* data);
-		static Ndarray<T> Zeros(const std::initializer_list<int> data);
-		static Ndarray<T> Ones(const unsigned int* data);
-		static Ndarray<T> Ones(const std::initializer_list<int> data);
+		// Shapes are checked like the Ndarray constructors': one that overflows, or has a 0 axis, gives the empty array.
+		template<typename A, typename = EnableIfShapeArray<A>>
+		static Ndarray<T> Zeros(const A& data);
+		static Ndarray<T> Zeros(const std::initializer_list<size_t> data);
+		template<typename I, typename = typename std::enable_if<std::is_integral<I>::value && !std::is_same<I, size_t>::value>::type>
+		static Ndarray<T> Zeros(const std::initializer_list<I> data);
+		template<typename A, typename = EnableIfShapeArray<A>>
+		static Ndarray<T> Ones(const A& data);
+		static Ndarray<T> Ones(const std::initializer_list<size_t> data);
+		template<typename I, typename = typename std::enable_if<std::is_integral<I>::value && !std::is_same<I, size_t>::value>::type>
+		static Ndarray<T> Ones(const std::initializer_list<I> data);
+		// Up to two dimensions each the result is 2-D, a 1-D operand read as one row. With more, a and b are stacks of matrices
+		// in their last two dimensions multiplied as numpy.matmul does: the leading (batch) dimensions broadcast against each other,
+		// and a 1-D a (b) is a row (column) whose dimension is dropped from the result. The products run as one batched GEMM.
 		static Ndarray<T> Dot(const Ndarray<T>& a, const Ndarray<T>& b);
+		// Lazy like the arithmetic operators, so Maximum(Dot(x, w) + b, 0) is a single pass after the GEMM.
+		template<typename L, typename R>
+		static BinaryExpression<ElementwiseOperation::Maximum, L, R> Maximum(const Expression<L>& a, const Expression<R>& b);
+		template<typename E>
+		static BinaryExpression<ElementwiseOperation::Maximum, E, ScalarExpression<T>> Maximum(const Expression<E>& a, const T& b);
+
+		// out= forms: when out already has the result's shape the result is written into its elements (views included)
+		// and nothing is allocated; otherwise out is rebound to a new array.
+		static void Dot(Ndarray<T>& out, const Ndarray<T>& a, const Ndarray<T>& b);
+		// out = a . b + bias, then ReLU when bRelu; bias has one element per column of the result and both are applied by the
+		// GEMM epilogue, so the product is written once.
+		static void Dot(Ndarray<T>& out, const Ndarray<T>& a, const Ndarray<T>& b, const Ndarray<T>& bias, const bool& bRelu);
+		// out = a' . b' where a' (b') is a with the elements whose maskA (maskB) entry is not positive replaced by 0. A mask is
+		// empty or has its operand's shape, and is applied while packing, so the masked operand is never stored.
+		static void MaskedDot(Ndarray<T>& out, const Ndarray<T>& a, const Ndarray<T>& b, const Ndarray<T>& maskA, const Ndarray<T>& maskB);
+		// out = a[indices] along axis 0, as numpy.take(a, indices, axis=0); every index must be below a's first size.
+		static void Take(Ndarray<T>& out, const Ndarray<T>& a, const size_t* indices, const size_t& count);
+		// Symmetric int8 quantization, a = scale * q with q in [-127, 127] rounded to nearest: one scale per index of axis
+		// (per channel, e.g. axis 1 for the columns of a weight matrix) or one for the whole array. A channel of zeros gets scale 0.
+		static Ndarray<std::int8_t> Quantize(const Ndarray<T>& a, const int& axis, Ndarray<T>& scales);
+		static Ndarray<std::int8_t> Quantize(const Ndarray<T>& a, T& scale);
+		static Ndarray<T> Dequantize(const Ndarray<std::int8_t>& q, const int& axis, const Ndarray<T>& scales);
+		static Ndarray<T> Dequantize(const Ndarray<std::int8_t>& q, const T& scale);
+		// out = a . b + bias, then ReLU when bRelu, through the int8 GEMM: b was quantized per column ahead of time and the rows of
+		// a are quantized as they are packed. bias is empty or has one element per column of the result.
+		static void Dot(Ndarray<T>& out, const Ndarray<T>& a, const QuantizedMatrix<T>& b, const Ndarray<T>& bias, const bool& bRelu);
+		template<typename L, typename R>
+		static void Add(Ndarray<T>& out, const Expression<L>& a, const Expression<R>& b);
+		template<typename E>
+		static void Add(Ndarray<T>& out, const Expression<E>& a, const T& b);
+		template<typename L, typename R>
+		static void Multiply(Ndarray<T>& out, const Expression<L>& a, const Expression<R>& b);
+		template<typename E>
+		static void Multiply(Ndarray<T>& out, const Expression<E>& a, const T& b);
+		template<typename L, typename R>
+		static void Maximum(Ndarray<T>& out, const Expression<L>& a, const Expression<R>& b);
+		template<typename E>
+		static void Maximum(Ndarray<T>& out, const Expression<E>& a, const T& b);
+
+		// Reductions along one axis (negative counts from the end). The axis is removed, or kept with size 1 when bKeepDims;
+		// a 1-D input reduces to shape (1). The overloads without an axis reduce every element.
+		static Ndarray<T> Sum(const Ndarray<T>& a, const int& axis, const bool& bKeepDims = false);
+		static T Sum(const Ndarray<T>& a);
+		static Ndarray<T> Mean(const Ndarray<T>& a, const int& axis, const bool& bKeepDims = false);
+		static T Mean(const Ndarray<T>& a);
+		static Ndarray<T> Max(const Ndarray<T>& a, const int& axis, const bool& bKeepDims = false);
+		static T Max(const Ndarray<T>& a);
+		static Ndarray<size_t> ArgMax(const Ndarray<T>& a, const int& axis, const bool& bKeepDims = false);
+		static size_t ArgMax(const Ndarray<T>& a);
+		// weights is either 1-D along axis or the shape of a; any other shape gives the empty array.
+		static Ndarray<T> Average(const Ndarray<T>& a, const Ndarray<T>& weights, const int& axis, const bool& bKeepDims = false);
+		// Population standard deviation (ddof = 0).
+		static Ndarray<T> Std(const Ndarray<T>& a, const int& axis, const bool& bKeepDims = false);
+		static T Std(const Ndarray<T>& a);
+
+		// Element-wise functions through MathKernel, whose float error bounds are listed in SimdMath.h. Gelu is x Phi(x) in its
+		// erf form. The out= forms follow the rule above and may pass a itself as out.
+		static Ndarray<T> Exp(const Ndarray<T>& a);
+		static Ndarray<T> Log(const Ndarray<T>& a);
+		static Ndarray<T> Tanh(const Ndarray<T>& a);
+		static Ndarray<T> Sigmoid(const Ndarray<T>& a);
+		static Ndarray<T> Erf(const Ndarray<T>& a);
+		static Ndarray<T> Gelu(const Ndarray<T>& a);
+		static void Exp(Ndarray<T>& out, const Ndarray<T>& a);
+		static void Log(Ndarray<T>& out, const Ndarray<T>& a);
+		static void Tanh(Ndarray<T>& out, const Ndarray<T>& a);
+		static void Sigmoid(Ndarray<T>& out, const Ndarray<T>& a);
+		static void Erf(Ndarray<T>& out, const Ndarray<T>& a);
+		static void Gelu(Ndarray<T>& out, const Ndarray<T>& a);
+		// exp(a - max) / sum(exp(a - max)) along axis (negative counts from the end), two passes over each slice.
+		static Ndarray<T> Softmax(const Ndarray<T>& a, const int& axis = -1);
+		static void Softmax(Ndarray<T>& out, const Ndarray<T>& a, const int& axis = -1);
+		// log(Softmax(a, axis)) as a - log(sum(exp(a))), which stays finite where the probabilities underflow.
+		static Ndarray<T> LogSoftmax(const Ndarray<T>& a, const int& axis = -1);
+		static void LogSoftmax(Ndarray<T>& out, const Ndarray<T>& a, const int& axis = -1);
 	private:
+		using Shape = InlineArray<size_t, Ndarray<T>::MAX_INLINE_DIMENSION>;
+
+		// Splits a at axis into the [outer][length][inner] block Reduction works on and builds the result shape.
+		static bool reductionLayout(const Ndarray<T>& a, const int& axis, const bool& bKeepDims,
+			size_t& outer, size_t& length, size_t& inner, Shape& arraySize);
+		// a itself when it is compact, otherwise a compact copy held in storage.
+		static const Ndarray<T>& compact(const Ndarray<T>& a, Ndarray<T>& storage);
+		template<ElementwiseOperation Op>
+		static Ndarray<T> reduce(const Ndarray<T>& a, const int& axis, const bool& bKeepDims);
+		static void divide(Ndarray<T>& a, const T& divisor);
+		template<MathFunction F>
+		static void math(Ndarray<T>& out, const Ndarray<T>& a);
+		// Softmax, or LogSoftmax when bLog, of every slice along axis.
+		static void softmax(Ndarray<T>& out, const Ndarray<T>& a, const int& axis, const bool& bLog);
+		// Where a result of a's shape is written: out's elements when they can take it in place, element i being read from
+		// source before it is written, otherwise result, allocated here. finish then hands result to out.
+		static T* elementwiseTarget(Ndarray<T>& out, const Ndarray<T>& a, const Ndarray<T>& source, Ndarray<T>& result);
+		static void finish(Ndarray<T>& out, Ndarray<T>& result);
+		// What a profiled product reports: operands read and result written, and 2mnk flops over every batch.
+		static std::uint64_t dotBytes(const Ndarray<T>& a, const Ndarray<T>& b, const Shape& arraySize);
+		static std::uint64_t dotFlops(const Ndarray<T>& a, const Shape& arraySize);
+		template<MathFunction F>
+		static constexpr const char* mathName();
+		// Quantizes data laid out as [outer][channels][inner] with one scale per channel.
+		static void quantize(const T* data, const size_t& outer, const size_t& channels, const size_t& inner, T* scales, std::int8_t* q);
+
+		static bool dotShape(const Ndarray<T>& a, const Ndarray<T>& b, Shape& arraySize);
+		// Columns of each product in a . b.
+		static size_t dotColumns(const Ndarray<T>& a, const Ndarray<T>& b);
+		// Writes a . b into out, in place when out already has the result's shape and can be written by Gemm. The fusion
+		// pointers must stay valid and may not alias out.
+		static void dot(Ndarray<T>& out, const Ndarray<T>& a, const Ndarray<T>& b, const Shape& arraySize, const GemmFusion<T>& fusion);
+		// c holds the products row-major with leading dimension ldc, one after another when a or b is batched (ldc is then the
+		// column count). Batch dimensions whose strides line up are merged, so each Gemm::MultiplyBatched call covers as many
+		// products as possible.
+		static void multiply(const Ndarray<T>& a, const Ndarray<T>& b, T* c, const size_t& ldc, const GemmFusion<T>& fusion = GemmFusion<T>());
+		// The mask's elements laid out with operand's strides, compacting both when their layouts differ. A mask sharing out's
+		// storage is copied, since Gemm may write out while still packing.
+		static const T* maskData(const Ndarray<T>& out, const Ndarray<T>*& operand, const Ndarray<T>& mask, Ndarray<T>& operandStorage, Ndarray<T>& maskStorage);
+
 		static int mSeed;
 	};
 
@@ -29,57 +164,51 @@ namespace numpy
 	//}
 
 	template<typename T>
-	Ndarray<T> Numpy<T>::Zeros(const unsigned int* data)
+	template<typename A, typename>
+	Ndarray<T> Numpy<T>::Zeros(const A& data)
 	{
-		unsigned int dimension = static_cast<unsigned int>(sizeof(data) / sizeof(data[0]));
-
-		unsigned int totalSize = 1;
-		std::unique_ptr<unsigned int[]> arraySize = std::make_unique<unsigned int[]>(dimension);
-		for (unsigned int i = 0; i < dimension; ++i)
-		{
-			arraySize[i] = data[i];
-			totalSize *= data[i];
-		}
-
-		std::unique_ptr<T[]> array = std::make_unique<T[]>(totalSize);
-		for (unsigned int i = 0; i < totalSize; ++i)
-		{
-			array[i] = 0;
-		}
-
-		return Ndarray<T>(dimension, totalSize, arraySize, array);
+		constexpr unsigned int dimension = static_cast<unsigned int>(std::extent<A>::value);
+		size_t arraySize[dimension];
+		std::copy(data, data + dimension, arraySize);
+		Ndarray<T> result = Ndarray<T>::uninitialized(dimension, arraySize);
+		std::fill(result.GetData(), result.GetData() + result.GetTotalSize(), static_cast<T>(0));
+		return result;
 	}
 
 	template<typename T>
-	inline Ndarray<T> Numpy<T>::Zeros(const std::initializer_list<int> data)
+	inline Ndarray<T> Numpy<T>::Zeros(const std::initializer_list<size_t> data)
 	{
 		return Ndarray<T>(data);
 	}
 
 	template<typename T>
-	Ndarray<T> Numpy<T>::Ones(const unsigned int* data)
+	template<typename I, typename>
+	inline Ndarray<T> Numpy<T>::Zeros(const std::initializer_list<I> data)
 	{
-		unsigned int dimension = static_cast<unsigned int>(sizeof(data) / sizeof(data[0]));
-
-		unsigned int totalSize = 1;
-		std::unique_ptr<unsigned int[]> arraySize = std::make_unique<unsigned int[]>(dimension);
-		for (unsigned int i = 0; i < dimension; ++i)
-		{
-			arraySize[i] = data[i];
-			totalSize *= data[i];
-		}
+		return Ndarray<T>(data);
+	}
 
-		std::unique_ptr<T[]> array = std::make_unique<T[]>(totalSize);
-		for (unsigned int i = 0; i < totalSize; ++i)
-		{
-			array[i] = 1;
-		}
+	template<typename T>
+	template<typename A, typename>
+	Ndarray<T> Numpy<T>::Ones(const A& data)
+	{
+		constexpr unsigned int dimension = static_cast<unsigned int>(std::extent<A>::value);
+		size_t arraySize[dimension];
+		std::copy(data, data + dimension, arraySize);
+		Ndarray<T> result = Ndarray<T>::uninitialized(dimension, arraySize);
+		std::fill(result.GetData(), result.GetData() + result.GetTotalSize(), static_cast<T>(1));
+		return result;
+	}
 
-		return Ndarray<T>(dimension, totalSize, std::move(arraySize), std::move(array));
+	template<typename T>
+	inline Ndarray<T> Numpy<T>::Ones(const std::initializer_list<size_t> data)
+	{
+		return Ndarray<T>(data, 1);
 	}
 
 	template<typename T>
-	inline Ndarray<T> Numpy<T>::Ones(const std::initializer_list<int> data)
+	template<typename I, typename>
+	inline Ndarray<T> Numpy<T>::Ones(const std::initializer_list<I> data)
 	{
 		return Ndarray<T>(data, 1);
 	}
@@ -117,33 +246,1013 @@ namespace numpy
 	template<typename T>
 	inline Ndarray<T> Numpy<T>::Dot(const Ndarray<T>& a, const Ndarray<T>& b)
 	{
-		if (a.mDimension == 0 || b.mDimension == 0)
+		Shape arraySize;
+		if (!dotShape(a, b, arraySize))
+			return Ndarray<T>();
+
+		NUMPY_PROFILE_SCOPE("Numpy::Dot", dotBytes(a, b, arraySize), dotFlops(a, arraySize));
+		// Gemm writes every element, so the result is taken straight from the allocator without zeroing or a copy. A shape
+		// whose size overflows comes back empty and is returned as is.
+		Ndarray<T> result = Ndarray<T>::uninitialized(arraySize.GetSize(), arraySize.Get());
+		if (result.mTotalSize != 0u)
+		{
+			multiply(a, b, result.GetData(), dotColumns(a, b));
+		}
+		return result;
+	}
+
+	template<typename T>
+	void Numpy<T>::Dot(Ndarray<T>& out, const Ndarray<T>& a, const Ndarray<T>& b)
+	{
+		Shape arraySize;
+		if (!dotShape(a, b, arraySize))
+		{
+			out = Ndarray<T>();
+			return;
+		}
+		dot(out, a, b, arraySize, GemmFusion<T>());
+	}
+
+	template<typename T>
+	void Numpy<T>::Dot(Ndarray<T>& out, const Ndarray<T>& a, const Ndarray<T>& b, const Ndarray<T>& bias, const bool& bRelu)
+	{
+		Shape arraySize;
+		if (!dotShape(a, b, arraySize) || bias.mDimension != 1u || bias.mArraySize[0] != dotColumns(a, b))
+		{
+			out = Ndarray<T>();
+			return;
+		}
+
+		// A bias sharing out's storage is read from a copy, since Gemm writes out before the epilogue has read every row.
+		Ndarray<T> biasStorage;
+		GemmFusion<T> fusion;
+		fusion.Bias = out.mArray == bias.mArray ? (biasStorage = Ndarray<T>(bias)).GetData() : compact(bias, biasStorage).GetData();
+		fusion.bRelu = bRelu;
+		dot(out, a, b, arraySize, fusion);
+	}
+
+	template<typename T>
+	void Numpy<T>::MaskedDot(Ndarray<T>& out, const Ndarray<T>& a, const Ndarray<T>& b, const Ndarray<T>& maskA, const Ndarray<T>& maskB)
+	{
+		Shape arraySize;
+		if (!dotShape(a, b, arraySize) || (maskA.mTotalSize != 0u && !maskA.hasShape(a)) || (maskB.mTotalSize != 0u && !maskB.hasShape(b)))
+		{
+			out = Ndarray<T>();
+			return;
+		}
+
+		const Ndarray<T>* operandA = &a;
+		const Ndarray<T>* operandB = &b;
+		Ndarray<T> storage[4];
+		GemmFusion<T> fusion;
+		fusion.MaskA = maskA.mTotalSize != 0u ? maskData(out, operandA, maskA, storage[0], storage[1]) : nullptr;
+		fusion.MaskB = maskB.mTotalSize != 0u ? maskData(out, operandB, maskB, storage[2], storage[3]) : nullptr;
+		dot(out, *operandA, *operandB, arraySize, fusion);
+	}
+
+	template<typename T>
+	Ndarray<std::int8_t> Numpy<T>::Quantize(const Ndarray<T>& a, const int& axis, Ndarray<T>& scales)
+	{
+		const int dimension = static_cast<int>(a.mDimension);
+		if (a.mTotalSize == 0u || axis < -dimension || axis >= dimension)
+		{
+			scales = Ndarray<T>();
+			return Ndarray<std::int8_t>();
+		}
+
+		const unsigned int channelAxis = static_cast<unsigned int>(axis < 0 ? axis + dimension : axis);
+		const size_t channels = a.mArraySize[channelAxis];
+		size_t inner = 1;
+		for (unsigned int i = channelAxis + 1; i < a.mDimension; ++i)
+		{
+			inner *= a.mArraySize[i];
+		}
+
+		Ndarray<T> storage;
+		Ndarray<std::int8_t> result = Ndarray<std::int8_t>::uninitialized(a.mDimension, a.mArraySize.Get());
+		scales = Ndarray<T>::uninitialized(1u, &channels);
+		quantize(compact(a, storage).GetData(), a.mTotalSize / channels / inner, channels, inner, scales.GetData(), result.GetData());
+		return result;
+	}
+
+	template<typename T>
+	Ndarray<std::int8_t> Numpy<T>::Quantize(const Ndarray<T>& a, T& scale)
+	{
+		scale = 0;
+		if (a.mTotalSize == 0u)
+			return Ndarray<std::int8_t>();
+
+		Ndarray<T> storage;
+		Ndarray<std::int8_t> result = Ndarray<std::int8_t>::uninitialized(a.mDimension, a.mArraySize.Get());
+		quantize(compact(a, storage).GetData(), 1, 1, a.mTotalSize, &scale, result.GetData());
+		return result;
+	}
+
+	template<typename T>
+	Ndarray<T> Numpy<T>::Dequantize(const Ndarray<std::int8_t>& q, const int& axis, const Ndarray<T>& scales)
+	{
+		const int dimension = static_cast<int>(q.GetDimension());
+		if (q.GetTotalSize() == 0u || axis < -dimension || axis >= dimension)
+			return Ndarray<T>();
+		const unsigned int channelAxis = static_cast<unsigned int>(axis < 0 ? axis + dimension : axis);
+		const size_t channels = q.GetArraySize(channelAxis);
+		if (scales.mDimension != 1u || scales.mArraySize[0] != channels)
 			return Ndarray<T>();
 
-		// unsigned int dimension = a.mDimension == 1u ? 2u; // TODO
+		size_t inner = 1;
+		for (unsigned int i = channelAxis + 1; i < q.GetDimension(); ++i)
+		{
+			inner *= q.GetArraySize(i);
+		}
+
+		Ndarray<T> result = q.template AsType<T>();
+		T* data = result.GetData();
+		const size_t outer = result.mTotalSize / channels / inner;
+		for (size_t o = 0; o < outer; ++o)
+		{
+			for (size_t c = 0; c < channels; ++c)
+			{
+				const T scale = scales.At(c);
+				T* block = data + (o * channels + c) * inner;
+				for (size_t i = 0; i < inner; ++i)
+				{
+					block[i] *= scale;
+				}
+			}
+		}
+		return result;
+	}
+
+	template<typename T>
+	Ndarray<T> Numpy<T>::Dequantize(const Ndarray<std::int8_t>& q, const T& scale)
+	{
+		Ndarray<T> result = q.template AsType<T>();
+		result *= scale;
+		return result;
+	}
 
-		unsigned int midSize = b.mDimension == 1u ? 1u : b.mArraySize[b.mDimension - 2u];
+	template<typename T>
+	void Numpy<T>::Dot(Ndarray<T>& out, const Ndarray<T>& a, const QuantizedMatrix<T>& b, const Ndarray<T>& bias, const bool& bRelu)
+	{
+		if (a.mDimension != 2u || b.IsEmpty() || a.mArraySize[1] != b.GetRows()
+			|| (bias.mTotalSize != 0u && (bias.mDimension != 1u || bias.mArraySize[0] != b.GetColumns())))
+		{
+			out = Ndarray<T>();
+			return;
+		}
+
+		const size_t arraySize[2] = { a.mArraySize[0], b.GetColumns() };
+		NUMPY_PROFILE_SCOPE("Numpy::QuantizedDot", a.mTotalSize * sizeof(T) + b.GetRows() * arraySize[1] + arraySize[0] * arraySize[1] * sizeof(T),
+			static_cast<std::uint64_t>(arraySize[0]) * arraySize[1] * b.GetRows() * 2u);
+		// As in the float Dot, a bias sharing out's storage is read from a copy.
+		Ndarray<T> biasStorage;
+		const T* biasData = bias.mTotalSize == 0u ? nullptr
+			: out.mArray == bias.mArray ? (biasStorage = Ndarray<T>(bias)).GetData() : compact(bias, biasStorage).GetData();
+
+		const bool bShape = out.mDimension == 2u && out.mArraySize[0] == arraySize[0] && out.mArraySize[1] == arraySize[1];
+		if (bShape && (arraySize[1] == 1u || out.mStrides[1] == 1u) && out.mArray != a.mArray)
+		{
+			QuantizedGemm<T>::Multiply(arraySize[0], a.GetData(), a.mStrides[0], a.mStrides[1], b, out.GetData(), out.mStrides[0], biasData, bRelu);
+			return;
+		}
+
+		Ndarray<T> result = Ndarray<T>::uninitialized(2u, arraySize);
+		if (result.mTotalSize == 0u)
+		{
+			out = Ndarray<T>();
+			return;
+		}
+		QuantizedGemm<T>::Multiply(arraySize[0], a.GetData(), a.mStrides[0], a.mStrides[1], b, result.GetData(), arraySize[1], biasData, bRelu);
+		if (bShape)
+		{
+			out.assign(result);
+			return;
+		}
+		out = std::move(result);
+	}
+
+	template<typename T>
+	bool Numpy<T>::dotShape(const Ndarray<T>& a, const Ndarray<T>& b, Shape& arraySize)
+	{
+		if (a.mDimension == 0 || b.mDimension == 0)
+			return false;
+
+		if (a.mDimension <= 2u && b.mDimension <= 2u)
+		{
+			const size_t midSize = b.mDimension == 1u ? 1 : b.mArraySize[b.mDimension - 2u];
+			if (midSize != a.mArraySize[a.mDimension - 1])
+				return false;
+
+			arraySize.Resize(2u);
+			arraySize[0] = a.mDimension == 1u ? 1 : a.mArraySize[a.mDimension - 2u];
+			arraySize[1] = b.mArraySize[b.mDimension - 1u];
+			return true;
+		}
+
+		const size_t midSize = b.mArraySize[b.mDimension == 1u ? 0u : b.mDimension - 2u];
 		if (midSize != a.mArraySize[a.mDimension - 1])
+			return false;
+
+		// Batch dimensions aligned from the right, a missing one counting as size 1.
+		const unsigned int batchA = a.mDimension > 2u ? a.mDimension - 2u : 0u;
+		const unsigned int batchB = b.mDimension > 2u ? b.mDimension - 2u : 0u;
+		const unsigned int batchDimension = std::max(batchA, batchB);
+		const unsigned int dimension = batchDimension + (a.mDimension == 1u ? 0u : 1u) + (b.mDimension == 1u ? 0u : 1u);
+		arraySize.Resize(dimension);
+		for (unsigned int i = 0; i < batchDimension; ++i)
+		{
+			const size_t sizeA = i + batchA >= batchDimension ? a.mArraySize[i + batchA - batchDimension] : 1;
+			const size_t sizeB = i + batchB >= batchDimension ? b.mArraySize[i + batchB - batchDimension] : 1;
+			if (sizeA != sizeB && sizeA != 1u && sizeB != 1u)
+				return false;
+			arraySize[i] = sizeA == 1u ? sizeB : sizeA;
+		}
+		unsigned int axis = batchDimension;
+		if (a.mDimension != 1u)
+		{
+			arraySize[axis++] = a.mArraySize[a.mDimension - 2u];
+		}
+		if (b.mDimension != 1u)
+		{
+			arraySize[axis] = b.mArraySize[b.mDimension - 1u];
+		}
+		return true;
+	}
+
+	template<typename T>
+	inline size_t Numpy<T>::dotColumns(const Ndarray<T>& a, const Ndarray<T>& b)
+	{
+		return b.mDimension == 1u && a.mDimension > 2u ? 1 : b.mArraySize[b.mDimension - 1u];
+	}
+
+	template<typename T>
+	void Numpy<T>::Take(Ndarray<T>& out, const Ndarray<T>& a, const size_t* indices, const size_t& count)
+	{
+		if (a.mDimension == 0u || count == 0)
+		{
+			out = Ndarray<T>();
+			return;
+		}
+
+		NUMPY_PROFILE_SCOPE("Numpy::Take", static_cast<std::uint64_t>(count) * (a.mTotalSize / a.mArraySize[0]) * sizeof(T) * 2u);
+		Shape arraySize(a.mDimension);
+		arraySize[0] = count;
+		bool bShape = out.mDimension == a.mDimension && out.mArraySize[0] == count;
+		for (unsigned int i = 1; i < a.mDimension; ++i)
+		{
+			arraySize[i] = a.mArraySize[i];
+			bShape = bShape && out.mArraySize[i] == a.mArraySize[i];
+		}
+
+		Ndarray<T> storage;
+		const Ndarray<T>& source = compact(a, storage);
+		Ndarray<T> result;
+		const bool bInPlace = bShape && out.IsContiguous() && out.mArray != a.mArray;
+		if (!bInPlace)
+		{
+			result = Ndarray<T>::uninitialized(a.mDimension, arraySize.Get());
+		}
+
+		const size_t rowSize = a.mTotalSize / a.mArraySize[0];
+		const T* data = source.GetData();
+		T* target = bInPlace ? out.GetData() : result.GetData();
+		for (size_t i = 0; i < count; ++i)
+		{
+			const T* row = data + indices[i] * rowSize;
+			std::copy(row, row + rowSize, target + i * rowSize);
+		}
+
+		if (bInPlace)
+			return;
+		if (bShape)
+		{
+			out.assign(result);
+			return;
+		}
+		out = std::move(result);
+	}
+
+	template<typename T>
+	void Numpy<T>::dot(Ndarray<T>& out, const Ndarray<T>& a, const Ndarray<T>& b, const Shape& arraySize, const GemmFusion<T>& fusion)
+	{
+		NUMPY_PROFILE_SCOPE("Numpy::Dot", dotBytes(a, b, arraySize), dotFlops(a, arraySize));
+		const unsigned int dimension = arraySize.GetSize();
+		bool bShape = out.mDimension == dimension;
+		for (unsigned int i = 0; bShape && i < dimension; ++i)
+		{
+			bShape = out.mArraySize[i] == arraySize[i];
+		}
+
+		// Gemm needs unit column stride in c (batched products also one after another) and must not overwrite an operand it is
+		// still reading.
+		const bool bBatched = a.mDimension > 2u || b.mDimension > 2u;
+		const bool bLayout = bBatched ? out.IsContiguous() : arraySize[1] == 1u || out.mStrides[1] == 1u;
+		if (bShape && bLayout && out.mArray != a.mArray && out.mArray != b.mArray)
+		{
+			multiply(a, b, out.GetData(), bBatched ? dotColumns(a, b) : out.mStrides[0], fusion);
+			return;
+		}
+
+		// Gemm writes every element, so the result is taken straight from the allocator without zeroing or a copy.
+		Ndarray<T> result = Ndarray<T>::uninitialized(dimension, arraySize.Get());
+		if (result.mTotalSize == 0u)
+		{
+			out = Ndarray<T>();
+			return;
+		}
+		multiply(a, b, result.GetData(), dotColumns(a, b), fusion);
+		if (bShape)
+		{
+			out.assign(result);
+			return;
+		}
+		out = std::move(result);
+	}
+
+	template<typename T>
+	void Numpy<T>::multiply(const Ndarray<T>& a, const Ndarray<T>& b, T* c, const size_t& ldc, const GemmFusion<T>& fusion)
+	{
+		const size_t rows = a.mDimension == 1u ? 1 : a.mArraySize[a.mDimension - 2u];
+		const size_t columns = dotColumns(a, b);
+		const size_t midSize = a.mArraySize[a.mDimension - 1u];
+
+		// Strides go straight to the packing routines, so Transpose() and Slice() views are multiplied without a copy.
+		const size_t rowStrideA = a.mDimension == 1u ? 0 : a.mStrides[a.mDimension - 2u];
+		size_t rowStrideB = b.mDimension == 1u ? 0 : b.mStrides[b.mDimension - 2u];
+		size_t columnStrideB = b.mStrides[b.mDimension - 1u];
+		if (a.mDimension <= 2u && b.mDimension <= 2u)
+		{
+			Gemm<T>::Multiply(rows, columns, midSize,
+				a.GetData(), rowStrideA, a.mStrides[a.mDimension - 1u],
+				b.GetData(), rowStrideB, columnStrideB,
+				c, ldc, fusion);
+			return;
+		}
+		if (b.mDimension == 1u)
+		{
+			// A batched 1-D b is a column.
+			rowStrideB = b.mStrides[0];
+			columnStrideB = 0;
+		}
+
+		// Element strides of each batch dimension, 0 where an operand is broadcast; c's products are compact.
+		const unsigned int batchA = a.mDimension > 2u ? a.mDimension - 2u : 0u;
+		const unsigned int batchB = b.mDimension > 2u ? b.mDimension - 2u : 0u;
+		const unsigned int batchDimension = std::max(batchA, batchB);
+		Shape arraySize(batchDimension), stridesA(batchDimension), stridesB(batchDimension), stridesC(batchDimension);
+		size_t strideC = rows * ldc;
+		for (unsigned int i = batchDimension; i-- > 0;)
+		{
+			const unsigned int axisA = i + batchA - batchDimension;
+			const unsigned int axisB = i + batchB - batchDimension;
+			const bool bA = i + batchA >= batchDimension && a.mArraySize[axisA] != 1u;
+			const bool bB = i + batchB >= batchDimension && b.mArraySize[axisB] != 1u;
+			arraySize[i] = bA ? a.mArraySize[axisA] : bB ? b.mArraySize[axisB] : 1;
+			stridesA[i] = bA ? a.mStrides[axisA] : 0;
+			stridesB[i] = bB ? b.mStrides[axisB] : 0;
+			stridesC[i] = strideC;
+			strideC *= arraySize[i];
+		}
+
+		// The innermost batch dimensions merge into one run while every operand steps through them with a single stride.
+		size_t innerCount = 1, innerA = 0, innerB = 0, innerC = 0;
+		unsigned int outerDimension = batchDimension;
+		for (; outerDimension > 0; --outerDimension)
+		{
+			const unsigned int i = outerDimension - 1u;
+			if (arraySize[i] == 1u)
+				continue;
+			if (innerCount == 1u)
+			{
+				innerA = stridesA[i];
+				innerB = stridesB[i];
+				innerC = stridesC[i];
+			}
+			else if (stridesA[i] != innerA * innerCount || stridesB[i] != innerB * innerCount || stridesC[i] != innerC * innerCount)
+				break;
+			innerCount *= arraySize[i];
+		}
+
+		size_t outerCount = 1;
+		for (unsigned int i = 0; i < outerDimension; ++i)
+		{
+			outerCount *= arraySize[i];
+		}
+		for (size_t outer = 0; outer < outerCount; ++outer)
+		{
+			size_t offsetA = 0, offsetB = 0, offsetC = 0;
+			size_t remainder = outer;
+			for (unsigned int i = outerDimension; i-- > 0;)
+			{
+				const size_t index = remainder % arraySize[i];
+				remainder /= arraySize[i];
+				offsetA += index * stridesA[i];
+				offsetB += index * stridesB[i];
+				offsetC += index * stridesC[i];
+			}
+			GemmFusion<T> entryFusion = fusion;
+			entryFusion.MaskA = fusion.MaskA != nullptr ? fusion.MaskA + offsetA : nullptr;
+			entryFusion.MaskB = fusion.MaskB != nullptr ? fusion.MaskB + offsetB : nullptr;
+			Gemm<T>::MultiplyBatched(innerCount, rows, columns, midSize,
+				a.GetData() + offsetA, innerA, rowStrideA, a.mStrides[a.mDimension - 1u],
+				b.GetData() + offsetB, innerB, rowStrideB, columnStrideB,
+				c + offsetC, innerC, ldc, entryFusion);
+		}
+	}
+
+	template<typename T>
+	const T* Numpy<T>::maskData(const Ndarray<T>& out, const Ndarray<T>*& operand, const Ndarray<T>& mask, Ndarray<T>& operandStorage, Ndarray<T>& maskStorage)
+	{
+		if (mask.mArray == out.mArray)
+		{
+			operand = &compact(*operand, operandStorage);
+			maskStorage = Ndarray<T>(mask);
+			return maskStorage.GetData();
+		}
+		for (unsigned int i = 0; i < mask.mDimension; ++i)
+		{
+			if (mask.mArraySize[i] != 1u && mask.mStrides[i] != operand->mStrides[i])
+			{
+				operand = &compact(*operand, operandStorage);
+				return compact(mask, maskStorage).GetData();
+			}
+		}
+		return mask.GetData();
+	}
+
+	template<typename T>
+	template<typename L, typename R>
+	inline BinaryExpression<ElementwiseOperation::Maximum, L, R> Numpy<T>::Maximum(const Expression<L>& a, const Expression<R>& b)
+	{
+		return BinaryExpression<ElementwiseOperation::Maximum, L, R>(a.Self(), b.Self());
+	}
+
+	template<typename T>
+	template<typename E>
+	inline BinaryExpression<ElementwiseOperation::Maximum, E, ScalarExpression<T>> Numpy<T>::Maximum(const Expression<E>& a, const T& b)
+	{
+		return BinaryExpression<ElementwiseOperation::Maximum, E, ScalarExpression<T>>(a.Self(), ScalarExpression<T>(b));
+	}
+
+	template<typename T>
+	template<typename L, typename R>
+	inline void Numpy<T>::Add(Ndarray<T>& out, const Expression<L>& a, const Expression<R>& b)
+	{
+		out.assign(a + b);
+	}
+
+	template<typename T>
+	template<typename E>
+	inline void Numpy<T>::Add(Ndarray<T>& out, const Expression<E>& a, const T& b)
+	{
+		out.assign(BinaryExpression<ElementwiseOperation::Add, E, ScalarExpression<T>>(a.Self(), ScalarExpression<T>(b)));
+	}
+
+	template<typename T>
+	template<typename L, typename R>
+	inline void Numpy<T>::Multiply(Ndarray<T>& out, const Expression<L>& a, const Expression<R>& b)
+	{
+		out.assign(a * b);
+	}
+
+	template<typename T>
+	template<typename E>
+	inline void Numpy<T>::Multiply(Ndarray<T>& out, const Expression<E>& a, const T& b)
+	{
+		out.assign(BinaryExpression<ElementwiseOperation::Multiply, E, ScalarExpression<T>>(a.Self(), ScalarExpression<T>(b)));
+	}
+
+	template<typename T>
+	template<typename L, typename R>
+	inline void Numpy<T>::Maximum(Ndarray<T>& out, const Expression<L>& a, const Expression<R>& b)
+	{
+		out.assign(Maximum(a, b));
+	}
+
+	template<typename T>
+	template<typename E>
+	inline void Numpy<T>::Maximum(Ndarray<T>& out, const Expression<E>& a, const T& b)
+	{
+		out.assign(Maximum(a, b));
+	}
+
+	template<typename T>
+	inline Ndarray<T> Numpy<T>::Sum(const Ndarray<T>& a, const int& axis, const bool& bKeepDims)
+	{
+		return reduce<ElementwiseOperation::Add>(a, axis, bKeepDims);
+	}
+
+	template<typename T>
+	T Numpy<T>::Sum(const Ndarray<T>& a)
+	{
+		if (a.mTotalSize == 0)
+			return 0;
+
+		Ndarray<T> storage;
+		T result;
+		Reduction<T>::template Reduce<ElementwiseOperation::Add>(compact(a, storage).GetData(), 1u, a.mTotalSize, 1u, &result);
+		return result;
+	}
+
+	template<typename T>
+	Ndarray<T> Numpy<T>::Mean(const Ndarray<T>& a, const int& axis, const bool& bKeepDims)
+	{
+		Ndarray<T> result = Sum(a, axis, bKeepDims);
+		if (result.mTotalSize != 0)
+		{
+			divide(result, static_cast<T>(a.mArraySize[axis < 0 ? axis + static_cast<int>(a.mDimension) : axis]));
+		}
+		return result;
+	}
+
+	template<typename T>
+	inline T Numpy<T>::Mean(const Ndarray<T>& a)
+	{
+		return a.mTotalSize == 0 ? 0 : static_cast<T>(Sum(a) / static_cast<T>(a.mTotalSize));
+	}
+
+	template<typename T>
+	inline Ndarray<T> Numpy<T>::Max(const Ndarray<T>& a, const int& axis, const bool& bKeepDims)
+	{
+		return reduce<ElementwiseOperation::Maximum>(a, axis, bKeepDims);
+	}
+
+	template<typename T>
+	T Numpy<T>::Max(const Ndarray<T>& a)
+	{
+		if (a.mTotalSize == 0)
+			return 0;
+
+		Ndarray<T> storage;
+		T result;
+		Reduction<T>::template Reduce<ElementwiseOperation::Maximum>(compact(a, storage).GetData(), 1u, a.mTotalSize, 1u, &result);
+		return result;
+	}
+
+	template<typename T>
+	Ndarray<size_t> Numpy<T>::ArgMax(const Ndarray<T>& a, const int& axis, const bool& bKeepDims)
+	{
+		size_t outer;
+		size_t length;
+		size_t inner;
+		Shape arraySize;
+		if (!reductionLayout(a, axis, bKeepDims, outer, length, inner, arraySize))
+			return Ndarray<size_t>();
+
+		Ndarray<T> storage;
+		Ndarray<size_t> result = Ndarray<size_t>::uninitialized(arraySize.GetSize(), arraySize.Get());
+		Reduction<T>::ArgMax(compact(a, storage).GetData(), outer, length, inner, result.GetData());
+		return result;
+	}
+
+	template<typename T>
+	size_t Numpy<T>::ArgMax(const Ndarray<T>& a)
+	{
+		if (a.mTotalSize == 0)
+			return 0;
+
+		Ndarray<T> storage;
+		size_t result;
+		Reduction<T>::ArgMax(compact(a, storage).GetData(), 1u, a.mTotalSize, 1u, &result);
+		return result;
+	}
+
+	template<typename T>
+	Ndarray<T> Numpy<T>::Average(const Ndarray<T>& a, const Ndarray<T>& weights, const int& axis, const bool& bKeepDims)
+	{
+		const int dimension = static_cast<int>(a.mDimension);
+		if (axis < -dimension || axis >= dimension)
 			return Ndarray<T>();
+		const unsigned int reduced = static_cast<unsigned int>(axis < 0 ? axis + dimension : axis);
 
-		std::unique_ptr<unsigned int[]> arraySize = std::make_unique<unsigned int[]>(2);
-		arraySize[0] = a.mDimension == 1u ? 1u : a.mArraySize[a.mDimension - 2u];
-		arraySize[1] = b.mArraySize[b.mDimension - 1u];
+		// 1-D weights become a stride-0 broadcast of a's shape, so a * weights needs no tiled copy.
+		Ndarray<T> fullWeights;
+		if (weights.mDimension == 1 && a.mDimension != 1)
+		{
+			if (weights.mArraySize[0] != a.mArraySize[reduced])
+				return Ndarray<T>();
 
-		unsigned int totalSize = arraySize[0] * arraySize[1];
-		std::unique_ptr<T[]> array = std::make_unique<T[]>(totalSize);
+			Shape strides(a.mDimension);
+			for (unsigned int i = 0; i < a.mDimension; ++i)
+			{
+				strides[i] = i == reduced ? weights.mStrides[0] : 0;
+			}
+			fullWeights = weights.view(a.mDimension, a.mArraySize.Get(), strides.Get(), weights.mOffset);
+		}
+		else if (a.hasShape(weights))
+		{
+			fullWeights = weights.view(weights.mDimension, weights.mArraySize.Get(), weights.mStrides.Get(), weights.mOffset);
+		}
+		else
+		{
+			// a * weights would broadcast other shapes into a different average.
+			return Ndarray<T>();
+		}
+
+		Ndarray<T> result = Sum(Ndarray<T>(a * fullWeights), axis, bKeepDims);
+		const Ndarray<T> weightSum = Sum(fullWeights, axis, bKeepDims);
+		if (result.mTotalSize == 0 || weightSum.mTotalSize != result.mTotalSize)
+			return Ndarray<T>();
+
+		for (size_t i = 0; i < result.mTotalSize; ++i)
+		{
+			result.mArray[i] = static_cast<T>(result.mArray[i] / weightSum.mArray[i]);
+		}
+		return result;
+	}
+
+	template<typename T>
+	Ndarray<T> Numpy<T>::Std(const Ndarray<T>& a, const int& axis, const bool& bKeepDims)
+	{
+		// Two passes: the mean first, then the mean squared deviation, which avoids the cancellation of E[x^2] - E[x]^2.
+		const Ndarray<T> mean = Mean(a, axis, true);
+		if (mean.mTotalSize == 0)
+			return Ndarray<T>();
 
-		for (unsigned int i = 0; i < totalSize; ++i)
+		Ndarray<T> centered(a);
+		centered -= mean;
+		centered *= centered;
+		Ndarray<T> result = Mean(centered, axis, bKeepDims);
+		for (size_t i = 0; i < result.mTotalSize; ++i)
 		{
-			unsigned int k = static_cast<unsigned int>(i / arraySize[1]);
-			unsigned int y = static_cast<unsigned int>(i % arraySize[0]);
-			for (unsigned int j = 0; j < midSize; ++j)
+			result.mArray[i] = static_cast<T>(std::sqrt(result.mArray[i]));
+		}
+		return result;
+	}
+
+	template<typename T>
+	T Numpy<T>::Std(const Ndarray<T>& a)
+	{
+		if (a.mTotalSize == 0)
+			return 0;
+
+		Ndarray<T> centered(a);
+		centered -= Mean(a);
+		centered *= centered;
+		return static_cast<T>(std::sqrt(Mean(centered)));
+	}
+
+	template<typename T>
+	inline Ndarray<T> Numpy<T>::Exp(const Ndarray<T>& a)
+	{
+		Ndarray<T> out;
+		math<MathFunction::Exp>(out, a);
+		return out;
+	}
+
+	template<typename T>
+	inline Ndarray<T> Numpy<T>::Log(const Ndarray<T>& a)
+	{
+		Ndarray<T> out;
+		math<MathFunction::Log>(out, a);
+		return out;
+	}
+
+	template<typename T>
+	inline Ndarray<T> Numpy<T>::Tanh(const Ndarray<T>& a)
+	{
+		Ndarray<T> out;
+		math<MathFunction::Tanh>(out, a);
+		return out;
+	}
+
+	template<typename T>
+	inline Ndarray<T> Numpy<T>::Sigmoid(const Ndarray<T>& a)
+	{
+		Ndarray<T> out;
+		math<MathFunction::Sigmoid>(out, a);
+		return out;
+	}
+
+	template<typename T>
+	inline Ndarray<T> Numpy<T>::Erf(const Ndarray<T>& a)
+	{
+		Ndarray<T> out;
+		math<MathFunction::Erf>(out, a);
+		return out;
+	}
+
+	template<typename T>
+	inline Ndarray<T> Numpy<T>::Gelu(const Ndarray<T>& a)
+	{
+		Ndarray<T> out;
+		math<MathFunction::Gelu>(out, a);
+		return out;
+	}
+
+	template<typename T>
+	inline void Numpy<T>::Exp(Ndarray<T>& out, const Ndarray<T>& a)
+	{
+		math<MathFunction::Exp>(out, a);
+	}
+
+	template<typename T>
+	inline void Numpy<T>::Log(Ndarray<T>& out, const Ndarray<T>& a)
+	{
+		math<MathFunction::Log>(out, a);
+	}
+
+	template<typename T>
+	inline void Numpy<T>::Tanh(Ndarray<T>& out, const Ndarray<T>& a)
+	{
+		math<MathFunction::Tanh>(out, a);
+	}
+
+	template<typename T>
+	inline void Numpy<T>::Sigmoid(Ndarray<T>& out, const Ndarray<T>& a)
+	{
+		math<MathFunction::Sigmoid>(out, a);
+	}
+
+	template<typename T>
+	inline void Numpy<T>::Erf(Ndarray<T>& out, const Ndarray<T>& a)
+	{
+		math<MathFunction::Erf>(out, a);
+	}
+
+	template<typename T>
+	inline void Numpy<T>::Gelu(Ndarray<T>& out, const Ndarray<T>& a)
+	{
+		math<MathFunction::Gelu>(out, a);
+	}
+
+	template<typename T>
+	inline Ndarray<T> Numpy<T>::Softmax(const Ndarray<T>& a, const int& axis)
+	{
+		Ndarray<T> out;
+		softmax(out, a, axis, false);
+		return out;
+	}
+
+	template<typename T>
+	inline void Numpy<T>::Softmax(Ndarray<T>& out, const Ndarray<T>& a, const int& axis)
+	{
+		softmax(out, a, axis, false);
+	}
+
+	template<typename T>
+	inline Ndarray<T> Numpy<T>::LogSoftmax(const Ndarray<T>& a, const int& axis)
+	{
+		Ndarray<T> out;
+		softmax(out, a, axis, true);
+		return out;
+	}
+
+	template<typename T>
+	inline void Numpy<T>::LogSoftmax(Ndarray<T>& out, const Ndarray<T>& a, const int& axis)
+	{
+		softmax(out, a, axis, true);
+	}
+
+	template<typename T>
+	bool Numpy<T>::reductionLayout(const Ndarray<T>& a, const int& axis, const bool& bKeepDims,
+		size_t& outer, size_t& length, size_t& inner, Shape& arraySize)
+	{
+		const int dimension = static_cast<int>(a.mDimension);
+		if (a.mTotalSize == 0 || axis < -dimension || axis >= dimension)
+			return false;
+		const unsigned int reduced = static_cast<unsigned int>(axis < 0 ? axis + dimension : axis);
+
+		outer = 1;
+		inner = 1;
+		length = a.mArraySize[reduced];
+		for (unsigned int i = 0; i < reduced; ++i)
+		{
+			outer *= a.mArraySize[i];
+		}
+		for (unsigned int i = reduced + 1; i < a.mDimension; ++i)
+		{
+			inner *= a.mArraySize[i];
+		}
+
+		if (bKeepDims || a.mDimension == 1)
+		{
+			arraySize = a.mArraySize;
+			arraySize[reduced] = 1;
+			return true;
+		}
+
+		arraySize.Resize(a.mDimension - 1);
+		for (unsigned int i = 0, j = 0; i < a.mDimension; ++i)
+		{
+			if (i != reduced)
+			{
+				arraySize[j++] = a.mArraySize[i];
+			}
+		}
+		return true;
+	}
+
+	template<typename T>
+	void Numpy<T>::quantize(const T* data, const size_t& outer, const size_t& channels, const size_t& inner, T* scales, std::int8_t* q)
+	{
+		std::fill(scales, scales + channels, static_cast<T>(0));
+		for (size_t o = 0; o < outer; ++o)
+		{
+			for (size_t c = 0; c < channels; ++c)
 			{
-				array[i] += a.mArray[j + k * midSize] * b.mArray[y + j * arraySize[1]];
+				const T* block = data + (o * channels + c) * inner;
+				for (size_t i = 0; i < inner; ++i)
+				{
+					scales[c] = std::max(scales[c], static_cast<T>(std::abs(block[i])));
+				}
 			}
 		}
+		for (size_t c = 0; c < channels; ++c)
+		{
+			scales[c] /= static_cast<T>(127);
+		}
 
-		return Ndarray<T>(2u, totalSize, arraySize, array);
+		for (size_t o = 0; o < outer; ++o)
+		{
+			for (size_t c = 0; c < channels; ++c)
+			{
+				const T inverse = scales[c] > 0 ? static_cast<T>(1) / scales[c] : static_cast<T>(0);
+				const size_t offset = (o * channels + c) * inner;
+				for (size_t i = 0; i < inner; ++i)
+				{
+					const long value = std::lround(data[offset + i] * inverse);
+					q[offset + i] = static_cast<std::int8_t>(std::max(-127l, std::min(127l, value)));
+				}
+			}
+		}
 	}
-}
 
+	template<typename T>
+	inline const Ndarray<T>& Numpy<T>::compact(const Ndarray<T>& a, Ndarray<T>& storage)
+	{
+		if (a.IsContiguous())
+			return a;
+
+		storage = Ndarray<T>(a);
+		return storage;
+	}
+
+	template<typename T>
+	template<ElementwiseOperation Op>
+	Ndarray<T> Numpy<T>::reduce(const Ndarray<T>& a, const int& axis, const bool& bKeepDims)
+	{
+		size_t outer;
+		size_t length;
+		size_t inner;
+		Shape arraySize;
+		if (!reductionLayout(a, axis, bKeepDims, outer, length, inner, arraySize))
+			return Ndarray<T>();
+
+		NUMPY_PROFILE_SCOPE(Op == ElementwiseOperation::Add ? "Numpy::Sum" : "Numpy::Max", (a.mTotalSize + outer * inner) * sizeof(T), a.mTotalSize);
+		Ndarray<T> storage;
+		Ndarray<T> result = Ndarray<T>::uninitialized(arraySize.GetSize(), arraySize.Get());
+		Reduction<T>::template Reduce<Op>(compact(a, storage).GetData(), outer, length, inner, result.GetData());
+		return result;
+	}
+
+	template<typename T>
+	void Numpy<T>::divide(Ndarray<T>& a, const T& divisor)
+	{
+		T* data = a.GetData();
+		for (size_t i = 0; i < a.mTotalSize; ++i)
+		{
+			data[i] = static_cast<T>(data[i] / divisor);
+		}
+	}
+
+	template<typename T>
+	template<MathFunction F>
+	void Numpy<T>::math(Ndarray<T>& out, const Ndarray<T>& a)
+	{
+		if (a.mTotalSize == 0)
+		{
+			out = Ndarray<T>();
+			return;
+		}
+
+		NUMPY_PROFILE_SCOPE(mathName<F>(), a.mTotalSize * sizeof(T) * 2u);
+		Ndarray<T> storage;
+		const Ndarray<T>& source = compact(a, storage);
+		Ndarray<T> result;
+		const T* data = source.GetData();
+		T* target = elementwiseTarget(out, a, source, result);
+		ParallelElements(a.mTotalSize, ELEMENTWISE_GRAIN, [data, target](size_t begin, size_t end)
+		{
+			MathKernel<T>::template Apply<F>(data + begin, target + begin, end - begin);
+		});
+		finish(out, result);
+	}
+
+	template<typename T>
+	void Numpy<T>::softmax(Ndarray<T>& out, const Ndarray<T>& a, const int& axis, const bool& bLog)
+	{
+		size_t outer;
+		size_t length;
+		size_t inner;
+		Shape arraySize;
+		if (!reductionLayout(a, axis, true, outer, length, inner, arraySize))
+		{
+			out = Ndarray<T>();
+			return;
+		}
+
+		NUMPY_PROFILE_SCOPE(bLog ? "Numpy::LogSoftmax" : "Numpy::Softmax", a.mTotalSize * sizeof(T) * 2u);
+		Ndarray<T> storage;
+		const Ndarray<T>& source = compact(a, storage);
+		Ndarray<T> result;
+		const T* data = source.GetData();
+		T* target = elementwiseTarget(out, a, source, result);
+		// A slice along an inner axis is strided, so it is gathered into a row, computed there and scattered back.
+		ParallelElements(outer * inner, std::max<size_t>(1, ELEMENTWISE_GRAIN / length), [data, target, length, inner, bLog](size_t begin, size_t end)
+		{
+			std::vector<T> row(inner == 1 ? 0 : length);
+			for (size_t slice = begin; slice < end; ++slice)
+			{
+				const size_t offset = (slice / inner) * length * inner + slice % inner;
+				const T* u = data + offset;
+				T* y = target + offset;
+				if (inner != 1)
+				{
+					for (size_t c = 0; c < length; ++c)
+					{
+						row[c] = u[c * inner];
+					}
+					u = row.data();
+					y = row.data();
+				}
+
+				if (bLog)
+				{
+					const T logSum = MathKernel<T>::LogSumExp(u, length);
+					for (size_t c = 0; c < length; ++c)
+					{
+						y[c] = static_cast<T>(u[c] - logSum);
+					}
+				}
+				else
+				{
+					MathKernel<T>::Softmax(u, y, length);
+				}
+
+				if (inner != 1)
+				{
+					for (size_t c = 0; c < length; ++c)
+					{
+						target[offset + c * inner] = row[c];
+					}
+				}
+			}
+		});
+		finish(out, result);
+	}
+
+	template<typename T>
+	T* Numpy<T>::elementwiseTarget(Ndarray<T>& out, const Ndarray<T>& a, const Ndarray<T>& source, Ndarray<T>& result)
+	{
+		// A view of a's storage other than a itself would be overwritten before all of it is read.
+		if (out.mTotalSize != 0 && out.hasShape(a) && out.IsContiguous() && (out.mArray != source.mArray || out.GetData() == source.GetData()))
+			return out.GetData();
+
+		result = Ndarray<T>::uninitialized(a.mDimension, a.mArraySize.Get());
+		return result.GetData();
+	}
+
+	template<typename T>
+	void Numpy<T>::finish(Ndarray<T>& out, Ndarray<T>& result)
+	{
+		if (result.mTotalSize == 0)
+			return;
+		if (out.mTotalSize != 0 && out.hasShape(result))
+		{
+			out.assign(result);
+			return;
+		}
+		out = std::move(result);
+	}
+
+	template<typename T>
+	std::uint64_t Numpy<T>::dotBytes(const Ndarray<T>& a, const Ndarray<T>& b, const Shape& arraySize)
+	{
+		std::uint64_t resultSize = 1;
+		for (unsigned int i = 0; i < arraySize.GetSize(); ++i)
+		{
+			resultSize *= arraySize[i];
+		}
+		return (a.mTotalSize + b.mTotalSize + resultSize) * sizeof(T);
+	}
+
+	template<typename T>
+	std::uint64_t Numpy<T>::dotFlops(const Ndarray<T>& a, const Shape& arraySize)
+	{
+		std::uint64_t resultSize = 1;
+		for (unsigned int i = 0; i < arraySize.GetSize(); ++i)
+		{
+			resultSize *= arraySize[i];
+		}
+		return resultSize * a.mArraySize[a.mDimension - 1u] * 2u;
+	}
+
+	template<typename T>
+	template<MathFunction F>
+	constexpr const char* Numpy<T>::mathName()
+	{
+		return F == MathFunction::Exp ? "Numpy::Exp" : F == MathFunction::Log ? "Numpy::Log" : F == MathFunction::Tanh ? "Numpy::Tanh"
+			: F == MathFunction::Sigmoid ? "Numpy::Sigmoid" : F == MathFunction::Erf ? "Numpy::Erf" : "Numpy::Gelu";
+	}
+}
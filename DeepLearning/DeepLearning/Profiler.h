@@ -0,0 +1,308 @@
+#pragma once
+#include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<cstdint>
+#include<fstream>
+#include<iomanip>
+#include<map>
+#include<memory>
+#include<mutex>
+#include<ostream>
+#include<string>
+#include<vector>
+
+// Building with NUMPY_PROFILE defined instruments Numpy, the element-wise expressions, array copies, the layers and the thread
+// pool tasks; without it NUMPY_PROFILE_SCOPE and NUMPY_PROFILE_ALLOCATION expand to nothing and their arguments are never
+// evaluated, so an unprofiled build runs exactly the uninstrumented code. ProfileScope itself is always available.
+#ifdef NUMPY_PROFILE
+#define NUMPY_PROFILE_CONCAT_(a, b) a##b
+#define NUMPY_PROFILE_CONCAT(a, b) NUMPY_PROFILE_CONCAT_(a, b)
+#define NUMPY_PROFILE_SCOPE(...) const ::numpy::ProfileScope NUMPY_PROFILE_CONCAT(numpyProfileScope, __LINE__)(__VA_ARGS__)
+#define NUMPY_PROFILE_ALLOCATION(bytes) ::numpy::Profiler::CountAllocation(bytes)
+#else
+#define NUMPY_PROFILE_SCOPE(...) static_cast<void>(0)
+#define NUMPY_PROFILE_ALLOCATION(bytes) static_cast<void>(0)
+#endif
+
+namespace numpy
+{
+	class ProfileScope;
+
+	// One finished scope; times are nanoseconds since the profiler started.
+	struct ProfileEvent
+	{
+		const char* Name;
+		std::uint64_t Start;
+		std::uint64_t Duration;
+		// Time spent in the scopes nested directly inside, so Duration - ChildDuration is the scope's own (self) time.
+		std::uint64_t ChildDuration;
+		std::uint64_t BytesAllocated;
+		std::uint64_t BytesMoved;
+		std::uint64_t Flops;
+	};
+
+	// Totals of every event with one name. Bytes moved and flops are the nominal counts the instrumented call reports (operands
+	// read plus results written, 2mnk for a product), not hardware counters; bytes allocated include nested scopes.
+	struct ProfileSummary
+	{
+		std::string Name;
+		unsigned long long Calls;
+		double Seconds;
+		double SelfSeconds;
+		unsigned long long BytesAllocated;
+		unsigned long long BytesMoved;
+		unsigned long long Flops;
+	};
+
+	// Static facade over the per-thread event buffers. Recording takes no lock: a scope appends to its own thread's buffer,
+	// and only the first scope of a thread registers that buffer. Reset, Summarize and WriteTrace read every buffer, so they
+	// must not run while profiled work is still running on another thread (between training steps, say).
+	class Profiler final
+	{
+	public:
+		Profiler() = delete;
+		~Profiler() = delete;
+
+		// Scopes opened while disabled (the default) record nothing and cost one relaxed load.
+		static void Enable(const bool& bEnable = true);
+		static bool IsEnabled();
+		static void Reset();
+
+		// Sorted by self time, largest first.
+		static std::vector<ProfileSummary> Summarize();
+		static void PrintSummary(std::ostream& os);
+		// Chrome trace event JSON with one complete ("X") event per scope, for chrome://tracing or ui.perfetto.dev.
+		static bool WriteTrace(const std::string& path);
+
+		// Adds to the bytes allocated by the scopes open on this thread.
+		static void CountAllocation(const size_t& bytes);
+	private:
+		friend class ProfileScope;
+
+		struct ThreadBuffer
+		{
+			std::vector<ProfileEvent> Events;
+			unsigned int Thread;
+			std::uint64_t Allocated;
+			ProfileScope* pCurrent;
+		};
+
+		static ThreadBuffer& buffer();
+		static std::uint64_t now();
+		static void writeEscaped(std::ostream& os, const char* text);
+
+		static std::atomic<bool> sbEnabled;
+		static std::mutex sMutex;
+		static std::vector<std::unique_ptr<ThreadBuffer>> sBuffers;
+		static const std::chrono::steady_clock::time_point sEpoch;
+		static thread_local ThreadBuffer* spBuffer;
+	};
+
+	// Times the enclosing block and records it with the bytes and flops the caller attributes to it. name must outlive the
+	// profiler's events (a string literal). Scopes nest per thread; the parent's self time excludes its children.
+	class ProfileScope final
+	{
+	public:
+		explicit ProfileScope(const char* name, const std::uint64_t& bytesMoved = 0, const std::uint64_t& flops = 0);
+		ProfileScope(const ProfileScope& rhs) = delete;
+		ProfileScope& operator=(const ProfileScope& rhs) = delete;
+		~ProfileScope();
+	private:
+		Profiler::ThreadBuffer* mpBuffer;
+		ProfileScope* mpParent;
+		const char* mName;
+		std::uint64_t mStart;
+		std::uint64_t mAllocated;
+		std::uint64_t mChildDuration;
+		std::uint64_t mBytesMoved;
+		std::uint64_t mFlops;
+	};
+
+	inline std::atomic<bool> Profiler::sbEnabled(false);
+	inline std::mutex Profiler::sMutex;
+	inline std::vector<std::unique_ptr<Profiler::ThreadBuffer>> Profiler::sBuffers;
+	inline const std::chrono::steady_clock::time_point Profiler::sEpoch = std::chrono::steady_clock::now();
+	inline thread_local Profiler::ThreadBuffer* Profiler::spBuffer = nullptr;
+
+	inline void Profiler::Enable(const bool& bEnable)
+	{
+		sbEnabled.store(bEnable, std::memory_order_relaxed);
+	}
+
+	inline bool Profiler::IsEnabled()
+	{
+		return sbEnabled.load(std::memory_order_relaxed);
+	}
+
+	inline void Profiler::Reset()
+	{
+		std::lock_guard<std::mutex> lock(sMutex);
+		for (const std::unique_ptr<ThreadBuffer>& buffer : sBuffers)
+		{
+			buffer->Events.clear();
+		}
+	}
+
+	inline std::vector<ProfileSummary> Profiler::Summarize()
+	{
+		std::map<std::string, ProfileSummary> totals;
+		{
+			std::lock_guard<std::mutex> lock(sMutex);
+			for (const std::unique_ptr<ThreadBuffer>& buffer : sBuffers)
+			{
+				for (const ProfileEvent& event : buffer->Events)
+				{
+					ProfileSummary& summary = totals[event.Name];
+					summary.Calls += 1;
+					summary.Seconds += event.Duration * 1e-9;
+					summary.SelfSeconds += (event.Duration - std::min(event.ChildDuration, event.Duration)) * 1e-9;
+					summary.BytesAllocated += event.BytesAllocated;
+					summary.BytesMoved += event.BytesMoved;
+					summary.Flops += event.Flops;
+				}
+			}
+		}
+
+		std::vector<ProfileSummary> summaries;
+		for (std::pair<const std::string, ProfileSummary>& total : totals)
+		{
+			total.second.Name = total.first;
+			summaries.push_back(std::move(total.second));
+		}
+		std::stable_sort(summaries.begin(), summaries.end(), [](const ProfileSummary& a, const ProfileSummary& b)
+		{
+			return a.SelfSeconds > b.SelfSeconds;
+		});
+		return summaries;
+	}
+
+	inline void Profiler::PrintSummary(std::ostream& os)
+	{
+		const std::vector<ProfileSummary> summaries = Summarize();
+		const std::ios_base::fmtflags flags = os.flags();
+		const std::streamsize precision = os.precision();
+		os << std::left << std::setw(28) << "op" << std::right << std::setw(10) << "calls" << std::setw(12) << "total ms"
+			<< std::setw(12) << "self ms" << std::setw(12) << "alloc MB" << std::setw(12) << "moved MB" << std::setw(10) << "GB/s"
+			<< std::setw(10) << "GFLOP/s" << std::endl;
+		os << std::fixed;
+		for (const ProfileSummary& summary : summaries)
+		{
+			os << std::left << std::setw(28) << summary.Name << std::right << std::setw(10) << summary.Calls
+				<< std::setprecision(3) << std::setw(12) << summary.Seconds * 1e3 << std::setw(12) << summary.SelfSeconds * 1e3
+				<< std::setprecision(2) << std::setw(12) << summary.BytesAllocated / 1e6 << std::setw(12) << summary.BytesMoved / 1e6
+				<< std::setprecision(1) << std::setw(10) << (summary.Seconds > 0 ? summary.BytesMoved / summary.Seconds / 1e9 : 0.0)
+				<< std::setw(10) << (summary.Seconds > 0 ? summary.Flops / summary.Seconds / 1e9 : 0.0) << std::endl;
+		}
+		os.flags(flags);
+		os.precision(precision);
+	}
+
+	inline bool Profiler::WriteTrace(const std::string& path)
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		file << "{\"traceEvents\":[";
+		file << std::fixed << std::setprecision(3);
+		bool bFirst = true;
+		{
+			std::lock_guard<std::mutex> lock(sMutex);
+			for (const std::unique_ptr<ThreadBuffer>& buffer : sBuffers)
+			{
+				file << (bFirst ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->Thread
+					<< ",\"args\":{\"name\":\"thread " << buffer->Thread << "\"}}";
+				bFirst = false;
+				for (const ProfileEvent& event : buffer->Events)
+				{
+					file << ",\n{\"name\":\"";
+					writeEscaped(file, event.Name);
+					file << "\",\"cat\":\"numpy\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->Thread
+						<< ",\"ts\":" << event.Start / 1e3 << ",\"dur\":" << event.Duration / 1e3
+						<< ",\"args\":{\"bytes_allocated\":" << event.BytesAllocated << ",\"bytes_moved\":" << event.BytesMoved
+						<< ",\"flops\":" << event.Flops << "}}";
+				}
+			}
+		}
+		file << "\n],\"displayTimeUnit\":\"ns\"}\n";
+		return static_cast<bool>(file);
+	}
+
+	inline void Profiler::CountAllocation(const size_t& bytes)
+	{
+		if (IsEnabled())
+		{
+			buffer().Allocated += bytes;
+		}
+	}
+
+	inline Profiler::ThreadBuffer& Profiler::buffer()
+	{
+		if (spBuffer == nullptr)
+		{
+			// Registered buffers are kept after their thread exits, so a restarted thread pool loses no events.
+			std::lock_guard<std::mutex> lock(sMutex);
+			sBuffers.push_back(std::make_unique<ThreadBuffer>());
+			spBuffer = sBuffers.back().get();
+			spBuffer->Thread = static_cast<unsigned int>(sBuffers.size());
+			spBuffer->Allocated = 0;
+			spBuffer->pCurrent = nullptr;
+		}
+		return *spBuffer;
+	}
+
+	inline std::uint64_t Profiler::now()
+	{
+		return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - sEpoch).count());
+	}
+
+	inline void Profiler::writeEscaped(std::ostream& os, const char* text)
+	{
+		for (; *text != '\0'; ++text)
+		{
+			if (*text == '"' || *text == '\\')
+			{
+				os << '\\';
+			}
+			if (static_cast<unsigned char>(*text) >= 0x20u)
+			{
+				os << *text;
+			}
+		}
+	}
+
+	inline ProfileScope::ProfileScope(const char* name, const std::uint64_t& bytesMoved, const std::uint64_t& flops)
+		: mpBuffer(nullptr)
+		, mpParent(nullptr)
+		, mName(name)
+		, mStart(0)
+		, mAllocated(0)
+		, mChildDuration(0)
+		, mBytesMoved(bytesMoved)
+		, mFlops(flops)
+	{
+		if (!Profiler::IsEnabled())
+			return;
+
+		mpBuffer = &Profiler::buffer();
+		mpParent = mpBuffer->pCurrent;
+		mpBuffer->pCurrent = this;
+		mAllocated = mpBuffer->Allocated;
+		mStart = Profiler::now();
+	}
+
+	inline ProfileScope::~ProfileScope()
+	{
+		if (mpBuffer == nullptr)
+			return;
+
+		const std::uint64_t duration = Profiler::now() - mStart;
+		mpBuffer->pCurrent = mpParent;
+		if (mpParent != nullptr)
+		{
+			mpParent->mChildDuration += duration;
+		}
+		mpBuffer->Events.push_back(ProfileEvent{ mName, mStart, duration, mChildDuration, mpBuffer->Allocated - mAllocated, mBytesMoved, mFlops });
+	}
+}
@@ -0,0 +1,493 @@
+#pragma once
+#include<algorithm>
+#include<cstdint>
+#include<cstring>
+#include<type_traits>
+#include<vector>
+#include "Ndarray.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+namespace numpy
+{
+	// Right-hand operand of an int8 Dot: a k x n matrix quantized per column (output channel), b[p][j] = scale[j] * q[p][j], packed
+	// once into the layout the kernels stream. Columns are grouped into NR-wide panels, and within a panel every run of 4 consecutive
+	// k holds the 4 bytes of each column side by side, which is the operand order of VNNI's vpdpbusd.
+	template<typename T>
+	class QuantizedMatrix final
+	{
+	public:
+		QuantizedMatrix();
+		// values (k x n, any layout) and scales (n), as Numpy<T>::Quantize(b, 1, scales) returns them. Values outside [-127, 127],
+		// mismatched shapes or k above MAX_ROWS make an empty matrix.
+		QuantizedMatrix(const Ndarray<std::int8_t>& values, const Ndarray<T>& scales);
+		~QuantizedMatrix() = default;
+
+		bool IsEmpty() const;
+		size_t GetRows() const;
+		size_t GetColumns() const;
+		// k rounded up to a multiple of 4; the padding is 0.
+		size_t GetDepth() const;
+		const std::int8_t* GetPanel(const size_t& column) const;
+		// Per column, padded with 0 to a multiple of NR like the panels.
+		const T* GetScales() const;
+		// Sum of each column's values, which removes the 128 offset of the unsigned activations.
+		const std::int32_t* GetColumnSums() const;
+
+		static constexpr unsigned int NR = 16;
+		// Largest k for which 255 * 127 * k, the largest unsigned-by-signed sum, fits in int32.
+		static constexpr size_t MAX_ROWS = 66000;
+	private:
+		size_t mRows;
+		size_t mColumns;
+		size_t mDepth;
+		std::vector<std::int8_t> mPacked;
+		std::vector<T> mScales;
+		std::vector<std::int32_t> mColumnSums;
+	};
+
+	// c[m x n] = a[m x k] . b for a float a and a QuantizedMatrix b, then bias and ReLU. Each row of a is quantized on the fly with
+	// its own scale and stored as unsigned bytes offset by 128; the products are summed exactly in int32 and the offset is taken
+	// out with b's column sums before scaling back. The int32 sums come from VNNI at the AVX512 level when the CPU has it, from
+	// AVX2 16-bit multiply-adds, or from a scalar loop.
+	template<typename T>
+	class QuantizedGemm final
+	{
+	public:
+		QuantizedGemm() = delete;
+		~QuantizedGemm() = delete;
+
+		static void Multiply(const size_t& m, const T* a, const size_t& rowStrideA, const size_t& columnStrideA, const QuantizedMatrix<T>& b,
+			T* c, const size_t& ldc, const T* bias, const bool& bRelu);
+
+		static constexpr unsigned int MR = 4;
+		static constexpr unsigned int NR = QuantizedMatrix<T>::NR;
+		// Rows quantized together and kept in L2 while every panel of b passes over them.
+		static constexpr unsigned int MC = 64;
+		static constexpr unsigned long long PARALLEL_THRESHOLD = 1ull << 18;
+	private:
+		using Tile = std::int32_t[MR * NR];
+
+		// Rows of a as depth bytes each, and their scales; rows from mc up to a multiple of MR are padding that reads as 0.
+		static void quantizeRows(const unsigned int& mc, const size_t& k, const size_t& depth, const T* a, const size_t& rowStride,
+			const size_t& columnStride, std::uint8_t* buffer, T* scales);
+		static void tile(const std::uint8_t* a, const std::int8_t* panel, const size_t& depth, Tile& sums);
+		static void scalarTile(const std::uint8_t* a, const std::int8_t* panel, const size_t& depth, Tile& sums);
+	};
+
+	namespace simd
+	{
+#if NUMPY_SIMD_X86
+		inline std::int32_t LoadQuad(const std::uint8_t* p)
+		{
+			std::int32_t value;
+			std::memcpy(&value, p, sizeof(value));
+			return value;
+		}
+
+		// Row quantization for contiguous float rows. The scale comes from the exact maximum, and bytes are the truncation of
+		// value * inverse + 128.5 with a separate multiply and add, so every level rounds exactly like the scalar loop.
+		NUMPY_TARGET_AVX512 inline float Avx512AbsMax(const float* row, const size_t& k)
+		{
+			__m512 largest = _mm512_setzero_ps();
+			size_t p = 0;
+			for (; p + 16 <= k; p += 16)
+			{
+				largest = _mm512_max_ps(largest, _mm512_abs_ps(_mm512_loadu_ps(row + p)));
+			}
+			if (p < k)
+			{
+				const __mmask16 mask = static_cast<__mmask16>((1u << (k - p)) - 1u);
+				largest = _mm512_max_ps(largest, _mm512_abs_ps(_mm512_maskz_loadu_ps(mask, row + p)));
+			}
+			return _mm512_reduce_max_ps(largest);
+		}
+
+		NUMPY_TARGET_AVX512 inline void Avx512QuantizeRow(const float* row, const size_t& k, const float& inverse, std::uint8_t* target)
+		{
+			const __m512 scale = _mm512_set1_ps(inverse);
+			const __m512 offset = _mm512_set1_ps(128.5f);
+			size_t p = 0;
+			for (; p + 16 <= k; p += 16)
+			{
+				const __m512i value = _mm512_cvttps_epi32(_mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(row + p), scale), offset));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(target + p), _mm512_cvtepi32_epi8(value));
+			}
+			if (p < k)
+			{
+				const __mmask16 mask = static_cast<__mmask16>((1u << (k - p)) - 1u);
+				const __m512i value = _mm512_cvttps_epi32(_mm512_add_ps(_mm512_mul_ps(_mm512_maskz_loadu_ps(mask, row + p), scale), offset));
+				_mm512_mask_cvtepi32_storeu_epi8(target + p, mask, value);
+			}
+		}
+
+		NUMPY_TARGET_AVX2 inline float Avx2AbsMax(const float* row, const size_t& k)
+		{
+			const __m256 sign = _mm256_set1_ps(-0.0f);
+			__m256 largest = _mm256_setzero_ps();
+			size_t p = 0;
+			for (; p + 8 <= k; p += 8)
+			{
+				largest = _mm256_max_ps(largest, _mm256_andnot_ps(sign, _mm256_loadu_ps(row + p)));
+			}
+			float lanes[8];
+			_mm256_storeu_ps(lanes, largest);
+			float result = *std::max_element(lanes, lanes + 8);
+			for (; p < k; ++p)
+			{
+				result = std::max(result, row[p] < 0 ? -row[p] : row[p]);
+			}
+			return result;
+		}
+
+		NUMPY_TARGET_AVX2 inline void Avx2QuantizeRow(const float* row, const size_t& k, const float& inverse, std::uint8_t* target)
+		{
+			const __m256 scale = _mm256_set1_ps(inverse);
+			const __m256 offset = _mm256_set1_ps(128.5f);
+			size_t p = 0;
+			for (; p + 8 <= k; p += 8)
+			{
+				const __m256i value = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(row + p), scale), offset));
+				const __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(target + p), _mm_packus_epi16(words, words));
+			}
+			for (; p < k; ++p)
+			{
+				target[p] = static_cast<std::uint8_t>(static_cast<int>(row[p] * inverse + 128.5f));
+			}
+		}
+
+		// 4 rows of unsigned bytes against a 16-column panel: one vpdpbusd per row and run of 4 k.
+		NUMPY_TARGET_AVX512_VNNI inline void VnniInt8Tile(const std::uint8_t* a, const std::int8_t* panel, const size_t& depth, std::int32_t* sums)
+		{
+			__m512i acc0 = _mm512_setzero_si512();
+			__m512i acc1 = _mm512_setzero_si512();
+			__m512i acc2 = _mm512_setzero_si512();
+			__m512i acc3 = _mm512_setzero_si512();
+			for (size_t p = 0; p < depth; p += 4)
+			{
+				const __m512i b = _mm512_loadu_si512(panel + p * 16);
+				acc0 = _mm512_dpbusd_epi32(acc0, _mm512_set1_epi32(LoadQuad(a + p)), b);
+				acc1 = _mm512_dpbusd_epi32(acc1, _mm512_set1_epi32(LoadQuad(a + depth + p)), b);
+				acc2 = _mm512_dpbusd_epi32(acc2, _mm512_set1_epi32(LoadQuad(a + 2 * depth + p)), b);
+				acc3 = _mm512_dpbusd_epi32(acc3, _mm512_set1_epi32(LoadQuad(a + 3 * depth + p)), b);
+			}
+			_mm512_storeu_si512(sums, acc0);
+			_mm512_storeu_si512(sums + 16, acc1);
+			_mm512_storeu_si512(sums + 32, acc2);
+			_mm512_storeu_si512(sums + 48, acc3);
+		}
+
+		// AVX2 has no byte dot product that cannot saturate, so both operands are widened to 16 bits and vpmaddwd sums pairs:
+		// lanes 2c and 2c + 1 of a group accumulator hold the two halves of column c's sum and are added at the end.
+		NUMPY_TARGET_AVX2 inline void Avx2Int8Tile(const std::uint8_t* a, const std::int8_t* panel, const size_t& depth, std::int32_t* sums)
+		{
+			for (unsigned int r = 0; r < 4; r += 2)
+			{
+				const std::uint8_t* row0 = a + r * depth;
+				const std::uint8_t* row1 = row0 + depth;
+				__m256i acc[2][4];
+				for (unsigned int g = 0; g < 4; ++g)
+				{
+					acc[0][g] = _mm256_setzero_si256();
+					acc[1][g] = _mm256_setzero_si256();
+				}
+				for (size_t p = 0; p < depth; p += 4)
+				{
+					const __m256i a0 = _mm256_cvtepu8_epi16(_mm_set1_epi32(LoadQuad(row0 + p)));
+					const __m256i a1 = _mm256_cvtepu8_epi16(_mm_set1_epi32(LoadQuad(row1 + p)));
+					for (unsigned int g = 0; g < 4; ++g)
+					{
+						const __m256i b = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(panel + p * 16 + g * 16)));
+						acc[0][g] = _mm256_add_epi32(acc[0][g], _mm256_madd_epi16(a0, b));
+						acc[1][g] = _mm256_add_epi32(acc[1][g], _mm256_madd_epi16(a1, b));
+					}
+				}
+				for (unsigned int h = 0; h < 2; ++h)
+				{
+					for (unsigned int g = 0; g < 4; ++g)
+					{
+						std::int32_t lanes[8];
+						_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc[h][g]);
+						for (unsigned int c = 0; c < 4; ++c)
+						{
+							sums[(r + h) * 16 + g * 4 + c] = lanes[2 * c] + lanes[2 * c + 1];
+						}
+					}
+				}
+			}
+		}
+#endif
+	}
+
+	template<typename T>
+	QuantizedMatrix<T>::QuantizedMatrix()
+		: mRows(0)
+		, mColumns(0)
+		, mDepth(0)
+	{
+	}
+
+	template<typename T>
+	QuantizedMatrix<T>::QuantizedMatrix(const Ndarray<std::int8_t>& values, const Ndarray<T>& scales)
+		: QuantizedMatrix()
+	{
+		if (values.GetDimension() != 2u || scales.GetDimension() != 1u || scales.GetArraySize(0) != values.GetArraySize(1)
+			|| values.GetArraySize(0) > MAX_ROWS)
+			return;
+
+		const size_t rows = values.GetArraySize(0);
+		const size_t columns = values.GetArraySize(1);
+		const size_t depth = (rows + 3) / 4 * 4;
+		const size_t panelCount = (columns + NR - 1) / NR;
+		const std::int8_t* data = values.GetData();
+		const size_t rowStride = values.GetStride(0);
+		const size_t columnStride = values.GetStride(1);
+
+		mPacked.assign(panelCount * depth * NR, 0);
+		mScales.assign(panelCount * NR, static_cast<T>(0));
+		mColumnSums.assign(panelCount * NR, 0);
+		for (size_t j = 0; j < columns; ++j)
+		{
+			std::int8_t* panel = mPacked.data() + j / NR * depth * NR;
+			const size_t lane = j % NR;
+			std::int32_t sum = 0;
+			for (size_t p = 0; p < rows; ++p)
+			{
+				const std::int8_t value = data[p * rowStride + j * columnStride];
+				if (value < -127)
+				{
+					mPacked.clear();
+					mScales.clear();
+					mColumnSums.clear();
+					return;
+				}
+				panel[p / 4 * 4 * NR + lane * 4 + p % 4] = value;
+				sum += value;
+			}
+			mColumnSums[j] = sum;
+			mScales[j] = scales.At(j);
+		}
+		mRows = rows;
+		mColumns = columns;
+		mDepth = depth;
+	}
+
+	template<typename T>
+	inline bool QuantizedMatrix<T>::IsEmpty() const
+	{
+		return mColumns == 0;
+	}
+
+	template<typename T>
+	inline size_t QuantizedMatrix<T>::GetRows() const
+	{
+		return mRows;
+	}
+
+	template<typename T>
+	inline size_t QuantizedMatrix<T>::GetColumns() const
+	{
+		return mColumns;
+	}
+
+	template<typename T>
+	inline size_t QuantizedMatrix<T>::GetDepth() const
+	{
+		return mDepth;
+	}
+
+	template<typename T>
+	inline const std::int8_t* QuantizedMatrix<T>::GetPanel(const size_t& column) const
+	{
+		return mPacked.data() + column / NR * mDepth * NR;
+	}
+
+	template<typename T>
+	inline const T* QuantizedMatrix<T>::GetScales() const
+	{
+		return mScales.data();
+	}
+
+	template<typename T>
+	inline const std::int32_t* QuantizedMatrix<T>::GetColumnSums() const
+	{
+		return mColumnSums.data();
+	}
+
+	template<typename T>
+	void QuantizedGemm<T>::Multiply(const size_t& m, const T* a, const size_t& rowStrideA, const size_t& columnStrideA, const QuantizedMatrix<T>& b,
+		T* c, const size_t& ldc, const T* bias, const bool& bRelu)
+	{
+		static_assert(std::is_floating_point<T>::value, "int8 GEMM scales and accumulates in floating point");
+		const size_t n = b.GetColumns();
+		const size_t k = b.GetRows();
+		const size_t depth = b.GetDepth();
+		if (m == 0 || n == 0)
+			return;
+
+		ThreadPool& pool = ThreadPool::Instance();
+		const bool bParallel = static_cast<double>(m) * n * k >= PARALLEL_THRESHOLD && pool.GetThreadCount() > 1;
+		const size_t blockCount = (m + MC - 1) / MC;
+
+		auto task = [&](size_t t)
+		{
+			static thread_local std::vector<std::uint8_t> sQuantized;
+			static thread_local std::vector<T> sScales;
+
+			const size_t ic = t * MC;
+			const unsigned int mc = static_cast<unsigned int>(std::min<size_t>(MC, m - ic));
+			const unsigned int paddedRows = (mc + MR - 1) / MR * MR;
+			if (sQuantized.size() < paddedRows * depth)
+			{
+				sQuantized.resize(paddedRows * depth);
+			}
+			if (sScales.size() < MC)
+			{
+				sScales.resize(MC);
+			}
+			quantizeRows(mc, k, depth, a + ic * rowStrideA, rowStrideA, columnStrideA, sQuantized.data(), sScales.data());
+
+			// Panels outside, row tiles inside: a panel of b stays in L1 while the quantized rows stream from L2.
+			for (size_t j = 0; j < n; j += NR)
+			{
+				const unsigned int nr = static_cast<unsigned int>(std::min<size_t>(NR, n - j));
+				const std::int8_t* panel = b.GetPanel(j);
+				const T* scaleB = b.GetScales() + j;
+				const std::int32_t* columnSums = b.GetColumnSums() + j;
+				for (unsigned int i = 0; i < mc; i += MR)
+				{
+					Tile sums;
+					tile(sQuantized.data() + static_cast<size_t>(i) * depth, panel, depth, sums);
+
+					const unsigned int mr = std::min(MR, mc - i);
+					for (unsigned int r = 0; r < mr; ++r)
+					{
+						T* row = c + (ic + i + r) * ldc + j;
+						const T scaleA = sScales[i + r];
+						for (unsigned int jr = 0; jr < nr; ++jr)
+						{
+							const std::int32_t exact = sums[r * NR + jr] - 128 * columnSums[jr];
+							T value = static_cast<T>(exact) * scaleA * scaleB[jr] + (bias != nullptr ? bias[j + jr] : static_cast<T>(0));
+							row[jr] = bRelu && value < 0 ? static_cast<T>(0) : value;
+						}
+					}
+				}
+			}
+		};
+
+		if (bParallel)
+		{
+			pool.ParallelFor(blockCount, 1, [&task](size_t begin, size_t end)
+			{
+				for (size_t t = begin; t < end; ++t)
+				{
+					task(t);
+				}
+			});
+		}
+		else
+		{
+			for (size_t t = 0; t < blockCount; ++t)
+			{
+				task(t);
+			}
+		}
+	}
+
+	template<typename T>
+	void QuantizedGemm<T>::quantizeRows(const unsigned int& mc, const size_t& k, const size_t& depth, const T* a, const size_t& rowStride,
+		const size_t& columnStride, std::uint8_t* buffer, T* scales)
+	{
+		const SimdLevel level = std::is_same<T, float>::value && columnStride == 1u ? Simd::GetLevel() : SimdLevel::Scalar;
+		const unsigned int paddedRows = (mc + MR - 1) / MR * MR;
+		for (unsigned int i = 0; i < paddedRows; ++i)
+		{
+			std::uint8_t* target = buffer + static_cast<size_t>(i) * depth;
+			if (i >= mc)
+			{
+				std::fill(target, target + depth, static_cast<std::uint8_t>(128));
+				continue;
+			}
+
+			const T* row = a + static_cast<size_t>(i) * rowStride;
+			T largest = 0;
+#if NUMPY_SIMD_X86
+			if constexpr (std::is_same<T, float>::value)
+			{
+				largest = level == SimdLevel::AVX512 ? simd::Avx512AbsMax(row, k) : level == SimdLevel::AVX2 ? simd::Avx2AbsMax(row, k) : largest;
+			}
+#endif
+			if (level != SimdLevel::AVX512 && level != SimdLevel::AVX2)
+			{
+				for (size_t p = 0; p < k; ++p)
+				{
+					const T value = row[p * columnStride];
+					largest = std::max(largest, value < 0 ? -value : value);
+				}
+			}
+			scales[i] = largest / static_cast<T>(127);
+			const T inverse = largest > 0 ? static_cast<T>(127) / largest : static_cast<T>(0);
+
+			// |value * inverse| <= 127, so adding 128.5 and truncating rounds half up into [1, 255] without a clamp.
+#if NUMPY_SIMD_X86
+			if constexpr (std::is_same<T, float>::value)
+			{
+				if (level == SimdLevel::AVX512 || level == SimdLevel::AVX2)
+				{
+					(level == SimdLevel::AVX512 ? simd::Avx512QuantizeRow : simd::Avx2QuantizeRow)(row, k, inverse, target);
+					std::fill(target + k, target + depth, static_cast<std::uint8_t>(128));
+					continue;
+				}
+			}
+#endif
+			for (size_t p = 0; p < k; ++p)
+			{
+				target[p] = static_cast<std::uint8_t>(static_cast<int>(row[p * columnStride] * inverse + static_cast<T>(128.5)));
+			}
+			std::fill(target + k, target + depth, static_cast<std::uint8_t>(128));
+		}
+	}
+
+	template<typename T>
+	inline void QuantizedGemm<T>::tile(const std::uint8_t* a, const std::int8_t* panel, const size_t& depth, Tile& sums)
+	{
+#if NUMPY_SIMD_X86
+		switch (Simd::GetLevel())
+		{
+		case SimdLevel::AVX512:
+			if (Simd::IsVnniSupported())
+			{
+				simd::VnniInt8Tile(a, panel, depth, sums);
+				return;
+			}
+			simd::Avx2Int8Tile(a, panel, depth, sums);
+			return;
+		case SimdLevel::AVX2:
+			simd::Avx2Int8Tile(a, panel, depth, sums);
+			return;
+		default:
+			break;
+		}
+#endif
+		scalarTile(a, panel, depth, sums);
+	}
+
+	template<typename T>
+	void QuantizedGemm<T>::scalarTile(const std::uint8_t* a, const std::int8_t* panel, const size_t& depth, Tile& sums)
+	{
+		std::fill(sums, sums + MR * NR, 0);
+		for (size_t p = 0; p < depth; p += 4)
+		{
+			const std::int8_t* quad = panel + p * NR;
+			for (unsigned int r = 0; r < MR; ++r)
+			{
+				const std::uint8_t* row = a + r * depth + p;
+				for (unsigned int j = 0; j < NR; ++j)
+				{
+					sums[r * NR + j] += row[0] * quad[j * 4] + row[1] * quad[j * 4 + 1] + row[2] * quad[j * 4 + 2] + row[3] * quad[j * 4 + 3];
+				}
+			}
+		}
+	}
+}
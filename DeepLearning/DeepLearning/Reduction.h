@@ -0,0 +1,260 @@
+#pragma once
+#include<algorithm>
+#include<vector>
+#include "Simd.h"
+#include "ThreadPool.h"
+
+namespace numpy
+{
+	// Reductions over the middle axis of a compact [outer][length][inner] block, the layout every single-axis reduction of a
+	// row-major array reduces to. Each output is independent, so tasks split outer (and inner when outer is short) across the pool.
+	// inner == 1 reduces contiguous runs with the horizontal SIMD kernels; inner > 1 folds whole rows with the element-wise ones.
+	template<typename T>
+	class Reduction final
+	{
+	public:
+		Reduction() = delete;
+		~Reduction() = delete;
+
+		// out[o * inner + i] = Op over r of data[(o * length + r) * inner + i]. Add is summed pairwise, so the rounding error
+		// grows with log(length) instead of length. length must not be 0.
+		template<ElementwiseOperation Op>
+		static void Reduce(const T* data, const size_t& outer, const size_t& length, const size_t& inner, T* out);
+		// Index of the first maximum along the middle axis.
+		static void ArgMax(const T* data, const size_t& outer, const size_t& length, const size_t& inner, size_t* out);
+
+		// Contiguous runs up to this length are reduced by one SIMD pass; longer runs are halved recursively.
+		static constexpr size_t PAIRWISE_BLOCK = 1024;
+		// Rows summed straight into one partial before partials are merged pairwise.
+		static constexpr size_t BLOCK_ROWS = 64;
+		static constexpr size_t COLUMN_CHUNK = 256;
+		static constexpr unsigned long long PARALLEL_THRESHOLD = 1ull << 16;
+	private:
+		template<ElementwiseOperation Op>
+		static T reduceContiguous(const T* data, const size_t& length);
+		template<ElementwiseOperation Op>
+		static void reduceRows(const T* data, const size_t& length, const size_t& stride, const size_t& columns, T* out);
+		static void argMaxRows(const T* data, const size_t& length, const size_t& stride, const size_t& columns, size_t* out);
+
+		// Runs task(t) for t in [0, count), each touching about work elements, batching tasks into PARALLEL_THRESHOLD-sized chunks.
+		template<typename Task>
+		static void run(const size_t& count, const size_t& work, const bool& bParallel, const Task& task);
+		static bool isParallel(const size_t& outer, const size_t& length, const size_t& inner);
+		static size_t columnChunks(const size_t& outer, const size_t& inner, const bool& bParallel);
+	};
+
+	template<typename T>
+	template<ElementwiseOperation Op>
+	void Reduction<T>::Reduce(const T* data, const size_t& outer, const size_t& length, const size_t& inner, T* out)
+	{
+		const bool bParallel = isParallel(outer, length, inner);
+		if (inner == 1)
+		{
+			// A single long run is cut into per-thread pieces whose results are folded afterwards.
+			if (outer == 1 && bParallel)
+			{
+				const size_t pieceLength = (length + ThreadPool::Instance().GetThreadCount() - 1) / ThreadPool::Instance().GetThreadCount();
+				const size_t pieceCount = (length + pieceLength - 1) / pieceLength;
+				std::vector<T> pieces(pieceCount);
+				run(pieceCount, pieceLength, true, [&](size_t p)
+				{
+					const size_t begin = p * pieceLength;
+					pieces[p] = reduceContiguous<Op>(data + begin, std::min(length, begin + pieceLength) - begin);
+				});
+				out[0] = reduceContiguous<Op>(pieces.data(), pieceCount);
+				return;
+			}
+
+			run(outer, length, bParallel, [&](size_t o)
+			{
+				out[o] = reduceContiguous<Op>(data + o * length, length);
+			});
+			return;
+		}
+
+		const size_t chunkCount = columnChunks(outer, inner, bParallel);
+		const size_t chunkSize = (inner + chunkCount - 1) / chunkCount;
+		run(outer * chunkCount, length * chunkSize, bParallel, [&](size_t t)
+		{
+			const size_t o = t / chunkCount;
+			const size_t begin = (t % chunkCount) * chunkSize;
+			const size_t end = std::min(inner, begin + chunkSize);
+			if (begin < end)
+			{
+				reduceRows<Op>(data + o * length * inner + begin, length, inner, end - begin, out + o * inner + begin);
+			}
+		});
+	}
+
+	template<typename T>
+	void Reduction<T>::ArgMax(const T* data, const size_t& outer, const size_t& length, const size_t& inner, size_t* out)
+	{
+		const bool bParallel = isParallel(outer, length, inner);
+		if (inner == 1)
+		{
+			run(outer, length, bParallel, [&](size_t o)
+			{
+				const T* row = data + o * length;
+				size_t best = 0;
+				for (size_t r = 1; r < length; ++r)
+				{
+					if (row[best] < row[r])
+					{
+						best = r;
+					}
+				}
+				out[o] = best;
+			});
+			return;
+		}
+
+		const size_t chunkCount = columnChunks(outer, inner, bParallel);
+		const size_t chunkSize = (inner + chunkCount - 1) / chunkCount;
+		run(outer * chunkCount, length * chunkSize, bParallel, [&](size_t t)
+		{
+			const size_t o = t / chunkCount;
+			const size_t begin = (t % chunkCount) * chunkSize;
+			const size_t end = std::min(inner, begin + chunkSize);
+			if (begin < end)
+			{
+				argMaxRows(data + o * length * inner + begin, length, inner, end - begin, out + o * inner + begin);
+			}
+		});
+	}
+
+	template<typename T>
+	template<ElementwiseOperation Op>
+	T Reduction<T>::reduceContiguous(const T* data, const size_t& length)
+	{
+		if (Op != ElementwiseOperation::Add || length <= PAIRWISE_BLOCK)
+		{
+			return ElementwiseKernel<T>::template Reduce<Op>(data, length);
+		}
+
+		const size_t half = length / 2;
+		return static_cast<T>(reduceContiguous<Op>(data, half) + reduceContiguous<Op>(data + half, length - half));
+	}
+
+	template<typename T>
+	template<ElementwiseOperation Op>
+	void Reduction<T>::reduceRows(const T* data, const size_t& length, const size_t& stride, const size_t& columns, T* out)
+	{
+		if (Op != ElementwiseOperation::Add)
+		{
+			std::copy(data, data + columns, out);
+			for (size_t r = 1; r < length; ++r)
+			{
+				ElementwiseKernel<T>::template Binary<Op>(out, data + r * stride, out, columns);
+			}
+			return;
+		}
+
+		// Blocks of BLOCK_ROWS rows are summed into a partial, and partials are merged like a binary counter: after block k,
+		// one merge per trailing zero bit of k. That is pairwise summation over blocks with at most log2(blocks) + 1 partials alive.
+		static thread_local std::vector<T> sPartials;
+		const size_t blockCount = (length + BLOCK_ROWS - 1) / BLOCK_ROWS;
+		size_t levels = 1;
+		while ((size_t(1) << (levels - 1)) < blockCount)
+		{
+			++levels;
+		}
+		if (sPartials.size() < levels * columns)
+		{
+			sPartials.resize(levels * columns);
+		}
+
+		size_t depth = 0;
+		for (size_t block = 0; block < blockCount; ++block)
+		{
+			const size_t begin = block * BLOCK_ROWS;
+			const size_t end = std::min(length, begin + BLOCK_ROWS);
+			T* partial = sPartials.data() + depth * columns;
+			std::copy(data + begin * stride, data + begin * stride + columns, partial);
+			for (size_t r = begin + 1; r < end; ++r)
+			{
+				ElementwiseKernel<T>::Add(partial, data + r * stride, partial, columns);
+			}
+			++depth;
+
+			for (size_t count = block + 1; (count & 1u) == 0; count >>= 1)
+			{
+				T* lower = sPartials.data() + (depth - 2) * columns;
+				ElementwiseKernel<T>::Add(lower, lower + columns, lower, columns);
+				--depth;
+			}
+		}
+		while (depth > 1)
+		{
+			T* lower = sPartials.data() + (depth - 2) * columns;
+			ElementwiseKernel<T>::Add(lower, lower + columns, lower, columns);
+			--depth;
+		}
+		std::copy(sPartials.data(), sPartials.data() + columns, out);
+	}
+
+	template<typename T>
+	void Reduction<T>::argMaxRows(const T* data, const size_t& length, const size_t& stride, const size_t& columns, size_t* out)
+	{
+		static thread_local std::vector<T> sBest;
+		if (sBest.size() < columns)
+		{
+			sBest.resize(columns);
+		}
+		T* best = sBest.data();
+		std::copy(data, data + columns, best);
+		std::fill(out, out + columns, size_t(0));
+
+		for (size_t r = 1; r < length; ++r)
+		{
+			const T* row = data + r * stride;
+			for (size_t c = 0; c < columns; ++c)
+			{
+				if (best[c] < row[c])
+				{
+					best[c] = row[c];
+					out[c] = r;
+				}
+			}
+		}
+	}
+
+	template<typename T>
+	template<typename Task>
+	void Reduction<T>::run(const size_t& count, const size_t& work, const bool& bParallel, const Task& task)
+	{
+		if (bParallel && count > 1)
+		{
+			const size_t grain = std::max<size_t>(1, static_cast<size_t>(PARALLEL_THRESHOLD / std::max<size_t>(1, work)));
+			ThreadPool::Instance().ParallelFor(count, grain, [&task](size_t begin, size_t end)
+			{
+				for (size_t t = begin; t < end; ++t)
+				{
+					task(t);
+				}
+			});
+			return;
+		}
+		for (size_t t = 0; t < count; ++t)
+		{
+			task(t);
+		}
+	}
+
+	template<typename T>
+	inline bool Reduction<T>::isParallel(const size_t& outer, const size_t& length, const size_t& inner)
+	{
+		return static_cast<double>(outer) * length * inner >= PARALLEL_THRESHOLD && ThreadPool::Instance().GetThreadCount() > 1;
+	}
+
+	template<typename T>
+	inline size_t Reduction<T>::columnChunks(const size_t& outer, const size_t& inner, const bool& bParallel)
+	{
+		// Split columns only when there are fewer outer blocks than threads, and never below COLUMN_CHUNK columns per task.
+		const size_t threadCount = ThreadPool::Instance().GetThreadCount();
+		if (!bParallel || outer >= threadCount)
+			return 1;
+
+		const size_t wanted = (threadCount + outer - 1) / outer;
+		return std::max<size_t>(1, std::min(wanted, inner / COLUMN_CHUNK));
+	}
+}
@@ -0,0 +1,766 @@
+#pragma once
+#include<atomic>
+#include<cstddef>
+#include<type_traits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NUMPY_SIMD_X86 1
+#include<immintrin.h>
+#if defined(_MSC_VER)
+#include<intrin.h>
+#else
+#include<cpuid.h>
+#endif
+#else
+#define NUMPY_SIMD_X86 0
+#endif
+
+// GCC and Clang only emit instructions the function is compiled for, so every kernel names its ISA.
+// MSVC accepts any intrinsic anywhere and needs nothing.
+#if NUMPY_SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+#define NUMPY_TARGET_SSE2 __attribute__((target("sse2")))
+#define NUMPY_TARGET_AVX2 __attribute__((target("avx2")))
+#define NUMPY_TARGET_AVX2_FMA __attribute__((target("avx2,fma")))
+#define NUMPY_TARGET_AVX512 __attribute__((target("avx512f")))
+#define NUMPY_TARGET_AVX512_VNNI __attribute__((target("avx512f,avx512vnni")))
+#else
+#define NUMPY_TARGET_SSE2
+#define NUMPY_TARGET_AVX2
+#define NUMPY_TARGET_AVX2_FMA
+#define NUMPY_TARGET_AVX512
+#define NUMPY_TARGET_AVX512_VNNI
+#endif
+
+namespace numpy
+{
+	enum class SimdLevel
+	{
+		Scalar = 0,
+		SSE2 = 1,
+		AVX2 = 2,
+		AVX512 = 3,
+	};
+
+	class Simd final
+	{
+	public:
+		Simd() = delete;
+		~Simd() = delete;
+
+		// Highest level both the CPU and the OS (saved register state) support, detected once.
+		static SimdLevel GetSupportedLevel();
+		// Level the kernels dispatch to; defaults to the supported level.
+		static SimdLevel GetLevel();
+		// Forces a lower level, e.g. for benchmarks. Requests above the supported level are clamped.
+		static void SetLevel(const SimdLevel& level);
+		static const char* GetName(const SimdLevel& level);
+		// AVX-512 VNNI (u8 x s8 dot products into int32), which the int8 kernels use at the AVX512 level.
+		static bool IsVnniSupported();
+		// FMA3 fused multiply-adds on YMM registers, which the float GEMM kernel uses at the AVX2 level. AVX-512 has its own.
+		static bool IsFmaSupported();
+	private:
+		static SimdLevel detect();
+		static bool detectVnni();
+		static bool detectFma();
+
+		static std::atomic<int> sLevel;
+	};
+
+	inline std::atomic<int> Simd::sLevel(-1);
+
+	inline SimdLevel Simd::GetSupportedLevel()
+	{
+		static const SimdLevel level = detect();
+		return level;
+	}
+
+	inline SimdLevel Simd::GetLevel()
+	{
+		const int level = sLevel.load(std::memory_order_relaxed);
+		if (level < 0)
+		{
+			return GetSupportedLevel();
+		}
+		return static_cast<SimdLevel>(level);
+	}
+
+	inline void Simd::SetLevel(const SimdLevel& level)
+	{
+		const SimdLevel supported = GetSupportedLevel();
+		sLevel.store(static_cast<int>(level < supported ? level : supported), std::memory_order_relaxed);
+	}
+
+	inline const char* Simd::GetName(const SimdLevel& level)
+	{
+		switch (level)
+		{
+		case SimdLevel::SSE2:
+			return "SSE2";
+		case SimdLevel::AVX2:
+			return "AVX2";
+		case SimdLevel::AVX512:
+			return "AVX-512";
+		default:
+			return "Scalar";
+		}
+	}
+
+	inline bool Simd::IsVnniSupported()
+	{
+		static const bool bSupported = detectVnni();
+		return bSupported;
+	}
+
+	inline bool Simd::IsFmaSupported()
+	{
+		static const bool bSupported = detectFma();
+		return bSupported;
+	}
+
+	inline bool Simd::detectFma()
+	{
+#if NUMPY_SIMD_X86
+		if (GetSupportedLevel() < SimdLevel::AVX2)
+			return false;
+#if defined(_MSC_VER)
+		int values[4];
+		__cpuidex(values, 1, 0);
+		const unsigned int ecx = static_cast<unsigned int>(values[2]);
+#else
+		unsigned int eax = 0;
+		unsigned int ebx = 0;
+		unsigned int ecx = 0;
+		unsigned int edx = 0;
+		__cpuid_count(1, 0, eax, ebx, ecx, edx);
+#endif
+		return (ecx & (1u << 12)) != 0;
+#else
+		return false;
+#endif
+	}
+
+	inline bool Simd::detectVnni()
+	{
+#if NUMPY_SIMD_X86
+		if (GetSupportedLevel() != SimdLevel::AVX512)
+			return false;
+#if defined(_MSC_VER)
+		int values[4];
+		__cpuidex(values, 7, 0);
+		const unsigned int ecx = static_cast<unsigned int>(values[2]);
+#else
+		unsigned int eax = 0;
+		unsigned int ebx = 0;
+		unsigned int ecx = 0;
+		unsigned int edx = 0;
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+#endif
+		return (ecx & (1u << 11)) != 0;
+#else
+		return false;
+#endif
+	}
+
+	inline SimdLevel Simd::detect()
+	{
+#if NUMPY_SIMD_X86
+		unsigned int registers[4] = {};
+		auto cpuid = [&registers](const unsigned int& leaf, const unsigned int& subleaf)
+		{
+#if defined(_MSC_VER)
+			int values[4];
+			__cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+			for (int i = 0; i < 4; ++i)
+				registers[i] = static_cast<unsigned int>(values[i]);
+#else
+			__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+		};
+
+		cpuid(0, 0);
+		const unsigned int maxLeaf = registers[0];
+		cpuid(1, 0);
+		const bool bSse2 = (registers[3] & (1u << 26)) != 0;
+		const bool bOsxsave = (registers[2] & (1u << 27)) != 0;
+		const bool bAvx = (registers[2] & (1u << 28)) != 0;
+		if (!bSse2)
+			return SimdLevel::Scalar;
+		if (!bOsxsave || !bAvx || maxLeaf < 7)
+			return SimdLevel::SSE2;
+
+#if defined(_MSC_VER)
+		const unsigned long long xcr0 = _xgetbv(0);
+#else
+		unsigned int xcr0Low = 0;
+		unsigned int xcr0High = 0;
+		__asm__ volatile("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+		const unsigned long long xcr0 = (static_cast<unsigned long long>(xcr0High) << 32) | xcr0Low;
+#endif
+		// XMM and YMM state, then opmask and both halves of ZMM state.
+		const bool bAvxState = (xcr0 & 0x6) == 0x6;
+		const bool bAvx512State = (xcr0 & 0xE6) == 0xE6;
+
+		cpuid(7, 0);
+		const bool bAvx2 = (registers[1] & (1u << 5)) != 0;
+		const bool bAvx512f = (registers[1] & (1u << 16)) != 0;
+
+		if (bAvx512f && bAvx2 && bAvx512State)
+			return SimdLevel::AVX512;
+		if (bAvx2 && bAvxState)
+			return SimdLevel::AVX2;
+		return SimdLevel::SSE2;
+#else
+		return SimdLevel::Scalar;
+#endif
+	}
+
+	enum class ElementwiseOperation
+	{
+		Add,
+		Multiply,
+		Maximum,
+	};
+
+	namespace simd
+	{
+		// Mixed operand types follow the usual arithmetic conversions, like the operators they replace.
+		template<ElementwiseOperation Op, typename A, typename B>
+		inline auto Apply(const A& a, const B& b) -> decltype(a + b)
+		{
+			if constexpr (Op == ElementwiseOperation::Add)
+				return a + b;
+			else if constexpr (Op == ElementwiseOperation::Multiply)
+				return a * b;
+			else
+				return a < b ? b : a;
+		}
+
+#if NUMPY_SIMD_X86
+		template<typename T>
+		struct Sse2Register;
+
+		template<>
+		struct Sse2Register<float>
+		{
+			using Register = __m128;
+			static constexpr size_t Width = 4;
+			NUMPY_TARGET_SSE2 static Register Load(const float* p) { return _mm_loadu_ps(p); }
+			NUMPY_TARGET_SSE2 static void Store(float* p, const Register& a) { _mm_storeu_ps(p, a); }
+			NUMPY_TARGET_SSE2 static Register Set(const float& a) { return _mm_set1_ps(a); }
+			NUMPY_TARGET_SSE2 static Register Add(const Register& a, const Register& b) { return _mm_add_ps(a, b); }
+			NUMPY_TARGET_SSE2 static Register Multiply(const Register& a, const Register& b) { return _mm_mul_ps(a, b); }
+			NUMPY_TARGET_SSE2 static Register Maximum(const Register& a, const Register& b) { return _mm_max_ps(b, a); }
+		};
+
+		template<>
+		struct Sse2Register<double>
+		{
+			using Register = __m128d;
+			static constexpr size_t Width = 2;
+			NUMPY_TARGET_SSE2 static Register Load(const double* p) { return _mm_loadu_pd(p); }
+			NUMPY_TARGET_SSE2 static void Store(double* p, const Register& a) { _mm_storeu_pd(p, a); }
+			NUMPY_TARGET_SSE2 static Register Set(const double& a) { return _mm_set1_pd(a); }
+			NUMPY_TARGET_SSE2 static Register Add(const Register& a, const Register& b) { return _mm_add_pd(a, b); }
+			NUMPY_TARGET_SSE2 static Register Multiply(const Register& a, const Register& b) { return _mm_mul_pd(a, b); }
+			NUMPY_TARGET_SSE2 static Register Maximum(const Register& a, const Register& b) { return _mm_max_pd(b, a); }
+		};
+
+		template<>
+		struct Sse2Register<int>
+		{
+			using Register = __m128i;
+			static constexpr size_t Width = 4;
+			NUMPY_TARGET_SSE2 static Register Load(const int* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+			NUMPY_TARGET_SSE2 static void Store(int* p, const Register& a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), a); }
+			NUMPY_TARGET_SSE2 static Register Set(const int& a) { return _mm_set1_epi32(a); }
+			NUMPY_TARGET_SSE2 static Register Add(const Register& a, const Register& b) { return _mm_add_epi32(a, b); }
+			NUMPY_TARGET_SSE2 static Register Multiply(const Register& a, const Register& b)
+			{
+				// SSE2 has no 32-bit low multiply, so multiply the even and odd lanes separately and interleave.
+				const __m128i even = _mm_mul_epu32(a, b);
+				const __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+				return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+			}
+			NUMPY_TARGET_SSE2 static Register Maximum(const Register& a, const Register& b)
+			{
+				// SSE2 has no signed 32-bit max either, so select through a compare mask.
+				const __m128i greater = _mm_cmpgt_epi32(b, a);
+				return _mm_or_si128(_mm_and_si128(greater, b), _mm_andnot_si128(greater, a));
+			}
+		};
+
+		template<typename T>
+		struct Avx2Register;
+
+		template<>
+		struct Avx2Register<float>
+		{
+			using Register = __m256;
+			static constexpr size_t Width = 8;
+			NUMPY_TARGET_AVX2 static Register Load(const float* p) { return _mm256_loadu_ps(p); }
+			NUMPY_TARGET_AVX2 static void Store(float* p, const Register& a) { _mm256_storeu_ps(p, a); }
+			NUMPY_TARGET_AVX2 static Register Set(const float& a) { return _mm256_set1_ps(a); }
+			NUMPY_TARGET_AVX2 static Register Add(const Register& a, const Register& b) { return _mm256_add_ps(a, b); }
+			NUMPY_TARGET_AVX2 static Register Multiply(const Register& a, const Register& b) { return _mm256_mul_ps(a, b); }
+			NUMPY_TARGET_AVX2 static Register Maximum(const Register& a, const Register& b) { return _mm256_max_ps(b, a); }
+		};
+
+		template<>
+		struct Avx2Register<double>
+		{
+			using Register = __m256d;
+			static constexpr size_t Width = 4;
+			NUMPY_TARGET_AVX2 static Register Load(const double* p) { return _mm256_loadu_pd(p); }
+			NUMPY_TARGET_AVX2 static void Store(double* p, const Register& a) { _mm256_storeu_pd(p, a); }
+			NUMPY_TARGET_AVX2 static Register Set(const double& a) { return _mm256_set1_pd(a); }
+			NUMPY_TARGET_AVX2 static Register Add(const Register& a, const Register& b) { return _mm256_add_pd(a, b); }
+			NUMPY_TARGET_AVX2 static Register Multiply(const Register& a, const Register& b) { return _mm256_mul_pd(a, b); }
+			NUMPY_TARGET_AVX2 static Register Maximum(const Register& a, const Register& b) { return _mm256_max_pd(b, a); }
+		};
+
+		template<>
+		struct Avx2Register<int>
+		{
+			using Register = __m256i;
+			static constexpr size_t Width = 8;
+			NUMPY_TARGET_AVX2 static Register Load(const int* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+			NUMPY_TARGET_AVX2 static void Store(int* p, const Register& a) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), a); }
+			NUMPY_TARGET_AVX2 static Register Set(const int& a) { return _mm256_set1_epi32(a); }
+			NUMPY_TARGET_AVX2 static Register Add(const Register& a, const Register& b) { return _mm256_add_epi32(a, b); }
+			NUMPY_TARGET_AVX2 static Register Multiply(const Register& a, const Register& b) { return _mm256_mullo_epi32(a, b); }
+			NUMPY_TARGET_AVX2 static Register Maximum(const Register& a, const Register& b) { return _mm256_max_epi32(a, b); }
+		};
+
+		template<typename T>
+		struct Avx512Register;
+
+		template<>
+		struct Avx512Register<float>
+		{
+			using Register = __m512;
+			static constexpr size_t Width = 16;
+			NUMPY_TARGET_AVX512 static Register Load(const float* p) { return _mm512_loadu_ps(p); }
+			NUMPY_TARGET_AVX512 static Register Load(const float* p, const __mmask16& mask) { return _mm512_maskz_loadu_ps(mask, p); }
+			NUMPY_TARGET_AVX512 static void Store(float* p, const Register& a) { _mm512_storeu_ps(p, a); }
+			NUMPY_TARGET_AVX512 static void Store(float* p, const Register& a, const __mmask16& mask) { _mm512_mask_storeu_ps(p, mask, a); }
+			NUMPY_TARGET_AVX512 static Register Set(const float& a) { return _mm512_set1_ps(a); }
+			NUMPY_TARGET_AVX512 static Register Add(const Register& a, const Register& b) { return _mm512_add_ps(a, b); }
+			NUMPY_TARGET_AVX512 static Register Multiply(const Register& a, const Register& b) { return _mm512_mul_ps(a, b); }
+			NUMPY_TARGET_AVX512 static Register Maximum(const Register& a, const Register& b) { return _mm512_max_ps(b, a); }
+		};
+
+		template<>
+		struct Avx512Register<double>
+		{
+			using Register = __m512d;
+			static constexpr size_t Width = 8;
+			NUMPY_TARGET_AVX512 static Register Load(const double* p) { return _mm512_loadu_pd(p); }
+			NUMPY_TARGET_AVX512 static Register Load(const double* p, const __mmask16& mask) { return _mm512_maskz_loadu_pd(static_cast<__mmask8>(mask), p); }
+			NUMPY_TARGET_AVX512 static void Store(double* p, const Register& a) { _mm512_storeu_pd(p, a); }
+			NUMPY_TARGET_AVX512 static void Store(double* p, const Register& a, const __mmask16& mask) { _mm512_mask_storeu_pd(p, static_cast<__mmask8>(mask), a); }
+			NUMPY_TARGET_AVX512 static Register Set(const double& a) { return _mm512_set1_pd(a); }
+			NUMPY_TARGET_AVX512 static Register Add(const Register& a, const Register& b) { return _mm512_add_pd(a, b); }
+			NUMPY_TARGET_AVX512 static Register Multiply(const Register& a, const Register& b) { return _mm512_mul_pd(a, b); }
+			NUMPY_TARGET_AVX512 static Register Maximum(const Register& a, const Register& b) { return _mm512_max_pd(b, a); }
+		};
+
+		template<>
+		struct Avx512Register<int>
+		{
+			using Register = __m512i;
+			static constexpr size_t Width = 16;
+			NUMPY_TARGET_AVX512 static Register Load(const int* p) { return _mm512_loadu_si512(p); }
+			NUMPY_TARGET_AVX512 static Register Load(const int* p, const __mmask16& mask) { return _mm512_maskz_loadu_epi32(mask, p); }
+			NUMPY_TARGET_AVX512 static void Store(int* p, const Register& a) { _mm512_storeu_si512(p, a); }
+			NUMPY_TARGET_AVX512 static void Store(int* p, const Register& a, const __mmask16& mask) { _mm512_mask_storeu_epi32(p, mask, a); }
+			NUMPY_TARGET_AVX512 static Register Set(const int& a) { return _mm512_set1_epi32(a); }
+			NUMPY_TARGET_AVX512 static Register Add(const Register& a, const Register& b) { return _mm512_add_epi32(a, b); }
+			NUMPY_TARGET_AVX512 static Register Multiply(const Register& a, const Register& b) { return _mm512_mullo_epi32(a, b); }
+			NUMPY_TARGET_AVX512 static Register Maximum(const Register& a, const Register& b) { return _mm512_max_epi32(a, b); }
+		};
+
+		template<typename V, ElementwiseOperation Op>
+		NUMPY_TARGET_SSE2 inline typename V::Register ApplySse2(const typename V::Register& a, const typename V::Register& b)
+		{
+			if constexpr (Op == ElementwiseOperation::Add)
+				return V::Add(a, b);
+			else if constexpr (Op == ElementwiseOperation::Multiply)
+				return V::Multiply(a, b);
+			else
+				return V::Maximum(a, b);
+		}
+
+		template<typename V, ElementwiseOperation Op>
+		NUMPY_TARGET_AVX2 inline typename V::Register ApplyAvx2(const typename V::Register& a, const typename V::Register& b)
+		{
+			if constexpr (Op == ElementwiseOperation::Add)
+				return V::Add(a, b);
+			else if constexpr (Op == ElementwiseOperation::Multiply)
+				return V::Multiply(a, b);
+			else
+				return V::Maximum(a, b);
+		}
+
+		template<typename V, ElementwiseOperation Op>
+		NUMPY_TARGET_AVX512 inline typename V::Register ApplyAvx512(const typename V::Register& a, const typename V::Register& b)
+		{
+			if constexpr (Op == ElementwiseOperation::Add)
+				return V::Add(a, b);
+			else if constexpr (Op == ElementwiseOperation::Multiply)
+				return V::Multiply(a, b);
+			else
+				return V::Maximum(a, b);
+		}
+
+		template<ElementwiseOperation Op, typename T>
+		NUMPY_TARGET_SSE2 void Sse2Binary(const T* a, const T* b, T* out, const size_t& size)
+		{
+			using V = Sse2Register<T>;
+			size_t i = 0;
+			for (; i + 2 * V::Width <= size; i += 2 * V::Width)
+			{
+				V::Store(out + i, ApplySse2<V, Op>(V::Load(a + i), V::Load(b + i)));
+				V::Store(out + i + V::Width, ApplySse2<V, Op>(V::Load(a + i + V::Width), V::Load(b + i + V::Width)));
+			}
+			for (; i < size; ++i)
+			{
+				out[i] = Apply<Op>(a[i], b[i]);
+			}
+		}
+
+		template<ElementwiseOperation Op, typename T>
+		NUMPY_TARGET_SSE2 void Sse2Scalar(const T* a, const T& b, T* out, const size_t& size)
+		{
+			using V = Sse2Register<T>;
+			const typename V::Register scalar = V::Set(b);
+			size_t i = 0;
+			for (; i + 2 * V::Width <= size; i += 2 * V::Width)
+			{
+				V::Store(out + i, ApplySse2<V, Op>(V::Load(a + i), scalar));
+				V::Store(out + i + V::Width, ApplySse2<V, Op>(V::Load(a + i + V::Width), scalar));
+			}
+			for (; i < size; ++i)
+			{
+				out[i] = Apply<Op>(a[i], b);
+			}
+		}
+
+		template<ElementwiseOperation Op, typename T>
+		NUMPY_TARGET_AVX2 void Avx2Binary(const T* a, const T* b, T* out, const size_t& size)
+		{
+			using V = Avx2Register<T>;
+			size_t i = 0;
+			for (; i + 2 * V::Width <= size; i += 2 * V::Width)
+			{
+				V::Store(out + i, ApplyAvx2<V, Op>(V::Load(a + i), V::Load(b + i)));
+				V::Store(out + i + V::Width, ApplyAvx2<V, Op>(V::Load(a + i + V::Width), V::Load(b + i + V::Width)));
+			}
+			for (; i < size; ++i)
+			{
+				out[i] = Apply<Op>(a[i], b[i]);
+			}
+		}
+
+		template<ElementwiseOperation Op, typename T>
+		NUMPY_TARGET_AVX2 void Avx2Scalar(const T* a, const T& b, T* out, const size_t& size)
+		{
+			using V = Avx2Register<T>;
+			const typename V::Register scalar = V::Set(b);
+			size_t i = 0;
+			for (; i + 2 * V::Width <= size; i += 2 * V::Width)
+			{
+				V::Store(out + i, ApplyAvx2<V, Op>(V::Load(a + i), scalar));
+				V::Store(out + i + V::Width, ApplyAvx2<V, Op>(V::Load(a + i + V::Width), scalar));
+			}
+			for (; i < size; ++i)
+			{
+				out[i] = Apply<Op>(a[i], b);
+			}
+		}
+
+		template<ElementwiseOperation Op, typename T>
+		NUMPY_TARGET_AVX512 void Avx512Binary(const T* a, const T* b, T* out, const size_t& size)
+		{
+			using V = Avx512Register<T>;
+			size_t i = 0;
+			for (; i + V::Width <= size; i += V::Width)
+			{
+				V::Store(out + i, ApplyAvx512<V, Op>(V::Load(a + i), V::Load(b + i)));
+			}
+			if (i < size)
+			{
+				const __mmask16 mask = static_cast<__mmask16>((1u << (size - i)) - 1u);
+				V::Store(out + i, ApplyAvx512<V, Op>(V::Load(a + i, mask), V::Load(b + i, mask)), mask);
+			}
+		}
+
+		template<ElementwiseOperation Op, typename T>
+		NUMPY_TARGET_AVX512 void Avx512Scalar(const T* a, const T& b, T* out, const size_t& size)
+		{
+			using V = Avx512Register<T>;
+			const typename V::Register scalar = V::Set(b);
+			size_t i = 0;
+			for (; i + V::Width <= size; i += V::Width)
+			{
+				V::Store(out + i, ApplyAvx512<V, Op>(V::Load(a + i), scalar));
+			}
+			if (i < size)
+			{
+				const __mmask16 mask = static_cast<__mmask16>((1u << (size - i)) - 1u);
+				V::Store(out + i, ApplyAvx512<V, Op>(V::Load(a + i, mask), scalar), mask);
+			}
+		}
+
+		// Horizontal reductions keep four vector accumulators in flight to hide the add latency, then fold the lanes in order.
+		template<ElementwiseOperation Op, typename V, typename T>
+		inline T FoldLanes(const T* lanes)
+		{
+			T result = lanes[0];
+			for (size_t i = 1; i < V::Width; ++i)
+			{
+				result = Apply<Op>(result, lanes[i]);
+			}
+			return result;
+		}
+
+		template<ElementwiseOperation Op, typename T>
+		NUMPY_TARGET_SSE2 T Sse2Reduce(const T* a, const size_t& size)
+		{
+			using V = Sse2Register<T>;
+			size_t i = 1;
+			T result = a[0];
+			if (size >= 4 * V::Width)
+			{
+				typename V::Register acc0 = V::Load(a);
+				typename V::Register acc1 = V::Load(a + V::Width);
+				typename V::Register acc2 = V::Load(a + 2 * V::Width);
+				typename V::Register acc3 = V::Load(a + 3 * V::Width);
+				for (i = 4 * V::Width; i + 4 * V::Width <= size; i += 4 * V::Width)
+				{
+					acc0 = ApplySse2<V, Op>(acc0, V::Load(a + i));
+					acc1 = ApplySse2<V, Op>(acc1, V::Load(a + i + V::Width));
+					acc2 = ApplySse2<V, Op>(acc2, V::Load(a + i + 2 * V::Width));
+					acc3 = ApplySse2<V, Op>(acc3, V::Load(a + i + 3 * V::Width));
+				}
+				T lanes[V::Width];
+				V::Store(lanes, ApplySse2<V, Op>(ApplySse2<V, Op>(acc0, acc1), ApplySse2<V, Op>(acc2, acc3)));
+				result = FoldLanes<Op, V>(lanes);
+			}
+			for (; i < size; ++i)
+			{
+				result = Apply<Op>(result, a[i]);
+			}
+			return result;
+		}
+
+		template<ElementwiseOperation Op, typename T>
+		NUMPY_TARGET_AVX2 T Avx2Reduce(const T* a, const size_t& size)
+		{
+			using V = Avx2Register<T>;
+			size_t i = 1;
+			T result = a[0];
+			if (size >= 4 * V::Width)
+			{
+				typename V::Register acc0 = V::Load(a);
+				typename V::Register acc1 = V::Load(a + V::Width);
+				typename V::Register acc2 = V::Load(a + 2 * V::Width);
+				typename V::Register acc3 = V::Load(a + 3 * V::Width);
+				for (i = 4 * V::Width; i + 4 * V::Width <= size; i += 4 * V::Width)
+				{
+					acc0 = ApplyAvx2<V, Op>(acc0, V::Load(a + i));
+					acc1 = ApplyAvx2<V, Op>(acc1, V::Load(a + i + V::Width));
+					acc2 = ApplyAvx2<V, Op>(acc2, V::Load(a + i + 2 * V::Width));
+					acc3 = ApplyAvx2<V, Op>(acc3, V::Load(a + i + 3 * V::Width));
+				}
+				T lanes[V::Width];
+				V::Store(lanes, ApplyAvx2<V, Op>(ApplyAvx2<V, Op>(acc0, acc1), ApplyAvx2<V, Op>(acc2, acc3)));
+				result = FoldLanes<Op, V>(lanes);
+			}
+			for (; i < size; ++i)
+			{
+				result = Apply<Op>(result, a[i]);
+			}
+			return result;
+		}
+
+		template<ElementwiseOperation Op, typename T>
+		NUMPY_TARGET_AVX512 T Avx512Reduce(const T* a, const size_t& size)
+		{
+			using V = Avx512Register<T>;
+			size_t i = 1;
+			T result = a[0];
+			if (size >= 4 * V::Width)
+			{
+				typename V::Register acc0 = V::Load(a);
+				typename V::Register acc1 = V::Load(a + V::Width);
+				typename V::Register acc2 = V::Load(a + 2 * V::Width);
+				typename V::Register acc3 = V::Load(a + 3 * V::Width);
+				for (i = 4 * V::Width; i + 4 * V::Width <= size; i += 4 * V::Width)
+				{
+					acc0 = ApplyAvx512<V, Op>(acc0, V::Load(a + i));
+					acc1 = ApplyAvx512<V, Op>(acc1, V::Load(a + i + V::Width));
+					acc2 = ApplyAvx512<V, Op>(acc2, V::Load(a + i + 2 * V::Width));
+					acc3 = ApplyAvx512<V, Op>(acc3, V::Load(a + i + 3 * V::Width));
+				}
+				T lanes[V::Width];
+				V::Store(lanes, ApplyAvx512<V, Op>(ApplyAvx512<V, Op>(acc0, acc1), ApplyAvx512<V, Op>(acc2, acc3)));
+				result = FoldLanes<Op, V>(lanes);
+			}
+			for (; i < size; ++i)
+			{
+				result = Apply<Op>(result, a[i]);
+			}
+			return result;
+		}
+#endif
+	}
+
+	// Contiguous element-wise kernels. float, double and int dispatch on Simd::GetLevel(); other types use the scalar loop.
+	template<typename T>
+	class ElementwiseKernel final
+	{
+	public:
+		ElementwiseKernel() = delete;
+		~ElementwiseKernel() = delete;
+
+		static void Add(const T* a, const T* b, T* out, const size_t& size);
+		static void Add(const T* a, const T& b, T* out, const size_t& size);
+		static void Multiply(const T* a, const T* b, T* out, const size_t& size);
+		static void Multiply(const T* a, const T& b, T* out, const size_t& size);
+		static void Maximum(const T* a, const T* b, T* out, const size_t& size);
+		static void Maximum(const T* a, const T& b, T* out, const size_t& size);
+
+		template<ElementwiseOperation Op>
+		static void Binary(const T* a, const T* b, T* out, const size_t& size);
+		template<ElementwiseOperation Op>
+		static void Scalar(const T* a, const T& b, T* out, const size_t& size);
+		// Folds a[0] ... a[size - 1] with Op; size must not be 0. Lanes are combined out of order, so float sums differ
+		// from a sequential loop by rounding only.
+		template<ElementwiseOperation Op>
+		static T Reduce(const T* a, const size_t& size);
+
+		static constexpr bool IS_VECTORIZED = std::is_same<T, float>::value || std::is_same<T, double>::value || std::is_same<T, int>::value;
+	};
+
+	template<typename T>
+	inline void ElementwiseKernel<T>::Add(const T* a, const T* b, T* out, const size_t& size)
+	{
+		Binary<ElementwiseOperation::Add>(a, b, out, size);
+	}
+
+	template<typename T>
+	inline void ElementwiseKernel<T>::Add(const T* a, const T& b, T* out, const size_t& size)
+	{
+		Scalar<ElementwiseOperation::Add>(a, b, out, size);
+	}
+
+	template<typename T>
+	inline void ElementwiseKernel<T>::Multiply(const T* a, const T* b, T* out, const size_t& size)
+	{
+		Binary<ElementwiseOperation::Multiply>(a, b, out, size);
+	}
+
+	template<typename T>
+	inline void ElementwiseKernel<T>::Multiply(const T* a, const T& b, T* out, const size_t& size)
+	{
+		Scalar<ElementwiseOperation::Multiply>(a, b, out, size);
+	}
+
+	template<typename T>
+	inline void ElementwiseKernel<T>::Maximum(const T* a, const T* b, T* out, const size_t& size)
+	{
+		Binary<ElementwiseOperation::Maximum>(a, b, out, size);
+	}
+
+	template<typename T>
+	inline void ElementwiseKernel<T>::Maximum(const T* a, const T& b, T* out, const size_t& size)
+	{
+		Scalar<ElementwiseOperation::Maximum>(a, b, out, size);
+	}
+
+	template<typename T>
+	template<ElementwiseOperation Op>
+	void ElementwiseKernel<T>::Binary(const T* a, const T* b, T* out, const size_t& size)
+	{
+#if NUMPY_SIMD_X86
+		if constexpr (IS_VECTORIZED)
+		{
+			switch (Simd::GetLevel())
+			{
+			case SimdLevel::AVX512:
+				simd::Avx512Binary<Op>(a, b, out, size);
+				return;
+			case SimdLevel::AVX2:
+				simd::Avx2Binary<Op>(a, b, out, size);
+				return;
+			case SimdLevel::SSE2:
+				simd::Sse2Binary<Op>(a, b, out, size);
+				return;
+			default:
+				break;
+			}
+		}
+#endif
+		for (size_t i = 0; i < size; ++i)
+		{
+			out[i] = simd::Apply<Op>(a[i], b[i]);
+		}
+	}
+
+	template<typename T>
+	template<ElementwiseOperation Op>
+	void ElementwiseKernel<T>::Scalar(const T* a, const T& b, T* out, const size_t& size)
+	{
+#if NUMPY_SIMD_X86
+		if constexpr (IS_VECTORIZED)
+		{
+			switch (Simd::GetLevel())
+			{
+			case SimdLevel::AVX512:
+				simd::Avx512Scalar<Op>(a, b, out, size);
+				return;
+			case SimdLevel::AVX2:
+				simd::Avx2Scalar<Op>(a, b, out, size);
+				return;
+			case SimdLevel::SSE2:
+				simd::Sse2Scalar<Op>(a, b, out, size);
+				return;
+			default:
+				break;
+			}
+		}
+#endif
+		for (size_t i = 0; i < size; ++i)
+		{
+			out[i] = simd::Apply<Op>(a[i], b);
+		}
+	}
+
+	template<typename T>
+	template<ElementwiseOperation Op>
+	T ElementwiseKernel<T>::Reduce(const T* a, const size_t& size)
+	{
+#if NUMPY_SIMD_X86
+		if constexpr (IS_VECTORIZED)
+		{
+			switch (Simd::GetLevel())
+			{
+			case SimdLevel::AVX512:
+				return simd::Avx512Reduce<Op>(a, size);
+			case SimdLevel::AVX2:
+				return simd::Avx2Reduce<Op>(a, size);
+			case SimdLevel::SSE2:
+				return simd::Sse2Reduce<Op>(a, size);
+			default:
+				break;
+			}
+		}
+#endif
+		T result = a[0];
+		for (size_t i = 1; i < size; ++i)
+		{
+			result = static_cast<T>(simd::Apply<Op>(result, a[i]));
+		}
+		return result;
+	}
+}
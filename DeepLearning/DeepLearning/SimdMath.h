@@ -0,0 +1,823 @@
+#pragma once
+#include<algorithm>
+#include<cmath>
+#include<cstddef>
+#include<cstdint>
+#include<limits>
+#include<type_traits>
+#include "Simd.h"
+
+namespace numpy
+{
+	enum class MathFunction
+	{
+		Exp,
+		Log,
+		Tanh,
+		Sigmoid,
+		Erf,
+		Gelu,
+	};
+
+	namespace simd
+	{
+		// Minimax polynomials in Horner order, highest degree first. Exp, Log, Tanh and the small-argument erf are the Cephes
+		// single precision sets; the erfc pieces were fitted for this file, to a relative error of 3e-8 and 4e-9 in long double.
+		// exp(r) = 1 + r + r^2 P(r) on |r| <= ln(2) / 2.
+		constexpr float EXP_POLYNOMIAL[] = { 1.9875691500e-4f, 1.3981999507e-3f, 8.3334519073e-3f, 4.1665795894e-2f, 1.6666665459e-1f, 5.0000001201e-1f };
+		// log(1 + m) = m - m^2 / 2 + m^3 P(m) on sqrt(1/2) - 1 <= m < sqrt(2) - 1.
+		constexpr float LOG_POLYNOMIAL[] = { 7.0376836292e-2f, -1.1514610310e-1f, 1.1676998740e-1f, -1.2420140846e-1f, 1.4249322787e-1f,
+			-1.6668057665e-1f, 2.0000714765e-1f, -2.4999993993e-1f, 3.3333331174e-1f };
+		// tanh(x) = x + x^3 P(x^2) on |x| < 0.625.
+		constexpr float TANH_POLYNOMIAL[] = { -5.70498872745e-3f, 2.06390887954e-2f, -5.37397155531e-2f, 1.33314422036e-1f, -3.33332819422e-1f };
+		// erf(x) = x P(x^2) on |x| < 1.
+		constexpr float ERF_POLYNOMIAL[] = { 7.853861353e-5f, -8.010193625e-4f, 5.188327686e-3f, -2.685381194e-2f, 1.128358515e-1f,
+			-3.761262582e-1f, 1.128379166e+0f };
+		// erfc(u) = exp(-u^2) / u P(1 / u^2), one set for 1 <= u < 2 and one for 2 <= u <= 10.
+		constexpr float ERFC_NEAR_POLYNOMIAL[] = { 2.326939512e-2f, -1.387099267e-1f, 3.687552528e-1f, -5.824884700e-1f, 6.210113721e-1f,
+			-4.944563948e-1f, 3.404893026e-1f, -2.741128971e-1f, 5.638259549e-1f };
+		constexpr float ERFC_FAR_POLYNOMIAL[] = { 2.916065480e+1f, -3.976676883e+1f, 2.495725716e+1f, -1.005736270e+1f, 3.226666221e+0f,
+			-1.035339838e+0f, 4.225134968e-1f, -2.820859159e-1f, 5.641895375e-1f };
+
+		// Inputs are clamped to this range before the reduction: below it the result rounds to 0, above it overflows to infinity,
+		// and 2^n is applied as two factors so both ends stay representable.
+		constexpr float EXP_MIN = -104.0f;
+		constexpr float EXP_MAX = 89.0f;
+		// Softmax terms below exp(SOFTMAX_MIN), still a normal float, are dropped: they cannot move a sum of at least 1, and
+		// computing them costs a microcode assist per denormal on x86.
+		constexpr float SOFTMAX_MIN = -87.0f;
+		constexpr float LOG2E = 1.44269504088896341f;
+		// ln(2) split so that n * LN2_HIGH is exact for every n the clamp allows.
+		constexpr float LN2_HIGH = 0.693359375f;
+		constexpr float LN2_LOW = -2.12194440e-4f;
+		constexpr float SQRT_HALF = 0.707106781186547524f;
+		constexpr float TANH_SMALL = 0.625f;
+		// erfc is below the smallest denormal past this.
+		constexpr float ERFC_MAX = 10.5f;
+
+#if NUMPY_SIMD_X86
+		// float registers with the integer and mask operations the math kernels need.
+		struct Avx2MathRegister
+		{
+			using Register = __m256;
+			using Integer = __m256i;
+			using Mask = __m256;
+			static constexpr size_t Width = 8;
+			NUMPY_TARGET_AVX2 static Register Load(const float* p) { return _mm256_loadu_ps(p); }
+			NUMPY_TARGET_AVX2 static void Store(float* p, const Register& a) { _mm256_storeu_ps(p, a); }
+			NUMPY_TARGET_AVX2 static Register Set(const float& a) { return _mm256_set1_ps(a); }
+			NUMPY_TARGET_AVX2 static Register Add(const Register& a, const Register& b) { return _mm256_add_ps(a, b); }
+			NUMPY_TARGET_AVX2 static Register Subtract(const Register& a, const Register& b) { return _mm256_sub_ps(a, b); }
+			NUMPY_TARGET_AVX2 static Register Multiply(const Register& a, const Register& b) { return _mm256_mul_ps(a, b); }
+			NUMPY_TARGET_AVX2 static Register Divide(const Register& a, const Register& b) { return _mm256_div_ps(a, b); }
+			// a * b + c, rounded twice: the AVX2 level does not assume FMA.
+			NUMPY_TARGET_AVX2 static Register MultiplyAdd(const Register& a, const Register& b, const Register& c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+			// Both return b when either operand is NaN, so a clamp keeps a NaN passed as b.
+			NUMPY_TARGET_AVX2 static Register Minimum(const Register& a, const Register& b) { return _mm256_min_ps(a, b); }
+			NUMPY_TARGET_AVX2 static Register Maximum(const Register& a, const Register& b) { return _mm256_max_ps(a, b); }
+			NUMPY_TARGET_AVX2 static Register Round(const Register& a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+			NUMPY_TARGET_AVX2 static Integer ToInteger(const Register& a) { return _mm256_cvttps_epi32(a); }
+			// a * 2^n for integer n in [-252, 254].
+			NUMPY_TARGET_AVX2 static Register Scale(const Register& a, const Integer& n)
+			{
+				const __m256i half = _mm256_srai_epi32(n, 1);
+				const __m256i bias = _mm256_set1_epi32(127);
+				const __m256 first = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(half, bias), 23));
+				const __m256 second = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_sub_epi32(n, half), bias), 23));
+				return _mm256_mul_ps(_mm256_mul_ps(a, first), second);
+			}
+			// Mantissa in [0.5, 1) of a positive normal a; exponent receives e with a = mantissa * 2^e.
+			NUMPY_TARGET_AVX2 static Register Decompose(const Register& a, Register& exponent)
+			{
+				const __m256i bits = _mm256_castps_si256(a);
+				exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+				return _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F000000)));
+			}
+			// a with the low 12 mantissa bits cleared, so the square of the result is exact.
+			NUMPY_TARGET_AVX2 static Register High(const Register& a) { return _mm256_and_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(static_cast<int>(0xFFFFF000u)))); }
+			NUMPY_TARGET_AVX2 static Register Abs(const Register& a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+			NUMPY_TARGET_AVX2 static Register Negate(const Register& a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+			// magnitude (not negative) with the sign of sign.
+			NUMPY_TARGET_AVX2 static Register CopySign(const Register& magnitude, const Register& sign) { return _mm256_or_ps(magnitude, _mm256_and_ps(sign, _mm256_set1_ps(-0.0f))); }
+			NUMPY_TARGET_AVX2 static Mask Less(const Register& a, const Register& b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+			NUMPY_TARGET_AVX2 static Mask Equal(const Register& a, const Register& b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+			// a < b, or either is NaN.
+			NUMPY_TARGET_AVX2 static Mask LessOrUnordered(const Register& a, const Register& b) { return _mm256_cmp_ps(a, b, _CMP_NGE_UQ); }
+			NUMPY_TARGET_AVX2 static Register Select(const Mask& mask, const Register& a, const Register& b) { return _mm256_blendv_ps(b, a, mask); }
+		};
+
+		struct Avx512MathRegister
+		{
+			using Register = __m512;
+			using Integer = __m512i;
+			using Mask = __mmask16;
+			static constexpr size_t Width = 16;
+			NUMPY_TARGET_AVX512 static Register Load(const float* p) { return _mm512_loadu_ps(p); }
+			// Lanes outside mask read as fill.
+			NUMPY_TARGET_AVX512 static Register Load(const float* p, const __mmask16& mask, const float& fill) { return _mm512_mask_loadu_ps(_mm512_set1_ps(fill), mask, p); }
+			NUMPY_TARGET_AVX512 static void Store(float* p, const Register& a) { _mm512_storeu_ps(p, a); }
+			NUMPY_TARGET_AVX512 static void Store(float* p, const Register& a, const __mmask16& mask) { _mm512_mask_storeu_ps(p, mask, a); }
+			NUMPY_TARGET_AVX512 static Register Set(const float& a) { return _mm512_set1_ps(a); }
+			NUMPY_TARGET_AVX512 static Register Add(const Register& a, const Register& b) { return _mm512_add_ps(a, b); }
+			NUMPY_TARGET_AVX512 static Register Subtract(const Register& a, const Register& b) { return _mm512_sub_ps(a, b); }
+			NUMPY_TARGET_AVX512 static Register Multiply(const Register& a, const Register& b) { return _mm512_mul_ps(a, b); }
+			NUMPY_TARGET_AVX512 static Register Divide(const Register& a, const Register& b) { return _mm512_div_ps(a, b); }
+			NUMPY_TARGET_AVX512 static Register MultiplyAdd(const Register& a, const Register& b, const Register& c) { return _mm512_fmadd_ps(a, b, c); }
+			NUMPY_TARGET_AVX512 static Register Minimum(const Register& a, const Register& b) { return _mm512_min_ps(a, b); }
+			NUMPY_TARGET_AVX512 static Register Maximum(const Register& a, const Register& b) { return _mm512_max_ps(a, b); }
+			NUMPY_TARGET_AVX512 static Register Round(const Register& a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+			NUMPY_TARGET_AVX512 static Integer ToInteger(const Register& a) { return _mm512_cvttps_epi32(a); }
+			NUMPY_TARGET_AVX512 static Register Scale(const Register& a, const Integer& n)
+			{
+				const __m512i half = _mm512_srai_epi32(n, 1);
+				const __m512i bias = _mm512_set1_epi32(127);
+				const __m512 first = _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(half, bias), 23));
+				const __m512 second = _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(_mm512_sub_epi32(n, half), bias), 23));
+				return _mm512_mul_ps(_mm512_mul_ps(a, first), second);
+			}
+			NUMPY_TARGET_AVX512 static Register Decompose(const Register& a, Register& exponent)
+			{
+				const __m512i bits = _mm512_castps_si512(a);
+				exponent = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_srli_epi32(bits, 23), _mm512_set1_epi32(126)));
+				return _mm512_castsi512_ps(_mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi32(0x007FFFFF)), _mm512_set1_epi32(0x3F000000)));
+			}
+			NUMPY_TARGET_AVX512 static Register High(const Register& a) { return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(static_cast<int>(0xFFFFF000u)))); }
+			NUMPY_TARGET_AVX512 static Register Abs(const Register& a) { return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x7FFFFFFF))); }
+			NUMPY_TARGET_AVX512 static Register Negate(const Register& a) { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_set1_epi32(static_cast<int>(0x80000000u)))); }
+			NUMPY_TARGET_AVX512 static Register CopySign(const Register& magnitude, const Register& sign)
+			{
+				const __m512i signBit = _mm512_and_si512(_mm512_castps_si512(sign), _mm512_set1_epi32(static_cast<int>(0x80000000u)));
+				return _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(magnitude), signBit));
+			}
+			NUMPY_TARGET_AVX512 static Mask Less(const Register& a, const Register& b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+			NUMPY_TARGET_AVX512 static Mask Equal(const Register& a, const Register& b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+			NUMPY_TARGET_AVX512 static Mask LessOrUnordered(const Register& a, const Register& b) { return _mm512_cmp_ps_mask(a, b, _CMP_NGE_UQ); }
+			NUMPY_TARGET_AVX512 static Register Select(const Mask& mask, const Register& a, const Register& b) { return _mm512_mask_blend_ps(mask, b, a); }
+		};
+
+		// The functions below are written once against the register interface and stamped out per level, since GCC and Clang
+		// only inline intrinsics into code compiled for their ISA.
+		template<typename V>
+		NUMPY_TARGET_AVX2 inline typename V::Register ExpAvx2(const typename V::Register& x)
+		{
+			using R = typename V::Register;
+			const R clamped = V::Minimum(V::Set(EXP_MAX), V::Maximum(V::Set(EXP_MIN), x));
+			const R n = V::Round(V::Multiply(clamped, V::Set(LOG2E)));
+			R r = V::MultiplyAdd(n, V::Set(-LN2_HIGH), clamped);
+			r = V::MultiplyAdd(n, V::Set(-LN2_LOW), r);
+			R p = V::Set(EXP_POLYNOMIAL[0]);
+			for (size_t i = 1; i < sizeof(EXP_POLYNOMIAL) / sizeof(float); ++i)
+			{
+				p = V::MultiplyAdd(p, r, V::Set(EXP_POLYNOMIAL[i]));
+			}
+			const R y = V::Add(V::MultiplyAdd(p, V::Multiply(r, r), r), V::Set(1.0f));
+			return V::Scale(y, V::ToInteger(n));
+		}
+
+		template<typename V>
+		NUMPY_TARGET_AVX2 inline typename V::Register LogAvx2(const typename V::Register& x)
+		{
+			using R = typename V::Register;
+			// Denormals are brought into the normal range first.
+			const typename V::Mask tiny = V::Less(x, V::Set(std::numeric_limits<float>::min()));
+			R exponent;
+			R m = V::Decompose(V::Select(tiny, V::Multiply(x, V::Set(8388608.0f)), x), exponent);
+			exponent = V::Select(tiny, V::Subtract(exponent, V::Set(23.0f)), exponent);
+			const typename V::Mask low = V::Less(m, V::Set(SQRT_HALF));
+			exponent = V::Select(low, V::Subtract(exponent, V::Set(1.0f)), exponent);
+			m = V::Subtract(V::Select(low, V::Add(m, m), m), V::Set(1.0f));
+
+			const R z = V::Multiply(m, m);
+			R p = V::Set(LOG_POLYNOMIAL[0]);
+			for (size_t i = 1; i < sizeof(LOG_POLYNOMIAL) / sizeof(float); ++i)
+			{
+				p = V::MultiplyAdd(p, m, V::Set(LOG_POLYNOMIAL[i]));
+			}
+			R y = V::Multiply(V::Multiply(p, m), z);
+			y = V::MultiplyAdd(exponent, V::Set(LN2_LOW), y);
+			y = V::MultiplyAdd(z, V::Set(-0.5f), y);
+			R result = V::MultiplyAdd(exponent, V::Set(LN2_HIGH), V::Add(m, y));
+
+			result = V::Select(V::Equal(x, V::Set(std::numeric_limits<float>::infinity())), x, result);
+			result = V::Select(V::Equal(x, V::Set(0.0f)), V::Set(-std::numeric_limits<float>::infinity()), result);
+			return V::Select(V::LessOrUnordered(x, V::Set(0.0f)), V::Set(std::numeric_limits<float>::quiet_NaN()), result);
+		}
+
+		template<typename V>
+		NUMPY_TARGET_AVX2 inline typename V::Register TanhAvx2(const typename V::Register& x)
+		{
+			using R = typename V::Register;
+			const R z = V::Multiply(x, x);
+			R p = V::Set(TANH_POLYNOMIAL[0]);
+			for (size_t i = 1; i < sizeof(TANH_POLYNOMIAL) / sizeof(float); ++i)
+			{
+				p = V::MultiplyAdd(p, z, V::Set(TANH_POLYNOMIAL[i]));
+			}
+			const R a = V::Abs(x);
+			const R small = V::MultiplyAdd(V::Multiply(p, z), a, a);
+
+			// 1 - 2 / (exp(2|x|) + 1) away from 0, which saturates to 1 once the exponential overflows. The sign goes on last so
+			// tanh(-0) = -0.
+			const R e = ExpAvx2<V>(V::Add(a, a));
+			const R large = V::Subtract(V::Set(1.0f), V::Divide(V::Set(2.0f), V::Add(e, V::Set(1.0f))));
+			return V::CopySign(V::Select(V::Less(a, V::Set(TANH_SMALL)), small, large), x);
+		}
+
+		template<typename V>
+		NUMPY_TARGET_AVX2 inline typename V::Register SigmoidAvx2(const typename V::Register& x)
+		{
+			const typename V::Register one = V::Set(1.0f);
+			return V::Divide(one, V::Add(one, ExpAvx2<V>(V::Negate(x))));
+		}
+
+		// erf(x) for |x| < 1.
+		template<typename V>
+		NUMPY_TARGET_AVX2 inline typename V::Register ErfSmallAvx2(const typename V::Register& x)
+		{
+			using R = typename V::Register;
+			const R z = V::Multiply(x, x);
+			R p = V::Set(ERF_POLYNOMIAL[0]);
+			for (size_t i = 1; i < sizeof(ERF_POLYNOMIAL) / sizeof(float); ++i)
+			{
+				p = V::MultiplyAdd(p, z, V::Set(ERF_POLYNOMIAL[i]));
+			}
+			return V::Multiply(p, x);
+		}
+
+		// factor * erfc(scale a) for scale a >= 1, where scaleSquare, the exact square of scale, is a power of 2; larger arguments than ERFC_MAX are clamped. a^2
+		// is formed exactly as a sum of two floats before scaling, and its low part applied to exp(-u^2) to first order; factor
+		// joins before the exponential, so a normal result never passes through a denormal. Together they keep the relative
+		// error of the tail.
+		template<typename V>
+		NUMPY_TARGET_AVX2 inline typename V::Register ErfcAvx2(const typename V::Register& a, const float& scale, const float& scaleSquare, const typename V::Register& factor)
+		{
+			using R = typename V::Register;
+			const R clamped = V::Minimum(V::Set(ERFC_MAX / scale), V::Maximum(V::Set(1.0f / scale), a));
+			const R q = V::Divide(V::Set(1.0f), V::Multiply(clamped, V::Set(scale)));
+			const R y = V::Multiply(q, q);
+			const typename V::Mask far = V::Less(q, V::Set(0.5f));
+			R p = V::Select(far, V::Set(ERFC_FAR_POLYNOMIAL[0]), V::Set(ERFC_NEAR_POLYNOMIAL[0]));
+			for (size_t i = 1; i < sizeof(ERFC_NEAR_POLYNOMIAL) / sizeof(float); ++i)
+			{
+				p = V::MultiplyAdd(p, y, V::Select(far, V::Set(ERFC_FAR_POLYNOMIAL[i]), V::Set(ERFC_NEAR_POLYNOMIAL[i])));
+			}
+
+			const R square = V::Multiply(clamped, clamped);
+			const R high = V::High(clamped);
+			const R low = V::Subtract(clamped, high);
+			const R error = V::MultiplyAdd(low, low, V::MultiplyAdd(V::Add(high, high), low, V::MultiplyAdd(high, high, V::Negate(square))));
+			const R e = V::Multiply(ExpAvx2<V>(V::Negate(V::Multiply(square, V::Set(scaleSquare)))), V::Subtract(V::Set(1.0f), V::Multiply(error, V::Set(scaleSquare))));
+			return V::Multiply(e, V::Multiply(V::Multiply(q, p), factor));
+		}
+
+		template<typename V>
+		NUMPY_TARGET_AVX2 inline typename V::Register ErfAvx2(const typename V::Register& x)
+		{
+			const typename V::Register a = V::Abs(x);
+			const typename V::Register large = V::CopySign(V::Subtract(V::Set(1.0f), ErfcAvx2<V>(a, 1.0f, 1.0f, V::Set(1.0f))), x);
+			return V::Select(V::Less(a, V::Set(1.0f)), ErfSmallAvx2<V>(x), large);
+		}
+
+		// x Phi(x) = x (1 + erf(x / sqrt(2))) / 2, with x erfc(|x| / sqrt(2)) / 2 on the negative tail so it keeps its relative accuracy.
+		template<typename V>
+		NUMPY_TARGET_AVX2 inline typename V::Register GeluAvx2(const typename V::Register& x)
+		{
+			using R = typename V::Register;
+			const R half = V::Set(0.5f);
+			const R v = V::Multiply(x, V::Set(SQRT_HALF));
+			const R small = V::Multiply(V::Multiply(half, x), V::Add(V::Set(1.0f), ErfSmallAvx2<V>(v)));
+			const typename V::Mask negative = V::Less(x, V::Set(0.0f));
+			const R c = ErfcAvx2<V>(V::Abs(x), SQRT_HALF, 0.5f, V::Select(negative, V::Multiply(half, x), half));
+			const R large = V::Select(negative, c, V::Multiply(x, V::Subtract(V::Set(1.0f), c)));
+			return V::Select(V::Less(V::Abs(v), V::Set(1.0f)), small, large);
+		}
+
+		template<typename V, MathFunction F>
+		NUMPY_TARGET_AVX2 inline typename V::Register ApplyMathAvx2(const typename V::Register& x)
+		{
+			if constexpr (F == MathFunction::Exp)
+				return ExpAvx2<V>(x);
+			else if constexpr (F == MathFunction::Log)
+				return LogAvx2<V>(x);
+			else if constexpr (F == MathFunction::Tanh)
+				return TanhAvx2<V>(x);
+			else if constexpr (F == MathFunction::Sigmoid)
+				return SigmoidAvx2<V>(x);
+			else if constexpr (F == MathFunction::Erf)
+				return ErfAvx2<V>(x);
+			else
+				return GeluAvx2<V>(x);
+		}
+
+		template<typename V>
+		NUMPY_TARGET_AVX512 inline typename V::Register ExpAvx512(const typename V::Register& x)
+		{
+			using R = typename V::Register;
+			const R clamped = V::Minimum(V::Set(EXP_MAX), V::Maximum(V::Set(EXP_MIN), x));
+			const R n = V::Round(V::Multiply(clamped, V::Set(LOG2E)));
+			R r = V::MultiplyAdd(n, V::Set(-LN2_HIGH), clamped);
+			r = V::MultiplyAdd(n, V::Set(-LN2_LOW), r);
+			R p = V::Set(EXP_POLYNOMIAL[0]);
+			for (size_t i = 1; i < sizeof(EXP_POLYNOMIAL) / sizeof(float); ++i)
+			{
+				p = V::MultiplyAdd(p, r, V::Set(EXP_POLYNOMIAL[i]));
+			}
+			const R y = V::Add(V::MultiplyAdd(p, V::Multiply(r, r), r), V::Set(1.0f));
+			return V::Scale(y, V::ToInteger(n));
+		}
+
+		template<typename V>
+		NUMPY_TARGET_AVX512 inline typename V::Register LogAvx512(const typename V::Register& x)
+		{
+			using R = typename V::Register;
+			const typename V::Mask tiny = V::Less(x, V::Set(std::numeric_limits<float>::min()));
+			R exponent;
+			R m = V::Decompose(V::Select(tiny, V::Multiply(x, V::Set(8388608.0f)), x), exponent);
+			exponent = V::Select(tiny, V::Subtract(exponent, V::Set(23.0f)), exponent);
+			const typename V::Mask low = V::Less(m, V::Set(SQRT_HALF));
+			exponent = V::Select(low, V::Subtract(exponent, V::Set(1.0f)), exponent);
+			m = V::Subtract(V::Select(low, V::Add(m, m), m), V::Set(1.0f));
+
+			const R z = V::Multiply(m, m);
+			R p = V::Set(LOG_POLYNOMIAL[0]);
+			for (size_t i = 1; i < sizeof(LOG_POLYNOMIAL) / sizeof(float); ++i)
+			{
+				p = V::MultiplyAdd(p, m, V::Set(LOG_POLYNOMIAL[i]));
+			}
+			R y = V::Multiply(V::Multiply(p, m), z);
+			y = V::MultiplyAdd(exponent, V::Set(LN2_LOW), y);
+			y = V::MultiplyAdd(z, V::Set(-0.5f), y);
+			R result = V::MultiplyAdd(exponent, V::Set(LN2_HIGH), V::Add(m, y));
+
+			result = V::Select(V::Equal(x, V::Set(std::numeric_limits<float>::infinity())), x, result);
+			result = V::Select(V::Equal(x, V::Set(0.0f)), V::Set(-std::numeric_limits<float>::infinity()), result);
+			return V::Select(V::LessOrUnordered(x, V::Set(0.0f)), V::Set(std::numeric_limits<float>::quiet_NaN()), result);
+		}
+
+		template<typename V>
+		NUMPY_TARGET_AVX512 inline typename V::Register TanhAvx512(const typename V::Register& x)
+		{
+			using R = typename V::Register;
+			const R z = V::Multiply(x, x);
+			R p = V::Set(TANH_POLYNOMIAL[0]);
+			for (size_t i = 1; i < sizeof(TANH_POLYNOMIAL) / sizeof(float); ++i)
+			{
+				p = V::MultiplyAdd(p, z, V::Set(TANH_POLYNOMIAL[i]));
+			}
+			const R a = V::Abs(x);
+			const R small = V::MultiplyAdd(V::Multiply(p, z), a, a);
+
+			const R e = ExpAvx512<V>(V::Add(a, a));
+			const R large = V::Subtract(V::Set(1.0f), V::Divide(V::Set(2.0f), V::Add(e, V::Set(1.0f))));
+			return V::CopySign(V::Select(V::Less(a, V::Set(TANH_SMALL)), small, large), x);
+		}
+
+		template<typename V>
+		NUMPY_TARGET_AVX512 inline typename V::Register SigmoidAvx512(const typename V::Register& x)
+		{
+			const typename V::Register one = V::Set(1.0f);
+			return V::Divide(one, V::Add(one, ExpAvx512<V>(V::Negate(x))));
+		}
+
+		template<typename V>
+		NUMPY_TARGET_AVX512 inline typename V::Register ErfSmallAvx512(const typename V::Register& x)
+		{
+			using R = typename V::Register;
+			const R z = V::Multiply(x, x);
+			R p = V::Set(ERF_POLYNOMIAL[0]);
+			for (size_t i = 1; i < sizeof(ERF_POLYNOMIAL) / sizeof(float); ++i)
+			{
+				p = V::MultiplyAdd(p, z, V::Set(ERF_POLYNOMIAL[i]));
+			}
+			return V::Multiply(p, x);
+		}
+
+		template<typename V>
+		NUMPY_TARGET_AVX512 inline typename V::Register ErfcAvx512(const typename V::Register& a, const float& scale, const float& scaleSquare, const typename V::Register& factor)
+		{
+			using R = typename V::Register;
+			const R clamped = V::Minimum(V::Set(ERFC_MAX / scale), V::Maximum(V::Set(1.0f / scale), a));
+			const R q = V::Divide(V::Set(1.0f), V::Multiply(clamped, V::Set(scale)));
+			const R y = V::Multiply(q, q);
+			const typename V::Mask far = V::Less(q, V::Set(0.5f));
+			R p = V::Select(far, V::Set(ERFC_FAR_POLYNOMIAL[0]), V::Set(ERFC_NEAR_POLYNOMIAL[0]));
+			for (size_t i = 1; i < sizeof(ERFC_NEAR_POLYNOMIAL) / sizeof(float); ++i)
+			{
+				p = V::MultiplyAdd(p, y, V::Select(far, V::Set(ERFC_FAR_POLYNOMIAL[i]), V::Set(ERFC_NEAR_POLYNOMIAL[i])));
+			}
+
+			const R square = V::Multiply(clamped, clamped);
+			const R high = V::High(clamped);
+			const R low = V::Subtract(clamped, high);
+			const R error = V::MultiplyAdd(low, low, V::MultiplyAdd(V::Add(high, high), low, V::MultiplyAdd(high, high, V::Negate(square))));
+			const R e = V::Multiply(ExpAvx512<V>(V::Negate(V::Multiply(square, V::Set(scaleSquare)))), V::Subtract(V::Set(1.0f), V::Multiply(error, V::Set(scaleSquare))));
+			return V::Multiply(e, V::Multiply(V::Multiply(q, p), factor));
+		}
+
+		template<typename V>
+		NUMPY_TARGET_AVX512 inline typename V::Register ErfAvx512(const typename V::Register& x)
+		{
+			const typename V::Register a = V::Abs(x);
+			const typename V::Register large = V::CopySign(V::Subtract(V::Set(1.0f), ErfcAvx512<V>(a, 1.0f, 1.0f, V::Set(1.0f))), x);
+			return V::Select(V::Less(a, V::Set(1.0f)), ErfSmallAvx512<V>(x), large);
+		}
+
+		template<typename V>
+		NUMPY_TARGET_AVX512 inline typename V::Register GeluAvx512(const typename V::Register& x)
+		{
+			using R = typename V::Register;
+			const R half = V::Set(0.5f);
+			const R v = V::Multiply(x, V::Set(SQRT_HALF));
+			const R small = V::Multiply(V::Multiply(half, x), V::Add(V::Set(1.0f), ErfSmallAvx512<V>(v)));
+			const typename V::Mask negative = V::Less(x, V::Set(0.0f));
+			const R c = ErfcAvx512<V>(V::Abs(x), SQRT_HALF, 0.5f, V::Select(negative, V::Multiply(half, x), half));
+			const R large = V::Select(negative, c, V::Multiply(x, V::Subtract(V::Set(1.0f), c)));
+			return V::Select(V::Less(V::Abs(v), V::Set(1.0f)), small, large);
+		}
+
+		template<typename V, MathFunction F>
+		NUMPY_TARGET_AVX512 inline typename V::Register ApplyMathAvx512(const typename V::Register& x)
+		{
+			if constexpr (F == MathFunction::Exp)
+				return ExpAvx512<V>(x);
+			else if constexpr (F == MathFunction::Log)
+				return LogAvx512<V>(x);
+			else if constexpr (F == MathFunction::Tanh)
+				return TanhAvx512<V>(x);
+			else if constexpr (F == MathFunction::Sigmoid)
+				return SigmoidAvx512<V>(x);
+			else if constexpr (F == MathFunction::Erf)
+				return ErfAvx512<V>(x);
+			else
+				return GeluAvx512<V>(x);
+		}
+
+		// A tail shorter than a register goes through a padded copy, so every element sees the same code whatever its position.
+		template<MathFunction F>
+		NUMPY_TARGET_AVX2 void Avx2Math(const float* a, float* out, const size_t& size)
+		{
+			using V = Avx2MathRegister;
+			size_t i = 0;
+			for (; i + V::Width <= size; i += V::Width)
+			{
+				V::Store(out + i, ApplyMathAvx2<V, F>(V::Load(a + i)));
+			}
+			if (i < size)
+			{
+				float lanes[V::Width] = {};
+				std::copy(a + i, a + size, lanes);
+				V::Store(lanes, ApplyMathAvx2<V, F>(V::Load(lanes)));
+				std::copy(lanes, lanes + (size - i), out + i);
+			}
+		}
+
+		template<MathFunction F>
+		NUMPY_TARGET_AVX512 void Avx512Math(const float* a, float* out, const size_t& size)
+		{
+			using V = Avx512MathRegister;
+			size_t i = 0;
+			for (; i + V::Width <= size; i += V::Width)
+			{
+				V::Store(out + i, ApplyMathAvx512<V, F>(V::Load(a + i)));
+			}
+			if (i < size)
+			{
+				const __mmask16 mask = static_cast<__mmask16>((1u << (size - i)) - 1u);
+				V::Store(out + i, ApplyMathAvx512<V, F>(V::Load(a + i, mask, 0.0f)), mask);
+			}
+		}
+
+		// Softmax runs in two passes over u. The first keeps, per lane, the largest element seen and the sum of exp(u - largest),
+		// rescaling the sum whenever the largest grows; the second writes exp(u - max) / sum. Blocks of four registers share
+		// one rescale. Padding lanes read as -infinity and add exp(-infinity) = 0.
+		template<typename V>
+		NUMPY_TARGET_AVX2 inline typename V::Register SoftmaxExpAvx2(const typename V::Register& x)
+		{
+			const typename V::Register lowest = V::Set(SOFTMAX_MIN);
+			return V::Select(V::Less(x, lowest), V::Set(0.0f), ExpAvx2<V>(V::Maximum(lowest, x)));
+		}
+
+		NUMPY_TARGET_AVX2 inline void Avx2SoftmaxSum(const float* u, const size_t& size, float& maximum, float& sum)
+		{
+			using V = Avx2MathRegister;
+			using R = V::Register;
+			const float lowest = -std::numeric_limits<float>::infinity();
+			// Finite, so a lane that has only seen padding subtracts to -infinity rather than NaN.
+			R runningMax = V::Set(-std::numeric_limits<float>::max());
+			R runningSum = V::Set(0.0f);
+			size_t i = 0;
+			for (; i + 4 * V::Width <= size; i += 4 * V::Width)
+			{
+				const R x0 = V::Load(u + i);
+				const R x1 = V::Load(u + i + V::Width);
+				const R x2 = V::Load(u + i + 2 * V::Width);
+				const R x3 = V::Load(u + i + 3 * V::Width);
+				const R blockMax = V::Maximum(V::Maximum(x0, x1), V::Maximum(x2, x3));
+				const R nextMax = V::Maximum(runningMax, blockMax);
+				R terms = V::Add(SoftmaxExpAvx2<V>(V::Subtract(x0, nextMax)), SoftmaxExpAvx2<V>(V::Subtract(x1, nextMax)));
+				terms = V::Add(terms, V::Add(SoftmaxExpAvx2<V>(V::Subtract(x2, nextMax)), SoftmaxExpAvx2<V>(V::Subtract(x3, nextMax))));
+				runningSum = V::MultiplyAdd(runningSum, SoftmaxExpAvx2<V>(V::Subtract(runningMax, nextMax)), terms);
+				runningMax = nextMax;
+			}
+			for (; i < size; i += V::Width)
+			{
+				float lanes[V::Width];
+				std::fill(lanes, lanes + V::Width, lowest);
+				std::copy(u + i, u + std::min(size, i + V::Width), lanes);
+				const R x = V::Load(lanes);
+				const R nextMax = V::Maximum(runningMax, x);
+				runningSum = V::MultiplyAdd(runningSum, SoftmaxExpAvx2<V>(V::Subtract(runningMax, nextMax)), SoftmaxExpAvx2<V>(V::Subtract(x, nextMax)));
+				runningMax = nextMax;
+			}
+
+			float maxLanes[V::Width];
+			V::Store(maxLanes, runningMax);
+			maximum = maxLanes[0];
+			for (size_t l = 1; l < V::Width; ++l)
+			{
+				maximum = std::max(maximum, maxLanes[l]);
+			}
+			float sumLanes[V::Width];
+			V::Store(sumLanes, V::Multiply(runningSum, SoftmaxExpAvx2<V>(V::Subtract(runningMax, V::Set(maximum)))));
+			sum = sumLanes[0];
+			for (size_t l = 1; l < V::Width; ++l)
+			{
+				sum += sumLanes[l];
+			}
+		}
+
+		NUMPY_TARGET_AVX2 inline void Avx2SoftmaxWrite(const float* u, float* out, const size_t& size, const float& maximum, const float& scale)
+		{
+			using V = Avx2MathRegister;
+			const V::Register max = V::Set(maximum);
+			const V::Register factor = V::Set(scale);
+			size_t i = 0;
+			for (; i + V::Width <= size; i += V::Width)
+			{
+				V::Store(out + i, V::Multiply(SoftmaxExpAvx2<V>(V::Subtract(V::Load(u + i), max)), factor));
+			}
+			if (i < size)
+			{
+				float lanes[V::Width] = {};
+				std::copy(u + i, u + size, lanes);
+				V::Store(lanes, V::Multiply(SoftmaxExpAvx2<V>(V::Subtract(V::Load(lanes), max)), factor));
+				std::copy(lanes, lanes + (size - i), out + i);
+			}
+		}
+
+		template<typename V>
+		NUMPY_TARGET_AVX512 inline typename V::Register SoftmaxExpAvx512(const typename V::Register& x)
+		{
+			const typename V::Register lowest = V::Set(SOFTMAX_MIN);
+			return V::Select(V::Less(x, lowest), V::Set(0.0f), ExpAvx512<V>(V::Maximum(lowest, x)));
+		}
+
+		NUMPY_TARGET_AVX512 inline void Avx512SoftmaxSum(const float* u, const size_t& size, float& maximum, float& sum)
+		{
+			using V = Avx512MathRegister;
+			using R = V::Register;
+			const float lowest = -std::numeric_limits<float>::infinity();
+			// Finite, so a lane that has only seen padding subtracts to -infinity rather than NaN.
+			R runningMax = V::Set(-std::numeric_limits<float>::max());
+			R runningSum = V::Set(0.0f);
+			size_t i = 0;
+			for (; i + 4 * V::Width <= size; i += 4 * V::Width)
+			{
+				const R x0 = V::Load(u + i);
+				const R x1 = V::Load(u + i + V::Width);
+				const R x2 = V::Load(u + i + 2 * V::Width);
+				const R x3 = V::Load(u + i + 3 * V::Width);
+				const R blockMax = V::Maximum(V::Maximum(x0, x1), V::Maximum(x2, x3));
+				const R nextMax = V::Maximum(runningMax, blockMax);
+				R terms = V::Add(SoftmaxExpAvx512<V>(V::Subtract(x0, nextMax)), SoftmaxExpAvx512<V>(V::Subtract(x1, nextMax)));
+				terms = V::Add(terms, V::Add(SoftmaxExpAvx512<V>(V::Subtract(x2, nextMax)), SoftmaxExpAvx512<V>(V::Subtract(x3, nextMax))));
+				runningSum = V::MultiplyAdd(runningSum, SoftmaxExpAvx512<V>(V::Subtract(runningMax, nextMax)), terms);
+				runningMax = nextMax;
+			}
+			for (; i < size; i += V::Width)
+			{
+				const __mmask16 mask = size - i >= V::Width ? static_cast<__mmask16>(0xFFFFu) : static_cast<__mmask16>((1u << (size - i)) - 1u);
+				const R x = V::Load(u + i, mask, lowest);
+				const R nextMax = V::Maximum(runningMax, x);
+				runningSum = V::MultiplyAdd(runningSum, SoftmaxExpAvx512<V>(V::Subtract(runningMax, nextMax)), SoftmaxExpAvx512<V>(V::Subtract(x, nextMax)));
+				runningMax = nextMax;
+			}
+
+			maximum = _mm512_reduce_max_ps(runningMax);
+			sum = _mm512_reduce_add_ps(V::Multiply(runningSum, SoftmaxExpAvx512<V>(V::Subtract(runningMax, V::Set(maximum)))));
+		}
+
+		NUMPY_TARGET_AVX512 inline void Avx512SoftmaxWrite(const float* u, float* out, const size_t& size, const float& maximum, const float& scale)
+		{
+			using V = Avx512MathRegister;
+			const V::Register max = V::Set(maximum);
+			const V::Register factor = V::Set(scale);
+			size_t i = 0;
+			for (; i + V::Width <= size; i += V::Width)
+			{
+				V::Store(out + i, V::Multiply(SoftmaxExpAvx512<V>(V::Subtract(V::Load(u + i), max)), factor));
+			}
+			if (i < size)
+			{
+				const __mmask16 mask = static_cast<__mmask16>((1u << (size - i)) - 1u);
+				V::Store(out + i, V::Multiply(SoftmaxExpAvx512<V>(V::Subtract(V::Load(u + i, mask, 0.0f), max)), factor), mask);
+			}
+		}
+#endif
+
+		// The scalar path evaluates in double, so float results are correctly rounded but for rare double rounding.
+		template<MathFunction F, typename T>
+		inline T ApplyMath(const T& a)
+		{
+			const double x = static_cast<double>(a);
+			if constexpr (F == MathFunction::Exp)
+				return static_cast<T>(std::exp(x));
+			else if constexpr (F == MathFunction::Log)
+				return static_cast<T>(std::log(x));
+			else if constexpr (F == MathFunction::Tanh)
+				return static_cast<T>(std::tanh(x));
+			else if constexpr (F == MathFunction::Sigmoid)
+				return static_cast<T>(1 / (1 + std::exp(-x)));
+			else if constexpr (F == MathFunction::Erf)
+				return static_cast<T>(std::erf(x));
+			else
+				return static_cast<T>(x * std::erfc(-x * 0.70710678118654752440) / 2);
+		}
+	}
+
+	// Contiguous transcendental kernels. float dispatches on Simd::GetLevel() to polynomial approximations at the AVX2 and
+	// AVX-512 levels; below that, and for every other type, the <cmath> functions are evaluated in double. out may be a. Largest errors of the
+	// float kernels at either level, measured against double over every 16411th float bit pattern in their domain, in units
+	// in the last place of the result (results below FLT_MIN, which are denormal, excepted):
+	//   Exp      1.0  (x in [-104, 89])
+	//   Log      0.8
+	//   Tanh     1.1
+	//   Sigmoid  2.0
+	//   Erf      2.5
+	//   Gelu     13 for x in [-1.42, -0.7], where 1 + erf(x / sqrt(2)) cancels, and 4 elsewhere above -14
+	template<typename T>
+	class MathKernel final
+	{
+	public:
+		MathKernel() = delete;
+		~MathKernel() = delete;
+
+		static void Exp(const T* a, T* out, const size_t& size);
+		static void Log(const T* a, T* out, const size_t& size);
+		static void Tanh(const T* a, T* out, const size_t& size);
+		static void Sigmoid(const T* a, T* out, const size_t& size);
+		static void Erf(const T* a, T* out, const size_t& size);
+		// x Phi(x) with the exact (erf) form, not the tanh approximation.
+		static void Gelu(const T* a, T* out, const size_t& size);
+		template<MathFunction F>
+		static void Apply(const T* a, T* out, const size_t& size);
+
+		// out = exp(u - max(u)) / sum(exp(u - max(u))) for size > 0; out may be u. Returns log(sum(exp(u))), the log-sum-exp,
+		// so a cross-entropy needs no second pass over out. Every path reads u twice and writes out once.
+		static T Softmax(const T* u, T* out, const size_t& size);
+		// First pass of Softmax alone.
+		static T LogSumExp(const T* u, const size_t& size);
+
+		static constexpr bool IS_VECTORIZED = std::is_same<T, float>::value;
+	private:
+		// Largest element and sum of exp(u - max).
+		static void softmaxSum(const T* u, const size_t& size, T& maximum, T& sum);
+	};
+
+	template<typename T>
+	inline void MathKernel<T>::Exp(const T* a, T* out, const size_t& size)
+	{
+		Apply<MathFunction::Exp>(a, out, size);
+	}
+
+	template<typename T>
+	inline void MathKernel<T>::Log(const T* a, T* out, const size_t& size)
+	{
+		Apply<MathFunction::Log>(a, out, size);
+	}
+
+	template<typename T>
+	inline void MathKernel<T>::Tanh(const T* a, T* out, const size_t& size)
+	{
+		Apply<MathFunction::Tanh>(a, out, size);
+	}
+
+	template<typename T>
+	inline void MathKernel<T>::Sigmoid(const T* a, T* out, const size_t& size)
+	{
+		Apply<MathFunction::Sigmoid>(a, out, size);
+	}
+
+	template<typename T>
+	inline void MathKernel<T>::Erf(const T* a, T* out, const size_t& size)
+	{
+		Apply<MathFunction::Erf>(a, out, size);
+	}
+
+	template<typename T>
+	inline void MathKernel<T>::Gelu(const T* a, T* out, const size_t& size)
+	{
+		Apply<MathFunction::Gelu>(a, out, size);
+	}
+
+	template<typename T>
+	template<MathFunction F>
+	void MathKernel<T>::Apply(const T* a, T* out, const size_t& size)
+	{
+#if NUMPY_SIMD_X86
+		if constexpr (IS_VECTORIZED)
+		{
+			switch (Simd::GetLevel())
+			{
+			case SimdLevel::AVX512:
+				simd::Avx512Math<F>(a, out, size);
+				return;
+			case SimdLevel::AVX2:
+				simd::Avx2Math<F>(a, out, size);
+				return;
+			default:
+				break;
+			}
+		}
+#endif
+		for (size_t i = 0; i < size; ++i)
+		{
+			out[i] = simd::ApplyMath<F>(a[i]);
+		}
+	}
+
+	template<typename T>
+	T MathKernel<T>::Softmax(const T* u, T* out, const size_t& size)
+	{
+		T maximum;
+		T sum;
+		softmaxSum(u, size, maximum, sum);
+		const T scale = static_cast<T>(1) / sum;
+#if NUMPY_SIMD_X86
+		if constexpr (IS_VECTORIZED)
+		{
+			switch (Simd::GetLevel())
+			{
+			case SimdLevel::AVX512:
+				simd::Avx512SoftmaxWrite(u, out, size, maximum, scale);
+				return static_cast<T>(maximum + std::log(sum));
+			case SimdLevel::AVX2:
+				simd::Avx2SoftmaxWrite(u, out, size, maximum, scale);
+				return static_cast<T>(maximum + std::log(sum));
+			default:
+				break;
+			}
+		}
+#endif
+		for (size_t i = 0; i < size; ++i)
+		{
+			out[i] = static_cast<T>(std::exp(u[i] - maximum) * scale);
+		}
+		return static_cast<T>(maximum + std::log(sum));
+	}
+
+	template<typename T>
+	inline T MathKernel<T>::LogSumExp(const T* u, const size_t& size)
+	{
+		T maximum;
+		T sum;
+		softmaxSum(u, size, maximum, sum);
+		return static_cast<T>(maximum + std::log(sum));
+	}
+
+	template<typename T>
+	void MathKernel<T>::softmaxSum(const T* u, const size_t& size, T& maximum, T& sum)
+	{
+#if NUMPY_SIMD_X86
+		if constexpr (IS_VECTORIZED)
+		{
+			switch (Simd::GetLevel())
+			{
+			case SimdLevel::AVX512:
+				simd::Avx512SoftmaxSum(u, size, maximum, sum);
+				return;
+			case SimdLevel::AVX2:
+				simd::Avx2SoftmaxSum(u, size, maximum, sum);
+				return;
+			default:
+				break;
+			}
+		}
+#endif
+		// One pass, like the vector paths: the running sum is rescaled whenever the maximum grows.
+		maximum = u[0];
+		sum = static_cast<T>(1);
+		for (size_t i = 1; i < size; ++i)
+		{
+			if (u[i] > maximum)
+			{
+				sum = static_cast<T>(sum * std::exp(maximum - u[i]) + 1);
+				maximum = u[i];
+			}
+			else
+			{
+				sum += static_cast<T>(std::exp(u[i] - maximum));
+			}
+		}
+	}
+}
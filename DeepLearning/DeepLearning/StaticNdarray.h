@@ -0,0 +1,385 @@
+#pragma once
+#include<algorithm>
+#include<cstddef>
+#include<initializer_list>
+#include<memory>
+#include<utility>
+#include "Ndarray.h"
+
+namespace numpy
+{
+	// Array whose shape is part of its type, for small layers where Ndarray's runtime shape and loop bounds cost more than the
+	// arithmetic. Elements live inline (on the stack or in the owning object), shapes are checked when the code is compiled,
+	// and the kernels below are unrolled over the compile-time extents.
+	template<typename T, size_t... Dims>
+	class StaticNdarray final
+	{
+	public:
+		static_assert(sizeof...(Dims) > 0, "StaticNdarray needs at least one axis");
+		static_assert(((Dims > 0) && ...), "StaticNdarray axes must not be empty");
+
+		static constexpr unsigned int DIMENSION = sizeof...(Dims);
+		static constexpr size_t TOTAL_SIZE = (Dims * ...);
+		static constexpr size_t ARRAY_SIZE[DIMENSION] = { Dims... };
+		// Element-wise kernels are unrolled completely up to this many elements; larger arrays use a loop with constant bounds.
+		static constexpr size_t UNROLL_LIMIT = 256;
+
+		StaticNdarray();
+		explicit StaticNdarray(const T& value);
+		// Elements in row-major order; missing trailing elements are 0.
+		StaticNdarray(const std::initializer_list<T>& values);
+
+		T& At(const size_t& index);
+		const T& At(const size_t& index) const;
+		T* GetData();
+		const T* GetData() const;
+		static constexpr unsigned int GetDimension() { return DIMENSION; }
+		static constexpr size_t GetTotalSize() { return TOTAL_SIZE; }
+		static constexpr size_t GetArraySize(const unsigned int& axis) { return ARRAY_SIZE[axis]; }
+
+		// Compact Ndarray over this array's elements without copying; writes through it change this array, which has to
+		// outlive the view. A const array has no view, since Ndarray cannot be made read-only; Copy gives its elements instead.
+		Ndarray<T> View();
+		Ndarray<T> Copy() const;
+		// Copies source in when it has this shape (any layout); false and unchanged otherwise.
+		bool Assign(const Ndarray<T>& source);
+
+		StaticNdarray<T, Dims...>& operator+=(const StaticNdarray<T, Dims...>& rhs);
+		StaticNdarray<T, Dims...>& operator-=(const StaticNdarray<T, Dims...>& rhs);
+		StaticNdarray<T, Dims...>& operator*=(const StaticNdarray<T, Dims...>& rhs);
+		StaticNdarray<T, Dims...>& operator*=(const T& rhs);
+		StaticNdarray<T, Dims...> operator+(const StaticNdarray<T, Dims...>& rhs) const;
+		StaticNdarray<T, Dims...> operator-(const StaticNdarray<T, Dims...>& rhs) const;
+		StaticNdarray<T, Dims...> operator*(const StaticNdarray<T, Dims...>& rhs) const;
+		StaticNdarray<T, Dims...> operator*(const T& rhs) const;
+		// Adds a 1-D array along the last axis, as NumPy broadcasting of a bias row.
+		template<size_t Columns>
+		StaticNdarray<T, Dims...> operator+(const StaticNdarray<T, Columns>& row) const;
+		bool operator==(const StaticNdarray<T, Dims...>& rhs) const;
+		bool operator!=(const StaticNdarray<T, Dims...>& rhs) const;
+
+		template<typename Op>
+		void Apply(const Op& op);
+	private:
+		template<typename Op, size_t... I>
+		void apply(const Op& op, std::index_sequence<I...>);
+
+		alignas(64) T mArray[TOTAL_SIZE];
+	};
+
+	// Fixed-shape counterparts of the Numpy operations, resolved and shape-checked at compile time.
+	template<typename T>
+	class StaticNumpy final
+	{
+	public:
+		StaticNumpy() = delete;
+		~StaticNumpy() = delete;
+
+		template<size_t M, size_t K, size_t L, size_t N>
+		static StaticNdarray<T, M, N> Dot(const StaticNdarray<T, M, K>& a, const StaticNdarray<T, L, N>& b);
+		// a . b + bias, then ReLU when bRelu, with the epilogue applied to each result block while it is still in registers.
+		template<size_t M, size_t K, size_t L, size_t N, size_t C>
+		static StaticNdarray<T, M, N> Dot(const StaticNdarray<T, M, K>& a, const StaticNdarray<T, L, N>& b, const StaticNdarray<T, C>& bias,
+			const bool& bRelu);
+		template<size_t M, size_t N>
+		static StaticNdarray<T, N, M> Transpose(const StaticNdarray<T, M, N>& a);
+		template<size_t... Dims>
+		static StaticNdarray<T, Dims...> Maximum(const StaticNdarray<T, Dims...>& a, const T& b);
+
+		// Dot works on TILE_ROWS x TILE_COLUMNS blocks of the result, sized like Gemm's micro-kernel so the block stays in registers.
+		static constexpr size_t TILE_ROWS = 4;
+		static constexpr size_t TILE_COLUMNS = 16;
+	private:
+		template<size_t M, size_t K, size_t N>
+		static void dot(const T* a, const T* b, T* c, const T* bias, const bool& bRelu);
+		template<size_t Rows, size_t K, size_t N>
+		static void rowBlock(const T* a, const T* b, T* c, const T* bias, const bool& bRelu);
+		template<size_t Rows, size_t Columns, size_t K, size_t N>
+		static void tile(const T* a, const T* b, T* c, const T* bias, const bool& bRelu);
+	};
+
+	template<typename T, size_t... Dims>
+	inline StaticNdarray<T, Dims...>::StaticNdarray()
+		: mArray{}
+	{
+	}
+
+	template<typename T, size_t... Dims>
+	inline StaticNdarray<T, Dims...>::StaticNdarray(const T& value)
+	{
+		std::fill(mArray, mArray + TOTAL_SIZE, value);
+	}
+
+	template<typename T, size_t... Dims>
+	inline StaticNdarray<T, Dims...>::StaticNdarray(const std::initializer_list<T>& values)
+		: mArray{}
+	{
+		std::copy(values.begin(), values.begin() + std::min(values.size(), TOTAL_SIZE), mArray);
+	}
+
+	template<typename T, size_t... Dims>
+	inline T& StaticNdarray<T, Dims...>::At(const size_t& index)
+	{
+		assert(index < TOTAL_SIZE);
+		return mArray[index];
+	}
+
+	template<typename T, size_t... Dims>
+	inline const T& StaticNdarray<T, Dims...>::At(const size_t& index) const
+	{
+		assert(index < TOTAL_SIZE);
+		return mArray[index];
+	}
+
+	template<typename T, size_t... Dims>
+	inline T* StaticNdarray<T, Dims...>::GetData()
+	{
+		return mArray;
+	}
+
+	template<typename T, size_t... Dims>
+	inline const T* StaticNdarray<T, Dims...>::GetData() const
+	{
+		return mArray;
+	}
+
+	template<typename T, size_t... Dims>
+	inline Ndarray<T> StaticNdarray<T, Dims...>::View()
+	{
+		// Aliasing constructor with an empty owner: the view points at mArray and never frees it.
+		return Ndarray<T>(std::shared_ptr<T[]>(std::shared_ptr<T[]>(), mArray), DIMENSION, ARRAY_SIZE);
+	}
+
+	template<typename T, size_t... Dims>
+	inline Ndarray<T> StaticNdarray<T, Dims...>::Copy() const
+	{
+		std::shared_ptr<T[]> storage = Allocator::AllocateShared<T>(TOTAL_SIZE);
+		std::copy(mArray, mArray + TOTAL_SIZE, storage.get());
+		return Ndarray<T>(storage, DIMENSION, ARRAY_SIZE);
+	}
+
+	template<typename T, size_t... Dims>
+	bool StaticNdarray<T, Dims...>::Assign(const Ndarray<T>& source)
+	{
+		if (source.GetDimension() != DIMENSION)
+			return false;
+		for (unsigned int i = 0; i < DIMENSION; ++i)
+			if (source.GetArraySize(i) != ARRAY_SIZE[i])
+				return false;
+
+		source.EvaluateTo(mArray);
+		return true;
+	}
+
+	template<typename T, size_t... Dims>
+	template<typename Op>
+	inline void StaticNdarray<T, Dims...>::Apply(const Op& op)
+	{
+		if constexpr (TOTAL_SIZE <= UNROLL_LIMIT)
+		{
+			apply(op, std::make_index_sequence<TOTAL_SIZE>());
+		}
+		else
+		{
+			for (size_t i = 0; i < TOTAL_SIZE; ++i)
+			{
+				op(i);
+			}
+		}
+	}
+
+	template<typename T, size_t... Dims>
+	template<typename Op, size_t... I>
+	inline void StaticNdarray<T, Dims...>::apply(const Op& op, std::index_sequence<I...>)
+	{
+		(op(I), ...);
+	}
+
+	template<typename T, size_t... Dims>
+	inline StaticNdarray<T, Dims...>& StaticNdarray<T, Dims...>::operator+=(const StaticNdarray<T, Dims...>& rhs)
+	{
+		Apply([this, &rhs](const size_t& i) { mArray[i] += rhs.mArray[i]; });
+		return *this;
+	}
+
+	template<typename T, size_t... Dims>
+	inline StaticNdarray<T, Dims...>& StaticNdarray<T, Dims...>::operator-=(const StaticNdarray<T, Dims...>& rhs)
+	{
+		Apply([this, &rhs](const size_t& i) { mArray[i] -= rhs.mArray[i]; });
+		return *this;
+	}
+
+	template<typename T, size_t... Dims>
+	inline StaticNdarray<T, Dims...>& StaticNdarray<T, Dims...>::operator*=(const StaticNdarray<T, Dims...>& rhs)
+	{
+		Apply([this, &rhs](const size_t& i) { mArray[i] *= rhs.mArray[i]; });
+		return *this;
+	}
+
+	template<typename T, size_t... Dims>
+	inline StaticNdarray<T, Dims...>& StaticNdarray<T, Dims...>::operator*=(const T& rhs)
+	{
+		Apply([this, rhs](const size_t& i) { mArray[i] *= rhs; });
+		return *this;
+	}
+
+	template<typename T, size_t... Dims>
+	inline StaticNdarray<T, Dims...> StaticNdarray<T, Dims...>::operator+(const StaticNdarray<T, Dims...>& rhs) const
+	{
+		StaticNdarray<T, Dims...> result(*this);
+		return result += rhs;
+	}
+
+	template<typename T, size_t... Dims>
+	inline StaticNdarray<T, Dims...> StaticNdarray<T, Dims...>::operator-(const StaticNdarray<T, Dims...>& rhs) const
+	{
+		StaticNdarray<T, Dims...> result(*this);
+		return result -= rhs;
+	}
+
+	template<typename T, size_t... Dims>
+	inline StaticNdarray<T, Dims...> StaticNdarray<T, Dims...>::operator*(const StaticNdarray<T, Dims...>& rhs) const
+	{
+		StaticNdarray<T, Dims...> result(*this);
+		return result *= rhs;
+	}
+
+	template<typename T, size_t... Dims>
+	inline StaticNdarray<T, Dims...> StaticNdarray<T, Dims...>::operator*(const T& rhs) const
+	{
+		StaticNdarray<T, Dims...> result(*this);
+		return result *= rhs;
+	}
+
+	template<typename T, size_t... Dims>
+	template<size_t Columns>
+	inline StaticNdarray<T, Dims...> StaticNdarray<T, Dims...>::operator+(const StaticNdarray<T, Columns>& row) const
+	{
+		static_assert(Columns == ARRAY_SIZE[DIMENSION - 1], "broadcast row length must match the last axis");
+
+		StaticNdarray<T, Dims...> result(*this);
+		const T* data = row.GetData();
+		result.Apply([&result, data](const size_t& i) { result.mArray[i] += data[i % Columns]; });
+		return result;
+	}
+
+	template<typename T, size_t... Dims>
+	inline bool StaticNdarray<T, Dims...>::operator==(const StaticNdarray<T, Dims...>& rhs) const
+	{
+		return std::equal(mArray, mArray + TOTAL_SIZE, rhs.mArray);
+	}
+
+	template<typename T, size_t... Dims>
+	inline bool StaticNdarray<T, Dims...>::operator!=(const StaticNdarray<T, Dims...>& rhs) const
+	{
+		return !(*this == rhs);
+	}
+
+	template<typename T>
+	template<size_t M, size_t K, size_t L, size_t N>
+	inline StaticNdarray<T, M, N> StaticNumpy<T>::Dot(const StaticNdarray<T, M, K>& a, const StaticNdarray<T, L, N>& b)
+	{
+		static_assert(K == L, "Dot: columns of a must match rows of b");
+
+		StaticNdarray<T, M, N> result;
+		dot<M, K, N>(a.GetData(), b.GetData(), result.GetData(), nullptr, false);
+		return result;
+	}
+
+	template<typename T>
+	template<size_t M, size_t K, size_t L, size_t N, size_t C>
+	inline StaticNdarray<T, M, N> StaticNumpy<T>::Dot(const StaticNdarray<T, M, K>& a, const StaticNdarray<T, L, N>& b,
+		const StaticNdarray<T, C>& bias, const bool& bRelu)
+	{
+		static_assert(K == L, "Dot: columns of a must match rows of b");
+		static_assert(C == N, "Dot: bias length must match the columns of the result");
+
+		StaticNdarray<T, M, N> result;
+		dot<M, K, N>(a.GetData(), b.GetData(), result.GetData(), bias.GetData(), bRelu);
+		return result;
+	}
+
+	template<typename T>
+	template<size_t M, size_t K, size_t N>
+	inline void StaticNumpy<T>::dot(const T* a, const T* b, T* c, const T* bias, const bool& bRelu)
+	{
+		for (size_t i = 0; i + TILE_ROWS <= M; i += TILE_ROWS)
+		{
+			rowBlock<TILE_ROWS, K, N>(a + i * K, b, c + i * N, bias, bRelu);
+		}
+		if constexpr (M % TILE_ROWS != 0)
+		{
+			rowBlock<M % TILE_ROWS, K, N>(a + M / TILE_ROWS * TILE_ROWS * K, b, c + M / TILE_ROWS * TILE_ROWS * N, bias, bRelu);
+		}
+	}
+
+	template<typename T>
+	template<size_t Rows, size_t K, size_t N>
+	inline void StaticNumpy<T>::rowBlock(const T* a, const T* b, T* c, const T* bias, const bool& bRelu)
+	{
+		for (size_t j = 0; j + TILE_COLUMNS <= N; j += TILE_COLUMNS)
+		{
+			tile<Rows, TILE_COLUMNS, K, N>(a, b + j, c + j, bias == nullptr ? nullptr : bias + j, bRelu);
+		}
+		if constexpr (N % TILE_COLUMNS != 0)
+		{
+			constexpr size_t j = N / TILE_COLUMNS * TILE_COLUMNS;
+			tile<Rows, N % TILE_COLUMNS, K, N>(a, b + j, c + j, bias == nullptr ? nullptr : bias + j, bRelu);
+		}
+	}
+
+	// Rows x Columns block of c = a . b: every trip count is a constant, so the accumulators are unrolled into registers and each
+	// b row is loaded once per block. Bias and ReLU are applied before the single store.
+	template<typename T>
+	template<size_t Rows, size_t Columns, size_t K, size_t N>
+	inline void StaticNumpy<T>::tile(const T* a, const T* b, T* c, const T* bias, const bool& bRelu)
+	{
+		T accumulator[Rows][Columns] = {};
+		for (size_t p = 0; p < K; ++p)
+		{
+			const T* bRow = b + p * N;
+			for (size_t i = 0; i < Rows; ++i)
+			{
+				const T value = a[i * K + p];
+				for (size_t j = 0; j < Columns; ++j)
+				{
+					accumulator[i][j] += value * bRow[j];
+				}
+			}
+		}
+
+		for (size_t i = 0; i < Rows; ++i)
+		{
+			for (size_t j = 0; j < Columns; ++j)
+			{
+				T value = accumulator[i][j] + (bias != nullptr ? bias[j] : static_cast<T>(0));
+				c[i * N + j] = bRelu && value < 0 ? static_cast<T>(0) : value;
+			}
+		}
+	}
+
+	template<typename T>
+	template<size_t M, size_t N>
+	inline StaticNdarray<T, N, M> StaticNumpy<T>::Transpose(const StaticNdarray<T, M, N>& a)
+	{
+		StaticNdarray<T, N, M> result;
+		for (size_t i = 0; i < M; ++i)
+		{
+			for (size_t j = 0; j < N; ++j)
+			{
+				result.At(j * M + i) = a.At(i * N + j);
+			}
+		}
+		return result;
+	}
+
+	template<typename T>
+	template<size_t... Dims>
+	inline StaticNdarray<T, Dims...> StaticNumpy<T>::Maximum(const StaticNdarray<T, Dims...>& a, const T& b)
+	{
+		StaticNdarray<T, Dims...> result(a);
+		T* data = result.GetData();
+		result.Apply([data, b](const size_t& i) { data[i] = data[i] < b ? b : data[i]; });
+		return result;
+	}
+}
@@ -0,0 +1,503 @@
+#pragma once
+#include<algorithm>
+#include<atomic>
+#include<condition_variable>
+#include<cstdlib>
+#include<fstream>
+#include<limits>
+#include<memory>
+#include<mutex>
+#include<string>
+#include<thread>
+#include<vector>
+#include "Profiler.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include<windows.h>
+#else
+#include<pthread.h>
+#include<sched.h>
+#endif
+
+namespace numpy
+{
+	// Work-stealing scheduler shared by every parallel kernel. A ParallelFor is cut into chunks of grain iterations, and each
+	// worker's deque receives a contiguous run of them, which the worker takes from the front; a thread that runs dry steals from
+	// the back of the others, so uneven chunks balance out without a shared counter to contend on. The calling thread works too,
+	// from a deque of its own, and several threads may run ParallelFor at once. A calling thread only runs chunks of its own
+	// job while it waits, since another job's chunk could reuse the thread-local buffers its own job is still reading.
+	//
+	// The thread count comes from NUMPY_NUM_THREADS, else the number of hardware threads, and can be changed with
+	// SetThreadCount. With NUMPY_PIN_THREADS=1 or SetAffinity(true), workers are pinned to one CPU each, filling one NUMA node
+	// before moving to the next so that neighbouring chunks share a memory controller.
+	class ThreadPool final
+	{
+	public:
+		ThreadPool(const ThreadPool& rhs) = delete;
+		ThreadPool& operator=(const ThreadPool& rhs) = delete;
+		~ThreadPool();
+
+		static ThreadPool& Instance();
+
+		unsigned int GetThreadCount() const;
+		bool IsPinned() const;
+		// Both restart the workers and must not be called while a ParallelFor is running. 0 restores the default count.
+		void SetThreadCount(const unsigned int& threadCount);
+		void SetAffinity(const bool& bPin);
+
+		// Runs task(0) ... task(count - 1) on the workers and the calling thread, and returns when all are done.
+		template<typename Function>
+		void ParallelFor(const unsigned int& count, const Function& task);
+		// Runs body(begin, end) over [0, count) in chunks of grain iterations (the last one shorter). Calls from inside a task
+		// run inline. The body is called through a pointer rather than copied into a std::function, so submitting work does not
+		// allocate once the deques have grown to the largest job.
+		template<typename Function>
+		void ParallelFor(const size_t& count, const size_t& grain, const Function& body);
+	private:
+		using Invoker = void (*)(const void*, size_t, size_t);
+
+		struct Job
+		{
+			const void* Body;
+			Invoker Invoke;
+			std::atomic<size_t> Remaining;
+			// Index in the callers' deque of the caller's next chunk. Its chunks there are contiguous, taken from the front by
+			// the caller and stolen from the back by workers, so the index stays valid while the task at it is the job's own.
+			size_t Next;
+		};
+
+		struct Task
+		{
+			Job* Owner;
+			size_t Begin;
+			size_t End;
+		};
+
+		// Tasks[Head, end) are queued; the vector is only cleared once drained, so its capacity is reused by the next job. A
+		// caller taking its chunk from behind another caller's leaves a task with no owner in its place rather than shifting
+		// the vector; Trim drops those once they reach either end.
+		struct alignas(64) Queue
+		{
+			std::mutex Mutex;
+			std::vector<Task> Tasks;
+			size_t Head = 0;
+
+			bool IsEmpty() const { return Head == Tasks.size(); }
+			void Trim()
+			{
+				while (Head < Tasks.size() && Tasks[Head].Owner == nullptr)
+				{
+					++Head;
+				}
+				while (Head < Tasks.size() && Tasks.back().Owner == nullptr)
+				{
+					Tasks.pop_back();
+				}
+				if (IsEmpty())
+				{
+					Tasks.clear();
+					Head = 0;
+				}
+			}
+		};
+
+		ThreadPool();
+
+		void parallelFor(const size_t& count, const size_t& grain, const void* body, const Invoker& invoke);
+		void start(const unsigned int& threadCount);
+		void stop();
+		void workerLoop(const unsigned int& index);
+		bool pop(const unsigned int& queue, Task& task);
+		bool steal(const unsigned int& thief, Task& task);
+		bool take(Job& job, Task& task);
+		void run(const Task& task);
+		static std::vector<unsigned int> cpuOrder();
+		static void pin(const unsigned int& cpu);
+		static unsigned int defaultThreadCount();
+
+		std::vector<std::thread> mWorkers;
+		// One deque per worker, and a last one for the threads calling ParallelFor.
+		std::vector<std::unique_ptr<Queue>> mQueues;
+		std::atomic<size_t> mPending;
+		std::atomic<unsigned int> mSleepers;
+		std::mutex mMutex;
+		std::condition_variable mWakeCondition;
+		std::condition_variable mDoneCondition;
+		bool mbStop;
+		bool mbPinned;
+
+		static thread_local bool sbInsidePool;
+	};
+
+	inline thread_local bool ThreadPool::sbInsidePool = false;
+
+	inline ThreadPool::ThreadPool()
+		: mPending(0)
+		, mSleepers(0)
+		, mbStop(false)
+	{
+		const char* pin = std::getenv("NUMPY_PIN_THREADS");
+		mbPinned = pin != nullptr && std::atoi(pin) != 0;
+		start(defaultThreadCount());
+	}
+
+	inline ThreadPool::~ThreadPool()
+	{
+		stop();
+	}
+
+	inline ThreadPool& ThreadPool::Instance()
+	{
+		static ThreadPool instance;
+		return instance;
+	}
+
+	inline unsigned int ThreadPool::GetThreadCount() const
+	{
+		return static_cast<unsigned int>(mWorkers.size()) + 1u;
+	}
+
+	inline bool ThreadPool::IsPinned() const
+	{
+		return mbPinned;
+	}
+
+	inline void ThreadPool::SetThreadCount(const unsigned int& threadCount)
+	{
+		stop();
+		start(threadCount == 0 ? defaultThreadCount() : threadCount);
+	}
+
+	inline void ThreadPool::SetAffinity(const bool& bPin)
+	{
+		const unsigned int threadCount = GetThreadCount();
+		stop();
+		mbPinned = bPin;
+		start(threadCount);
+	}
+
+	template<typename Function>
+	inline void ThreadPool::ParallelFor(const unsigned int& count, const Function& task)
+	{
+		const auto body = [&task](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				task(static_cast<unsigned int>(i));
+			}
+		};
+		ParallelFor(count, 1, body);
+	}
+
+	template<typename Function>
+	inline void ThreadPool::ParallelFor(const size_t& count, const size_t& grain, const Function& body)
+	{
+		if (count == 0)
+			return;
+
+		const size_t chunkSize = std::max<size_t>(1, grain);
+		if (count <= chunkSize || mWorkers.empty() || sbInsidePool)
+		{
+			body(size_t(0), count);
+			return;
+		}
+
+		parallelFor(count, chunkSize, &body, [](const void* function, size_t begin, size_t end)
+		{
+			(*static_cast<const Function*>(function))(begin, end);
+		});
+	}
+
+	inline void ThreadPool::parallelFor(const size_t& count, const size_t& chunkSize, const void* body, const Invoker& invoke)
+	{
+		// Queue q gets chunks [q * chunkCount / queues, (q + 1) * chunkCount / queues); the caller's share goes to the last deque.
+		const size_t chunkCount = (count - 1) / chunkSize + 1;
+		Job job;
+		job.Body = body;
+		job.Invoke = invoke;
+		job.Remaining.store(chunkCount);
+		job.Next = std::numeric_limits<size_t>::max();
+		const unsigned int queueCount = static_cast<unsigned int>(mQueues.size());
+		for (unsigned int q = 0; q < queueCount; ++q)
+		{
+			const size_t first = chunkCount / queueCount * q + chunkCount % queueCount * q / queueCount;
+			const size_t last = chunkCount / queueCount * (q + 1) + chunkCount % queueCount * (q + 1) / queueCount;
+			if (first == last)
+				continue;
+
+			std::lock_guard<std::mutex> lock(mQueues[q]->Mutex);
+			if (q == queueCount - 1)
+			{
+				job.Next = mQueues[q]->Tasks.size();
+			}
+			for (size_t c = first; c < last; ++c)
+			{
+				const size_t begin = c * chunkSize;
+				mQueues[q]->Tasks.push_back(Task{ &job, begin, std::min(count, begin + chunkSize) });
+			}
+		}
+		// Sequentially consistent with the sleepers' increment of mSleepers, so either they see the work or they are woken.
+		mPending.fetch_add(chunkCount);
+		if (mSleepers.load() != 0u)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+			}
+			mWakeCondition.notify_all();
+		}
+
+		sbInsidePool = true;
+		Task task;
+		while (job.Remaining.load() != 0u)
+		{
+			if (take(job, task))
+			{
+				run(task);
+				continue;
+			}
+			// Everything left is running on the workers.
+			std::unique_lock<std::mutex> lock(mMutex);
+			mDoneCondition.wait(lock, [&job]() { return job.Remaining.load() == 0u; });
+		}
+		sbInsidePool = false;
+	}
+
+	inline void ThreadPool::start(const unsigned int& threadCount)
+	{
+		mbStop = false;
+		mQueues.clear();
+		for (unsigned int i = 0; i < std::max(1u, threadCount); ++i)
+		{
+			mQueues.push_back(std::make_unique<Queue>());
+		}
+		for (unsigned int i = 1; i < threadCount; ++i)
+		{
+			mWorkers.emplace_back(&ThreadPool::workerLoop, this, i - 1);
+		}
+	}
+
+	inline void ThreadPool::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mbStop = true;
+		}
+		mWakeCondition.notify_all();
+		for (std::thread& worker : mWorkers)
+		{
+			worker.join();
+		}
+		mWorkers.clear();
+	}
+
+	inline void ThreadPool::workerLoop(const unsigned int& index)
+	{
+		sbInsidePool = true;
+		if (mbPinned)
+		{
+			// The first CPU in the order is left to the thread that started the pool.
+			const std::vector<unsigned int> cpus = cpuOrder();
+			if (!cpus.empty())
+			{
+				pin(cpus[(index + 1) % cpus.size()]);
+			}
+		}
+
+		Task task;
+		while (true)
+		{
+			if (pop(index, task) || steal(index, task))
+			{
+				run(task);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(mMutex);
+			mSleepers.fetch_add(1);
+			mWakeCondition.wait(lock, [this]() { return mbStop || mPending.load() != 0u; });
+			mSleepers.fetch_sub(1);
+			if (mbStop)
+				return;
+		}
+	}
+
+	inline bool ThreadPool::pop(const unsigned int& queue, Task& task)
+	{
+		Queue& own = *mQueues[queue];
+		std::lock_guard<std::mutex> lock(own.Mutex);
+		if (own.IsEmpty())
+			return false;
+		task = own.Tasks[own.Head++];
+		own.Trim();
+		mPending.fetch_sub(1);
+		return true;
+	}
+
+	inline bool ThreadPool::steal(const unsigned int& thief, Task& task)
+	{
+		if (mPending.load() == 0u)
+			return false;
+
+		const unsigned int queueCount = static_cast<unsigned int>(mQueues.size());
+		for (unsigned int i = 1; i < queueCount; ++i)
+		{
+			Queue& victim = *mQueues[(thief + i) % queueCount];
+			std::lock_guard<std::mutex> lock(victim.Mutex);
+			if (victim.IsEmpty())
+				continue;
+			task = victim.Tasks.back();
+			victim.Tasks.pop_back();
+			victim.Trim();
+			mPending.fetch_sub(1);
+			return true;
+		}
+		return false;
+	}
+
+	// Like pop and steal for a calling thread, but only returns a chunk of job: its next chunk in the callers' deque, which
+	// other callers share, else the back of a worker's deque when that is one of job's. Both are constant time.
+	inline bool ThreadPool::take(Job& job, Task& task)
+	{
+		const unsigned int queueCount = static_cast<unsigned int>(mQueues.size());
+		for (unsigned int i = 0; i < queueCount; ++i)
+		{
+			if (mPending.load() == 0u)
+				return false;
+
+			Queue& queue = *mQueues[(queueCount - 1 + i) % queueCount];
+			std::lock_guard<std::mutex> lock(queue.Mutex);
+			if (i == 0)
+			{
+				if (job.Next < queue.Head || job.Next >= queue.Tasks.size() || queue.Tasks[job.Next].Owner != &job)
+					continue;
+				task = queue.Tasks[job.Next];
+				queue.Tasks[job.Next++].Owner = nullptr;
+			}
+			else
+			{
+				if (queue.IsEmpty() || queue.Tasks.back().Owner != &job)
+					continue;
+				task = queue.Tasks.back();
+				queue.Tasks.pop_back();
+			}
+			queue.Trim();
+			mPending.fetch_sub(1);
+			return true;
+		}
+		return false;
+	}
+
+	inline void ThreadPool::run(const Task& task)
+	{
+		{
+			// Recorded before the decrement, so the owner's thread sees every task's event once ParallelFor returns.
+			NUMPY_PROFILE_SCOPE("ThreadPool::Task");
+			task.Owner->Invoke(task.Owner->Body, task.Begin, task.End);
+		}
+		// The owner may return as soon as it sees 0, so the job is not touched after the decrement.
+		if (task.Owner->Remaining.fetch_sub(1) == 1u)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+			}
+			mDoneCondition.notify_all();
+		}
+	}
+
+	// CPUs this process may run on, grouped by NUMA node where the system reports nodes.
+	inline std::vector<unsigned int> ThreadPool::cpuOrder()
+	{
+		std::vector<unsigned int> cpus;
+#ifdef _WIN32
+		DWORD_PTR processMask = 0;
+		DWORD_PTR systemMask = 0;
+		if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+		{
+			for (unsigned int cpu = 0; cpu < sizeof(DWORD_PTR) * 8; ++cpu)
+			{
+				if (processMask >> cpu & 1u)
+				{
+					cpus.push_back(cpu);
+				}
+			}
+		}
+#else
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+			return cpus;
+
+		std::vector<bool> bTaken(CPU_SETSIZE, false);
+		for (unsigned int node = 0; ; ++node)
+		{
+			std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+			std::string list;
+			if (!file || !std::getline(file, list))
+				break;
+
+			// Ranges such as "0-3,8-11".
+			const char* cursor = list.c_str();
+			while (*cursor != '\0')
+			{
+				char* end = nullptr;
+				const unsigned long first = std::strtoul(cursor, &end, 10);
+				if (end == cursor)
+					break;
+				unsigned long last = first;
+				cursor = end;
+				if (*cursor == '-')
+				{
+					last = std::strtoul(cursor + 1, &end, 10);
+					cursor = end;
+				}
+				for (unsigned long cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu)
+				{
+					if (CPU_ISSET(cpu, &allowed) && !bTaken[cpu])
+					{
+						cpus.push_back(static_cast<unsigned int>(cpu));
+						bTaken[cpu] = true;
+					}
+				}
+				cursor += *cursor == ',' ? 1 : 0;
+			}
+		}
+		for (unsigned int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+		{
+			if (CPU_ISSET(cpu, &allowed) && !bTaken[cpu])
+			{
+				cpus.push_back(cpu);
+			}
+		}
+#endif
+		return cpus;
+	}
+
+	inline void ThreadPool::pin(const unsigned int& cpu)
+	{
+#ifdef _WIN32
+		if (cpu < sizeof(DWORD_PTR) * 8)
+		{
+			SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << cpu);
+		}
+#else
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+	}
+
+	inline unsigned int ThreadPool::defaultThreadCount()
+	{
+		const char* value = std::getenv("NUMPY_NUM_THREADS");
+		if (value != nullptr && std::atoi(value) > 0)
+			return static_cast<unsigned int>(std::atoi(value));
+		return std::thread::hardware_concurrency() == 0 ? 1u : std::thread::hardware_concurrency();
+	}
+}
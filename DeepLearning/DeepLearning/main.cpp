@@ -1,7 +1,184 @@
+#include<cmath>
+#include<cstdio>
+#include<cstdint>
+#include<cstdlib>
+#include<cstring>
+#include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<fstream>
 #include<memory>
+#include<new>
 #include<iostream>
+#include<iterator>
+#include<limits>
+#include<string>
+#include<thread>
+#include<vector>
 
 #include "Numpy.h"
+#include "Layer.h"
+#include "Mlp.h"
+#include "Dataset.h"
+#include "Npy.h"
+#include "DataLoader.h"
+#include "ThreadPool.h"
+#include "StaticNdarray.h"
+#include "Half.h"
+#include "Autograd.h"
+#include "Graph.h"
+#include "Convolution.h"
+#include "Distributed.h"
+#include "Profiler.h"
+#include "InferenceServer.h"
+
+// Every operator new in the program, plain, array, nothrow and over-aligned, so tests can check that a code path really
+// stays off the heap rather than only out of the Allocator's statistics. Each delete frees the way its new allocated.
+static std::atomic<size_t> gHeapAllocations(0);
+
+static void* countedAllocate(std::size_t size)
+{
+	gHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	return std::malloc(size == 0 ? 1 : size);
+}
+
+// The block returned by malloc is kept just below the aligned pointer.
+static void* countedAllocate(std::size_t size, std::align_val_t alignment)
+{
+	const std::size_t align = std::max(static_cast<std::size_t>(alignment), alignof(void*));
+	if (size > std::numeric_limits<std::size_t>::max() - align - sizeof(void*))
+		return nullptr;
+	gHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	void* block = std::malloc(size + align + sizeof(void*));
+	if (block == nullptr)
+		return nullptr;
+	const std::uintptr_t first = reinterpret_cast<std::uintptr_t>(block) + sizeof(void*);
+	void** pointer = reinterpret_cast<void**>((first + align - 1) & ~(static_cast<std::uintptr_t>(align) - 1));
+	pointer[-1] = block;
+	return pointer;
+}
+
+static void countedFree(void* pointer, std::align_val_t)
+{
+	if (pointer != nullptr)
+	{
+		std::free(static_cast<void**>(pointer)[-1]);
+	}
+}
+
+// GCC inlines the replacements into their callers and then mistakes the frees below for ones of memory from the built-in new.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t size)
+{
+	if (void* pointer = countedAllocate(size))
+		return pointer;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAllocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	if (void* pointer = countedAllocate(size, alignment))
+		return pointer;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return countedAllocate(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return countedAllocate(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t alignment) noexcept
+{
+	countedFree(pointer, alignment);
+}
+
+void operator delete[](void* pointer, std::align_val_t alignment) noexcept
+{
+	countedFree(pointer, alignment);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t alignment) noexcept
+{
+	countedFree(pointer, alignment);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t alignment) noexcept
+{
+	countedFree(pointer, alignment);
+}
+
+void operator delete(void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	countedFree(pointer, alignment);
+}
+
+void operator delete[](void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	countedFree(pointer, alignment);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
 
 void test1()
 {
@@ -54,7 +231,7 @@ void test1()
 	std::cout << array3 << std::endl;
 	std::cout << "N Data Array scalar +/* Test Done" << std::endl;
 
-	assert(numpy::Numpy<int>::Dot(array2, array3) == numpy::Ndarray<int>::Ndarray());
+	assert(numpy::Numpy<int>::Dot(array2, array3) == numpy::Ndarray<int>());
 
 	arraySize[0] = 4;
 	arraySize[1] = 5;
@@ -82,16 +259,1999 @@ void test2()
 	std::cout << numpy::Numpy<int>::Ones({ 1,2,3 }) << std::endl;
 }
 
-int main()
+void test3()
+{
+	// Shapes that straddle the micro-kernel and cache-block edges of Gemm.
+	const unsigned int shapes[][3] = { { 1, 1, 1 }, { 3, 5, 7 }, { 37, 300, 19 }, { 130, 9, 260 } };
+	for (const auto& shape : shapes)
+	{
+		const unsigned int m = shape[0];
+		const unsigned int k = shape[1];
+		const unsigned int n = shape[2];
+
+		std::unique_ptr<unsigned int[]> arraySize = std::make_unique<unsigned int[]>(2);
+		std::unique_ptr<int[]> arrayA = std::make_unique<int[]>(m * k);
+		std::unique_ptr<int[]> arrayB = std::make_unique<int[]>(k * n);
+		std::unique_ptr<int[]> arrayC = std::make_unique<int[]>(m * n);
+		for (unsigned int i = 0; i < m * k; ++i)
+			arrayA[i] = static_cast<int>(i % 7) - 3;
+		for (unsigned int i = 0; i < k * n; ++i)
+			arrayB[i] = static_cast<int>(i % 5) - 2;
+		for (unsigned int i = 0; i < m; ++i)
+			for (unsigned int j = 0; j < n; ++j)
+				for (unsigned int p = 0; p < k; ++p)
+					arrayC[i * n + j] += arrayA[i * k + p] * arrayB[p * n + j];
+
+		arraySize[0] = m;
+		arraySize[1] = k;
+		numpy::Ndarray<int> a(2, m * k, arraySize, arrayA);
+		arraySize[0] = k;
+		arraySize[1] = n;
+		numpy::Ndarray<int> b(2, k * n, arraySize, arrayB);
+		arraySize[0] = m;
+		arraySize[1] = n;
+		assert(numpy::Numpy<int>::Dot(a, b) == numpy::Ndarray<int>(2, m * n, arraySize, arrayC));
+
+		// Every level's float micro-kernel, with the bias and ReLU epilogue; small integers keep the sums exact.
+		numpy::Ndarray<float> floatA({ m, k });
+		numpy::Ndarray<float> floatB({ k, n });
+		numpy::Ndarray<float> bias({ n });
+		numpy::Ndarray<float> expected({ m, n });
+		for (unsigned int i = 0; i < m * k; ++i)
+			floatA.At(i) = static_cast<float>(arrayA[i]);
+		for (unsigned int i = 0; i < k * n; ++i)
+			floatB.At(i) = static_cast<float>(arrayB[i]);
+		for (unsigned int j = 0; j < n; ++j)
+			bias.At(j) = static_cast<float>(j % 3) - 1.0f;
+		for (unsigned int i = 0; i < m * n; ++i)
+			expected.At(i) = std::max(static_cast<float>(arrayC[i]) + bias.At(i % n), 0.0f);
+		const numpy::SimdLevel supported = numpy::Simd::GetSupportedLevel();
+		for (int level = 0; level <= static_cast<int>(supported); ++level)
+		{
+			numpy::Simd::SetLevel(static_cast<numpy::SimdLevel>(level));
+			numpy::Ndarray<float> out;
+			numpy::Numpy<float>::Dot(out, floatA, floatB, bias, true);
+			assert(out == expected);
+		}
+		numpy::Simd::SetLevel(supported);
+	}
+	std::cout << "Blocked Dot Test Done" << std::endl;
+}
+
+void test4()
+{
+	const numpy::SimdLevel supported = numpy::Simd::GetSupportedLevel();
+	for (int level = 0; level <= static_cast<int>(supported); ++level)
+	{
+		numpy::Simd::SetLevel(static_cast<numpy::SimdLevel>(level));
+
+		numpy::Ndarray<float> a({ 3, 37 }, 1.5f);
+		assert(a + a == numpy::Ndarray<float>({ 3, 37 }, 3.0f));
+		assert(a * 2.0f == numpy::Ndarray<float>({ 3, 37 }, 3.0f));
+		assert(a + 1 == numpy::Ndarray<float>({ 3, 37 }, 2.5f));
+
+		numpy::Ndarray<double> b({ 19 }, 0.25);
+		assert(b * b == numpy::Ndarray<double>({ 19 }, 0.0625));
+
+		numpy::Ndarray<int> c({ 5, 7 }, 3);
+		assert(c * numpy::Ndarray<int>({ 5, 7 }, -4) == numpy::Ndarray<int>({ 5, 7 }, -12));
+		assert(c * 0.5f == numpy::Ndarray<int>({ 5, 7 }, 1));
+	}
+	numpy::Simd::SetLevel(supported);
+	std::cout << "SIMD " << numpy::Simd::GetName(supported) << " Elementwise Test Done" << std::endl;
+}
+
+void test5()
+{
+	numpy::Ndarray<int> a({ 2, 3 }, 2);
+	numpy::Ndarray<int> b({ 2, 3 }, -7);
+
+	numpy::Ndarray<int> step = a * a;
+	step = step + b;
+	step = step * 3;
+	numpy::Ndarray<int> fused = (a * a + b) * 3;
+	assert(fused == step);
+	assert((a * a + b) * 3 == step);
+	assert(((a + b) * a).Eval() == numpy::Ndarray<int>({ 2, 3 }, -10));
+
+	assert(numpy::Numpy<int>::Maximum(a * a + b, 0) == numpy::Ndarray<int>({ 2, 3 }, 0));
+	assert(numpy::Numpy<int>::Maximum(b, a) == a);
+
+	a = a + a * 2;
+	assert(a == numpy::Ndarray<int>({ 2, 3 }, 6));
+
+	assert(a + numpy::Ndarray<int>({ 3, 2 }, 1) == numpy::Ndarray<int>());
+	std::cout << "Fused Expression Test Done" << std::endl;
+}
+
+void test6()
+{
+	const unsigned int values[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+	const unsigned int shape[] = { 3, 4 };
+	numpy::Ndarray<int> a(2, 12, shape, values);
+
+	const unsigned int transposedShape[] = { 4, 3 };
+	const unsigned int transposedValues[] = { 0, 4, 8, 1, 5, 9, 2, 6, 10, 3, 7, 11 };
+	numpy::Ndarray<int> t = a.Transpose();
+	assert(!t.IsContiguous());
+	assert(t == numpy::Ndarray<int>(2, 12, transposedShape, transposedValues));
+	assert(t.Transpose() == a);
+
+	const unsigned int sliceShape[] = { 2, 2 };
+	const unsigned int sliceValues[] = { 5, 7, 9, 11 };
+	numpy::Ndarray<int> s = a.Slice(0, 1, 3).Slice(1, 1, 4, 2);
+	assert(s == numpy::Ndarray<int>(2, 4, sliceShape, sliceValues));
+
+	// Writes through a view land in the shared storage.
+	s.At(0) = -1;
+	assert(a.At(5) == -1);
+	a.At(5) = 5;
+
+	numpy::Ndarray<int> r = a.Reshape({ 2, -1 });
+	assert(r.GetArraySize(1) == 6 && r.GetData() == a.GetData());
+	numpy::Ndarray<int> rt = t.Reshape({ 12 });
+	assert(rt.GetData() != a.GetData() && rt.At(1) == 4);
+
+	const unsigned int rowShape[] = { 4 };
+	const unsigned int rowValues[] = { 1, 2, 3, 4 };
+	numpy::Ndarray<int> row(1, 4, rowShape, rowValues);
+	numpy::Ndarray<int> broadcast = row.BroadcastTo({ 3, 4 });
+	assert(broadcast.GetStride(0) == 0 && broadcast.At(9) == 2);
+	assert(a.BroadcastTo({ 2, 4 }) == numpy::Ndarray<int>());
+
+	// Elementwise expressions and Dot read strided operands in place.
+	assert(t + t == t * 2);
+	assert((a.Slice(1, 0, 4, 2) + 1).Eval().At(3) == 7);
+	assert(numpy::Numpy<int>::Dot(t, a) == numpy::Numpy<int>::Dot(numpy::Ndarray<int>(t), a));
+	assert(numpy::Numpy<int>::Dot(a, t) == numpy::Numpy<int>::Dot(a, numpy::Ndarray<int>(t)));
+	assert(numpy::Numpy<int>::Dot(s, broadcast.Slice(0, 0, 2)) == numpy::Numpy<int>::Dot(numpy::Ndarray<int>(s), numpy::Ndarray<int>(broadcast.Slice(0, 0, 2))));
+	std::cout << "View Test Done" << std::endl;
+}
+
+void test7()
+{
+	const unsigned int batchShape[] = { 2, 3 };
+	const unsigned int batchValues[] = { 0, 1, 2, 3, 4, 5 };
+	numpy::Ndarray<int> batch(2, 6, batchShape, batchValues);
+
+	const unsigned int biasShape[] = { 3 };
+	const unsigned int biasValues[] = { 10, 20, 30 };
+	numpy::Ndarray<int> bias(1, 3, biasShape, biasValues);
+	const unsigned int rowSum[] = { 10, 21, 32, 13, 24, 35 };
+	assert(batch + bias == numpy::Ndarray<int>(2, 6, batchShape, rowSum));
+	assert(bias + batch == numpy::Ndarray<int>(2, 6, batchShape, rowSum));
+
+	const unsigned int columnShape[] = { 2, 1 };
+	const unsigned int columnValues[] = { 2, 3 };
+	numpy::Ndarray<int> column(2, 2, columnShape, columnValues);
+	const unsigned int columnProduct[] = { 0, 2, 4, 9, 12, 15 };
+	assert(batch * column == numpy::Ndarray<int>(2, 6, batchShape, columnProduct));
+	assert(column * batch == numpy::Ndarray<int>(2, 6, batchShape, columnProduct));
+
+	// (2, 1) against (3) stretches both sides into an outer sum.
+	const unsigned int outerSum[] = { 12, 22, 32, 13, 23, 33 };
+	assert(column + bias == numpy::Ndarray<int>(2, 6, batchShape, outerSum));
+
+	assert(batch + numpy::Ndarray<int>({ 1 }, 1) == batch + 1);
+	assert(numpy::Numpy<int>::Maximum(batch, numpy::Ndarray<int>({ 2, 1 }, 3)).Eval().At(1) == 3);
+	assert((batch * 2 + bias).Eval().At(4) == 28);
+	assert((batch.Transpose() + column.Transpose()).Eval().At(1) == 6);
+	assert((batch + bias).GetTotalSize() == 6);
+
+	assert(batch + numpy::Ndarray<int>({ 2 }, 1) == numpy::Ndarray<int>());
+	// An empty operand is not a size-1 one and empties the result, wherever it appears.
+	const numpy::Ndarray<int> empty;
+	assert(empty + batch == numpy::Ndarray<int>() && batch * empty == numpy::Ndarray<int>());
+	assert((batch * 2 + empty).Eval().GetTotalSize() == 0 && empty + empty == numpy::Ndarray<int>());
+	std::cout << "Broadcast Test Done" << std::endl;
+}
+
+void test8()
+{
+	numpy::Ndarray<float> x({ 32, 64 }, 0.5f);
+	numpy::Ndarray<float> w({ 64, 16 }, 0.25f);
+	numpy::Ndarray<float> bias({ 16 }, -1.0f);
+	numpy::Ndarray<float> hidden;
+	auto step = [&]()
+	{
+		hidden = numpy::Numpy<float>::Maximum(numpy::Numpy<float>::Dot(x, w) + bias, 0.0f);
+		hidden = hidden * 0.5f + hidden.Transpose().Transpose();
+	};
+
+	// The first steps fill the pool; after that every buffer is recycled.
+	step();
+	step();
+	numpy::Allocator::ResetStatistics();
+	const size_t heapAllocations = gHeapAllocations.load();
+	step();
+	step();
+	assert(gHeapAllocations.load() == heapAllocations);
+	const numpy::AllocationStatistics pooled = numpy::Allocator::GetStatistics();
+	assert(pooled.SystemAllocations == 0 && pooled.SystemDeallocations == 0 && pooled.PoolAllocations > 0);
+	assert(hidden == numpy::Ndarray<float>({ 32, 16 }, 10.5f));
+
+	// The same holds for passes split across the thread pool, once its deques have grown.
+	numpy::ThreadPool& pool = numpy::ThreadPool::Instance();
+	const unsigned int defaultCount = pool.GetThreadCount();
+	pool.SetThreadCount(4);
+	numpy::Ndarray<float> wide({ 300, 700 }, 1.0f);
+	numpy::Ndarray<float> row({ 700 }, 2.0f);
+	numpy::Ndarray<float> sum;
+	for (int i = 0; i < 2; ++i)
+	{
+		sum = wide * 3.0f + row;
+	}
+	numpy::Allocator::ResetStatistics();
+	const size_t parallelAllocations = gHeapAllocations.load();
+	for (int i = 0; i < 2; ++i)
+	{
+		sum = wide * 3.0f + row;
+	}
+	assert(gHeapAllocations.load() == parallelAllocations && numpy::Allocator::GetStatistics().SystemAllocations == 0);
+	assert(sum.At(1234) == 5.0f);
+	pool.SetThreadCount(defaultCount);
+	assert(reinterpret_cast<size_t>(hidden.GetData()) % numpy::Allocator::ALIGNMENT == 0);
+
+	numpy::Arena arena(1 << 16);
+	for (int i = 0; i < 3; ++i)
+	{
+		numpy::ArenaScope scope(arena);
+		numpy::Ndarray<float> scratch = numpy::Numpy<float>::Dot(x, w) + bias;
+		assert(scratch.At(0) == 7.0f && arena.GetUsedSize() > 0);
+		numpy::Allocator::ResetStatistics();
+		numpy::Ndarray<float> doubled = scratch * 2.0f;
+		assert(numpy::Allocator::GetStatistics().ArenaAllocations > 0 && numpy::Allocator::GetStatistics().SystemAllocations == 0);
+		scratch = numpy::Ndarray<float>();
+		doubled = numpy::Ndarray<float>();
+		arena.Reset();
+	}
+	assert(arena.GetUsedSize() == 0 && arena.GetCapacity() == 1 << 16);
+
+	// A size class caches at most MAX_CACHED_BYTES; the blocks past that go back to the system.
+	const size_t large = static_cast<size_t>(1) << 20;
+	const size_t cached = numpy::MemoryPool::MAX_CACHED_BYTES / (large * sizeof(float));
+	std::vector<numpy::Ndarray<float>> held;
+	held.reserve(cached + 4);
+	for (size_t i = 0; i < cached + 4; ++i)
+	{
+		held.emplace_back(std::initializer_list<size_t>{ large });
+	}
+	numpy::Allocator::ResetStatistics();
+	held.clear();
+	assert(numpy::Allocator::GetStatistics().SystemDeallocations == 4);
+
+	// A buffer freed on another thread goes back to the pool of the thread that allocated it.
+	numpy::Ndarray<float> shared({ 3, large });
+	const float* sharedData = shared.GetData();
+	bool bReusedElsewhere = true;
+	std::thread([&]()
+	{
+		numpy::Ndarray<float> moved = std::move(shared);
+		moved = numpy::Ndarray<float>();
+		const numpy::Ndarray<float> again({ 3, large });
+		bReusedElsewhere = again.GetData() == sharedData;
+	}).join();
+	numpy::Allocator::ResetStatistics();
+	const numpy::Ndarray<float> reused({ 3, large });
+	assert(!bReusedElsewhere && numpy::Allocator::GetStatistics().SystemAllocations == 0);
+
+	// Ranks above the inline capacity spill the shape to the heap and behave the same.
+	numpy::Ndarray<int> deep({ 1, 2, 1, 2, 1, 2, 1, 2 }, 3);
+	assert(deep.Transpose().GetArraySize(0) == 2 && (deep + deep).Eval().At(15) == 6);
+	std::cout << "Allocator Test Done" << std::endl;
+}
+
+void test9()
 {
+	numpy::Ndarray<float> w({ 64, 16 }, 1.0f);
+	numpy::Ndarray<float> gradient({ 64, 16 }, 2.0f);
+	numpy::Ndarray<float> bias({ 16 }, 0.5f);
+	const float* storage = w.GetData();
+
+	w -= gradient * 0.25f;
+	w += bias;
+	w *= 2.0f;
+	w -= 1.0f;
+	assert(w == numpy::Ndarray<float>({ 64, 16 }, 1.0f) && w.GetData() == storage);
+
+	numpy::Allocator::ResetStatistics();
+	w -= gradient * 0.25f;
+	w = numpy::Numpy<float>::Maximum(w, 0.0f);
+	numpy::Numpy<float>::Add(w, w, bias);
+	assert(numpy::Allocator::GetStatistics().PoolAllocations == 0 && numpy::Allocator::GetStatistics().SystemAllocations == 0);
+	assert(w == numpy::Ndarray<float>({ 64, 16 }, 1.0f));
+
+	// Compound assignment on a view writes through; an operand that reads the target transposed is evaluated first.
+	const unsigned int values[] = { 1, 2, 3, 4 };
+	const unsigned int shape[] = { 2, 2 };
+	numpy::Ndarray<int> a(2, 4, shape, values);
+	a.Slice(1, 1, 2) *= 10;
+	const unsigned int scaled[] = { 1, 20, 3, 40 };
+	assert(a == numpy::Ndarray<int>(2, 4, shape, scaled));
+	a += a.Transpose();
+	const unsigned int symmetric[] = { 2, 23, 23, 80 };
+	assert(a == numpy::Ndarray<int>(2, 4, shape, symmetric));
+
+	// Copy assignment reuses the buffer unless a view still shares it.
+	numpy::Ndarray<int> b({ 4 }, 0);
+	const int* bStorage = b.GetData();
+	b = a;
+	assert(b.GetData() == bStorage && b == a);
+	numpy::Ndarray<int> view = b.Slice(0, 0, 1);
+	b = numpy::Ndarray<int>({ 2, 2 }, 7);
+	assert(b.GetData() != bStorage && view.At(0) == 2);
+
+	numpy::Ndarray<float> product({ 64, 64 }, 0.0f);
+	const float* productStorage = product.GetData();
+	numpy::Numpy<float>::Dot(product, w, gradient.Transpose());
+	assert(product.GetData() == productStorage && product == numpy::Ndarray<float>({ 64, 64 }, 32.0f));
+	numpy::Ndarray<float> wide({ 64, 128 }, 0.0f);
+	numpy::Ndarray<float> right = wide.Slice(1, 64, 128);
+	numpy::Numpy<float>::Dot(right, w, gradient.Transpose());
+	assert(wide.At(63) == 0.0f && wide.At(64) == 32.0f);
+
+	numpy::Ndarray<float> out;
+	numpy::Numpy<float>::Multiply(out, bias, 4.0f);
+	assert(out == numpy::Ndarray<float>({ 16 }, 2.0f));
+	std::cout << "In-place Test Done" << std::endl;
+}
+
+void test10()
+{
+	const unsigned int values[] = { 3, 1, 4, 1, 5, 9, 2, 6, 5, 3, 5, 8 };
+	const unsigned int shape[] = { 3, 4 };
+	numpy::Ndarray<int> a(2, 12, shape, values);
+
+	const unsigned int columnShape[] = { 4 };
+	const unsigned int columnSums[] = { 13, 13, 11, 15 };
+	assert(numpy::Numpy<int>::Sum(a, 0) == numpy::Ndarray<int>(1, 4, columnShape, columnSums));
+	const unsigned int rowShape[] = { 3, 1 };
+	const unsigned int rowSums[] = { 9, 22, 21 };
+	assert(numpy::Numpy<int>::Sum(a, -1, true) == numpy::Ndarray<int>(2, 3, rowShape, rowSums));
+	assert(numpy::Numpy<int>::Sum(a) == 52 && numpy::Numpy<int>::Max(a) == 9 && numpy::Numpy<int>::ArgMax(a) == 5);
+
+	const unsigned int maxShape[] = { 3 };
+	const unsigned int rowMax[] = { 4, 9, 8 };
+	const unsigned int rowArgMax[] = { 2, 1, 3 };
+	assert(numpy::Numpy<int>::Max(a, 1) == numpy::Ndarray<int>(1, 3, maxShape, rowMax));
+	assert(numpy::Numpy<int>::ArgMax(a, 1) == numpy::Ndarray<size_t>(1, 3, maxShape, rowArgMax));
+	const unsigned int columnArgMax[] = { 1, 1, 2, 2 };
+	assert(numpy::Numpy<int>::ArgMax(a, 0) == numpy::Ndarray<size_t>(1, 4, columnShape, columnArgMax));
+	// Strided views reduce like their copies.
+	assert(numpy::Numpy<int>::Sum(a.Transpose(), 1) == numpy::Numpy<int>::Sum(a, 0));
+	assert(numpy::Numpy<int>::Sum(a, 2) == numpy::Ndarray<int>());
+
+	numpy::Ndarray<double> b({ 2, 3, 4 }, 2.0);
+	b.At(5) = 6.0;
+	assert(numpy::Numpy<double>::Mean(b, 1).At(1) == 10.0 / 3.0 && numpy::Numpy<double>::Mean(b, 1).GetArraySize(1) == 4);
+	assert(numpy::Numpy<double>::Std(b, 2).At(1) == std::sqrt(3.0) && numpy::Numpy<double>::Std(b, 2).At(0) == 0.0);
+	const unsigned int weightShape[] = { 4 };
+	const unsigned int weightValues[] = { 1, 3, 0, 0 };
+	numpy::Ndarray<double> weights(1, 4, weightShape, weightValues);
+	assert(numpy::Numpy<double>::Average(b, weights, -1, true).At(1) == 5.0);
+	// Weights that would only broadcast against a are refused.
+	assert(numpy::Numpy<double>::Average(b, numpy::Ndarray<double>({ 3, 4 }, 1.0), 1).GetTotalSize() == 0);
+	assert(numpy::Numpy<double>::Average(b, numpy::Ndarray<double>({ 1, 3, 1 }, 1.0), 1).GetTotalSize() == 0);
+	assert(numpy::Numpy<double>::Average(b, numpy::Ndarray<double>({ 2, 3, 4 }, 1.0), 1) == numpy::Numpy<double>::Mean(b, 1));
+
+	// Pairwise summation keeps a long float sum close; a sequential float loop drifts by several percent here.
+	const unsigned int count = 1u << 24;
+	numpy::Ndarray<float> c({ count }, 0.1f);
+	assert(std::fabs(numpy::Numpy<float>::Sum(c) - 0.1 * count) < 1e-4 * 0.1 * count);
+	numpy::Ndarray<float> d({ 1 << 12, 1 << 12 }, 0.1f);
+	assert(std::fabs(numpy::Numpy<float>::Sum(d, 0).At(7) - 0.1 * (1 << 12)) < 1e-3);
+	std::cout << "Reduction Test Done" << std::endl;
+}
+
+float maxDifference(const numpy::Ndarray<float>& a, const numpy::Ndarray<float>& b)
+{
+	assert(a.GetTotalSize() == b.GetTotalSize());
+	float difference = 0.0f;
+	for (size_t i = 0; i < a.GetTotalSize(); ++i)
+	{
+		difference = std::max(difference, std::fabs(a.At(i) - b.At(i)));
+	}
+	return difference;
+}
+
+void test11()
+{
+	// k = 300 spans two KC blocks, so the epilogue runs after accumulation into c.
+	const unsigned int batch = 9;
+	const unsigned int inputSize = 300;
+	const unsigned int outputSize = 13;
+	numpy::Ndarray<float> x({ batch, inputSize });
+	for (size_t i = 0; i < x.GetTotalSize(); ++i)
+	{
+		x.At(i) = static_cast<float>((i * 37) % 11) * 0.1f - 0.5f;
+	}
+	numpy::Dense<float> layer(inputSize, outputSize, numpy::Activation::Relu, 7);
+	for (unsigned int i = 0; i < outputSize; ++i)
+	{
+		layer.GetBias().At(i) = static_cast<float>(i % 3) * 0.2f - 0.2f;
+	}
+
+	const numpy::Ndarray<float> y = layer.Forward(x);
+	const numpy::Ndarray<float> u = numpy::Numpy<float>::Dot(x, layer.GetWeight()) + layer.GetBias();
+	assert(maxDifference(y, numpy::Numpy<float>::Maximum(u, 0.0f)) < 1e-5f);
+
+	numpy::Ndarray<float> gradOutput({ batch, outputSize });
+	numpy::Ndarray<float> delta({ batch, outputSize });
+	for (size_t i = 0; i < gradOutput.GetTotalSize(); ++i)
+	{
+		gradOutput.At(i) = static_cast<float>((i * 5) % 7) * 0.3f - 0.9f;
+		delta.At(i) = u.At(i) <= 0.0f ? 0.0f : gradOutput.At(i);
+	}
+	layer.Backward(gradOutput);
+	assert(maxDifference(layer.GetGradWeight(), numpy::Numpy<float>::Dot(x.Transpose(), delta)) < 1e-4f);
+	assert(maxDifference(layer.GetGradInput(), numpy::Numpy<float>::Dot(delta, layer.GetWeight().Transpose())) < 1e-5f);
+	assert(maxDifference(layer.GetGradBias(), numpy::Numpy<float>::Sum(delta, 0)) < 1e-5f);
+
+	const numpy::Ndarray<float> weight = layer.GetWeight();
+	layer.Update(0.5f);
+	assert(maxDifference(layer.GetWeight(), weight + layer.GetGradWeight() * -0.5f) < 1e-6f);
+
+	// Softmax cross-entropy stays finite where exp(u) overflows and log(y) underflows.
+	const unsigned int logitShape[] = { 2, 3 };
+	const unsigned int logitValues[] = { 1, 2, 3, 1000, 0, 0 };
+	const unsigned int targetValues[] = { 0, 0, 1, 0, 1, 0 };
+	const numpy::Ndarray<float> logits(2, 6, logitShape, logitValues);
+	const numpy::Ndarray<float> target(2, 6, logitShape, targetValues);
+	numpy::SoftmaxCrossEntropy<float> loss;
+	const float value = loss.Forward(logits, target);
+	const float sum = std::exp(1.0f) + std::exp(2.0f) + std::exp(3.0f);
+	assert(std::fabs(loss.GetProbability().At(2) - std::exp(3.0f) / sum) < 1e-6f);
+	assert(std::fabs(value - (std::log(sum) - 3.0f + 1000.0f) / 2.0f) < 1e-3f);
+	assert(loss.GetProbability().At(3) == 1.0f && loss.Backward().At(4) == -1.0f && loss.Backward().At(2) == loss.GetProbability().At(2) - 1.0f);
+	std::cout << "Dense Test Done" << std::endl;
+}
+
+void test12()
+{
+	const unsigned int shape[] = { 4, 2 };
+	const unsigned int values[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+	const numpy::Ndarray<float> a(2, 8, shape, values);
+	const size_t indices[] = { 3, 0, 3 };
+	numpy::Ndarray<float> taken;
+	numpy::Numpy<float>::Take(taken, a, indices, 3);
+	const float* data = taken.GetData();
+	assert(taken.GetArraySize(0) == 3 && taken.At(0) == 6.0f && taken.At(3) == 1.0f && taken.At(5) == 7.0f);
+	// Same shape again: written in place, here from a strided source.
+	const size_t others[] = { 0, 3, 0 };
+	numpy::Numpy<float>::Take(taken, a.Transpose().Slice(0, 0, 2).Transpose(), others, 3);
+	assert(taken.GetData() == data && taken.At(0) == 0.0f && taken.At(5) == 1.0f);
+
+	const unsigned int labelShape[] = { 4 };
+	const unsigned int labelValues[] = { 2, 0, 1, 2 };
+	const numpy::Ndarray<unsigned int> labels(1, 4, labelShape, labelValues);
+	const numpy::Ndarray<float> oneHot = numpy::Dataset<float>::OneHot(labels, 3);
+	assert(oneHot.GetArraySize(1) == 3 && oneHot.At(2) == 1.0f && oneHot.At(3) == 1.0f && numpy::Numpy<float>::Sum(oneHot) == 4.0f);
+
+	// Two classes told apart by the sign of the first feature.
+	numpy::Ndarray<float> x({ 64, 4 });
+	numpy::Ndarray<float> t({ 64, 2 }, 0.0f);
+	for (unsigned int r = 0; r < 64; ++r)
+	{
+		for (unsigned int c = 0; c < 4; ++c)
+		{
+			x.At(r * 4 + c) = static_cast<float>((r * 7 + c * 3) % 5) * 0.25f - 0.5f;
+		}
+		x.At(r * 4) = r % 2 == 0 ? 1.0f : -1.0f;
+		t.At(r * 2 + r % 2) = 1.0f;
+	}
+	numpy::Ndarray<float> xTrain;
+	numpy::Ndarray<float> xTest;
+	numpy::Ndarray<float> tTrain;
+	numpy::Ndarray<float> tTest;
+	numpy::Dataset<float>::Split(x, t, 0.25, 1, xTrain, xTest, tTrain, tTest);
+	assert(xTrain.GetArraySize(0) == 48 && tTest.GetArraySize(0) == 16 && numpy::Numpy<float>::Sum(tTrain) == 48.0f);
+
+	numpy::Mlp<float> mlp({ 4, 8, 2 }, 3);
+	numpy::Ndarray<float> xBatch;
+	numpy::Ndarray<float> tBatch;
+	const size_t order[] = { 0, 5, 10, 15, 20, 25, 30, 35, 40, 45, 1, 6, 11, 16, 21, 26 };
+	float accuracy = 0.0f;
+	for (unsigned int epoch = 0; epoch < 50; ++epoch)
+	{
+		if (epoch == 2)
+		{
+			numpy::Allocator::ResetStatistics();
+		}
+		numpy::Numpy<float>::Take(xBatch, xTrain, order, 16);
+		numpy::Numpy<float>::Take(tBatch, tTrain, order, 16);
+		mlp.TrainBatch(xBatch, tBatch, 0.1f);
+		mlp.Evaluate(xTest, tTest, accuracy);
+	}
+	// Inference has its own buffers, so alternating with training reuses everything.
+	const numpy::AllocationStatistics statistics = numpy::Allocator::GetStatistics();
+	assert(statistics.PoolAllocations == 0 && statistics.SystemAllocations == 0);
+	assert(mlp.Evaluate(xTest, tTest, accuracy) < 0.1f && accuracy == 1.0f);
+	std::cout << "MLP Test Done" << std::endl;
+}
+
+void test13()
+{
+	numpy::Ndarray<float> a({ 3, 5 });
+	for (size_t i = 0; i < a.GetTotalSize(); ++i)
+	{
+		a.At(i) = static_cast<float>(i) * 0.5f - 2.0f;
+	}
+	assert(numpy::Npy<float>::Save("test13.npy", a));
+	const numpy::Ndarray<float> loaded = numpy::Npy<float>::Load("test13.npy");
+	assert(loaded == a);
+	// Mapped pages are private, so writing to the view leaves the file alone.
+	numpy::Ndarray<float> mapped = numpy::Npy<float>::Map("test13.npy");
+	assert(mapped == a && reinterpret_cast<uintptr_t>(mapped.GetData()) % numpy::Npy<float>::ALIGNMENT == 0);
+	mapped.At(0) = 100.0f;
+	assert(numpy::Npy<float>::Load("test13.npy") == a);
+
+	// A strided view is saved compact; reading as another type converts.
+	assert(numpy::Npy<float>::Save("test13.npy", a.Transpose()));
+	const numpy::Ndarray<double> converted = numpy::Npy<double>::Map("test13.npy");
+	assert(converted.GetArraySize(0) == 5 && converted.GetArraySize(1) == 3 && converted.At(1) == a.At(5));
+
+	// Fortran-ordered big-endian int16, as numpy.save(np.asfortranarray(x.astype('>i2'))) writes it.
+	std::string header = "{'descr': '>i2', 'fortran_order': True, 'shape': (2, 3), }";
+	header.append(128 - 10 - header.size() - 1, ' ');
+	header += '\n';
+	const char data[] = { 0, 1, 0, 4, 0, 2, 0, 5, 0, 3, 0, 6 };
+	std::ofstream("test13.npy", std::ios::binary) << std::string("\x93NUMPY\x01\x00", 8) << static_cast<char>(header.size()) << '\0' << header << std::string(data, sizeof(data));
+	const numpy::Ndarray<int> fortran = numpy::Npy<int>::Load("test13.npy");
+	assert(fortran.GetArraySize(0) == 2 && fortran.GetArraySize(1) == 3);
+	assert(fortran.At(0) == 1 && fortran.At(1) == 2 && fortran.At(2) == 3 && fortran.At(3) == 4 && fortran.At(5) == 6);
+
+	const numpy::Ndarray<float> bias({ 7 }, 1.5f);
+	assert(numpy::Npy<float>::SaveNpz("test13.npz", { { "weight", a }, { "bias", bias } }));
+	std::map<std::string, numpy::Ndarray<float>> archive = numpy::Npy<float>::MapNpz("test13.npz");
+	assert(archive.size() == 2 && archive["weight"] == a && archive["bias"] == bias);
+	assert(reinterpret_cast<uintptr_t>(archive["bias"].GetData()) % numpy::Npy<float>::ALIGNMENT == 0);
+	assert(numpy::Npy<float>::LoadNpz("test13.npz")["weight"] == a);
+
+	// A central directory entry whose name runs past the end of the file is rejected rather than read.
+	std::string zip;
+	{
+		std::ifstream in("test13.npz", std::ios::binary);
+		zip.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+	const std::string valid = zip;
+	const size_t entry = zip.find("PK\x01\x02");
+	assert(entry != std::string::npos);
+	zip[entry + 28] = '\xFF';
+	zip[entry + 29] = '\xFF';
+	std::ofstream("test13.npz", std::ios::binary) << zip;
+	assert(numpy::Npy<float>::LoadNpz("test13.npz").empty());
+	// So is one whose local header offset does not point at a local header signature.
+	zip = valid;
+	zip[entry + 42] = static_cast<char>(zip[entry + 42] + 1);
+	std::ofstream("test13.npz", std::ios::binary) << zip;
+	assert(numpy::Npy<float>::LoadNpz("test13.npz").empty());
+
+	// A 0 axis is a valid file and reads as the empty array; saving an empty array fails without touching the target.
+	std::string zeroHeader = "{'descr': '<f4', 'fortran_order': False, 'shape': (0, 3), }";
+	zeroHeader.append(128 - 10 - zeroHeader.size() - 1, ' ');
+	zeroHeader += '\n';
+	std::ofstream("test13.npy", std::ios::binary) << std::string("\x93NUMPY\x01\x00", 8) << static_cast<char>(zeroHeader.size()) << '\0' << zeroHeader;
+	assert(numpy::Npy<float>::Load("test13.npy").GetTotalSize() == 0);
+	assert(numpy::Npy<float>::Save("test13.npy", a));
+	assert(!numpy::Npy<float>::Save("test13.npy", numpy::Ndarray<float>()) && numpy::Npy<float>::Load("test13.npy") == a);
+	std::remove("test13.npy");
+	std::remove("test13.npz");
+	std::cout << "Npy Test Done" << std::endl;
+}
+
+void test14()
+{
+	// Row r of x holds r and r + 100; row r of t holds -r, so every batch can be checked for matching rows.
+	numpy::Ndarray<float> x({ 10, 2 });
+	numpy::Ndarray<float> t({ 10, 1 });
+	for (unsigned int r = 0; r < 10; ++r)
+	{
+		x.At(r * 2) = static_cast<float>(r);
+		x.At(r * 2 + 1) = static_cast<float>(r + 100);
+		t.At(r) = -static_cast<float>(r);
+	}
+
+	std::vector<float> sequence;
+	{
+		numpy::DataLoader<float> loader({ &x, &t }, 3, 2, 7);
+		assert(loader.GetBatchCount() == 3);
+		for (unsigned int epoch = 0; epoch < 3; ++epoch)
+		{
+			bool seen[10] = {};
+			unsigned int batches = 0;
+			while (const std::vector<numpy::Ndarray<float>>* batch = loader.Next())
+			{
+				const numpy::Ndarray<float>& xBatch = (*batch)[0];
+				const numpy::Ndarray<float>& tBatch = (*batch)[1];
+				assert(xBatch.GetArraySize(0) == 3 && xBatch.GetArraySize(1) == 2 && tBatch.GetArraySize(0) == 3);
+				for (unsigned int i = 0; i < 3; ++i)
+				{
+					const unsigned int row = static_cast<unsigned int>(xBatch.At(i * 2));
+					assert(xBatch.At(i * 2 + 1) == static_cast<float>(row + 100) && tBatch.At(i) == -static_cast<float>(row));
+					assert(!seen[row]);
+					seen[row] = true;
+					sequence.push_back(xBatch.At(i * 2));
+				}
+				++batches;
+			}
+			assert(batches == 3);
+		}
+		assert(!std::equal(sequence.begin(), sequence.begin() + 9, sequence.begin() + 9));
+	}
+
+	// More workers and a strided source give the same batches in the same order.
+	const numpy::Ndarray<float> tStrided = numpy::Ndarray<float>({ 1, 10 }, 0.0f).Transpose();
+	numpy::DataLoader<float> parallel({ &x, &tStrided }, 3, 4, 7, 0, 3);
+	size_t position = 0;
+	for (unsigned int epoch = 0; epoch < 3; ++epoch)
+	{
+		while (const std::vector<numpy::Ndarray<float>>* batch = parallel.Next())
+		{
+			for (unsigned int i = 0; i < 3; ++i)
+			{
+				assert((*batch)[0].At(i * 2) == sequence[position++] && (*batch)[1].At(i) == 0.0f);
+			}
+		}
+	}
+	assert(position == sequence.size());
+
+	// Chunks of 4 rows: each batch of 2 stays inside one chunk.
+	numpy::DataLoader<float> chunked({ &x }, 2, 2, 1, 4);
+	for (unsigned int epoch = 0; epoch < 2; ++epoch)
+	{
+		while (const std::vector<numpy::Ndarray<float>>* batch = chunked.Next())
+		{
+			assert(static_cast<unsigned int>((*batch)[0].At(0)) / 4 == static_cast<unsigned int>((*batch)[0].At(2)) / 4);
+		}
+	}
+
+	// Fewer samples than one batch: no batches at all.
+	numpy::DataLoader<float> empty({ &x }, 11);
+	assert(empty.GetBatchCount() == 0 && empty.Next() == nullptr);
+	std::cout << "DataLoader Test Done" << std::endl;
+}
+
+void test15()
+{
+	// Several threads even on a single core, so the stealing paths run.
+	numpy::ThreadPool& pool = numpy::ThreadPool::Instance();
+	const unsigned int defaultCount = pool.GetThreadCount();
+	pool.SetThreadCount(4);
+	assert(pool.GetThreadCount() == 4);
+
+	std::vector<std::atomic<unsigned int>> hits(1000);
+	std::atomic<unsigned int> chunks(0);
+	std::atomic<unsigned int> nested(0);
+	pool.ParallelFor(1000, 7, [&](size_t begin, size_t end)
+	{
+		assert(begin % 7 == 0 && end - begin <= 7);
+		for (size_t i = begin; i < end; ++i)
+		{
+			hits[i].fetch_add(1);
+		}
+		// Nested calls run inline.
+		pool.ParallelFor(3, [&](unsigned int) { nested.fetch_add(1); });
+		chunks.fetch_add(1);
+	});
+	assert(chunks.load() == 143 && nested.load() == 3 * 143);
+	for (const std::atomic<unsigned int>& hit : hits)
+	{
+		assert(hit.load() == 1u);
+	}
+
+	// Two threads submitting at once share the workers, but a waiting caller only runs chunks of its own job. Single-index
+	// chunks interleave the two callers' tasks in the shared deque.
+	static thread_local unsigned int tCaller = 0;
+	std::atomic<unsigned long long> total(0);
+	const auto submit = [&](const unsigned int caller)
+	{
+		tCaller = caller;
+		pool.ParallelFor(50000, 1, [&total, caller](size_t begin, size_t end)
+		{
+			assert(tCaller == 0 || tCaller == caller);
+			total.fetch_add(begin * (end - begin) + (end - begin) * (end - begin - 1) / 2);
+		});
+		tCaller = 0;
+	};
+	std::thread other(submit, 2u);
+	submit(1u);
+	other.join();
+	assert(total.load() == 2ull * 49999 * 50000 / 2);
+
+	// Element-wise passes large enough to be split match the single-threaded result.
+	numpy::Ndarray<float> a({ 300, 700 });
+	numpy::Ndarray<float> row({ 700 });
+	for (size_t i = 0; i < a.GetTotalSize(); ++i)
+	{
+		a.At(i) = static_cast<float>(i % 97) - 48.0f;
+	}
+	for (unsigned int i = 0; i < 700; ++i)
+	{
+		row.At(i) = static_cast<float>(i) * 0.5f;
+	}
+	const numpy::Ndarray<float> parallel = a * 2.0f + row;
+	const numpy::Ndarray<float> transposed = a.Transpose() * 3.0f;
+	pool.SetThreadCount(1);
+	assert(pool.GetThreadCount() == 1);
+	assert(parallel == (a * 2.0f + row).Eval() && transposed == (a.Transpose() * 3.0f).Eval());
+
+	pool.SetThreadCount(defaultCount);
+	std::cout << "Thread Pool Test Done" << std::endl;
+}
+
+void test16()
+{
+	// Shapes whose element count or byte size overflows size_t come back empty instead of wrapping.
+	const size_t big = size_t(1) << 40;
+	assert(numpy::Ndarray<float>({ big, big }).GetTotalSize() == 0);
+	assert(numpy::Ndarray<double>({ std::numeric_limits<size_t>::max() / 4, 2 }).GetTotalSize() == 0);
+	assert(numpy::Numpy<float>::Zeros({ 3, 0 }).GetTotalSize() == 0);
+	// The built-in array forms take their rank from the array type and check their product the same way.
+	const unsigned int cube[] = { 2, 3, 4 };
+	const unsigned int huge[] = { 1u << 31, 1u << 31, 1u << 31 };
+	assert(numpy::Numpy<int>::Ones(cube).GetDimension() == 3 && numpy::Numpy<int>::Ones(cube).GetTotalSize() == 24);
+	assert(numpy::Numpy<double>::Zeros(huge).GetTotalSize() == 0);
+	numpy::Ndarray<int> reshaped({ 6, 4 }, 1);
+	reshaped.Reshape(huge);
+	assert(reshaped.GetDimension() == 2);
+	reshaped.Reshape(cube);
+	assert(reshaped.GetDimension() == 3 && reshaped.GetArraySize(2) == 4);
+	// int and unsigned int variables need no casts; a negative size gives the empty array.
+	const int rows = 3;
+	const unsigned int columns = 5;
+	assert(numpy::Ndarray<float>({ rows, rows }).GetTotalSize() == 9 && numpy::Numpy<float>::Ones({ columns, columns }).At(24) == 1.0f);
+	assert(numpy::Ndarray<float>({ rows, -rows }, 1.0f).GetTotalSize() == 0);
+	// So does a product whose result shape overflows, without Gemm being asked to fill it.
+	const numpy::Ndarray<float> unit({ 1, 1 }, 1.0f);
+	const numpy::Ndarray<float> bigColumn = unit.BroadcastTo({ big, 1 });
+	const numpy::Ndarray<float> bigRow = unit.BroadcastTo({ 1, big });
+	assert(bigColumn.GetTotalSize() == big && numpy::Numpy<float>::Dot(bigColumn, bigRow).GetTotalSize() == 0);
+	numpy::Ndarray<float> product({ 2, 2 });
+	numpy::Numpy<float>::Dot(product, bigColumn, bigRow);
+	assert(product.GetTotalSize() == 0);
+
+	// Broadcast views past 2^32 elements are addressed with 64-bit indices and strides, without allocating them.
+	numpy::Ndarray<float> column({ 1u << 17, 1 });
+	for (unsigned int i = 0; i < (1u << 17); ++i)
+	{
+		column.At(i) = static_cast<float>(i);
+	}
+	const numpy::Ndarray<float> wide = column.BroadcastTo({ 1u << 17, 1u << 16 });
+	assert(wide.GetTotalSize() == size_t(1) << 33 && wide.GetStride(1) == 0);
+	assert(wide.At((size_t(1) << 33) - 1) == static_cast<float>((1u << 17) - 1));
+	assert(wide.At((size_t(5) << 16) + 7) == 5.0f);
+	const numpy::Ndarray<float> tail = wide.Slice(0, (1u << 17) - 2, 1u << 17);
+	assert(tail.GetTotalSize() == size_t(2) << 16 && tail.At(1u << 16) == static_cast<float>((1u << 17) - 1));
+	assert(wide.Transpose().At((size_t(3) << 17) + 9) == 9.0f);
+	assert(column.BroadcastTo({ big, big, 1u << 17, 1 }).GetTotalSize() == 0);
+
+	// So does a broadcast expression whose result would overflow.
+	const numpy::Ndarray<float> one({ 1 }, 1.0f);
+	const numpy::Ndarray<float> tall = one.BroadcastTo({ big, 1 });
+	const numpy::Ndarray<float> flat = one.BroadcastTo({ 1, big });
+	assert(!(tall + flat).IsValid() && numpy::Ndarray<float>(tall + flat).GetTotalSize() == 0);
+
+	// Reshape still infers -1.
+	assert(numpy::Ndarray<float>({ 4, 6 }).Reshape({ -1, 3 }).GetArraySize(0) == 8);
+	std::cout << "Large Tensor Test Done" << std::endl;
+}
+
+void test17()
+{
+	using Matrix = numpy::StaticNdarray<float, 3, 4>;
+	static_assert(Matrix::DIMENSION == 2 && Matrix::TOTAL_SIZE == 12 && Matrix::GetArraySize(1) == 4, "static shape");
+	Matrix a({ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 });
+	const Matrix ones(1.0f);
+	const numpy::StaticNdarray<float, 4> row({ 10, 20, 30, 40 });
+	assert((a + ones).At(11) == 13.0f && (a - ones).At(0) == 0.0f && (a * a).At(2) == 9.0f && (a * 2.0f).At(5) == 12.0f);
+	assert((a + row).At(0) == 11.0f && (a + row).At(7) == 48.0f);
+	assert(numpy::StaticNumpy<float>::Transpose(a).At(1) == 5.0f);
+
+	// Dot, with and without the bias and ReLU epilogue, matches the dynamic GEMM.
+	numpy::StaticNdarray<float, 4, 5> b;
+	for (size_t i = 0; i < b.GetTotalSize(); ++i)
+	{
+		b.At(i) = static_cast<float>(i % 7) - 3.0f;
+	}
+	const numpy::StaticNdarray<float, 5> bias({ -50, 0, 5, -5, 1 });
+	const numpy::StaticNdarray<float, 3, 5> product = numpy::StaticNumpy<float>::Dot(a, b);
+	const numpy::Ndarray<float> expected = numpy::Numpy<float>::Dot(a.View(), b.View());
+	assert(product.Copy() == expected);
+	numpy::Ndarray<float> fused;
+	numpy::Numpy<float>::Dot(fused, a.View(), b.View(), bias.Copy(), true);
+	assert(numpy::StaticNumpy<float>::Dot(a, b, bias, true).View() == fused);
+	assert(numpy::StaticNumpy<float>::Maximum(product + bias, 0.0f) == numpy::StaticNumpy<float>::Dot(a, b, bias, true));
+
+	// Views share the elements both ways, and Assign copies a dynamic array of the same shape in.
+	numpy::Ndarray<float> view = a.View();
+	assert(view.GetData() == a.GetData() && view.GetArraySize(0) == 3);
+	view *= 2.0f;
+	assert(a.At(11) == 24.0f);
+	numpy::Ndarray<float> detached = product.Copy();
+	detached *= 0.0f;
+	assert(detached.GetData() != product.GetData() && product.At(0) == expected.At(0));
+	Matrix copy;
+	assert(copy.Assign(expected.Slice(1, 0, 4)) && copy.At(4) == expected.At(5));
+	assert(!copy.Assign(expected) && copy.At(4) == expected.At(5));
+	std::cout << "Static Ndarray Test Done" << std::endl;
+}
+
+void test18()
+{
+	// 16-bit storage: round to nearest even on the way in, exact on the way out, and the usual specials.
+	numpy::Ndarray<float> a({ 8, 600 });
+	numpy::Ndarray<float> b({ 600, 5 });
+	for (size_t i = 0; i < a.GetTotalSize(); ++i)
+	{
+		a.At(i) = static_cast<float>(i % 5) - 2.0f;
+	}
+	for (size_t i = 0; i < b.GetTotalSize(); ++i)
+	{
+		b.At(i) = static_cast<float>(i % 7) - 3.0f;
+	}
+	const numpy::Ndarray<numpy::BFloat16> a16 = a.AsType<numpy::BFloat16>();
+	assert(a16.AsType<float>() == a && a.Transpose().AsType<numpy::BFloat16>().AsType<float>() == a.Transpose());
+	assert(static_cast<float>(numpy::BFloat16(1.00390625f)) == 1.0f && static_cast<float>(numpy::BFloat16(1.01171875f)) == 1.015625f);
+	assert(static_cast<float>(numpy::Float16(70000.0f)) == std::numeric_limits<float>::infinity());
+	assert(static_cast<float>(numpy::Float16(65504.0f)) == 65504.0f && static_cast<float>(numpy::Float16(-std::ldexp(1.0f, -24))) == -std::ldexp(1.0f, -24));
+	assert(std::isnan(static_cast<float>(numpy::BFloat16(std::numeric_limits<float>::quiet_NaN()))));
+
+	// Dot sums in float over k > KC and rounds once, so it equals the float product rounded to the storage type.
+	const numpy::Ndarray<float> product = numpy::Numpy<float>::Dot(a, b);
+	assert(numpy::Numpy<numpy::BFloat16>::Dot(a16, b.AsType<numpy::BFloat16>()) == product.AsType<numpy::BFloat16>());
+	assert(numpy::Numpy<numpy::Float16>::Dot(a.AsType<numpy::Float16>(), b.AsType<numpy::Float16>()) == product.AsType<numpy::Float16>());
+	const numpy::Ndarray<float> bias({ 5 }, -20.0f);
+	numpy::Ndarray<float> fused;
+	numpy::Numpy<float>::Dot(fused, a.Slice(1, 0, 200), b.Slice(0, 0, 200), bias, true);
+	numpy::Ndarray<numpy::BFloat16> fused16;
+	numpy::Numpy<numpy::BFloat16>::Dot(fused16, a16.Slice(1, 0, 200), b.Slice(0, 0, 200).AsType<numpy::BFloat16>(), bias.AsType<numpy::BFloat16>(), true);
+	assert(fused16 == fused.AsType<numpy::BFloat16>());
+
+	// Float16 has a NumPy dtype and maps without a copy.
+	const numpy::Ndarray<numpy::Float16> half = product.AsType<numpy::Float16>();
+	assert(numpy::Npy<numpy::Float16>::Save("test18.npy", half) && numpy::Npy<numpy::Float16>::Map("test18.npy") == half);
+	assert(numpy::Npy<float>::Load("test18.npy") == half.AsType<float>());
+	std::remove("test18.npy");
+
+	// int8 quantization: per channel, per tensor, and the round trip is within half a step.
+	numpy::Ndarray<float> w({ 70, 21 });
+	numpy::Ndarray<float> x({ 37, 70 });
+	for (size_t i = 0; i < w.GetTotalSize(); ++i)
+	{
+		w.At(i) = std::sin(static_cast<float>(i)) * static_cast<float>(1 + i % 21);
+	}
+	for (size_t i = 0; i < x.GetTotalSize(); ++i)
+	{
+		x.At(i) = std::cos(static_cast<float>(i) * 0.37f) * 3.0f;
+	}
+	numpy::Ndarray<float> scales;
+	const numpy::Ndarray<std::int8_t> q = numpy::Numpy<float>::Quantize(w, 1, scales);
+	assert(scales.GetArraySize(0) == 21 && std::fabs(scales.At(20) * 127.0f - numpy::Numpy<float>::Max(numpy::Numpy<float>::Maximum(w, 0.0f) + numpy::Numpy<float>::Maximum(w * -1.0f, 0.0f), 0).At(20)) < 1e-4f);
+	const numpy::Ndarray<float> restored = numpy::Numpy<float>::Dequantize(q, 1, scales);
+	for (size_t i = 0; i < w.GetTotalSize(); ++i)
+	{
+		assert(std::fabs(restored.At(i) - w.At(i)) <= scales.At(i % 21) * 0.5f + 1e-5f);
+	}
+	float scale = 0.0f;
+	const numpy::Ndarray<std::int8_t> qTensor = numpy::Numpy<float>::Quantize(w, scale);
+	assert(std::fabs(numpy::Numpy<float>::Dequantize(qTensor, scale).At(0) - w.At(0)) <= scale * 0.5f);
+	numpy::Ndarray<float> none({ 1 });
+	assert(numpy::Numpy<float>::Quantize(w, 2, none).GetTotalSize() == 0 && none.GetTotalSize() == 0);
+
+	// The int8 Dot is the float product of the per-row quantized x and the per-column quantized w, and every kernel produces
+	// the same integer sums.
+	const numpy::QuantizedMatrix<float> quantized(q, scales);
+	const numpy::Ndarray<float> bias21({ 21 }, 0.5f);
+	numpy::Ndarray<float> xScales;
+	const numpy::Ndarray<std::int8_t> xq = numpy::Numpy<float>::Quantize(x, 0, xScales);
+	numpy::Ndarray<float> reference;
+	numpy::Numpy<float>::Dot(reference, numpy::Numpy<float>::Dequantize(xq, 0, xScales), restored, bias21, true);
+	numpy::Ndarray<float> int8;
+	numpy::Numpy<float>::Dot(int8, x, quantized, bias21, true);
+	const float largest = numpy::Numpy<float>::Max(reference);
+	for (size_t i = 0; i < reference.GetTotalSize(); ++i)
+	{
+		assert(std::fabs(int8.At(i) - reference.At(i)) < largest * 1e-5f);
+	}
+	const numpy::SimdLevel supported = numpy::Simd::GetSupportedLevel();
+	for (int level = 0; level <= static_cast<int>(supported); ++level)
+	{
+		numpy::Simd::SetLevel(static_cast<numpy::SimdLevel>(level));
+		numpy::Ndarray<float> out({ 37, 21 });
+		numpy::Numpy<float>::Dot(out, x, quantized, bias21, true);
+		assert(out == int8);
+	}
+	numpy::Simd::SetLevel(supported);
+	numpy::Ndarray<float> transposed;
+	numpy::Numpy<float>::Dot(transposed, numpy::Ndarray<float>(x.Transpose()).Transpose(), quantized, numpy::Ndarray<float>(), false);
+	numpy::Numpy<float>::Dot(reference, x, quantized, numpy::Ndarray<float>(), false);
+	assert(transposed == reference);
+	assert(numpy::QuantizedMatrix<float>(q, numpy::Ndarray<float>({ 20 })).IsEmpty());
+	std::cout << "Reduced Precision Test Done (int8 " << (numpy::Simd::IsVnniSupported() ? "VNNI" : numpy::Simd::GetName(supported)) << ")" << std::endl;
+}
+
+void test19()
+{
+	// A two-layer network with every kind of node; its gradients match central differences of the loss.
+	numpy::Ndarray<double> x({ 4, 3 });
+	numpy::Ndarray<double> w1({ 3, 5 });
+	numpy::Ndarray<double> b1({ 5 });
+	numpy::Ndarray<double> w2({ 5, 2 });
+	numpy::Ndarray<double> b2({ 2 });
+	numpy::Ndarray<double> t({ 4, 2 }, 0.0);
+	numpy::Ndarray<double>* parameters[] = { &w1, &b1, &w2, &b2 };
+	for (size_t p = 0; p < 4; ++p)
+	{
+		for (size_t i = 0; i < parameters[p]->GetTotalSize(); ++i)
+		{
+			parameters[p]->At(i) = std::sin(static_cast<double>(7 * p + 3 * i + 1));
+		}
+	}
+	for (size_t i = 0; i < x.GetTotalSize(); ++i)
+	{
+		x.At(i) = std::cos(static_cast<double>(i));
+	}
+	for (size_t r = 0; r < 4; ++r)
+	{
+		t.At(r * 2 + r % 2) = 1.0;
+	}
+
+	using Tape = numpy::Tape<double>;
+	using Variable = numpy::Variable<double>;
+	const Tape::Segment hidden = [](Tape& tape, const std::vector<Variable>& in)
+	{
+		const Variable u = tape.Dot(in[0], in[1]) + in[2];
+		return tape.Relu(u) + tape.Tanh(u) * tape.Sigmoid(u);
+	};
+	auto forward = [&](Tape& tape, const bool& bCheckpoint, Variable* leaves)
+	{
+		const Variable input = tape.Constant(x);
+		for (size_t p = 0; p < 4; ++p)
+		{
+			leaves[p] = tape.Parameter(*parameters[p]);
+		}
+		const std::vector<Variable> in = { input, leaves[0], leaves[1] };
+		const Variable h = bCheckpoint ? tape.Checkpoint(hidden, in) : hidden(tape, in);
+		const Variable logits = tape.Dot(h, leaves[2]) + leaves[3];
+		const Variable penalty = tape.Mean(tape.Sum(h * h, 1)) + tape.Sum(tape.Mean(leaves[0], 0));
+		return tape.SoftmaxCrossEntropy(logits, t) + penalty * tape.Constant(numpy::Ndarray<double>({ 1 }, 0.01));
+	};
+
+	Tape tape;
+	Variable leaves[4];
+	const Variable loss = forward(tape, false, leaves);
+	assert(loss.IsValid() && tape.GetSavedSize() > 0);
+	const double lossValue = loss.GetValue().At(0);
+	const size_t saved = tape.GetSavedSize();
+	assert(tape.Backward(loss) && !tape.Backward(loss));
+	// Only the leaves and their gradients survive Backward.
+	assert(tape.GetSavedSize() == 0 && loss.GetValue().GetTotalSize() == 0);
+	for (size_t p = 0; p < 4; ++p)
+	{
+		const numpy::Ndarray<double>& gradient = leaves[p].GetGradient();
+		assert(gradient.GetDimension() == parameters[p]->GetDimension() && gradient.GetTotalSize() == parameters[p]->GetTotalSize());
+		for (size_t i = 0; i < parameters[p]->GetTotalSize(); ++i)
+		{
+			const double value = parameters[p]->At(i);
+			double losses[2];
+			for (int side = 0; side < 2; ++side)
+			{
+				parameters[p]->At(i) = value + (side == 0 ? 1e-6 : -1e-6);
+				Tape probe;
+				Variable unused[4];
+				losses[side] = forward(probe, false, unused).GetValue().At(0);
+			}
+			parameters[p]->At(i) = value;
+			const double numeric = (losses[0] - losses[1]) / 2e-6;
+			assert(std::abs(numeric - gradient.At(i)) <= 1e-6 * (1.0 + std::abs(numeric)));
+		}
+	}
+
+	// Checkpointing keeps only the segment's output and gives the same gradients.
+	Tape checkpointed;
+	Variable recomputed[4];
+	const Variable same = forward(checkpointed, true, recomputed);
+	assert(std::abs(same.GetValue().At(0) - lossValue) < 1e-12);
+	assert(checkpointed.GetSavedSize() < saved && checkpointed.Backward(same));
+	for (size_t p = 0; p < 4; ++p)
+	{
+		for (size_t i = 0; i < parameters[p]->GetTotalSize(); ++i)
+		{
+			assert(std::abs(recomputed[p].GetGradient().At(i) - leaves[p].GetGradient().At(i)) < 1e-12);
+		}
+	}
+
+	// Operands that do not fit give invalid variables, and only a single element can seed Backward.
+	Tape invalid;
+	const Variable a = invalid.Parameter(w1);
+	assert(!invalid.Dot(a, a).IsValid() && !(a + invalid.Constant(b2)).IsValid() && !(a * Variable()).IsValid());
+	assert(!invalid.Backward(a) && !invalid.Backward(Variable()) && !tape.Backward(a));
+
+	// A training step reuses the pool for values and the arena for gradients, so it takes nothing from the system.
+	numpy::Ndarray<float> xf = x.AsType<float>();
+	numpy::Ndarray<float> tf({ 4, 5 }, 0.0f);
+	for (size_t r = 0; r < 4; ++r)
+	{
+		tf.At(r * 5 + r) = 1.0f;
+	}
+	numpy::Ndarray<float> wf = w1.AsType<float>();
+	numpy::Ndarray<float> bf = b1.AsType<float>();
+	numpy::Tape<float> training;
+	auto step = [&]()
+	{
+		training.Clear();
+		const numpy::Variable<float> w = training.Parameter(wf);
+		const numpy::Variable<float> b = training.Parameter(bf);
+		const numpy::Variable<float> u = training.Dot(training.Constant(xf), w) + b;
+		const numpy::Variable<float> l = training.SoftmaxCrossEntropy(training.Relu(u), tf);
+		const float value = l.GetValue().At(0);
+		assert(training.Backward(l));
+		wf -= w.GetGradient() * 0.5f;
+		bf -= b.GetGradient() * 0.5f;
+		return value;
+	};
+	const float first = step();
+	step();
+	numpy::Allocator::ResetStatistics();
+	float last = 0.0f;
+	for (int i = 0; i < 20; ++i)
+	{
+		last = step();
+	}
+	const numpy::AllocationStatistics statistics = numpy::Allocator::GetStatistics();
+	assert(statistics.SystemAllocations == 0 && statistics.ArenaAllocations > 0 && last < first);
+	assert(training.GetArena().GetUsedSize() > 0);
+	std::cout << "Autograd Test Done" << std::endl;
+}
+
+void test20()
+{
+	// An MLP captured as a graph: bias and ReLU fold into each GEMM, leaving three products and a softmax.
+	numpy::Mlp<float> mlp({ 8, 16, 16, 4 }, 5);
+	numpy::Ndarray<float> x({ 50, 8 });
+	for (size_t i = 0; i < x.GetTotalSize(); ++i)
+	{
+		x.At(i) = std::sin(static_cast<float>(i));
+	}
+	numpy::Graph<float> graph;
+	numpy::Symbol<float> y = graph.Input({ 50, 8 });
+	for (unsigned int i = 0; i < mlp.GetLayerCount(); ++i)
+	{
+		y = graph.Dot(y, graph.Constant(mlp.GetLayer(i).GetWeight())) + graph.Constant(mlp.GetLayer(i).GetBias());
+		y = i + 1 < mlp.GetLayerCount() ? graph.Relu(y) : y;
+	}
+	numpy::CompiledGraph<float> compiled = graph.Compile({ graph.Softmax(y) });
+	assert(compiled.IsValid() && compiled.GetStepCount() == 4 && compiled.GetWorkspaceSize() < compiled.GetUnplannedSize());
+
+	// Run allocates nothing at all, and matches the layer-by-layer model.
+	assert(compiled.Run({ &x }));
+	numpy::Allocator::ResetStatistics();
+	assert(compiled.Run({ &x }));
+	const numpy::AllocationStatistics statistics = numpy::Allocator::GetStatistics();
+	assert(statistics.SystemAllocations == 0 && statistics.PoolAllocations == 0 && statistics.ArenaAllocations == 0);
+	const numpy::Ndarray<float>& logits = mlp.Predict(x);
+	const numpy::Ndarray<float>& probability = compiled.GetOutput(0);
+	for (size_t r = 0; r < 50; ++r)
+	{
+		float sum = 0.0f;
+		for (size_t c = 0; c < 4; ++c)
+		{
+			sum += std::exp(logits.At(r * 4 + c) - logits.At(r * 4));
+		}
+		for (size_t c = 0; c < 4; ++c)
+		{
+			const float expected = std::exp(logits.At(r * 4 + c) - logits.At(r * 4)) / sum;
+			assert(std::abs(probability.At(r * 4 + c) - expected) < 1e-6f);
+		}
+	}
+
+	// Products whose lifetimes do not overlap share memory: four in a chain fit in two buffers.
+	numpy::Graph<float> chain;
+	const numpy::Symbol<float> w = chain.Input({ 16, 16 });
+	numpy::Symbol<float> product = chain.Input({ 16, 16 });
+	for (int i = 0; i < 4; ++i)
+	{
+		product = chain.Dot(product, w);
+	}
+	numpy::CompiledGraph<float> chained = chain.Compile({ product });
+	assert(chained.GetWorkspaceSize() == 2 * 16 * 16 * sizeof(float) && chained.GetUnplannedSize() == 4 * 16 * 16 * sizeof(float));
+	const numpy::Ndarray<float> half({ 16, 16 }, 0.5f);
+	assert(chained.Run({ &half, &half }) && chained.GetOutput(0) == numpy::Ndarray<float>({ 16, 16 }, 2048.0f));
+
+	// An element-wise chain over two inputs, one broadcast, runs as a single step.
+	numpy::Graph<double> elementwise;
+	const numpy::Symbol<double> a = elementwise.Input({ 300, 7 });
+	const numpy::Symbol<double> b = elementwise.Input({ 7 });
+	const numpy::Symbol<double> chainOutput = elementwise.Tanh(elementwise.Sigmoid(b + a) * a);
+	numpy::CompiledGraph<double> fused = elementwise.Compile({ chainOutput });
+	numpy::Ndarray<double> av({ 300, 7 });
+	numpy::Ndarray<double> bv({ 7 });
+	for (size_t i = 0; i < av.GetTotalSize(); ++i)
+	{
+		av.At(i) = std::cos(static_cast<double>(i));
+	}
+	for (size_t i = 0; i < bv.GetTotalSize(); ++i)
+	{
+		bv.At(i) = 0.5 * static_cast<double>(i) - 1.0;
+	}
+	assert(fused.GetStepCount() == 1 && fused.Run({ &av, &bv }));
+	for (size_t i = 0; i < av.GetTotalSize(); ++i)
+	{
+		assert(std::abs(fused.GetOutput(0).At(i) - std::tanh(av.At(i) / (1.0 + std::exp(-(av.At(i) + bv.At(i % 7)))))) < 1e-15);
+	}
+
+	// Shapes are checked when nodes are added and when inputs are bound.
+	assert(!graph.Dot(graph.Input({ 3, 4 }), graph.Input({ 5, 4 })).IsValid());
+	assert(!(a + elementwise.Input({ 6 })).IsValid() && !elementwise.Compile({ a }).IsValid());
+	const numpy::Ndarray<double> strided = numpy::Ndarray<double>({ 300, 14 }, 1.0).Slice(1, 0, 14, 2);
+	assert(!fused.Run({ &bv, &av }) && !fused.Run({ &av }) && !fused.Run({ &strided, &bv }));
+	std::cout << "Graph Test Done" << std::endl;
+}
+
+// c[e] = a[e] . b[e] for 3-D stacks, a stack of one matrix broadcast over every e.
+template<typename T>
+bool matchesBatchedDot(const numpy::Ndarray<T>& c, const numpy::Ndarray<T>& a, const numpy::Ndarray<T>& b, const double& tolerance)
+{
+	const size_t batch = c.GetArraySize(0), m = a.GetArraySize(1), k = a.GetArraySize(2), n = b.GetArraySize(2);
+	if (c.GetDimension() != 3 || c.GetArraySize(1) != m || c.GetArraySize(2) != n)
+		return false;
+	for (size_t e = 0; e < batch; ++e)
+	{
+		const size_t entryA = a.GetArraySize(0) == 1 ? 0 : e, entryB = b.GetArraySize(0) == 1 ? 0 : e;
+		for (size_t i = 0; i < m; ++i)
+		{
+			for (size_t j = 0; j < n; ++j)
+			{
+				double expected = 0.0;
+				for (size_t p = 0; p < k; ++p)
+				{
+					expected += static_cast<double>(a.At((entryA * m + i) * k + p)) * static_cast<double>(b.At((entryB * k + p) * n + j));
+				}
+				if (std::abs(static_cast<double>(c.At((e * m + i) * n + j)) - expected) > tolerance)
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+void test21()
+{
+	auto fill = [](numpy::Ndarray<double>& a, const double& phase)
+	{
+		for (size_t i = 0; i < a.GetTotalSize(); ++i)
+		{
+			a.At(i) = std::sin(static_cast<double>(i) * 0.7 + phase);
+		}
+	};
+
+	// One pair of matrices per batch entry: enough small products that they run on separate threads.
+	numpy::Ndarray<double> a({ 64, 16, 32 });
+	numpy::Ndarray<double> b({ 64, 32, 16 });
+	fill(a, 0.0);
+	fill(b, 1.0);
+	numpy::Ndarray<double> c = numpy::Numpy<double>::Dot(a, b);
+	assert(matchesBatchedDot(c, a, b, 1e-12));
+
+	// out= writes into an array of the result's shape; a 2-D b is shared by every entry of a, including a transposed view.
+	numpy::Ndarray<double> out({ 64, 16, 16 });
+	const double* data = out.GetData();
+	numpy::Numpy<double>::Dot(out, a, b);
+	assert(out.GetData() == data && out == c);
+	numpy::Ndarray<double> w({ 32, 5 });
+	fill(w, 2.0);
+	const numpy::Ndarray<double> shared = w.Reshape({ 1, 32, 5 });
+	assert(matchesBatchedDot(numpy::Numpy<double>::Dot(a, w), a, shared, 1e-12));
+	numpy::Ndarray<double> x({ 64, 32, 16 });
+	fill(x, 3.0);
+	const numpy::Ndarray<double> xt = x.Transpose({ 0, 2, 1 });
+	numpy::Ndarray<double> sharedOut = numpy::Numpy<double>::Dot(xt, w);
+	assert(matchesBatchedDot(sharedOut, xt, shared, 1e-12));
+
+	// Attention-style scores q . k^T per head, k^T a strided view.
+	numpy::Ndarray<double> q({ 4, 10, 8 });
+	numpy::Ndarray<double> key({ 4, 12, 8 });
+	fill(q, 4.0);
+	fill(key, 5.0);
+	const numpy::Ndarray<double> keyT = key.Transpose({ 0, 2, 1 });
+	assert(matchesBatchedDot(numpy::Numpy<double>::Dot(q, keyT), q, keyT, 1e-12));
+
+	// Batch dimensions broadcast: (2, 1, 5, 7) . (3, 7, 4) is (2, 3, 5, 4).
+	numpy::Ndarray<double> left({ 2, 1, 5, 7 });
+	numpy::Ndarray<double> right({ 3, 7, 4 });
+	fill(left, 6.0);
+	fill(right, 7.0);
+	const numpy::Ndarray<double> broadcast = numpy::Numpy<double>::Dot(left, right);
+	assert(broadcast.GetDimension() == 4 && broadcast.GetArraySize(0) == 2 && broadcast.GetArraySize(1) == 3);
+	for (size_t i = 0; i < 2; ++i)
+	{
+		assert(matchesBatchedDot(broadcast.Slice(0, i, i + 1).Reshape({ 3, 5, 4 }), left.Slice(0, i, i + 1).Reshape({ 1, 5, 7 }), right, 1e-12));
+	}
+
+	// A 1-D operand is a row (column) whose dimension is dropped.
+	numpy::Ndarray<double> v({ 7 });
+	fill(v, 8.0);
+	const numpy::Ndarray<double> row = numpy::Numpy<double>::Dot(v, right);
+	const numpy::Ndarray<double> column = numpy::Numpy<double>::Dot(left.Reshape({ 2, 5, 7 }), v);
+	assert(row.GetDimension() == 2 && row.GetArraySize(0) == 3 && row.GetArraySize(1) == 4);
+	assert(column.GetDimension() == 2 && column.GetArraySize(0) == 2 && column.GetArraySize(1) == 5);
+	assert(matchesBatchedDot(row.Reshape({ 3, 1, 4 }), v.Reshape({ 1, 1, 7 }), right, 1e-12));
+	assert(matchesBatchedDot(column.Reshape({ 2, 5, 1 }), left.Reshape({ 2, 5, 7 }), v.Reshape({ 1, 7, 1 }), 1e-12));
+
+	// bfloat16 entries longer than one k block keep their float partial sums.
+	const numpy::Ndarray<numpy::BFloat16> a16 = numpy::Ndarray<double>({ 3, 4, 300 }, 0.25).AsType<numpy::BFloat16>();
+	const numpy::Ndarray<numpy::BFloat16> b16 = numpy::Ndarray<double>({ 3, 300, 5 }, 0.5).AsType<numpy::BFloat16>();
+	assert(matchesBatchedDot(numpy::Numpy<numpy::BFloat16>::Dot(a16, b16), a16, b16, 0.0));
+
+	// Batch and inner sizes must agree.
+	assert(numpy::Numpy<double>::Dot(numpy::Ndarray<double>({ 2, 5, 7 }), numpy::Ndarray<double>({ 3, 7, 4 })).GetTotalSize() == 0);
+	assert(numpy::Numpy<double>::Dot(numpy::Ndarray<double>({ 2, 5, 7 }), numpy::Ndarray<double>({ 2, 6, 4 })).GetTotalSize() == 0);
+	std::cout << "Batched Dot Test Done" << std::endl;
+}
+
+void test22()
+{
+	using Convolution = numpy::Convolution<double>;
+	auto fill = [](numpy::Ndarray<double>& a, const double& phase)
+	{
+		for (size_t i = 0; i < a.GetTotalSize(); ++i)
+		{
+			a.At(i) = std::sin(static_cast<double>(i) * 0.37 + phase);
+		}
+	};
+	auto close = [](const numpy::Ndarray<double>& a, const numpy::Ndarray<double>& b, const double& tolerance)
+	{
+		if (a.GetDimension() != b.GetDimension() || a.GetTotalSize() != b.GetTotalSize() || a.GetTotalSize() == 0)
+			return false;
+		for (unsigned int i = 0; i < a.GetDimension(); ++i)
+		{
+			if (a.GetArraySize(i) != b.GetArraySize(i))
+				return false;
+		}
+		for (size_t i = 0; i < a.GetTotalSize(); ++i)
+		{
+			if (std::abs(a.At(i) - b.At(i)) > tolerance)
+				return false;
+		}
+		return true;
+	};
+
+	// Every algorithm agrees with the direct loop, in both layouts, on odd image sizes that leave partial Winograd tiles.
+	numpy::Ndarray<double> x({ 2, 3, 7, 9 });
+	numpy::Ndarray<double> weight({ 4, 3, 3, 3 });
+	numpy::Ndarray<double> bias({ 4 });
+	fill(x, 0.0);
+	fill(weight, 1.0);
+	fill(bias, 2.0);
+	const numpy::Ndarray<double> xNhwc(x.Transpose({ 0, 2, 3, 1 }));
+	const numpy::Ndarray<double> weightNhwc(weight.Transpose({ 2, 3, 1, 0 }));
+	numpy::ConvolutionParameters nchw;
+	nchw.Padding = 1;
+	numpy::ConvolutionParameters nhwc = nchw;
+	nhwc.Layout = numpy::ImageLayout::Nhwc;
+	numpy::Ndarray<double> reference, out, outNhwc;
+	Convolution::Forward(reference, x, weight, bias, nchw, true, numpy::ConvolutionAlgorithm::Direct);
+	assert(reference.GetArraySize(1) == 4 && reference.GetArraySize(2) == 7 && reference.GetArraySize(3) == 9);
+	const numpy::ConvolutionAlgorithm algorithms[] = { numpy::ConvolutionAlgorithm::Im2col, numpy::ConvolutionAlgorithm::Winograd };
+	for (const numpy::ConvolutionAlgorithm& algorithm : algorithms)
+	{
+		Convolution::Forward(out, x, weight, bias, nchw, true, algorithm);
+		Convolution::Forward(outNhwc, xNhwc, weightNhwc, bias, nhwc, true, algorithm);
+		assert(close(out, reference, 1e-12) && close(outNhwc.Transpose({ 0, 3, 1, 2 }), reference, 1e-12));
+	}
+
+	// Enough channels for Auto to pick Winograd, over tiles in more than one block.
+	numpy::Ndarray<double> deep({ 3, 64, 16, 18 });
+	numpy::Ndarray<double> deepWeight({ 64, 64, 3, 3 });
+	fill(deep, 6.0);
+	fill(deepWeight, 7.0);
+	deepWeight *= 0.05;
+	Convolution::Forward(reference, deep, deepWeight, numpy::Ndarray<double>(), nchw, false, numpy::ConvolutionAlgorithm::Direct);
+	Convolution::Forward(out, deep, deepWeight, numpy::Ndarray<double>(), nchw, false);
+	assert(close(out, reference, 1e-11));
+
+	// Strided, non-square kernels go through im2col.
+	numpy::Ndarray<double> wide({ 5, 3, 2, 3 });
+	fill(wide, 3.0);
+	numpy::ConvolutionParameters strided = nchw;
+	strided.Stride = 2;
+	Convolution::Forward(reference, x, wide, numpy::Ndarray<double>(), strided, false, numpy::ConvolutionAlgorithm::Direct);
+	Convolution::Forward(out, x, wide, numpy::Ndarray<double>(), strided, false);
+	assert(reference.GetArraySize(2) == 4 && reference.GetArraySize(3) == 5 && close(out, reference, 1e-12));
+
+	// Layer gradients against central differences of L = sum(y * r), in both layouts.
+	for (const numpy::ImageLayout& layout : { numpy::ImageLayout::Nchw, numpy::ImageLayout::Nhwc })
+	{
+		numpy::ConvolutionParameters parameters = strided;
+		parameters.Layout = layout;
+		numpy::Conv2D<double> layer(3, 4, 3, parameters, numpy::Activation::Identity, 7);
+		fill(layer.GetBias(), 4.0);
+		numpy::Ndarray<double> input(layout == numpy::ImageLayout::Nchw ? xNhwc.Transpose({ 0, 3, 1, 2 }) : xNhwc);
+		numpy::Ndarray<double> r(layer.Forward(input));
+		fill(r, 5.0);
+		layer.Backward(r);
+		auto loss = [&]()
+		{
+			numpy::Ndarray<double> y;
+			layer.Infer(input, y);
+			double sum = 0.0;
+			for (size_t i = 0; i < y.GetTotalSize(); ++i)
+			{
+				sum += y.At(i) * r.At(i);
+			}
+			return sum;
+		};
+		auto check = [&](numpy::Ndarray<double>& variable, const numpy::Ndarray<double>& gradient)
+		{
+			assert(gradient.GetTotalSize() == variable.GetTotalSize());
+			for (size_t i = 0; i < variable.GetTotalSize(); i += 5)
+			{
+				const double saved = variable.At(i);
+				variable.At(i) = saved + 1e-5;
+				const double up = loss();
+				variable.At(i) = saved - 1e-5;
+				const double down = loss();
+				variable.At(i) = saved;
+				assert(std::abs((up - down) / 2e-5 - gradient.At(i)) < 1e-6);
+			}
+		};
+		check(input, layer.GetGradInput());
+		check(layer.GetWeight(), layer.GetGradWeight());
+		check(layer.GetBias(), layer.GetGradBias());
+	}
+
+	// Max pooling keeps the first maximum of each window and routes the gradient back to it.
+	numpy::Ndarray<double> image({ 1, 1, 4, 4 });
+	const double pixels[] = { 1, 5, 2, 0, 3, 4, 2, 8, 0, 0, 1, 1, 9, 0, 1, 2 };
+	for (size_t i = 0; i < 16; ++i)
+	{
+		image.At(i) = pixels[i];
+	}
+	numpy::MaxPool2D<double> pool(2, 2, numpy::ImageLayout::Nchw);
+	const numpy::Ndarray<double>& pooled = pool.Forward(image);
+	assert(pooled.GetArraySize(2) == 2 && pooled.At(0) == 5 && pooled.At(1) == 8 && pooled.At(2) == 9 && pooled.At(3) == 2);
+	const numpy::Ndarray<double>& routed = pool.Backward(numpy::Ndarray<double>({ 1, 1, 2, 2 }, 1.0));
+	for (size_t i = 0; i < 16; ++i)
+	{
+		assert(routed.At(i) == (i == 1 || i == 7 || i == 12 || i == 15 ? 1.0 : 0.0));
+	}
+	numpy::Ndarray<size_t> indices;
+	Convolution::MaxPool(out, indices, x, 3, 2, numpy::ImageLayout::Nchw);
+	Convolution::MaxPool(outNhwc, indices, xNhwc, 3, 2, numpy::ImageLayout::Nhwc);
+	assert(out.GetArraySize(2) == 3 && out.GetArraySize(3) == 4 && close(outNhwc.Transpose({ 0, 3, 1, 2 }), out, 0.0));
+
+	// A small convolutional classifier of 8x8 bar images (horizontal or vertical) learns.
+	numpy::Ndarray<float> bars({ 32, 1, 8, 8 }, 0.0f);
+	numpy::Ndarray<float> target({ 32, 2 }, 0.0f);
+	for (size_t n = 0; n < 32; ++n)
+	{
+		const size_t line = (n * 5) % 8;
+		for (size_t i = 0; i < 8; ++i)
+		{
+			bars.At(n * 64 + (n % 2 == 0 ? line * 8 + i : i * 8 + line)) = 1.0f;
+		}
+		target.At(n * 2 + n % 2) = 1.0f;
+	}
+	numpy::ConvolutionParameters same;
+	same.Padding = 1;
+	numpy::Conv2D<float> conv(1, 4, 3, same, numpy::Activation::Relu, 3);
+	numpy::MaxPool2D<float> maxPool(2, 2, numpy::ImageLayout::Nchw);
+	numpy::Dense<float> dense(4 * 4 * 4, 2, numpy::Activation::Identity, 4);
+	numpy::SoftmaxCrossEntropy<float> criterion;
+	float first = 0.0f, last = 0.0f;
+	for (int step = 0; step < 30; ++step)
+	{
+		const numpy::Ndarray<float>& features = maxPool.Forward(conv.Forward(bars));
+		const numpy::Ndarray<float> flat = features.Reshape({ 32, 64 });
+		last = criterion.Forward(dense.Forward(flat), target);
+		first = step == 0 ? last : first;
+		const numpy::Ndarray<float> gradFeatures = dense.Backward(criterion.Backward()).Reshape({ 32, 4, 4, 4 });
+		conv.Backward(maxPool.Backward(gradFeatures));
+		conv.Update(0.01f);
+		dense.Update(0.01f);
+	}
+	assert(last < 0.5f * first);
+
+	// Shapes are checked: channel counts must match and Winograd takes only 3x3 stride-1 kernels.
+	Convolution::Forward(out, x, numpy::Ndarray<double>({ 4, 2, 3, 3 }), bias, nchw, false);
+	assert(out.GetTotalSize() == 0);
+	Convolution::Forward(out, x, weight, bias, strided, false, numpy::ConvolutionAlgorithm::Winograd);
+	assert(out.GetTotalSize() == 0);
+	std::cout << "Convolution Test Done" << std::endl;
+}
+
+// Error of value in units in the last place of the float nearest reference; results the float range cannot hold normally
+// (overflow or denormal) are compared exactly or skipped.
+double ulpError(const float& value, const double& reference)
+{
+	if (std::isnan(reference))
+		return std::isnan(value) ? 0.0 : std::numeric_limits<double>::infinity();
+	if (std::fabs(reference) > std::numeric_limits<float>::max())
+		return value == static_cast<float>(reference) ? 0.0 : std::numeric_limits<double>::infinity();
+	if (std::fabs(reference) < std::numeric_limits<float>::min())
+		return 0.0;
+	return std::fabs(value - reference) / std::ldexp(1.0, std::ilogb(reference) - 23);
+}
+
+void test23()
+{
+	using Math = numpy::MathKernel<float>;
+	using Function = numpy::MathFunction;
+	// Every 16411th float bit pattern that falls in [low, high].
+	auto sample = [](const float& low, const float& high)
+	{
+		std::vector<float> x;
+		for (uint64_t bits = 0; bits < (uint64_t(1) << 32); bits += 16411)
+		{
+			const uint32_t pattern = static_cast<uint32_t>(bits);
+			float value;
+			std::memcpy(&value, &pattern, sizeof(value));
+			if (value >= low && value <= high)
+			{
+				x.push_back(value);
+			}
+		}
+		return x;
+	};
+	auto maxError = [](const std::vector<float>& x, const Function& function, double (*reference)(double))
+	{
+		std::vector<float> y(x.size());
+		switch (function)
+		{
+		case Function::Exp: Math::Exp(x.data(), y.data(), x.size()); break;
+		case Function::Log: Math::Log(x.data(), y.data(), x.size()); break;
+		case Function::Tanh: Math::Tanh(x.data(), y.data(), x.size()); break;
+		case Function::Sigmoid: Math::Sigmoid(x.data(), y.data(), x.size()); break;
+		case Function::Erf: Math::Erf(x.data(), y.data(), x.size()); break;
+		default: Math::Gelu(x.data(), y.data(), x.size()); break;
+		}
+		double error = 0.0;
+		for (size_t i = 0; i < x.size(); ++i)
+		{
+			error = std::max(error, ulpError(y[i], reference(x[i])));
+		}
+		return error;
+	};
+	double (*sigmoid)(double) = [](double x) { return 1.0 / (1.0 + std::exp(-x)); };
+	double (*gelu)(double) = [](double x) { return 0.5 * x * std::erfc(-x / std::sqrt(2.0)); };
+	double (*exp)(double) = [](double x) { return std::exp(x); };
+	double (*log)(double) = [](double x) { return std::log(x); };
+	double (*tanh)(double) = [](double x) { return std::tanh(x); };
+	double (*erf)(double) = [](double x) { return std::erf(x); };
+	const std::vector<float> expRange = sample(-104.0f, 89.0f);
+	const std::vector<float> positive = sample(0.0f, std::numeric_limits<float>::infinity());
+	const std::vector<float> all = sample(-std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity());
+	const std::vector<float> geluRange = sample(-14.0f, std::numeric_limits<float>::infinity());
+	const std::vector<float> geluBand = sample(-1.42f, -0.7f);
+	const float inf = std::numeric_limits<float>::infinity();
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+
+	const numpy::SimdLevel supported = numpy::Simd::GetSupportedLevel();
+	for (int level = 0; level <= static_cast<int>(supported); ++level)
+	{
+		numpy::Simd::SetLevel(static_cast<numpy::SimdLevel>(level));
+
+		// The bounds documented on MathKernel, measured with the same sampling, with overflow to infinity, NaN in and out, and
+		// the whole float range for the bounded functions.
+		assert(maxError(expRange, Function::Exp, exp) <= 1.0);
+		assert(maxError(positive, Function::Log, log) <= 0.8);
+		assert(maxError(all, Function::Tanh, tanh) <= 1.1);
+		assert(maxError(all, Function::Sigmoid, sigmoid) <= 2.0);
+		assert(maxError(all, Function::Erf, erf) <= 2.5);
+		assert(maxError(geluRange, Function::Gelu, gelu) <= 13.0);
+		std::vector<float> geluRest;
+		for (const float& x : geluRange)
+		{
+			if (x < -1.42f || x > -0.7f)
+				geluRest.push_back(x);
+		}
+		assert(maxError(geluRest, Function::Gelu, gelu) <= 4.0);
+		assert(maxError(geluBand, Function::Gelu, gelu) <= 13.0);
+
+		const float special[] = { nan, inf, -inf, 0.0f, -0.0f, -1.0f, 88.72f, 89.5f, -200.0f, 1e-40f };
+		float y[10];
+		Math::Exp(special, y, 10);
+		assert(std::isnan(y[0]) && y[1] == inf && y[2] == 0.0f && y[3] == 1.0f && y[4] == 1.0f && std::isfinite(y[6]) && y[7] == inf && y[8] == 0.0f);
+		Math::Log(special, y, 10);
+		assert(std::isnan(y[0]) && y[1] == inf && std::isnan(y[2]) && y[3] == -inf && y[4] == -inf && std::isnan(y[5]));
+		assert(ulpError(y[9], std::log(1e-40)) <= 1.0);
+		Math::Tanh(special, y, 10);
+		assert(std::isnan(y[0]) && y[1] == 1.0f && y[2] == -1.0f && y[3] == 0.0f && std::signbit(y[4]) && y[8] == -1.0f);
+		Math::Sigmoid(special, y, 10);
+		assert(std::isnan(y[0]) && y[1] == 1.0f && y[2] == 0.0f && y[3] == 0.5f && y[7] == 1.0f && y[8] == 0.0f);
+		Math::Erf(special, y, 10);
+		assert(std::isnan(y[0]) && y[1] == 1.0f && y[2] == -1.0f && y[3] == 0.0f && std::signbit(y[4]));
+		Math::Gelu(special, y, 10);
+		assert(std::isnan(y[0]) && y[1] == inf && y[3] == 0.0f && y[7] == 89.5f && y[8] == 0.0f);
+
+		// An element's result does not depend on where it sits, tails and in-place calls included.
+		std::vector<float> x(37);
+		for (size_t i = 0; i < x.size(); ++i)
+		{
+			x[i] = static_cast<float>(std::sin(static_cast<double>(i) * 1.7)) * 6.0f;
+		}
+		for (size_t size = 1; size <= x.size(); size += 4)
+		{
+			std::vector<float> whole(x.begin(), x.begin() + size);
+			Math::Gelu(whole.data(), whole.data(), size);
+			for (size_t i = 0; i < size; ++i)
+			{
+				float single;
+				Math::Gelu(&x[i], &single, 1);
+				assert(single == whole[i]);
+			}
+		}
+
+		// Softmax against the max-subtracted reference exp(u) / sum(exp(u)) in double, on rows from 1 to 300 columns so every
+		// block and tail of the online pass is taken, with offsets that would overflow exp(u) directly.
+		for (const size_t columns : { 1, 10, 37, 64, 300 })
+		{
+			numpy::Ndarray<float> u({ 5, columns });
+			for (size_t i = 0; i < u.GetTotalSize(); ++i)
+			{
+				u.At(i) = static_cast<float>(std::cos(static_cast<double>(i) * 0.91) * 8.0 + (i / columns) * 300.0);
+			}
+			const numpy::Ndarray<float> y = numpy::Numpy<float>::Softmax(u);
+			const numpy::Ndarray<float> logY = numpy::Numpy<float>::LogSoftmax(u, 1);
+			assert(y.GetArraySize(0) == 5 && y.GetArraySize(1) == columns);
+			for (size_t r = 0; r < 5; ++r)
+			{
+				double maximum = u.At(r * columns);
+				for (size_t c = 1; c < columns; ++c)
+				{
+					maximum = std::max(maximum, static_cast<double>(u.At(r * columns + c)));
+				}
+				double sum = 0.0;
+				for (size_t c = 0; c < columns; ++c)
+				{
+					sum += std::exp(u.At(r * columns + c) - maximum);
+				}
+				double total = 0.0;
+				for (size_t c = 0; c < columns; ++c)
+				{
+					const double expected = std::exp(u.At(r * columns + c) - maximum) / sum;
+					assert(std::fabs(y.At(r * columns + c) - expected) <= 1e-6 * expected + 1e-30);
+					assert(std::fabs(logY.At(r * columns + c) - std::log(expected)) <= 2e-5 * std::max(1.0, std::fabs(std::log(expected))));
+					total += y.At(r * columns + c);
+				}
+				assert(std::fabs(total - 1.0) < 1e-5);
+			}
+		}
+	}
+	numpy::Simd::SetLevel(supported);
+
+	// Ndarray forms: the shape is kept, strided views are read through, out may be the input, and -infinity has probability 0.
+	numpy::Ndarray<float> a({ 4, 3, 5 });
+	for (size_t i = 0; i < a.GetTotalSize(); ++i)
+	{
+		a.At(i) = static_cast<float>(i % 11) - 5.0f;
+	}
+	const numpy::Ndarray<float> e = numpy::Numpy<float>::Exp(a);
+	assert(e.GetDimension() == 3 && e.GetArraySize(2) == 5 && ulpError(e.At(7), std::exp(2.0)) <= 1.0);
+	const numpy::Ndarray<float> transposed = numpy::Numpy<float>::Tanh(a.Transpose());
+	assert(transposed.GetArraySize(0) == 5 && transposed.At(1) == numpy::Numpy<float>::Tanh(a).At(15));
+	numpy::Ndarray<float> inPlace = a;
+	numpy::Numpy<float>::Sigmoid(inPlace, inPlace);
+	assert(inPlace == numpy::Numpy<float>::Sigmoid(a));
+	assert(numpy::Numpy<float>::Log(numpy::Ndarray<float>()).GetTotalSize() == 0);
+
+	// Along an inner axis the result is the transposed last-axis softmax.
+	const numpy::Ndarray<float> middle = numpy::Numpy<float>::Softmax(a, 1);
+	const numpy::Ndarray<float> last = numpy::Numpy<float>::Softmax(numpy::Ndarray<float>(a.Transpose({ 0, 2, 1 })));
+	for (size_t i = 0; i < 4; ++i)
+	{
+		for (size_t j = 0; j < 3; ++j)
+		{
+			for (size_t k = 0; k < 5; ++k)
+			{
+				assert(std::fabs(middle.At(i * 15 + j * 5 + k) - last.At(i * 15 + k * 3 + j)) < 1e-7f);
+			}
+		}
+	}
+	numpy::Ndarray<float> masked({ 2, 4 }, 1.0f);
+	masked.At(1) = -std::numeric_limits<float>::infinity();
+	numpy::Numpy<float>::Softmax(masked, masked);
+	assert(masked.At(1) == 0.0f && std::fabs(masked.At(0) - 1.0f / 3.0f) < 1e-7f && std::fabs(masked.At(4) - 0.25f) < 1e-7f);
+	assert(numpy::Numpy<float>::Softmax(a, 3).GetTotalSize() == 0);
+
+	// The reference cross-entropy -sum(t * log(y + 1e-7)) / N, now expressible, agrees with SoftmaxCrossEntropy.
+	numpy::Ndarray<float> logits({ 6, 10 });
+	numpy::Ndarray<float> target({ 6, 10 }, 0.0f);
+	for (size_t i = 0; i < logits.GetTotalSize(); ++i)
+	{
+		logits.At(i) = static_cast<float>(std::sin(static_cast<double>(i) * 2.3)) * 3.0f;
+	}
+	for (size_t r = 0; r < 6; ++r)
+	{
+		target.At(r * 10 + (r * 7) % 10) = 1.0f;
+	}
+	numpy::SoftmaxCrossEntropy<float> criterion;
+	const float loss = criterion.Forward(logits, target);
+	const numpy::Ndarray<float> probability = numpy::Numpy<float>::Softmax(logits);
+	assert(probability == criterion.GetProbability());
+	const float reference = -numpy::Numpy<float>::Sum(target * numpy::Numpy<float>::Log(probability + 1e-7f)) / 6.0f;
+	assert(std::fabs(loss - reference) < 1e-4f);
+	std::cout << "SIMD Math Test Done" << std::endl;
+}
+
+// The collective calls and data-parallel training of test24, made by every process of the group.
+void distributedSteps(numpy::ProcessGroup& group)
+{
+	const unsigned int rank = group.GetRank();
+	const unsigned int size = group.GetSize();
+	assert(group.IsValid() && rank < size);
+
+	// Fewer elements than ranks, empty chunks, and several windows of the 256-byte buffers. The sums are exact in float.
+	for (const size_t count : { 0, 1, 2, 5, 64, 1000 })
+	{
+		std::vector<float> data(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			data[i] = static_cast<float>(rank * 1000 + i);
+		}
+		assert(group.AllReduce(data.data(), count));
+		for (size_t i = 0; i < count; ++i)
+		{
+			assert(data[i] == static_cast<float>(size * i + 1000 * size * (size - 1) / 2));
+		}
+	}
+	std::vector<double> first(3, rank + 1.0);
+	std::vector<double> second(70, 2.0 * rank);
+	assert(group.AllReduce(std::vector<std::pair<double*, size_t>>{ { first.data(), first.size() }, { second.data(), second.size() } }));
+	assert(first[2] == size * (size + 1) / 2.0 && second[0] == size * (size - 1.0) && second[69] == second[0]);
+
+	std::vector<int> values(100, static_cast<int>(rank));
+	assert(group.Broadcast(values.data(), values.size(), size - 1));
+	assert(values[0] == static_cast<int>(size - 1) && values[99] == values[0]);
+	assert(group.Barrier());
+
+	// Each process trains on its rows of the batch with gradients summed in buckets of 10 floats; the weights follow training on
+	// the whole batch in one process.
+	numpy::Ndarray<float> x({ 10, 6 });
+	numpy::Ndarray<float> t({ 10, 4 }, 0.0f);
+	for (size_t i = 0; i < x.GetTotalSize(); ++i)
+	{
+		x.At(i) = static_cast<float>(std::sin(static_cast<double>(i) * 0.7));
+	}
+	for (size_t r = 0; r < 10; ++r)
+	{
+		t.At(r * 4 + r % 4) = 1.0f;
+	}
+	numpy::Mlp<float> parallel({ 6, 12, 4 }, 5);
+	numpy::Mlp<float> serial({ 6, 12, 4 }, 5);
+	numpy::GradientReducer<float> reducer(group, 40);
+	size_t begin = 0;
+	size_t end = 0;
+	group.GetShard(10, begin, end);
+	const numpy::Ndarray<float> xShard = x.Slice(0, begin, end);
+	const numpy::Ndarray<float> tShard = t.Slice(0, begin, end);
+	for (unsigned int step = 0; step < 5; ++step)
+	{
+		assert(!std::isnan(parallel.TrainBatch(xShard, tShard, 0.05f, reducer)));
+		serial.TrainBatch(x, t, 0.05f);
+	}
+	for (unsigned int l = 0; l < serial.GetLayerCount(); ++l)
+	{
+		const numpy::Ndarray<float>& weight = parallel.GetLayer(l).GetWeight();
+		for (size_t i = 0; i < weight.GetTotalSize(); ++i)
+		{
+			assert(std::fabs(weight.At(i) - serial.GetLayer(l).GetWeight().At(i)) < 1e-5f);
+		}
+		assert(std::fabs(parallel.GetLayer(l).GetBias().At(0) - serial.GetLayer(l).GetBias().At(0)) < 1e-5f);
+	}
+}
+
+void test24()
+{
+	// A process on its own is a group of one.
+	numpy::ProcessGroup single;
+	float value = 3.0f;
+	assert(single.IsValid() && single.GetSize() == 1 && single.AllReduce(&value, 1) && value == 3.0f && single.Join());
+
+	// Three processes running main() as workers, with buffers small enough that every call is split into windows.
+	const unsigned int threadCount = numpy::ThreadPool::Instance().GetThreadCount();
+	{
+		numpy::ProcessGroup group(3, {}, 256);
+		assert(group.GetRank() == 0 && group.GetSize() == 3);
+		distributedSteps(group);
+		assert(group.Join());
+		assert(!group.Barrier());
+	}
+
+	// A worker that exits with a failure makes the others' calls fail instead of waiting for it.
+	{
+		numpy::ProcessGroup failing(3, { "fail" });
+		std::vector<float> data(10, 1.0f);
+		assert(!failing.AllReduce(data.data(), data.size()));
+		assert(!failing.Join());
+	}
+	numpy::ThreadPool::Instance().SetThreadCount(threadCount);
+	std::cout << "Distributed Test Done" << std::endl;
+}
+
+void test25()
+{
+	using numpy::Profiler;
+	using numpy::ProfileScope;
+	using numpy::ProfileSummary;
+
+	const auto find = [](const std::vector<ProfileSummary>& summaries, const char* name) -> const ProfileSummary*
+	{
+		for (const ProfileSummary& summary : summaries)
+			if (summary.Name == name)
+				return &summary;
+		return nullptr;
+	};
+
+	// Nested scopes: the outer one's self time leaves out the inner ones, and nothing is recorded while disabled.
+	Profiler::Reset();
+	Profiler::Enable();
+	{
+		ProfileScope outer("outer", 100, 10);
+		for (int i = 0; i < 3; ++i)
+		{
+			ProfileScope inner("inner", 8, 2);
+			numpy::Ndarray<float> a({ 256, 256 }, 1.0f);
+			assert(numpy::Numpy<float>::Sum(a) == 65536.0f);
+		}
+	}
+	Profiler::Enable(false);
+	{
+		ProfileScope ignored("ignored");
+	}
+	std::vector<ProfileSummary> summaries = Profiler::Summarize();
+	const ProfileSummary* outer = find(summaries, "outer");
+	const ProfileSummary* inner = find(summaries, "inner");
+	assert(outer != nullptr && inner != nullptr && find(summaries, "ignored") == nullptr);
+	assert(outer->Calls == 1 && outer->BytesMoved == 100 && outer->Flops == 10);
+	assert(inner->Calls == 3 && inner->BytesMoved == 24 && inner->Flops == 6);
+	assert(outer->Seconds >= inner->Seconds && outer->SelfSeconds <= outer->Seconds - inner->Seconds + 1e-6);
+#ifdef NUMPY_PROFILE
+	// Allocations are counted only where the allocator is instrumented.
+	assert(inner->BytesAllocated >= 3 * 256 * 256 * sizeof(float) && outer->BytesAllocated == inner->BytesAllocated);
+#endif
+
+	// Every thread records into its own buffer, and the summary merges them.
+	numpy::ThreadPool& pool = numpy::ThreadPool::Instance();
+	Profiler::Reset();
+	Profiler::Enable();
+	pool.ParallelFor(64u, [](unsigned int)
+	{
+		ProfileScope task("task", 4, 1);
+	});
+	Profiler::Enable(false);
+	summaries = Profiler::Summarize();
+	const ProfileSummary* task = find(summaries, "task");
+	assert(task != nullptr && task->Calls == 64 && task->BytesMoved == 256 && task->Flops == 64);
+
+	// The trace has one complete event per scope.
+	assert(Profiler::WriteTrace("test25.json"));
+	std::ifstream trace("test25.json");
+	const std::string text((std::istreambuf_iterator<char>(trace)), std::istreambuf_iterator<char>());
+	trace.close();
+	std::remove("test25.json");
+	assert(text.compare(0, 15, "{\"traceEvents\":") == 0 && text.find("\"ph\":\"M\"") != std::string::npos);
+	size_t events = 0;
+	for (size_t at = text.find("\"name\":\"task\""); at != std::string::npos; at = text.find("\"name\":\"task\"", at + 1))
+	{
+		++events;
+	}
+	assert(events == 64 && text.find("\"ph\":\"X\"") != std::string::npos);
+
+	// The library's own calls are instrumented only in a profiled build; otherwise they leave no trace at all.
+	Profiler::Reset();
+	Profiler::Enable();
+	numpy::Ndarray<float> x({ 32, 48 }, 0.5f);
+	numpy::Ndarray<float> w({ 48, 16 }, 0.25f);
+	numpy::Ndarray<float> y = numpy::Numpy<float>::Dot(x, w);
+	numpy::Ndarray<float> z = y * 2.0f + y;
+	Profiler::Enable(false);
+	summaries = Profiler::Summarize();
+	assert(z.GetData()[0] == 18.0f);
+#ifdef NUMPY_PROFILE
+	const ProfileSummary* dot = find(summaries, "Numpy::Dot");
+	const ProfileSummary* evaluate = find(summaries, "Expression::Evaluate");
+	assert(dot != nullptr && dot->Calls == 1 && dot->Flops == 2ull * 32 * 48 * 16);
+	assert(dot->BytesMoved == (32 * 48 + 48 * 16 + 32 * 16) * sizeof(float) && dot->BytesAllocated >= 32 * 16 * sizeof(float));
+	assert(evaluate != nullptr && evaluate->Calls == 1 && evaluate->Flops == 2ull * 32 * 16 && evaluate->BytesMoved == 3ull * 32 * 16 * sizeof(float));
+#else
+	assert(summaries.empty());
+#endif
+	Profiler::Reset();
+	std::cout << "Profiler Test Done" << std::endl;
+}
+
+void test26()
+{
+	using Array = numpy::Ndarray<float>;
+
+	// A saved model loads back with the same shapes and weights.
+	numpy::Mlp<float> mlp({ 64, 32, 16, 10 }, 7);
+	assert(mlp.Save("test26.npz"));
+	numpy::Mlp<float> loaded({ 4, 2 });
+	assert(!loaded.Load("missing.npz") && loaded.GetLayerCount() == 1);
+	assert(loaded.Load("test26.npz") && loaded.GetLayerCount() == 3);
+	const size_t count = 120;
+	Array x({ count, 64 });
+	for (size_t i = 0; i < x.GetTotalSize(); ++i)
+	{
+		x.GetData()[i] = static_cast<float>((i * 29) % 17) / 8.0f - 1.0f;
+	}
+	const Array expected(mlp.Predict(x));
+	const Array& reloaded = loaded.Predict(x);
+	for (size_t i = 0; i < expected.GetTotalSize(); ++i)
+	{
+		assert(reloaded.GetData()[i] == expected.GetData()[i]);
+	}
+
+	numpy::InferenceServer<float> missing("missing.npz");
+	float row[10] = {};
+	assert(!missing.IsValid() && !missing.Infer(x.GetData(), 1, row));
+
+	const auto close = [&expected](const float* output, const size_t& first, const size_t& rows)
+	{
+		for (size_t i = 0; i < rows * 10; ++i)
+		{
+			const float reference = expected.GetData()[first * 10 + i];
+			if (std::fabs(output[i] - reference) > 1e-4f * (1.0f + std::fabs(reference)))
+				return false;
+		}
+		return true;
+	};
+
+	{
+		// Concurrent callers of 1 to 3 rows each get their own rows' logits back, whatever batch they shared.
+		numpy::InferenceServer<float> server("test26.npz", 8, std::chrono::microseconds(500));
+		assert(server.IsValid() && server.GetInputSize() == 64 && server.GetOutputSize() == 10 && server.GetMaxBatch() == 8);
+		assert(!server.Infer(x.GetData(), 9, row) && !server.Infer(x.GetData(), 0, row));
+		std::atomic<unsigned int> failures(0);
+		std::atomic<unsigned int> requests(0);
+		std::atomic<unsigned int> rowsSent(0);
+		std::vector<std::thread> clients;
+		for (unsigned int c = 0; c < 6; ++c)
+		{
+			clients.emplace_back([&, c]()
+			{
+				std::vector<float> output(3 * 10);
+				for (size_t first = c, step = 0; first + 3 <= count; first += 6, ++step)
+				{
+					const size_t rows = 1 + (c + step) % 3;
+					requests.fetch_add(1);
+					rowsSent.fetch_add(static_cast<unsigned int>(rows));
+					if (!server.Infer(x.GetData() + first * 64, rows, output.data()) || !close(output.data(), first, rows))
+					{
+						failures.fetch_add(1);
+					}
+				}
+			});
+		}
+		for (std::thread& client : clients)
+		{
+			client.join();
+		}
+		assert(failures.load() == 0);
+		const numpy::InferenceStatistics statistics = server.GetStatistics();
+		assert(statistics.Requests == requests.load() && statistics.Rows == rowsSent.load());
+		assert(statistics.Batches >= 1 && statistics.Batches <= statistics.Requests && statistics.Rows <= 8 * statistics.Batches);
+
+		// Listening does not replace a file that is not a socket, but does replace a socket nothing listens on.
+		std::ofstream("test26.sock") << "data";
+		assert(!server.Listen("test26.sock") && std::ifstream("test26.sock").good());
+		std::remove("test26.sock");
+		const numpy::LocalSocket::Handle stale = numpy::LocalSocket::Listen("test26.sock");
+		assert(stale != numpy::LocalSocket::INVALID);
+		numpy::LocalSocket::Close(stale);
+
+		// The same over a local socket, with a client per thread. A live socket is not taken over.
+		assert(server.Listen("test26.sock") && !server.Listen("test26.sock"));
+		assert(numpy::LocalSocket::Listen("test26.sock") == numpy::LocalSocket::INVALID);
+		numpy::InferenceClient<float> first;
+		numpy::InferenceClient<float> second;
+		assert(first.Connect("test26.sock") && second.Connect("test26.sock"));
+		assert(first.GetInputSize() == 64 && first.GetOutputSize() == 10);
+		std::vector<float> output(8 * 10);
+		std::thread other([&]()
+		{
+			std::vector<float> own(2 * 10);
+			for (int i = 0; i < 10; ++i)
+			{
+				if (!second.Infer(x.GetData() + 100 * 64, 2, own.data()) || !close(own.data(), 100, 2))
+				{
+					failures.fetch_add(1);
+				}
+			}
+		});
+		for (int i = 0; i < 10; ++i)
+		{
+			assert(first.Infer(x.GetData() + 16 * 64, 8, output.data()) && close(output.data(), 16, 8));
+		}
+		other.join();
+		assert(failures.load() == 0);
+		assert(!first.Infer(x.GetData(), 9, output.data()) && first.IsConnected());
+
+		// Connections that come and go are each served, then closed along with their thread.
+		for (int i = 0; i < 200; ++i)
+		{
+			numpy::InferenceClient<float> brief;
+			assert(brief.Connect("test26.sock") && brief.Infer(x.GetData() + (i % count) * 64, 1, output.data()) && close(output.data(), i % count, 1));
+		}
+	}
+	// The server and its socket are gone.
+	numpy::InferenceClient<float> late;
+	assert(!late.Connect("test26.sock"));
+	std::remove("test26.npz");
+	std::cout << "Inference Server Test Done" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	// The processes test24 starts: the ones asked to fail do so at once, the others make the group's calls.
+	if (numpy::ProcessGroup::IsWorker())
+	{
+		if (argc > 1 && std::strcmp(argv[1], "fail") == 0)
+			return 1;
+		numpy::ProcessGroup group;
+		distributedSteps(group);
+		return 0;
+	}
+
 	test1();
 
 	test2();
 
+	test3();
+
+	test4();
+
+	test5();
+
+	test6();
+
+	test7();
+
+	test8();
+
+	test9();
+
+	test10();
+
+	test11();
+
+	test12();
+
+	test13();
+
+	test14();
+
+	test15();
+
+	test16();
+
+	test17();
+
+	test18();
+
+	test19();
+
+	test20();
+
+	test21();
+
+	test22();
+
+	test23();
+
+	test24();
+
+	test25();
+
+	test26();
+
 	std::cout << "Test Done" << std::endl;
 }
 
 
+// The script below runs natively in Digits/main.cpp.
 //import numpy as np
 //# import cupy as np  # GPU ̿ 
 //import matplotlib.pyplot as plt
@@ -0,0 +1,280 @@
+#include<algorithm>
+#include<chrono>
+#include<cmath>
+#include<cstdint>
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<iostream>
+#include<random>
+#include<string>
+#include<vector>
+
+#include "DataLoader.h"
+#include "Dataset.h"
+#include "Distributed.h"
+#include "Half.h"
+#include "Mlp.h"
+#include "Profiler.h"
+
+namespace
+{
+	using Array = numpy::Ndarray<float>;
+	using Numpy = numpy::Numpy<float>;
+
+	// Stand-in for the digits data when no file is given: 1797 noisy 8x8 images around one random prototype per class,
+	// with pixel values 0 to 16 like the original.
+	void synthesize(Array& x, numpy::Ndarray<unsigned int>& labels)
+	{
+		const unsigned int count = 1797;
+		const unsigned int features = 64;
+		std::mt19937 engine(0);
+		std::uniform_int_distribution<int> pixel(0, 16);
+		std::normal_distribution<float> noise(0.0f, 3.0f);
+
+		float prototypes[10][features];
+		for (unsigned int c = 0; c < 10; ++c)
+		{
+			for (unsigned int i = 0; i < features; ++i)
+			{
+				prototypes[c][i] = static_cast<float>(pixel(engine));
+			}
+		}
+
+		std::vector<unsigned int> classes(count);
+		x = Array({ count, features });
+		for (unsigned int r = 0; r < count; ++r)
+		{
+			classes[r] = r % 10;
+			for (unsigned int i = 0; i < features; ++i)
+			{
+				x.At(r * features + i) = std::min(16.0f, std::max(0.0f, prototypes[classes[r]][i] + noise(engine)));
+			}
+		}
+		const unsigned int arraySize[] = { count };
+		labels = numpy::Ndarray<unsigned int>(1u, count, arraySize, classes.data());
+	}
+
+	// Fraction of rows whose largest logit is at the largest entry of the target row.
+	float accuracy(const Array& logits, const Array& target)
+	{
+		const numpy::Ndarray<size_t> predicted = Numpy::ArgMax(logits, 1);
+		const numpy::Ndarray<size_t> expected = Numpy::ArgMax(target, 1);
+		size_t correct = 0;
+		for (size_t i = 0; i < predicted.GetTotalSize(); ++i)
+		{
+			correct += predicted.At(i) == expected.At(i) ? 1u : 0u;
+		}
+		return static_cast<float>(correct) / static_cast<float>(predicted.GetTotalSize());
+	}
+
+	// Calls infer until 0.2 s have passed and prints the accuracy of its logits with the samples per second.
+	template<typename F>
+	void report(const char* name, const F& infer, const Array& x, const Array& t)
+	{
+		const float correct = accuracy(infer(), t);
+		unsigned int runs = 0;
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		double seconds = 0.0;
+		do
+		{
+			infer();
+			++runs;
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		} while (seconds < 0.2);
+		std::printf("  %-5s accuracy %6.2f%%  %10.0f samples/s\n", name, correct * 100.0f, runs * static_cast<double>(x.GetArraySize(0)) / seconds);
+	}
+
+	// The trained layers with S storage: weights, biases and activations take 16 bits, products are summed in float.
+	template<typename S>
+	void reportHalf(const char* name, numpy::Mlp<float>& mlp, const Array& x, const Array& t)
+	{
+		const unsigned int count = mlp.GetLayerCount();
+		std::vector<numpy::Ndarray<S>> weights;
+		std::vector<numpy::Ndarray<S>> biases;
+		std::vector<numpy::Ndarray<S>> outputs(count);
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			weights.push_back(mlp.GetLayer(i).GetWeight().AsType<S>());
+			biases.push_back(mlp.GetLayer(i).GetBias().AsType<S>());
+		}
+		report(name, [&]()
+		{
+			const numpy::Ndarray<S> input = x.AsType<S>();
+			const numpy::Ndarray<S>* y = &input;
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				numpy::Numpy<S>::Dot(outputs[i], *y, weights[i], biases[i], i + 1 < count);
+				y = &outputs[i];
+			}
+			return y->template AsType<float>();
+		}, x, t);
+	}
+
+	// The trained layers with int8 weights quantized per output channel and activations quantized per row.
+	void reportInt8(numpy::Mlp<float>& mlp, const Array& x, const Array& t)
+	{
+		const unsigned int count = mlp.GetLayerCount();
+		std::vector<numpy::QuantizedMatrix<float>> weights;
+		std::vector<Array> outputs(count);
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			Array scales;
+			const numpy::Ndarray<std::int8_t> values = Numpy::Quantize(mlp.GetLayer(i).GetWeight(), 1, scales);
+			weights.emplace_back(values, scales);
+		}
+		report("int8", [&]() -> const Array&
+		{
+			const Array* y = &x;
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				Numpy::Dot(outputs[i], *y, weights[i], mlp.GetLayer(i).GetBias(), i + 1 < count);
+				y = &outputs[i];
+			}
+			return *y;
+		}, x, t);
+	}
+}
+
+// Digits [digits.csv] [epochs] [workers]
+// The 8x8 digits MLP from the Python script at the bottom of DeepLearning/main.cpp: 64-16-16-10, mini-batches of 32, eta 0.001.
+// digits.csv is scikit-learn's sklearn/datasets/data/digits.csv.gz, decompressed; without it a synthetic set of the same shape is used.
+// With workers > 1, that many processes train data-parallel: each takes its rows of every mini-batch and the gradients are
+// summed over all of them before each update. Only the first prints.
+int main(int argc, char* argv[])
+{
+	const unsigned int nOut = 10;
+	const float eta = 0.001f;
+	const unsigned int epochs = argc > 2 ? static_cast<unsigned int>(std::atoi(argv[2])) : 51u;
+	const unsigned int batchSize = 32;
+	const unsigned int interval = 5;
+	const unsigned int workers = argc > 3 ? std::min(batchSize, std::max(1u, static_cast<unsigned int>(std::atoi(argv[3])))) : 1u;
+
+	// The other processes run this program with the same arguments.
+	numpy::ProcessGroup group(workers, std::vector<std::string>(argv + 1, argv + argc));
+	if (!group.IsValid())
+	{
+		std::fprintf(stderr, "cannot start %u workers\n", workers);
+		return 1;
+	}
+	numpy::GradientReducer<float> reducer(group);
+	const bool bMain = group.GetRank() == 0;
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// -- Input data --
+	Array input;
+	numpy::Ndarray<unsigned int> correct;
+	if (argc > 1 && std::strcmp(argv[1], "-") != 0)
+	{
+		if (!numpy::Dataset<float>::LoadCsv(argv[1], input, correct))
+		{
+			std::fprintf(stderr, "cannot read %s\n", argv[1]);
+			return 1;
+		}
+	}
+	else
+	{
+		synthesize(input, correct);
+	}
+	// Mean 0, standard deviation 1 over all pixels.
+	const float average = Numpy::Mean(input);
+	const float deviation = Numpy::Std(input);
+	input = (input + -average) * (1.0f / deviation);
+
+	// -- Correct data, one-hot --
+	const Array correctData = numpy::Dataset<float>::OneHot(correct, nOut);
+
+	// -- Train and test split --
+	Array xTrain;
+	Array xTest;
+	Array tTrain;
+	Array tTest;
+	numpy::Dataset<float>::Split(input, correctData, 0.25, 0, xTrain, xTest, tTrain, tTest);
+
+	numpy::Mlp<float> mlp({ static_cast<unsigned int>(input.GetArraySize(1)), 16, 16, nOut }, 0);
+
+	const size_t trainCount = xTrain.GetArraySize(0);
+	// Mini-batches are shuffled and gathered on a background thread while the previous one trains.
+	numpy::DataLoader<float> loader({ &xTrain, &tTrain }, batchSize, 2, 0);
+	const size_t nBatch = loader.GetBatchCount();
+
+	if (bMain)
+	{
+		std::printf("%zu train, %zu test samples, %zu features\n", trainCount, xTest.GetArraySize(0), input.GetArraySize(1));
+		if (group.GetSize() > 1u)
+		{
+			std::printf("Data-parallel over %u processes\n", group.GetSize());
+		}
+	}
+	double trainSeconds = 0.0;
+	for (unsigned int i = 0; i < epochs; ++i)
+	{
+		// -- Training --
+		numpy::Allocator::ResetStatistics();
+		const std::chrono::steady_clock::time_point epochStart = std::chrono::steady_clock::now();
+		// Only training is profiled, not the evaluation below.
+		numpy::Profiler::Enable();
+		while (const std::vector<Array>* batch = loader.Next())
+		{
+			if (group.GetSize() == 1u)
+			{
+				mlp.TrainBatch((*batch)[0], (*batch)[1], eta);
+				continue;
+			}
+			size_t begin = 0;
+			size_t end = 0;
+			group.GetShard((*batch)[0].GetArraySize(0), begin, end);
+			if (std::isnan(mlp.TrainBatch((*batch)[0].Slice(0, begin, end), (*batch)[1].Slice(0, begin, end), eta, reducer)))
+			{
+				std::fprintf(stderr, "a worker process failed\n");
+				return 1;
+			}
+		}
+		numpy::Profiler::Enable(false);
+		const double epochSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - epochStart).count();
+		const numpy::AllocationStatistics statistics = numpy::Allocator::GetStatistics();
+		trainSeconds += epochSeconds;
+		if (!bMain)
+			continue;
+
+		// -- Error measurement --
+		float accuracyTrain = 0.0f;
+		float accuracyTest = 0.0f;
+		const float errorTrain = mlp.Evaluate(xTrain, tTrain, accuracyTrain);
+		const float errorTest = mlp.Evaluate(xTest, tTest, accuracyTest);
+
+		if (i % interval == 0)
+		{
+			std::printf("Epoch:%u/%u Error_train: %f Error_test: %f %.0f samples/s, %llu allocations\n", i + 1, epochs, errorTrain, errorTest,
+				nBatch * batchSize / epochSeconds, statistics.PoolAllocations + statistics.SystemAllocations + statistics.ArenaAllocations);
+		}
+	}
+
+	if (!bMain)
+		return 0;
+	float accuracyTrain = 0.0f;
+	float accuracyTest = 0.0f;
+	mlp.Evaluate(xTrain, tTrain, accuracyTrain);
+	mlp.Evaluate(xTest, tTest, accuracyTest);
+	std::printf("Accuracy Train: %.2f%% Accuracy Test: %.2f%%\n", accuracyTrain * 100.0f, accuracyTest * 100.0f);
+	// -- Reduced precision inference: accuracy against throughput of the trained model --
+	std::printf("Inference on the %zu test samples:\n", xTest.GetArraySize(0));
+	report("fp32", [&]() -> const Array& { return mlp.Predict(xTest); }, xTest, tTest);
+	reportHalf<numpy::BFloat16>("bf16", mlp, xTest, tTest);
+	reportHalf<numpy::Float16>("fp16", mlp, xTest, tTest);
+	reportInt8(mlp, xTest, tTest);
+
+	std::printf("Training %.3f s (%.0f samples/s, %llu of %llu batches waited for the loader), total %.3f s\n", trainSeconds,
+		static_cast<double>(epochs) * nBatch * batchSize / trainSeconds, loader.GetStallCount(), static_cast<unsigned long long>(epochs) * nBatch,
+		std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+#ifdef NUMPY_PROFILE
+	std::printf("Profile of training:\n");
+	numpy::Profiler::PrintSummary(std::cout);
+	if (numpy::Profiler::WriteTrace("digits-trace.json"))
+	{
+		std::printf("Trace written to digits-trace.json\n");
+	}
+#endif
+	return group.Join() ? 0 : 1;
+}